@@ -0,0 +1,120 @@
+#服务端和仿真器共用的源文件和第三方库
+INCLUDEPATH += $$PWD
+
+#qmake CONFIG+=avx2 启用AVX2(车队位姿的批量计算)，运行的机器必须支持AVX2
+avx2 {
+    msvc: QMAKE_CXXFLAGS += /arch:AVX2
+    else: QMAKE_CXXFLAGS += -mavx2
+}
+
+SOURCES += \
+    $$PWD/util/common.cpp \
+    $$PWD/util/global.cpp \
+    $$PWD/util/timingwheel.cpp \
+    $$PWD/sql/sql.cpp \
+    $$PWD/sql/sqlserver.cpp \
+    $$PWD/sql/taskjournal.cpp \
+    $$PWD/business/agvcenter.cpp \
+    $$PWD/business/mapcenter.cpp \
+    $$PWD/business/taskcenter.cpp \
+    $$PWD/business/taskstats.cpp \
+    $$PWD/business/taskqueue.cpp \
+    $$PWD/business/taskhistorycache.cpp \
+    $$PWD/business/fleetstate.cpp \
+    $$PWD/business/msgcenter.cpp \
+    $$PWD/business/usermsgprocessor.cpp \
+    $$PWD/log/agvlog.cpp \
+    $$PWD/log/agvlogprocess.cpp \
+    $$PWD/service/taskmaker.cpp \
+    $$PWD/service/taskmakerworker.cpp \
+    $$PWD/service/agvrebalancer.cpp \
+    $$PWD/service/chargescheduler.cpp \
+    $$PWD/network/qyhzmqserver.cpp \
+    $$PWD/network/qyhzmqserverworker.cpp \
+    $$PWD/network/qyhzmqftp.cpp \
+    $$PWD/network/agvframeparser.cpp \
+    $$PWD/network/agvioworker.cpp \
+    $$PWD/network/agvioengine.cpp \
+    $$PWD/network/agvcapture.cpp \
+    $$PWD/util/bezierarc.cpp \
+    $$PWD/util/posekernel.cpp \
+    $$PWD/util/motionestimator.cpp \
+    $$PWD/publisher/agvpositionpublisher.cpp \
+    $$PWD/publisher/agvstatuspublisher.cpp \
+    $$PWD/publisher/agvtaskpublisher.cpp \
+    $$PWD/publisher/logpublisher.cpp \
+    $$PWD/publisher/publishthread.cpp \
+    $$PWD/bean/task.cpp \
+    $$PWD/bean/agvcmdqueue.cpp \
+    $$PWD/bean/agv.cpp
+
+HEADERS += \
+    $$PWD/util/common.h \
+    $$PWD/util/concurrentqueue.h \
+    $$PWD/util/global.h \
+    $$PWD/util/timingwheel.h \
+    $$PWD/sql/sql.h \
+    $$PWD/sql/sqlserver.h \
+    $$PWD/sql/taskjournal.h \
+    $$PWD/business/agvcenter.h \
+    $$PWD/business/mapcenter.h \
+    $$PWD/business/taskcenter.h \
+    $$PWD/business/taskstats.h \
+    $$PWD/business/taskqueue.h \
+    $$PWD/business/taskhistorycache.h \
+    $$PWD/business/fleetstate.h \
+    $$PWD/business/msgcenter.h \
+    $$PWD/business/usermsgprocessor.h \
+    $$PWD/log/agvlog.h \
+    $$PWD/log/agvlogprocess.h \
+    $$PWD/service/taskmaker.h \
+    $$PWD/service/taskmakerworker.h \
+    $$PWD/service/agvrebalancer.h \
+    $$PWD/service/chargescheduler.h \
+    $$PWD/network/qyhzmqserver.h \
+    $$PWD/network/qyhzmqserverworker.h \
+    $$PWD/network/qyhzmqftp.h \
+    $$PWD/network/agvframeparser.h \
+    $$PWD/network/agvprotocol.h \
+    $$PWD/network/agvioworker.h \
+    $$PWD/network/agvioengine.h \
+    $$PWD/network/agvcapture.h \
+    $$PWD/util/bezierarc.h \
+    $$PWD/util/posekernel.h \
+    $$PWD/util/motionestimator.h \
+    $$PWD/util/histogram.h \
+    $$PWD/bean/agvline.h \
+    $$PWD/bean/agvstation.h \
+    $$PWD/publisher/agvpositionpublisher.h \
+    $$PWD/publisher/agvstatuspublisher.h \
+    $$PWD/publisher/agvtaskpublisher.h \
+    $$PWD/publisher/logpublisher.h \
+    $$PWD/publisher/publishthread.h \
+    $$PWD/bean/task.h \
+    $$PWD/bean/agvcmdqueue.h \
+    $$PWD/bean/agvtelemetry.h \
+    $$PWD/bean/agv.h
+
+#pluginXml
+INCLUDEPATH += D:\thirdparty\pugixml\include
+CONFIG(debug, debug|release) {
+    LIBS += D:\thirdparty\pugixml\staticlib\Debug\pugixml.lib
+} else {
+    LIBS += D:\thirdparty\pugixml\staticlib\Release\pugixml.lib
+}
+
+#QyhTcpLib
+INCLUDEPATH += D:\thirdparty\QyhTcpLib\include
+CONFIG(debug, debug|release) {
+    LIBS += D:\thirdparty\QyhTcpLib\lib\Debug\QyhTcpLib.lib
+} else {
+    LIBS += D:\thirdparty\QyhTcpLib\lib\Release\QyhTcpLib.lib
+}
+
+#zeromq
+INCLUDEPATH += D:\thirdparty\zeromq\include
+CONFIG(debug, debug|release) {
+    LIBS += D:\thirdparty\zeromq\lib\debug\dynamic\libzmq.lib
+} else {
+    LIBS += D:\thirdparty\zeromq\lib\release\dynamic\libzmq.lib
+}
@@ -1,9 +1,8 @@
 #include "agv.h"
 #include "util/common.h"
+#include "util/global.h"
 
-Agv::Agv(QObject *parent) : QObject(parent),
-    cmdQueue(NULL),
-    connection(NULL)
+Agv::Agv(QObject *parent) : QObject(parent)
 {
 
 }
@@ -11,8 +10,9 @@ Agv::Agv(QObject *parent) : QObject(parent),
 
 Agv::~Agv()
 {
-    if(cmdQueue)delete cmdQueue;
-    if(connection)delete connection;
+    if(cmdQueue)cmdQueue->close();
+    if(g_fleetState!=NULL)
+        g_fleetState->removeAgv(id);
 }
 
 //开始任务
@@ -34,7 +34,13 @@ void Agv::stopTask()
 }
 
 
+//命令发送线程中调用，交给主线程处理
 void Agv::onQueueFinish()
+{
+    QMetaObject::invokeMethod(this,"doQueueFinish",Qt::QueuedConnection);
+}
+
+void Agv::doQueueFinish()
 {
     if(taskFinish!=nullptr){
         taskFinish(this);
@@ -43,10 +49,9 @@ void Agv::onQueueFinish()
 
 void Agv::onSend(const char *data,int len)
 {
-    if(connection && connection->isWritable())
-    {
-        connection->write(data,len);
-    }
+    //由IO引擎所在的线程发送
+    if(g_agvIoEngine!=NULL)
+        g_agvIoEngine->send(id,QByteArray(data,len));
 }
 
 bool Agv::init(QString _ip, int _port,TaskFinishCallback _taskFinish,TaskErrorCallback _taskError,TaskInteruptCallback _taskInteruput,UpdateMCallback _updateM,UpdateMRCallback _updateMR)
@@ -59,124 +64,97 @@ bool Agv::init(QString _ip, int _port,TaskFinishCallback _taskFinish,TaskErrorCa
     updateM = _updateM;
     updateMR = _updateMR;
     if(cmdQueue){
-        delete cmdQueue;
-        cmdQueue = NULL;
-    }
-    if(connection){
-        delete connection;
-        connection = NULL;
+        cmdQueue->close();
+        cmdQueue.reset();
     }
 
-    //创建连接
-    connection = new QTcpSocket;
-    connect(connection,SIGNAL(connected()),this,SLOT(onConnect()));
-    connect(connection,SIGNAL(disconnected()),this,SLOT(onDisconnect()));
-    connect(connection,SIGNAL(readyRead()),this,SLOT(onRecv()));
-    connection->connectToHost(_ip,_port);
-
     //创建队列处理
     AgvCmdQueue::ToSendCallback s = std::bind(&Agv::onSend,this,std::placeholders::_1,std::placeholders::_2);
     AgvCmdQueue::FinishCallback f = std::bind(&Agv::onQueueFinish,this);
-    cmdQueue = new AgvCmdQueue;
-    cmdQueue->init(s,f);
+    cmdQueue = std::make_shared<AgvCmdQueue>();
+    cmdQueue->init(g_timingWheel,s,f);
+
+    //连上之前不参与调度
+    status = AGV_STATUS_UNCONNECT;
+
+    if(g_fleetState!=NULL){
+        fleetSlot = g_fleetState->addAgv(id);
+        if(fleetSlot<0)
+            g_log->log(AGV_LOG_LEVEL_WARN,QString("agv %1: fleet state is full").arg(id));
+        commitState();
+        commitInfo();
+    }
 
-    return true;
+    //连接交给IO引擎
+    if(g_agvIoEngine==NULL){
+        g_log->log(AGV_LOG_LEVEL_ERROR,QString("agv %1: io engine not started").arg(id));
+        return false;
+    }
+    //IO线程:命令应答直接交给命令队列，不经过主线程。回调持有队列，车辆删除后也不会访问到车辆
+    std::shared_ptr<AgvCmdQueue> queue = cmdQueue;
+    return g_agvIoEngine->addAgv(id,_ip,_port,[queue](const AgvTelemetry &telemetry){
+        queue->onOrderQueueChanged(telemetry.recvQueueNumber,telemetry.orderCount);
+    });
 }
 
-void  Agv::onRecv()
+void Agv::commitInfo()
 {
-    QByteArray qba = connection->readAll();
-    static QByteArray buff;
-    buff+= qba;
-    while(true)
-    {
-        int start = buff.indexOf(0x66);
-        int end = buff.indexOf(0x88);
-        if(start>=0&&end>=0){
-            //这个是一个包:
-            QByteArray onePack = buff.mid(start,end-start+1);
-            if(onePack.length()>0){
-                processOnePack(onePack);
-            }
-            //然后将之前的数据丢弃
-            buff = buff.right(buff.length()-end-1);
-        }else{
-            break;
-        }
-    }
+    if(g_fleetState==NULL)return ;
+    FleetState::AgvInfo info;
+    info.agvId = id;
+    info.name = name;
+    info.ip = ip;
+    info.port = port;
+    info.cmdQueue = cmdQueue;
+    g_fleetState->setAgvInfo(info);
 }
 
-void Agv::processOnePack(QByteArray qba)
+void Agv::commitState()
 {
-    int kk = (int)(qba.at(1));
-    //qDebug()<<"qba.length=="<<qba.length();
-    if(kk != qba.length()-1) return ;//除去包头
-    //上报的命令
-    char *str = qba.data();
-    str+=2;//跳过包头和包长
-
-    mileage = getInt32FromByte(str);
-    str+=4;
-
-    currentRfid = getInt32FromByte(str);
-    //qDebug()<<"current rfid="<<currentRfid;
-    str+=4;
-
-    nextRfid = getInt32FromByte(str);
-    str+=4;
-
-    current = getInt16FromByte(str);
-    str+=2;
-
-    voltage = getInt16FromByte(str);
-    str+=2;
-
-    positionMagneticStripe =  getInt16FromByte(str);
-    str+=2;
-
-    pcbTemperature = getInt8FromByte(str);
-    str+=1;
-
-    motorTemperature = getInt8FromByte(str);
-    str+=1;
-
-    cpu = getInt8FromByte(str);
-    str+=1;
-
-    speed = getInt8FromByte(str);
-    str+=1;
-
-    angle = getInt8FromByte(str);
-    str+=1;
-
-    height = getInt8FromByte(str);
-    str+=1;
-
-    error_no = getInt8FromByte(str);
-    str+=1;
-
-    mode = getInt8FromByte(str);
-    str+=1;
-
-    recvQueueNumber = getInt8FromByte(str);
-    str+=1;
-
-    orderCount = getInt8FromByte(str);
-    str+=1;
-
-
-    CRC = getInt8FromByte(str);
-    str+=1;
+    if(fleetSlot<0 || g_fleetState==NULL)return ;
+    FleetState::AgvState state;
+    state.agvId = id;
+#define AGV_COMMIT_FIELD(name) state.name = name;
+    FLEET_STATE_FIELDS(AGV_COMMIT_FIELD)
+#undef AGV_COMMIT_FIELD
+    g_fleetState->write(fleetSlot,state);
+}
 
-    //校验CRC
-    str = qba.data();
-    unsigned char c = checkSum((unsigned char *)(str+2),kk-4);
-    if(c != CRC)
-    {
-        //TODO:
-        //校验不合格
+void Agv::onTelemetry(const AgvTelemetry &telemetry)
+{
+    if(telemetry.type == AgvTelemetry::TYPE_CONNECTED){
+        //断开时的任务还等着这辆车(任务中心保留了task)，连上后等任务中心继续，不作为空闲车辆
+        if(status == AGV_STATUS_UNCONNECT)
+            status = task>0?AGV_STATUS_TASKING:AGV_STATUS_IDLE;
+        g_log->log(AGV_LOG_LEVEL_INFO,QString("agv %1 connected").arg(id));
+        return ;
+    }
+    //断开的车辆不再参与调度，手上的任务由任务中心处理。手动、故障、充电中的保持原状态
+    if(telemetry.type == AgvTelemetry::TYPE_DISCONNECTED){
+        if(status == AGV_STATUS_IDLE || status == AGV_STATUS_TASKING || status == AGV_STATUS_GO_CHARGING)
+            status = AGV_STATUS_UNCONNECT;
+        g_log->log(AGV_LOG_LEVEL_WARN,QString("agv %1 disconnected").arg(id));
+        return ;
     }
 
+    mileage = telemetry.mileage;
+    currentRfid = telemetry.currentRfid;
+    nextRfid = telemetry.nextRfid;
+    current = telemetry.current;
+    voltage = telemetry.voltage;
+    positionMagneticStripe = telemetry.positionMagneticStripe;
+    pcbTemperature = telemetry.pcbTemperature;
+    motorTemperature = telemetry.motorTemperature;
+    cpu = telemetry.cpu;
+    speed = telemetry.speed;
+    angle = telemetry.angle;
+    height = telemetry.height;
+    error_no = telemetry.error_no;
+    mode = telemetry.mode;
+    recvQueueNumber = telemetry.recvQueueNumber;
+    orderCount = telemetry.orderCount;
+    CRC = telemetry.CRC;
+
     //更新小车状态
     if(mode == AGV_MODE_HAND){
         if(currentTaskId > 0)
@@ -222,19 +200,4 @@ void Agv::processOnePack(QByteArray qba)
             updateM(mileage,this);
         }
     }
-
-    if(cmdQueue){
-        cmdQueue->onOrderQueueChanged(recvQueueNumber,orderCount);
-    }
-
-
-}
-
-void  Agv::onConnect()
-{
-    //TODO:
-}
-void  Agv::onDisconnect()
-{
-    //TODO:
 }
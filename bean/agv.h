@@ -2,8 +2,9 @@
 #define AGV_H
 
 #include <QObject>
+#include <memory>
 #include "agvcmdqueue.h"
-#include <QTcpSocket>
+#include "agvtelemetry.h"
 
 class Agv : public QObject
 {
@@ -74,6 +75,11 @@ public:
     int y = 0;
     int rotation = 0;
 
+    //在线路上的位置(曲线参数t)，提交车队状态时整个车队一起换算成坐标
+    int poseLine = 0;
+    double poseT = 0;
+    bool posePending = false;
+
     //计算路径用的
     int task = 0;
     int lastStation = 0;
@@ -102,8 +108,10 @@ public:
 
     int mileage = 0;//行驶距离 (mm)
     int currentRfid = 0;//当前rfid号，后8位
-    int current = 0;//电流 0.1A
+    int current = 0;//电流 0.1A，放电为正，充电为负
     int voltage = 0;//电压 0.01v
+    int soc = -1;//估算的剩余电量(%)，-1表示还没有电压数据
+    int range = 0;//估算的剩余续航里程(mm)
     int positionMagneticStripe = 0;//当前磁条位置
     int pcbTemperature = 0;//温度 主控板的
     int motorTemperature = 0;//温度 电机的
@@ -143,17 +151,35 @@ public:
 
     /////////////-------------------------------------------------------------------------
 
+    //主线程:处理IO引擎解析出的状态、连接变化
+    void onTelemetry(const AgvTelemetry &telemetry);
+
+    //主线程:把当前的状态写入车队状态，供其它线程读取
+    void commitState();
+
+    //主线程:名字、地址改变后，写入车队的名册
+    void commitInfo();
+
+    //在车队状态中的槽位，-1表示没有
+    int fleetSlot = -1;
+
+    //急停是锁定的(记在命令队列中，急停在zmq线程中设置)，解除之前不接任务、不下发命令
+    bool isStopped(){return cmdQueue && cmdQueue->isStopped();}
+    void releaseStop(){if(cmdQueue)cmdQueue->release();}
+
+    //命令队列(查询链路统计)，还没有连接时为NULL
+    AgvCmdQueue *getCmdQueue(){return cmdQueue.get();}
+
 signals:
 
 public slots:
-    void onRecv();
-    void onConnect();
-    void onDisconnect();
-private:
-    AgvCmdQueue *cmdQueue;//维护长队列、短队列
-    QTcpSocket *connection;//维护和AGV的连接
 
-    void processOnePack(QByteArray qba);
+private slots:
+    void doQueueFinish();
+
+private:
+    //维护长队列、短队列。名册、IO线程的应答回调也持有它，车辆删除后还可能被读一会儿
+    std::shared_ptr<AgvCmdQueue> cmdQueue;
 };
 
 #endif // AGV_H
@@ -1,223 +1,273 @@
 ﻿#include "agvcmdqueue.h"
 #include <QByteArray>
-#include "util/common.h"
-#include "util/global.h"
+#include "network/agvprotocol.h"
+#include <chrono>
 
-AgvCmdQueue::AgvCmdQueue():
-    quit(false)
+static qint64 steadyMsecs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static_assert(AgvCmdQueue::WINDOW_ORDERS<AgvProtocol::DispatchFrame::GROUPS,"the last group of a dispatch frame is always stop");
+
+AgvCmdQueue::AgvCmdQueue()
 {
 
 }
 
 AgvCmdQueue::~AgvCmdQueue()
 {
-    quit = true;
-    while(!threadAlreadQuit)
-    {
-        std::chrono::milliseconds dura(10);
-        std::this_thread::sleep_for(dura);
-    }
+    close();
 }
 
-void AgvCmdQueue::cmdThread(void *param)
+void AgvCmdQueue::close()
 {
-    ((AgvCmdQueue *)param)->cmdProcess();
+    //不能持有锁取消:定时器回调正在等这个锁时会死锁
+    mtx.lock();
+    quit = true;
+    TimingWheel::TimerId id = timerPending?timerId:0;
+    mtx.unlock();
+    if(id!=0 && wheel!=NULL)
+        wheel->cancel(id);
 }
 
-
-void AgvCmdQueue::cmdProcess()
+void AgvCmdQueue::init(TimingWheel *_wheel, ToSendCallback _toSend, FinishCallback _finish)
 {
-    threadAlreadQuit = false;
-    while(!quit)
-    {
-        //如果没有要发送的内容，等待
-        mtx.lock();
-        if(orders.length()<=0)
-        {
-            mtx.unlock();
-            std::chrono::milliseconds dura(50);
-            std::this_thread::sleep_for(dura);
-            continue;
-        }
-        mtx.unlock();
-
-        //第一次发送任务
-        if(ordersSendIndex == 0){
-            sendOrder();
-        }else{
-            //如果当前执行的序列>=1表示已经执行了1个或几个发过去的指令了，那么要填充新的指令给它
-            if(orderExcuteIndex >= 1)
-            {
-                if(lastSendOrderAmount>=orderExcuteIndex)
-                {
-                    ordersSendIndex -= (lastSendOrderAmount-orderExcuteIndex);
-                }
-                sendOrder();
-            }
-        }
-    }
-    threadAlreadQuit = true;
+    wheel = _wheel;
+    toSend = _toSend;
+    finish = _finish;
 }
 
-void AgvCmdQueue::sendOrder()
+//处理上报、完成、超时重传，需要时发送一个包(持有锁)
+//发送和完成的回调都只是入队，持有锁调用保证包的顺序
+void AgvCmdQueue::process(qint64 nowMsecs)
 {
-    mtx.lock();
-    if(ordersSendIndex>=orders.length()){
+    if(quit)return ;
+    if(ackPending)
+        processAck(nowMsecs);
+
+    //车辆执行完了所有的指令
+    bool finished = false;
+    if(orders.length()>0 && base>=orders.length()){
         orders.clear();
-        ordersSendIndex = 0;
-        lastSendOrderAmount = 0;
-        mtx.unlock();
-        //TODO:完成了队列的发送:
-        if(finish!=nullptr)
-        {
-            finish();
-        }
-        return ;
+        base = 0;
+        inflight.clear();
+        hasAcked = false;
+        finished = true;
     }
 
+    //最新的包超时没有应答，重传窗口，RTO加倍
+    if(!needSend && inflight.length()>0 && nowMsecs-inflight.last().sendMsecs>=rto){
+        needSend = true;
+        rto = qMin(rto*2,(int)MAX_RTO);
+        ++retransmitCount;
+        ++timeouts;
+    }
 
-    //根据orders封装一个发送的命令
-    QByteArray content;
+    if(needSend){
+        QByteArray packet = makeWindow(nowMsecs);
+        if(toSend!=nullptr)
+            toSend(packet.data(),packet.length());
+    }
+    if(finished && finish!=nullptr)
+        finish();
 
-    //工作方式
-    content.append(AGV_PACK_SEND_CODE_DISPATCH_MODE);
+    armTimer(nowMsecs);
+}
 
-    //命令编号
-    content.append(++sendQueueNumber);
+//有在途的包时，在重传超时的时刻检查一次。提前触发的会重新定时(持有锁)
+void AgvCmdQueue::armTimer(qint64 nowMsecs)
+{
+    if(quit || timerPending || inflight.isEmpty() || wheel==NULL)return ;
+    timerPending = true;
+    int delay = (int)qMax((qint64)1,inflight.last().sendMsecs+rto-nowMsecs);
+    timerId = wheel->schedule(delay,[this](){onTimer();});
+}
 
-    lastSendOrderAmount = 0;
+//时间轮线程
+void AgvCmdQueue::onTimer()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    timerPending = false;
+    process(steadyMsecs());
+}
 
-    for(int i=0;i<3;++i)
-    {
-        if(i+ordersSendIndex>=orders.size()){
-            //放入一个空
-            content.append(getRfidByte(AgvOrder::RFID_CODE_IMMEDIATELY));
-            content.append((char)(AgvOrder::ORDER_STOP));
-            content.append((char)0x00);
-        }else{
-            AgvOrder order = orders[i+ordersSendIndex];
-            content.append(getRfidByte(order.rfid));
-            content.append(order.order&0xFF);
-            content.append(order.param&0xFF);
-            lastSendOrderAmount+=1;
+//处理车辆上报的包序号和执行到第几条(持有锁)
+void AgvCmdQueue::processAck(qint64 nowMsecs)
+{
+    ackPending = false;
+    int seq = ackSeq&0xFF;
+
+    //应答了一个在途的包，比它早发的包都作废了(车辆的缓存已经被这个包替换)
+    for(int i=inflight.length()-1;i>=0;--i){
+        if(inflight.at(i).seq == seq){
+            qint64 rtt = nowMsecs-inflight.at(i).sendMsecs;
+            updateRto(rtt);
+            linkStats[LINK_RTT].record(rtt);
+            linkStats[LINK_RETRANSMITS].record(timeouts);
+            timeouts = 0;
+            lastAcked = inflight.at(i);
+            hasAcked = true;
+            for(int j=0;j<=i;++j)
+                inflight.removeFirst();
+            break;
         }
     }
-    mtx.unlock();
-    content.append(getRfidByte(AgvOrder::RFID_CODE_IMMEDIATELY));
-    content.append((char)(AgvOrder::ORDER_STOP));
-    content.append((char)0x00);
-
-    QByteArray qba = getSendPacket(content);
-
-    if(toSend != nullptr)
-    {
-        int sendTime = 3;//失败重复发送三次
-        int interval = 200;//200ms记一次发送失败
-        int per = 50;//每50ms查看一次结果
-        int times = interval/per;//多少次查看结果失败后 记一次发送失败
-        int percount = 0;//记录查看结果 失败的次数
-        bool sendResult = false;//发送结果 默认是失败的
-
-        for(int i=0;i<sendTime;++i)
-        {
-            toSend(qba.data(),qba.length());
-
-            while(true)
-            {
-                QyhSleep(per);
-
-                if(recvQueueNumber==sendQueueNumber)//发送成功
-                {
-                    sendResult = true;
-                    break;
-                }
-
-                ++percount;
-                if(percount>=times)
-                {
-                    sendResult = false;
-                    break;
-                }
-            }
-
-            if(sendResult)
-            {
-                ordersSendIndex+=lastSendOrderAmount;//发送成功，index改变
-                break;
-            }
-        }
+    if(!hasAcked || lastAcked.seq != seq)return ;//过时的上报
 
-        if(!sendResult)++sendQueueNumber;//如果一直发送失败，可能是queueNumber相同造成的，这里增加1，下次就不会还是相同的
-    }
+    int executed = qBound(0,ackCount,lastAcked.amount);
+    if(lastAcked.base+executed>base)
+        base = lastAcked.base+executed;
+
+    //车辆缓存的指令不满一个窗口，并且没有在途的包，立即补发
+    int end = qMin(base+(int)WINDOW_ORDERS,orders.length());
+    if(inflight.isEmpty() && lastAcked.base+lastAcked.amount<end)
+        needSend = true;
 }
 
-void AgvCmdQueue::init(ToSendCallback _toSend, FinishCallback _finish)
+//从第一条未执行的指令开始，组一个包(持有锁)。没有指令时是一个停止包
+QByteArray AgvCmdQueue::makeWindow(qint64 nowMsecs)
 {
-    toSend = _toSend;
-    finish = _finish;
-    //启动一个线程，创建socket并连接，然后发送和读取
-    std::thread(cmdThread,this).detach();
+    needSend = false;
+
+    InFlight f;
+    f.seq = (++sendQueueNumber)&0xFF;
+    if(f.seq == AgvProtocol::DispatchFrame::ESTOP_SEQ)
+        f.seq = (++sendQueueNumber)&0xFF;
+    f.base = base;
+    f.amount = qBound(0,orders.length()-base,(int)WINDOW_ORDERS);
+    f.sendMsecs = nowMsecs;
+    inflight.append(f);
+    while(inflight.length()>MAX_INFLIGHT)
+        inflight.removeFirst();
+
+    //封装到栈上的定长缓冲区，没有的指令是立即执行的停止
+    unsigned char packet[AgvProtocol::DispatchFrame::LENGTH];
+    AgvOrder window[WINDOW_ORDERS];
+    for(int i=0;i<f.amount;++i)
+        window[i] = orders.at(f.base+i);
+    AgvProtocol::DispatchFrame::encode(packet,f.seq,window,f.amount);
+    return QByteArray((const char *)packet,AgvProtocol::DispatchFrame::LENGTH);
 }
 
-void AgvCmdQueue::onOrderQueueChanged(int queueNumber,int orderQueueNumber)
+//RFC6298: SRTT、RTTVAR平滑，RTO = SRTT+4*RTTVAR
+void AgvCmdQueue::updateRto(qint64 rtt)
 {
-    recvQueueNumber = queueNumber;
-    orderExcuteIndex = orderQueueNumber;
+    if(rtt<0)rtt = 0;
+    if(srtt<=0){
+        srtt = rtt;
+        rttvar = rtt/2.0;
+    }else{
+        rttvar = 0.75*rttvar+0.25*qAbs(srtt-rtt);
+        srtt = 0.875*srtt+0.125*rtt;
+    }
+    rto = qBound((int)MIN_RTO,(int)(srtt+qMax(1.0,4*rttvar)),(int)MAX_RTO);
 }
 
+void AgvCmdQueue::onOrderQueueChanged(int queueNumber,int orderQueueNumber)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    qint64 nowMsecs = steadyMsecs();
+    if(lastReportMsecs>0)
+        linkStats[LINK_ACK_GAP].record(nowMsecs-lastReportMsecs);
+    lastReportMsecs = nowMsecs;
+
+    //没有要发送的，也没有在途的包，不需要处理
+    if(orders.isEmpty() && inflight.isEmpty())return ;
+    ackPending = true;
+    ackSeq = queueNumber;
+    ackCount = orderQueueNumber;
+    process(nowMsecs);
+}
 
 void AgvCmdQueue::clear()
 {
-    mtx.lock();
-    ordersSendIndex = 0;
+    std::unique_lock<std::mutex> lock(mtx);
     orders.clear();
-    sendOrder();
-    mtx.unlock();
+    base = 0;
+    inflight.clear();
+    hasAcked = false;
+    timeouts = 0;
+    needSend = true;//发一个停止包
+    process(steadyMsecs());
 }
 
-void AgvCmdQueue::setQueue(const QList<AgvOrder> &ord)
+void AgvCmdQueue::halt()
 {
-    mtx.lock();
-    ordersSendIndex = 0;
-    orders=ord;
-    mtx.unlock();
+    std::unique_lock<std::mutex> lock(mtx);
+    orders.clear();
+    base = 0;
+    inflight.clear();
+    hasAcked = false;
+    timeouts = 0;
+    needSend = false;
+    stopped = true;
 }
 
-QByteArray AgvCmdQueue::getRfidByte(int rfid)
+void AgvCmdQueue::release()
 {
-    QByteArray qba;
-    qba.append((rfid)&0xFF);
-    qba.append((rfid>>8)&0xFF);
-    qba.append((rfid>>16)&0xFF);
-    qba.append((rfid>>24)&0xFF);
-    return qba;
+    std::unique_lock<std::mutex> lock(mtx);
+    stopped = false;
 }
 
-//将内容封包
-//加入包头、(功能码)、包长、(内容)、校验和、包尾
-QByteArray AgvCmdQueue::getSendPacket(QByteArray content)
+bool AgvCmdQueue::isStopped()
 {
-    //组包//加入包头、功能码、内容、校验和、包尾
-    QByteArray result;
-
-    //包头
-    result.append(AGV_PACK_HEAD);
-
-    //包长
-    //       包长 内容长         校验码 包尾
-    int len = 1+content.length()+1+1;
-    result.append(len&0xFF);
+    std::unique_lock<std::mutex> lock(mtx);
+    return stopped;
+}
 
-    //内容
-    result.append(content);
+bool AgvCmdQueue::setQueue(const QList<AgvOrder> &ord)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    //急停之后排进来的新命令(序号比急停新)不能发出去，否则急停被悄悄覆盖
+    if(stopped)return false;
+    orders = ord;
+    base = 0;
+    inflight.clear();
+    hasAcked = false;
+    timeouts = 0;
+    needSend = true;
+    process(steadyMsecs());
+    return true;
+}
 
-    //校验和
-    unsigned char sum = checkSum((unsigned char *)content.data(),content.length());
-    result.append(sum);
+int AgvCmdQueue::getSrtt()
+{
+    mtx.lock();
+    int result = (int)srtt;
+    mtx.unlock();
+    return result;
+}
 
-    //包尾
-    result.append(AGV_PACK_END);
+int AgvCmdQueue::getRto()
+{
+    mtx.lock();
+    int result = rto;
+    mtx.unlock();
+    return result;
+}
 
+quint64 AgvCmdQueue::getRetransmitCount()
+{
+    mtx.lock();
+    quint64 result = retransmitCount;
+    mtx.unlock();
     return result;
 }
 
+const char *AgvCmdQueue::linkMetricName(int metric)
+{
+    switch(metric){
+    case LINK_RTT:return "rtt";
+    case LINK_RETRANSMITS:return "retransmits";
+    case LINK_ACK_GAP:return "ackGap";
+    default:return "";
+    }
+}
+
+//直方图本身是原子的，不需要加锁
+AtomicHistogram::Snapshot AgvCmdQueue::linkSnapshot(int metric)
+{
+    if(metric<0||metric>=LINK_METRIC_COUNT)return AtomicHistogram::Snapshot();
+    return linkStats[metric].snapshot();
+}
@@ -3,9 +3,12 @@
 
 #include <QList>
 #include <mutex>
+#include <functional>
 #include <QByteArray>
+#include "util/timingwheel.h"
+#include "util/histogram.h"
 /*
- * 发送给Agv的命令的队列及其处理线程
+ * 发送给Agv的命令的队列
  * 队列的单个内容是AgvOrder
  * 维护长队列
  */
@@ -65,6 +68,13 @@ public:
 };
 
 
+//滑动窗口的命令发送
+//车辆一次最多缓存3条指令(一个包)，每个包有一个序号，车辆上报收到的最后一个包的序号和这个包执行到了第几条
+//1.车辆每执行完一条，立即从第一条未执行的指令开始补发一个包，让车辆的缓存一直是满的
+//2.每个发出的包记录发送时间，收到应答时得到往返时间，按RFC6298估算重传超时(RTO)
+//3.超时只重传最新的窗口(用新的序号)，连续超时RTO加倍。包序号ESTOP_SEQ留给急停，不使用
+//车辆的上报在IO线程中直接处理，重传超时由共享的时间轮定时，每辆车不再需要一个发送线程
+//4.往返时间、重传次数、上报间隔记入直方图，用来找出无线信号差的车辆
 class AgvCmdQueue
 {
 public:
@@ -76,33 +86,99 @@ public:
         PICK_PUT_HEIGHT = 30,//叉起或者放下需要的升降的高度
     };
 
+    enum{
+        WINDOW_ORDERS = 3,//一个包最多3条指令
+        INIT_RTO = 200,//初始的重传超时 ms
+        MIN_RTO = 50,
+        MAX_RTO = 2000,
+        MAX_INFLIGHT = 8,//记录的未应答的包的个数
+    };
+
+    //链路统计的指标
+    enum{
+        LINK_RTT = 0,//包的往返时间 ms
+        LINK_RETRANSMITS = 1,//每个得到应答的包之前连续超时重传了几次
+        LINK_ACK_GAP = 2,//两次上报之间的间隔 ms
+        LINK_METRIC_COUNT = 3,
+    };
+
+    static const char *linkMetricName(int metric);
+
     AgvCmdQueue();
     ~AgvCmdQueue();
 
-    void init(ToSendCallback _toSend, FinishCallback _finish);
+    void init(TimingWheel *_wheel, ToSendCallback _toSend, FinishCallback _finish);
 
+    //清空队列，让车辆立即停止
     void clear();
 
-    void setQueue(const QList<AgvOrder>& ord);
+    //急停:清空队列，不再发送、重传(停止包由IO引擎直接发出)
+    //持有锁完成，返回之后这个队列不会再发出包含指令的包。急停是锁定的，release之前setQueue都被拒绝
+    void halt();
+    //解除急停
+    void release();
+    bool isStopped();
+
+    //车辆要删除了:取消重传定时器，之后不再发送、不再回调(其他线程可能还持有这个队列，读链路统计)
+    void close();
 
+    //急停中返回false，不下发
+    bool setQueue(const QList<AgvOrder>& ord);
+
+    //任意线程:车辆上报的包序号和执行到第几条
     void onOrderQueueChanged(int queueNumber,int orderQueueNumber);
 
-    static void cmdThread(void *param);
+    //平滑后的往返时间、当前的重传超时 ms
+    int getSrtt();
+    int getRto();
+    quint64 getRetransmitCount();
+
+    //任意线程:链路统计
+    AtomicHistogram::Snapshot linkSnapshot(int metric);
+
 private:
-    void cmdProcess();
-    QByteArray getSendPacket(QByteArray content);
-    QByteArray getRfidByte(int rfid);
-    void sendOrder();
+    //发出去还没有应答的包
+    struct InFlight{
+        int seq = 0;
+        int base = 0;//第一条指令的下标
+        int amount = 0;//指令条数
+        qint64 sendMsecs = 0;
+    };
+
+    void process(qint64 nowMsecs);
+    void armTimer(qint64 nowMsecs);
+    void onTimer();
+    void processAck(qint64 nowMsecs);
+    QByteArray makeWindow(qint64 nowMsecs);
+    void updateRto(qint64 rtt);
+
     QList<AgvOrder> orders;
+    int base = 0;//车辆还没有执行的第一条指令
+    QList<InFlight> inflight;
+    InFlight lastAcked;//车辆当前缓存的包
+    bool hasAcked = false;
+    bool needSend = false;
+    bool stopped = false;//急停，等待解除
+
+    //车辆上报的，等待处理
+    bool ackPending = false;
+    int ackSeq = 0;
+    int ackCount = 0;
+
+    uint8_t sendQueueNumber = 0;
+    double srtt = 0;
+    double rttvar = 0;
+    int rto = INIT_RTO;
+    quint64 retransmitCount = 0;
+    int timeouts = 0;//上次应答之后连续超时的次数
+    qint64 lastReportMsecs = 0;
+    AtomicHistogram linkStats[LINK_METRIC_COUNT];
+
     std::mutex mtx;
-    volatile bool quit;
-    volatile bool threadAlreadQuit;
-
-    int8_t sendQueueNumber = 0;
-    volatile int recvQueueNumber = 0;//当前命令的序列编号
-    volatile int orderExcuteIndex = 0;//当前执行到命令条数(0,4)
-    volatile int ordersSendIndex = 0;//当前发送指令的下标
-    volatile int lastSendOrderAmount = 0;//上一次发送的指令的数量
+    bool quit = false;
+    TimingWheel *wheel = NULL;
+    bool timerPending = false;//重传定时器
+    TimingWheel::TimerId timerId = 0;
 
     ToSendCallback toSend;
     FinishCallback finish;
@@ -13,6 +13,7 @@ public:
         id(0),
         rfid(0),
         occuAgv(0),
+        reserveAgv(0),
         color_r(255),
         color_g(0),
         color_b(0)
@@ -27,6 +28,7 @@ public:
         id=b.id;
         rfid=b.rfid;
         occuAgv=b.occuAgv;
+        reserveAgv=b.reserveAgv;
         color_r = b.color_r;
         color_g = b.color_g;
         color_b = b.color_b;
@@ -52,6 +54,7 @@ public:
 
     ////用于计算线路的，不存库
     int occuAgv;
+    int reserveAgv;//被哪辆车预留为后续某一段任务的目的地
 };
 
 #endif // AGVSTATION_H
@@ -0,0 +1,37 @@
+﻿#ifndef AGVTELEMETRY_H
+#define AGVTELEMETRY_H
+
+#include <QtGlobal>
+
+//车辆上报的一帧状态(在IO线程中解析，交给业务线程处理)
+struct AgvTelemetry
+{
+    enum{
+        TYPE_STATUS = 0,//状态上报
+        TYPE_CONNECTED = 1,//连接上了
+        TYPE_DISCONNECTED = 2,//断开了
+    };
+    int type = TYPE_STATUS;
+    int agvId = 0;
+    qint64 recvMsecs = 0;//收到的时间
+
+    int mileage = 0;//行驶距离 (mm)
+    int currentRfid = 0;
+    int nextRfid = 0;
+    int current = 0;//电流 0.1A，放电为正，充电为负
+    int voltage = 0;//电压 0.01v
+    int positionMagneticStripe = 0;
+    int pcbTemperature = 0;
+    int motorTemperature = 0;
+    int cpu = 0;
+    int speed = 0;
+    int angle = 0;
+    int height = 0;
+    int error_no = 0;
+    int mode = 0;
+    int recvQueueNumber = 0;
+    int orderCount = 0;
+    int CRC = 0;
+};
+
+#endif // AGVTELEMETRY_H
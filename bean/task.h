@@ -11,18 +11,36 @@ class Task : public QObject
 public:
     explicit Task(QObject *parent = nullptr);
 
-    Task(const Task &b) {
+    //复制全部字段(任务快照用)，不复制QObject的父对象
+    Task(const Task &b) : QObject() {
         id = b.id;
-        status = b.status;
+        produceTime = b.produceTime;
+        doneTime = b.doneTime;
+        doTime = b.doTime;
         excuteCar = b.excuteCar;
+        status = b.status;
         circle = b.circle;
+        agvFixed = b.agvFixed;
+        priority = b.priority;
+        deadline = b.deadline;
         currentDoIndex = b.currentDoIndex;
-        if(b.produceTime.isValid())
-            produceTime = b.produceTime;
-        if(b.doneTime.isValid())
-            doneTime = b.doneTime;
-        if(b.doTime.isValid())
-            doTime = b.doTime;
+        getGoodDirect = b.getGoodDirect;
+        getGoodDistance = b.getGoodDistance;
+        getGoodStation = b.getGoodStation;
+        getGoodHeight = b.getGoodHeight;
+        getStartTime = b.getStartTime;
+        getFinishTime = b.getFinishTime;
+        putGoodDirect = b.putGoodDirect;
+        putGoodDistance = b.putGoodDistance;
+        putGoodStation = b.putGoodStation;
+        putGoodHeight = b.putGoodHeight;
+        putStartTime = b.putStartTime;
+        putFinishTime = b.putFinishTime;
+        standByStation = b.standByStation;
+        standByStartTime = b.standByStartTime;
+        standByFinishTime = b.standByFinishTime;
+        queueTime = b.queueTime;
+        arriveTime = b.arriveTime;
     }
 
     //对其进行排序时，采用从小到大排序，就是a<b 则a先执行
@@ -60,6 +78,8 @@ public:
 
     bool circle = false;//是否是循环任务
 
+    bool agvFixed = false;//创建时指定了车辆，不会被改派、抢占(记入日志和数据库，重启后保持)
+
     enum{
         PRIORITY_VERY_LOW = 0,//最低的优先级
         PRIORITY_LOW = 1,//低优先级
@@ -69,6 +89,8 @@ public:
     };
     int priority = PRIORITY_NORMAL;//优先级
 
+    QDateTime deadline;//截止时间(要求送达的时间)，无效表示没有要求
+
     enum{
         INDEX_GETTING_GOOD = 0,//去取货
         INDEX_PUTTING_GOOD = 1,//去放货
@@ -107,6 +129,10 @@ public:
     int standByStation = 0;//停留点
     QDateTime standByStartTime;//开始去停留点时间
     QDateTime standByFinishTime;//到达停留点时间
+
+    //以下只用于统计，不保存
+    QDateTime queueTime;//最近一次进入未分配队列的时间
+    QDateTime arriveTime;//到达当前这一段目的地的时间
 };
 
 #endif // TASK_H
@@ -0,0 +1,23 @@
+QT += core
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = BezierArcBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+#只用到弧长表，不依赖数据库、zmq等
+SOURCES += \
+    bezierarcbench.cpp \
+    ../util/bezierarc.cpp
+
+HEADERS += \
+    benchutil.h \
+    ../util/bezierarc.h
+
+DEFINES += QT_DEPRECATED_WARNINGS
@@ -0,0 +1,34 @@
+QT += core network
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = EStopBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+#只用到车辆连接的IO引擎，不依赖数据库、zmq等
+SOURCES += \
+    estopbench.cpp \
+    ../network/agvframeparser.cpp \
+    ../network/agvioworker.cpp \
+    ../network/agvioengine.cpp \
+    ../network/agvcapture.cpp \
+    ../util/common.cpp
+
+HEADERS += \
+    benchutil.h \
+    ../network/agvframeparser.h \
+    ../network/agvprotocol.h \
+    ../network/agvioworker.h \
+    ../network/agvioengine.h \
+    ../network/agvcapture.h \
+    ../bean/agvtelemetry.h \
+    ../util/concurrentqueue.h \
+    ../util/histogram.h
+
+DEFINES += QT_DEPRECATED_WARNINGS
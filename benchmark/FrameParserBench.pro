@@ -0,0 +1,26 @@
+QT += core
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = FrameParserBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+#只用到上报包的拆包，不依赖数据库、zmq等
+SOURCES += \
+    frameparserbench.cpp \
+    ../network/agvframeparser.cpp \
+    ../util/common.cpp
+
+HEADERS += \
+    benchutil.h \
+    ../network/agvframeparser.h \
+    ../network/agvprotocol.h \
+    ../bean/agvtelemetry.h
+
+DEFINES += QT_DEPRECATED_WARNINGS
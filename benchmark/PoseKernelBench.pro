@@ -0,0 +1,27 @@
+QT += core
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = PoseKernelBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+#AVX2的版本，运行的机器必须支持
+msvc: QMAKE_CXXFLAGS += /arch:AVX2
+else: QMAKE_CXXFLAGS += -mavx2
+
+#只用到位姿计算，不依赖数据库、zmq等
+SOURCES += \
+    posekernelbench.cpp \
+    ../util/posekernel.cpp
+
+HEADERS += \
+    benchutil.h \
+    ../util/posekernel.h
+
+DEFINES += QT_DEPRECATED_WARNINGS
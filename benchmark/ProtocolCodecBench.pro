@@ -0,0 +1,24 @@
+QT += core
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = ProtocolCodecBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+#只用到协议的编解码，不依赖数据库、zmq等
+SOURCES += \
+    protocolcodecbench.cpp \
+    ../util/common.cpp
+
+HEADERS += \
+    benchutil.h \
+    ../network/agvprotocol.h \
+    ../bean/agvtelemetry.h
+
+DEFINES += QT_DEPRECATED_WARNINGS
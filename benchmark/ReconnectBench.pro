@@ -0,0 +1,21 @@
+QT += core sql network
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = ReconnectBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += \
+    reconnectbench.cpp
+
+HEADERS += \
+    benchutil.h
+
+#断开时任务中心的处理(释放占用、放回队列、重连继续)和服务端共用
+include(../AgvServer.pri)
+
+DEFINES += QT_DEPRECATED_WARNINGS
@@ -0,0 +1,27 @@
+QT += core
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = TaskIntakeBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+#只用到任务队列，不依赖数据库、zmq等
+SOURCES += \
+    taskintakebench.cpp \
+    ../business/taskqueue.cpp \
+    ../bean/task.cpp
+
+HEADERS += \
+    benchutil.h \
+    ../business/taskqueue.h \
+    ../bean/task.h \
+    ../util/concurrentqueue.h \
+    ../util/histogram.h
+
+DEFINES += QT_DEPRECATED_WARNINGS
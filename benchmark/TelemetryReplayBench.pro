@@ -0,0 +1,21 @@
+QT += core sql network
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = TelemetryReplayBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += \
+    telemetryreplaybench.cpp
+
+HEADERS += \
+    benchutil.h
+
+#车辆状态处理(里程、站点、车队状态)和服务端共用
+include(../AgvServer.pri)
+
+DEFINES += QT_DEPRECATED_WARNINGS
@@ -0,0 +1,24 @@
+QT += core
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = TimingWheelBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+#只用到时间轮
+SOURCES += \
+    timingwheelbench.cpp \
+    ../util/timingwheel.cpp
+
+HEADERS += \
+    benchutil.h \
+    ../util/timingwheel.h \
+    ../util/histogram.h
+
+DEFINES += QT_DEPRECATED_WARNINGS
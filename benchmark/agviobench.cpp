@@ -0,0 +1,184 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QThread>
+#include <QTextStream>
+#include <chrono>
+#include "network/agvioengine.h"
+#include "util/histogram.h"
+#include "util/common.h"
+#include "benchutil.h"
+
+//车辆连接的负载测试:本机模拟大量车辆，按固定频率上报状态
+//同时主线程周期性地忙一段时间(模拟调度、地图计算)
+//分别统计IO线程(命令应答)和主线程(业务处理)收到状态的延迟
+//上报包的里程计字段里放发送时刻(us)，用来计算延迟
+
+static Clock::time_point benchStart;
+
+static int nowUs()
+{
+    return (int)(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-benchStart).count()&0x7FFFFFFF);
+}
+
+//里程计字段放发送时刻
+static QByteArray makeReport(int mileage)
+{
+    AgvTelemetry telemetry;
+    telemetry.mileage = mileage;
+    telemetry.voltage = 2500;
+    return makeStatusFrame(telemetry);
+}
+
+//模拟的车辆:接受连接，定时给每个连接发状态
+class FakeFleet : public QObject
+{
+    Q_OBJECT
+public:
+    FakeFleet(int _periodMs):periodMs(_periodMs){}
+
+    quint16 listen(){
+        server = new QTcpServer(this);
+        connect(server,SIGNAL(newConnection()),this,SLOT(onNewConnection()));
+        server->listen(QHostAddress::LocalHost,0);
+        return server->serverPort();
+    }
+
+public slots:
+    void start(){
+        timer = new QTimer(this);
+        connect(timer,SIGNAL(timeout()),this,SLOT(report()));
+        timer->start(periodMs);
+    }
+
+    void onNewConnection(){
+        while(server->hasPendingConnections()){
+            QTcpSocket *socket = server->nextPendingConnection();
+            socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
+            sockets.append(socket);
+        }
+    }
+
+    void report(){
+        for(int i=0;i<sockets.length();++i)
+            sockets.at(i)->write(makeReport(nowUs()));
+    }
+
+private:
+    int periodMs;
+    QTcpServer *server = NULL;
+    QTimer *timer = NULL;
+    QList<QTcpSocket *> sockets;
+};
+
+struct BenchConfig{
+    int agvs = 500;
+    int rate = 10;//每辆车每秒上报次数
+    int threads = AgvIoEngine::DEFAULT_THREADS;
+    int seconds = 10;
+    int periodUs = 100000;//主线程忙的周期
+    int holdUs = 20000;//每个周期主线程忙的时间
+};
+
+static void report(QTextStream &out, const QString &name, AtomicHistogram &h, double seconds)
+{
+    AtomicHistogram::Snapshot snap = h.snapshot();
+    out<<name<<": frames:"<<(qint64)snap.count
+      <<" frames/s:"<<(seconds>0?snap.count/seconds:0)
+     <<" latency(us) p50:"<<snap.percentile(50)
+    <<" p99:"<<snap.percentile(99)
+    <<" p99.9:"<<snap.percentile(99.9)
+    <<" max:"<<snap.max<<"\n";
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("AgvIoBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("agv connection load test: io threads vs busy main thread");
+    parser.addHelpOption();
+    QCommandLineOption agvsOption("agvs","simulated agvs.","count","500");
+    QCommandLineOption rateOption("rate","reports per agv per second.","hz","10");
+    QCommandLineOption threadsOption("threads","io threads.","count",QString::number(AgvIoEngine::DEFAULT_THREADS));
+    QCommandLineOption secondsOption("seconds","test duration.","seconds","10");
+    QCommandLineOption periodOption("period","main thread busy period in us.","us","100000");
+    QCommandLineOption holdOption("hold","main thread busy time per period in us.","us","20000");
+    parser.addOption(agvsOption);
+    parser.addOption(rateOption);
+    parser.addOption(threadsOption);
+    parser.addOption(secondsOption);
+    parser.addOption(periodOption);
+    parser.addOption(holdOption);
+    parser.process(a);
+
+    BenchConfig config;
+    config.agvs = qMax(1,parser.value(agvsOption).toInt());
+    config.rate = qMax(1,parser.value(rateOption).toInt());
+    config.threads = qMax(1,parser.value(threadsOption).toInt());
+    config.seconds = qMax(1,parser.value(secondsOption).toInt());
+    config.periodUs = qMax(1000,parser.value(periodOption).toInt());
+    config.holdUs = qMax(0,parser.value(holdOption).toInt());
+
+    benchStart = Clock::now();
+
+    QThread fleetThread;
+    FakeFleet fleet(qMax(1,1000/config.rate));
+    quint16 port = fleet.listen();
+    fleet.moveToThread(&fleetThread);
+    fleetThread.start();
+
+    AtomicHistogram ioLatency;
+    AtomicHistogram mainLatency;
+    AgvIoEngine engine;
+    engine.setTelemetryHandler([&](const AgvTelemetry &t){
+        if(t.type==AgvTelemetry::TYPE_STATUS)
+            mainLatency.record(nowUs()-t.mileage);
+    });
+    engine.start(config.threads);
+    AgvIoWorker::AckCallback ack = [&](const AgvTelemetry &t){
+        ioLatency.record(nowUs()-t.mileage);
+    };
+    for(int i=1;i<=config.agvs;++i)
+        engine.addAgv(i,"127.0.0.1",port,ack);
+
+    //连接都建立后再开始上报
+    Clock::time_point connectDeadline = Clock::now()+std::chrono::seconds(60);
+    while(engine.getOnlineCount()<config.agvs){
+        if(Clock::now()>=connectDeadline){
+            QTextStream(stderr)<<"only "<<engine.getOnlineCount()<<"/"<<config.agvs<<" agvs connected\n";
+            engine.stop();
+            fleetThread.quit();
+            fleetThread.wait();
+            return 1;
+        }
+        QCoreApplication::processEvents();
+        QThread::msleep(10);
+    }
+    QMetaObject::invokeMethod(&fleet,"start",Qt::QueuedConnection);
+
+    //主线程周期性地忙
+    QTimer busy;
+    QObject::connect(&busy,&QTimer::timeout,[&](){spin(config.holdUs);});
+    busy.start(config.periodUs/1000);
+
+    QTimer::singleShot(config.seconds*1000,&a,SLOT(quit()));
+    a.exec();
+
+    QTextStream out(stdout);
+    out<<"agvs:"<<config.agvs<<" rate:"<<config.rate<<"Hz io threads:"<<config.threads
+      <<" main busy:"<<config.holdUs<<"/"<<config.periodUs<<"us\n";
+    report(out,"io thread",ioLatency,config.seconds);
+    report(out,"main thread",mainLatency,config.seconds);
+    out.flush();
+
+    engine.stop();
+    fleetThread.quit();
+    fleetThread.wait();
+    return 0;
+}
+
+#include "agviobench.moc"
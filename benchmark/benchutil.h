@@ -0,0 +1,27 @@
+﻿#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+#include <QByteArray>
+#include <chrono>
+#include "network/agvprotocol.h"
+
+//各个基准共用的计时和组包
+
+typedef std::chrono::steady_clock Clock;
+
+//忙等us微秒(模拟调度、地图计算占用线程)
+inline void spin(int us)
+{
+    Clock::time_point end = Clock::now()+std::chrono::microseconds(us);
+    while(Clock::now()<end);
+}
+
+//按车辆上报的格式组包，和服务端解析用同一张字段表
+inline QByteArray makeStatusFrame(const AgvTelemetry &telemetry)
+{
+    unsigned char frame[AgvProtocol::StatusFrame::LENGTH];
+    AgvProtocol::StatusFrame::encode(frame,telemetry);
+    return QByteArray((const char *)frame,AgvProtocol::StatusFrame::LENGTH);
+}
+
+#endif // BENCHUTIL_H
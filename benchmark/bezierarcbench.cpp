@@ -0,0 +1,177 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <math.h>
+#include "util/bezierarc.h"
+#include "benchutil.h"
+
+//曲线弧长表的精度和查找速度
+//参照:把曲线均分成200000段的折线，累计长度
+//1.弧长表的总长度和参照长度的相对误差
+//2.距离->t(弧长表)->距离(参照)，和原来距离的差，相对于曲线长度
+//除了随机曲线，还有退化的:四个点重合、控制点在一条直线上、有尖点的。超出容差时返回1
+
+static const int REFERENCE_SEGMENTS = 200000;
+static const double LENGTH_TOLERANCE = 1e-5;
+static const double ROUNDTRIP_TOLERANCE = 1e-3;
+//比这短的当作长度为0(四个点重合时，参照折线只有计算的舍入误差)，弧长表的长度也要小于它 mm
+static const double ZERO_LENGTH = 1e-3;
+
+struct Curve{
+    QPointF p0,p1,p2,p3;
+};
+
+//参照折线:ref[i]是t从0到i/REFERENCE_SEGMENTS的长度
+static void reference(const BezierArc &arc, std::vector<double> &ref)
+{
+    ref.resize(REFERENCE_SEGMENTS+1);
+    ref[0] = 0;
+    QPointF last = arc.pointAt(0);
+    for(int i=1;i<=REFERENCE_SEGMENTS;++i){
+        QPointF p = arc.pointAt((double)i/REFERENCE_SEGMENTS);
+        double dx = p.x()-last.x(),dy = p.y()-last.y();
+        ref[i] = ref[i-1]+sqrt(dx*dx+dy*dy);
+        last = p;
+    }
+}
+
+static double referenceAt(const std::vector<double> &ref, double t)
+{
+    double pos = t*REFERENCE_SEGMENTS;
+    int i = (int)pos;
+    if(i>=REFERENCE_SEGMENTS)return ref[REFERENCE_SEGMENTS];
+    return ref[i]+(pos-i)*(ref[i+1]-ref[i]);
+}
+
+struct Errors{
+    double length = 0;
+    double roundTrip = 0;
+    bool zeroLength = true;//长度为0的曲线，弧长表的长度也是0
+};
+
+//误差都是相对于曲线长度的
+static Errors check(const std::vector<Curve> &curves)
+{
+    Errors e;
+    std::vector<double> ref;
+    for(size_t k=0;k<curves.size();++k){
+        const Curve &c = curves[k];
+        BezierArc arc(c.p0,c.p1,c.p2,c.p3);
+        reference(arc,ref);
+        double total = ref[REFERENCE_SEGMENTS];
+        if(total<ZERO_LENGTH){
+            if(arc.length()>=ZERO_LENGTH)e.zeroLength = false;
+            continue;
+        }
+        e.length = qMax(e.length,fabs(arc.length()-total)/total);
+        for(int i=0;i<=1000;++i){
+            double s = arc.length()*i/1000;
+            double t = arc.paramAt(s);
+            e.roundTrip = qMax(e.roundTrip,fabs(referenceAt(ref,t)-s)/total);
+        }
+    }
+    return e;
+}
+
+static bool withinTolerance(const Errors &e)
+{
+    return e.length<=LENGTH_TOLERANCE && e.roundTrip<=ROUNDTRIP_TOLERANCE && e.zeroLength;
+}
+
+static std::vector<Curve> degenerateCurves()
+{
+    std::vector<Curve> curves;
+    Curve c;
+    //四个点重合
+    c.p0 = c.p1 = c.p2 = c.p3 = QPointF(5000,5000);
+    curves.push_back(c);
+    //控制点在起点终点的连线上
+    c.p0 = QPointF(0,0);c.p1 = QPointF(1000,0);c.p2 = QPointF(2000,0);c.p3 = QPointF(3000,0);
+    curves.push_back(c);
+    //控制点和端点重合(速度在两端为0)
+    c.p0 = c.p1 = QPointF(0,0);c.p2 = c.p3 = QPointF(3000,4000);
+    curves.push_back(c);
+    //尖点:中间速度为0
+    c.p0 = QPointF(0,0);c.p1 = QPointF(3000,3000);c.p2 = QPointF(0,3000);c.p3 = QPointF(3000,0);
+    curves.push_back(c);
+    //来回:终点回到起点
+    c.p0 = QPointF(0,0);c.p1 = QPointF(4000,0);c.p2 = QPointF(4000,0);c.p3 = QPointF(0,0);
+    curves.push_back(c);
+    return curves;
+}
+
+static void report(QTextStream &out, const char *name, const Errors &e, bool ok)
+{
+    out<<name<<": max relative error length:"<<e.length<<" distance->t->distance:"<<e.roundTrip
+      <<(e.zeroLength?"":" zero length curve has length")<<(ok?"":" FAIL")<<"\n";
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("BezierArcBench");
+
+    QCommandLineParser cmd;
+    cmd.setApplicationDescription("bezier arc-length table accuracy against a polyline, and lookup speed");
+    cmd.addHelpOption();
+    QCommandLineOption curvesOption("curves","random curves to check.","count","200");
+    QCommandLineOption lookupsOption("lookups","distance lookups to time.","count","10000000");
+    cmd.addOption(curvesOption);
+    cmd.addOption(lookupsOption);
+    cmd.process(a);
+
+    int count = qMax(1,cmd.value(curvesOption).toInt());
+    int lookups = qMax(1,cmd.value(lookupsOption).toInt());
+
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<double> coord(0,100000);
+    std::vector<Curve> curves(count);
+    for(int i=0;i<count;++i){
+        Curve &c = curves[i];
+        c.p0 = QPointF(coord(rng),coord(rng));
+        c.p1 = QPointF(coord(rng),coord(rng));
+        c.p2 = QPointF(coord(rng),coord(rng));
+        c.p3 = QPointF(coord(rng),coord(rng));
+    }
+
+    QTextStream out(stdout);
+    out<<"curves:"<<count<<" table segments:"<<BezierArc::DEFAULT_SEGMENTS<<" reference segments:"<<REFERENCE_SEGMENTS<<"\n";
+
+    Errors e = check(curves);
+    bool ok = withinTolerance(e);
+    report(out,"random",e,ok);
+
+    Errors d = check(degenerateCurves());
+    bool degenerateOk = withinTolerance(d);
+    report(out,"degenerate",d,degenerateOk);
+    ok = ok && degenerateOk;
+    out.flush();
+    if(!ok){
+        QTextStream(stderr)<<"arc-length table drifts from the polyline beyond tolerance (length "<<LENGTH_TOLERANCE
+                          <<", distance "<<ROUNDTRIP_TOLERANCE<<")\n";
+        return 1;
+    }
+
+    //上报里程时的换算:距离->t->坐标和朝向
+    std::vector<BezierArc> arcs;
+    for(int i=0;i<count;++i)
+        arcs.push_back(BezierArc(curves[i].p0,curves[i].p1,curves[i].p2,curves[i].p3));
+    std::uniform_real_distribution<double> ratio(0,1);
+    std::vector<double> ratios(1024);
+    for(size_t i=0;i<ratios.size();++i)ratios[i] = ratio(rng);
+
+    double sink = 0;
+    Clock::time_point t0 = Clock::now();
+    for(int i=0;i<lookups;++i){
+        const BezierArc &arc = arcs[i%count];
+        double t = arc.paramAt(arc.length()*ratios[i&1023]);
+        QPointF p = arc.pointAt(t);
+        sink += p.x()+arc.angleAt(t);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now()-t0).count();
+    out<<"pose lookup: ns/lookup:"<<seconds*1e9/lookups<<" sink:"<<sink<<"\n";
+    return 0;
+}
@@ -0,0 +1,218 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QTextStream>
+#include <chrono>
+#include <atomic>
+#include "network/agvioengine.h"
+#include "network/agvprotocol.h"
+#include "util/histogram.h"
+#include "benchutil.h"
+
+//急停的扇出延迟:本机模拟大量车辆，每辆车都有一批排队待发的命令包时让所有车辆停止
+//queued: 原来的路径，停止包和命令包一样逐辆车排在发送队列后面
+//estop:  急停路径，IO线程优先处理，预先封装好的停止包直接写入所有连接，之前排队的命令包丢弃
+//统计从发出停止到每辆车收到停止包的延迟，以及最后一辆车收到的时间(整个车队停下来)
+
+static Clock::time_point benchStart;
+
+static qint64 nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-benchStart).count();
+}
+
+enum{
+    QUEUED_STOP_SEQ = 0xFF,//queued模式的停止包用这个序号，和命令包区分
+};
+
+//模拟的车辆:接受连接，按定长拆出命令包，记录每一轮停止包到达的时间
+class FakeFleet : public QObject
+{
+    Q_OBJECT
+public:
+    struct Peer{
+        QByteArray buff;
+        int round = 0;//已经收到停止包的轮次
+    };
+
+    quint16 listen(){
+        server = new QTcpServer(this);
+        connect(server,SIGNAL(newConnection()),this,SLOT(onNewConnection()));
+        server->listen(QHostAddress::LocalHost,0);
+        return server->serverPort();
+    }
+
+    //主线程:开始新的一轮
+    void startRound(int _round, qint64 _startUs){
+        arrived.store(0);
+        staleFrames.store(0);
+        startUs.store(_startUs);
+        round.store(_round);
+    }
+
+    int getConnections(){return connections.load();}
+
+    std::atomic<int> round{0};
+    std::atomic<qint64> startUs{0};
+    std::atomic<int> arrived{0};
+    std::atomic<int> staleFrames{0};//收到停止包之后又收到的命令包
+    AtomicHistogram latency;//每辆车收到停止包的延迟 us
+    std::atomic<qint64> lastArrivalUs{0};
+
+public slots:
+    void onNewConnection(){
+        while(server->hasPendingConnections()){
+            QTcpSocket *socket = server->nextPendingConnection();
+            socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
+            connect(socket,SIGNAL(readyRead()),this,SLOT(onReadyRead()));
+            peers.insert(socket,Peer());
+            ++connections;
+        }
+    }
+
+    void onReadyRead(){
+        QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+        if(socket==NULL || !peers.contains(socket))return ;
+        Peer &peer = peers[socket];
+        peer.buff.append(socket->readAll());
+        int current = round.load();
+        const int length = AgvProtocol::DispatchFrame::LENGTH;
+        while(peer.buff.length()>=length){
+            int seq = AgvProtocol::DispatchFrame::Seq::get((const unsigned char *)peer.buff.data());
+            peer.buff.remove(0,length);
+            bool stop = seq==AgvProtocol::DispatchFrame::ESTOP_SEQ || seq==QUEUED_STOP_SEQ;
+            if(!stop){
+                if(peer.round==current)++staleFrames;
+                continue;
+            }
+            if(peer.round==current)continue;
+            peer.round = current;
+            qint64 now = nowUs();
+            latency.record(now-startUs.load());
+            lastArrivalUs.store(now);
+            ++arrived;
+        }
+    }
+
+private:
+    QTcpServer *server = NULL;
+    QHash<QTcpSocket *,Peer> peers;
+    std::atomic<int> connections{0};
+};
+
+struct Order{
+    int rfid;
+    int order;
+    int param;
+};
+
+static QByteArray encode(int seq, bool stop)
+{
+    unsigned char packet[AgvProtocol::DispatchFrame::LENGTH];
+    Order orders[3] = {{0x100,0x01,5},{0x200,0x03,90},{0x300,0x01,5}};
+    AgvProtocol::DispatchFrame::encode(packet,seq,orders,stop?0:3);
+    return QByteArray((const char *)packet,AgvProtocol::DispatchFrame::LENGTH);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("EStopBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("emergency stop fan-out latency: queued stop vs priority path");
+    parser.addHelpOption();
+    QCommandLineOption agvsOption("agvs","simulated agvs.","count","200");
+    QCommandLineOption threadsOption("threads","io threads.","count",QString::number(AgvIoEngine::DEFAULT_THREADS));
+    QCommandLineOption backlogOption("backlog","command packets queued per agv before each stop.","count","8");
+    QCommandLineOption roundsOption("rounds","stops per mode.","count","50");
+    parser.addOption(agvsOption);
+    parser.addOption(threadsOption);
+    parser.addOption(backlogOption);
+    parser.addOption(roundsOption);
+    parser.process(a);
+
+    int agvs = qMax(1,parser.value(agvsOption).toInt());
+    int threads = qMax(1,parser.value(threadsOption).toInt());
+    int backlog = qMax(0,parser.value(backlogOption).toInt());
+    int rounds = qMax(1,parser.value(roundsOption).toInt());
+
+    benchStart = Clock::now();
+
+    QThread fleetThread;
+    FakeFleet fleet;
+    quint16 port = fleet.listen();
+    fleet.moveToThread(&fleetThread);
+    fleetThread.start();
+
+    AgvIoEngine engine;
+    engine.start(threads);
+    for(int i=1;i<=agvs;++i)
+        engine.addAgv(i,"127.0.0.1",port);
+    for(int i=0;i<100 && fleet.getConnections()<agvs;++i)
+        QThread::msleep(50);
+    QThread::msleep(200);
+
+    QByteArray command = encode(1,false);
+    QByteArray queuedStop = encode(QUEUED_STOP_SEQ,true);
+
+    QTextStream out(stdout);
+    out<<"agvs:"<<agvs<<" connected:"<<fleet.getConnections()<<" io threads:"<<threads
+      <<" backlog:"<<backlog<<" rounds:"<<rounds<<"\n";
+
+    const char *names[] = {"queued","estop"};
+    int roundId = 0;
+    for(int mode=0;mode<2;++mode){
+        fleet.latency.reset();
+        AtomicHistogram fleetStop;//最后一辆车收到停止包的时间 us
+        qint64 stale = 0;
+        int incomplete = 0;
+        for(int r=0;r<rounds;++r){
+            fleet.startRound(++roundId,0);
+            for(int i=1;i<=agvs;++i){
+                for(int k=0;k<backlog;++k)
+                    engine.send(i,command);
+            }
+
+            qint64 start = nowUs();
+            fleet.startUs.store(start);
+            if(mode==0){
+                for(int i=1;i<=agvs;++i)
+                    engine.send(i,queuedStop);
+            }else{
+                engine.emergencyStop();
+            }
+
+            qint64 deadline = start+2000000;
+            while(fleet.arrived.load()<agvs && nowUs()<deadline)
+                QThread::usleep(50);
+            if(fleet.arrived.load()<agvs)++incomplete;
+            else fleetStop.record(fleet.lastArrivalUs.load()-start);
+
+            //等排队的命令包发完(estop时被丢弃)，再统计停止之后到达的
+            QThread::msleep(100);
+            stale += fleet.staleFrames.load();
+        }
+
+        AtomicHistogram::Snapshot each = fleet.latency.snapshot();
+        AtomicHistogram::Snapshot all = fleetStop.snapshot();
+        out<<names[mode]<<": per agv(us) p50:"<<each.percentile(50)<<" p99:"<<each.percentile(99)<<" max:"<<each.max
+          <<" | whole fleet(us) p50:"<<all.percentile(50)<<" p99:"<<all.percentile(99)<<" max:"<<all.max
+         <<" | commands after stop:"<<stale<<" incomplete rounds:"<<incomplete<<"\n";
+        out.flush();
+    }
+
+    AtomicHistogram::Snapshot internal = engine.getEStopLatency();
+    out<<"engine estop (call to last io thread flushed, us) p50:"<<internal.percentile(50)
+      <<" p99:"<<internal.percentile(99)<<" max:"<<internal.max<<"\n";
+    out.flush();
+
+    engine.stop();
+    fleetThread.quit();
+    fleetThread.wait();
+    return 0;
+}
+
+#include "estopbench.moc"
@@ -0,0 +1,212 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QByteArray>
+#include <QList>
+#include <chrono>
+#include <random>
+#include <string.h>
+#include "network/agvframeparser.h"
+#include "util/common.h"
+#include "benchutil.h"
+
+//上报包拆包的微基准(单线程，即每个核的处理能力)
+//legacy: 原来的做法，indexOf找包头包尾，mid复制出包，right移动缓冲区
+//ring:   环形缓冲区，按包长取包，在缓冲区中直接解析
+//数据按随机大小分段送入(模拟TCP分段)，可以混入噪声字节和损坏的包
+
+struct BenchConfig{
+    int frames = 2000000;
+    double noise = 0;//每个包之前混入噪声的概率
+    double corrupt = 0;//包内容被改坏的概率
+    int maxChunk = 1460;
+    int rounds = 3;
+};
+
+//原来的解析方式用indexOf找包头包尾，包的内容中出现这两个字节就解不出来
+//每个字节避开包头包尾，干净的数据流两种方式都能全部解出，才能比较结果
+static int avoidMarks(int value)
+{
+    int result = 0;
+    for(int i=0;i<4;++i){
+        int b = (value>>(i*8))&0xFF;
+        if(b==AgvFrameParser::FRAME_HEAD || b==AgvFrameParser::FRAME_END)++b;
+        result |= b<<(i*8);
+    }
+    return result;
+}
+
+static bool hasMarks(const QByteArray &frame)
+{
+    for(int i=1;i<frame.length()-1;++i){
+        unsigned char b = (unsigned char)frame.at(i);
+        if(b==AgvFrameParser::FRAME_HEAD || b==AgvFrameParser::FRAME_END)return true;
+    }
+    return false;
+}
+
+static QByteArray makeStream(const BenchConfig &config, std::mt19937 &rng)
+{
+    QByteArray stream;
+    stream.reserve(config.frames*AgvFrameParser::FRAME_LENGTH*11/10);
+    std::uniform_real_distribution<double> prob(0,1);
+    std::uniform_int_distribution<int> byte(0,255);
+    for(int i=0;i<config.frames;++i){
+        if(config.noise>0 && prob(rng)<config.noise){
+            int n = 1+byte(rng)%16;
+            for(int j=0;j<n;++j)stream.append((char)byte(rng));
+        }
+        AgvTelemetry telemetry;
+        telemetry.mileage = avoidMarks(i*37);
+        telemetry.currentRfid = avoidMarks(i%200);
+        telemetry.nextRfid = avoidMarks(i%200+1);
+        telemetry.current = 12;
+        telemetry.voltage = 2500;
+        telemetry.pcbTemperature = 35;
+        telemetry.speed = i%8;
+        telemetry.recvQueueNumber = avoidMarks(i&0xFF);
+        QByteArray frame = makeStatusFrame(telemetry);
+        //校验和碰上包头包尾的，换一个里程
+        while(hasMarks(frame)){
+            telemetry.mileage = avoidMarks(telemetry.mileage+1);
+            frame = makeStatusFrame(telemetry);
+        }
+        if(config.corrupt>0 && prob(rng)<config.corrupt)
+            frame[2+byte(rng)%27] = (char)byte(rng);
+        stream.append(frame);
+    }
+    return stream;
+}
+
+static QList<int> makeChunks(int total, int maxChunk, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<int> size(1,maxChunk);
+    QList<int> chunks;
+    int sum = 0;
+    while(sum<total){
+        int n = qMin(size(rng),total-sum);
+        chunks.append(n);
+        sum += n;
+    }
+    return chunks;
+}
+
+//原来的解析方式(每个连接一个缓冲区，不校验)
+static quint64 runLegacy(const QByteArray &stream, const QList<int> &chunks, quint64 &checksum)
+{
+    QByteArray buff;
+    quint64 frames = 0;
+    int offset = 0;
+    for(int c=0;c<chunks.length();++c){
+        buff += stream.mid(offset,chunks.at(c));
+        offset += chunks.at(c);
+        while(true){
+            int start = buff.indexOf(0x66);
+            int end = buff.indexOf(0x88);
+            if(start>=0&&end>=0){
+                QByteArray onePack = buff.mid(start,end-start+1);
+                if(onePack.length()>0 && (int)(onePack.at(1))==onePack.length()-1){
+                    AgvTelemetry t;
+                    AgvFrameParser::decode((const unsigned char *)onePack.data(),t);
+                    checksum += t.mileage;
+                    ++frames;
+                }
+                buff = buff.right(buff.length()-end-1);
+            }else{
+                break;
+            }
+        }
+    }
+    return frames;
+}
+
+static quint64 runRing(const QByteArray &stream, const QList<int> &chunks, quint64 &checksum, quint64 &crcErrors)
+{
+    AgvFrameParser parser;
+    AgvTelemetry t;
+    const char *data = stream.constData();
+    for(int c=0;c<chunks.length();++c){
+        int len = chunks.at(c);
+        while(len>0){
+            int space = 0;
+            char *buff = parser.writeBuffer(space);
+            int n = qMin(space,len);
+            memcpy(buff,data,n);
+            parser.commit(n);
+            data += n;
+            len -= n;
+            while(parser.next(t))
+                checksum += t.mileage;
+        }
+    }
+    crcErrors = parser.getCrcErrorCount();
+    return parser.getFrameCount();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("FrameParserBench");
+
+    QCommandLineParser cmd;
+    cmd.setApplicationDescription("agv report frame parser microbenchmark: legacy vs ring buffer");
+    cmd.addHelpOption();
+    QCommandLineOption framesOption("frames","frames in the stream.","count","2000000");
+    QCommandLineOption noiseOption("noise","probability of garbage bytes before a frame.","p","0");
+    QCommandLineOption corruptOption("corrupt","probability of a corrupted frame.","p","0");
+    QCommandLineOption chunkOption("chunk","max bytes per read.","bytes","1460");
+    QCommandLineOption roundsOption("rounds","rounds, the best one is reported.","count","3");
+    cmd.addOption(framesOption);
+    cmd.addOption(noiseOption);
+    cmd.addOption(corruptOption);
+    cmd.addOption(chunkOption);
+    cmd.addOption(roundsOption);
+    cmd.process(a);
+
+    BenchConfig config;
+    config.frames = qMax(1,cmd.value(framesOption).toInt());
+    config.noise = qBound(0.0,cmd.value(noiseOption).toDouble(),1.0);
+    config.corrupt = qBound(0.0,cmd.value(corruptOption).toDouble(),1.0);
+    config.maxChunk = qMax(1,cmd.value(chunkOption).toInt());
+    config.rounds = qMax(1,cmd.value(roundsOption).toInt());
+
+    std::mt19937 rng(12345);
+    QByteArray stream = makeStream(config,rng);
+    QList<int> chunks = makeChunks(stream.length(),config.maxChunk,rng);
+
+    QTextStream out(stdout);
+    out<<"frames:"<<config.frames<<" bytes:"<<stream.length()<<" reads:"<<chunks.length()
+      <<" noise:"<<config.noise<<" corrupt:"<<config.corrupt<<"\n";
+
+    //干净的数据流上，环形缓冲区的结果必须和原来的一样
+    bool clean = config.noise==0 && config.corrupt==0;
+    quint64 legacyFrames = 0,legacyChecksum = 0;
+    bool failed = false;
+    for(int mode=0;mode<2;++mode){
+        double best = 0;
+        quint64 frames = 0,checksum = 0,crcErrors = 0;
+        for(int r=0;r<config.rounds;++r){
+            checksum = 0;
+            Clock::time_point t0 = Clock::now();
+            if(mode==0)frames = runLegacy(stream,chunks,checksum);
+            else frames = runRing(stream,chunks,checksum,crcErrors);
+            double seconds = std::chrono::duration<double>(Clock::now()-t0).count();
+            if(best==0||seconds<best)best = seconds;
+        }
+        out<<(mode==0?"legacy":"ring")<<": decoded:"<<frames
+          <<" crcErrors:"<<crcErrors
+         <<" frames/s per core:"<<(qint64)(best>0?frames/best:0)
+        <<" MB/s:"<<(best>0?stream.length()/best/1e6:0)
+        <<" checksum:"<<checksum<<"\n";
+        if(mode==0){
+            legacyFrames = frames;
+            legacyChecksum = checksum;
+        }else if(clean && (frames!=legacyFrames || checksum!=legacyChecksum || frames!=(quint64)config.frames)){
+            out<<"FAIL: ring parser differs from legacy on the clean stream (legacy decoded:"<<legacyFrames
+              <<" checksum:"<<legacyChecksum<<")\n";
+            failed = true;
+        }
+        out.flush();
+    }
+    return failed?1:0;
+}
@@ -0,0 +1,178 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <cmath>
+#include "util/motionestimator.h"
+#include "benchutil.h"
+
+//车辆位置推算(虚拟时间，单线程)
+//车辆沿直线/曲线变速行驶，每隔report毫秒(有抖动)上报一次走过的距离，按rate发布位置
+//hold:     原来的做法，发布上次上报的位置
+//estimate: 按估计的速度推算当前的位置
+//输出和真实位置的误差，以及不同车队规模下每次推算每辆车的耗时
+
+struct Vehicle{
+    MotionEstimator::Line line;
+    double length = 0;
+    double distance = 0;//真实走过的距离
+    double reported = 0;//上次上报的距离
+    double baseSpeed = 0;//地图单位/ms
+    double phase = 0;
+    qint64 nextReport = 0;
+};
+
+static QPointF positionAt(const Vehicle &v, double s)
+{
+    const MotionEstimator::Line &l = v.line;
+    if(l.straight){
+        double t = v.length>0?s/v.length:0;
+        return QPointF(l.p0x+(l.p3x-l.p0x)*t,l.p0y+(l.p3y-l.p0y)*t);
+    }
+    return l.arc.pointAt(l.arc.paramAt(s));
+}
+
+static std::vector<Vehicle> makeFleet(int count, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<double> coord(0,20000);
+    std::uniform_real_distribution<double> prob(0,1);
+    std::vector<Vehicle> vehicles(count);
+    for(int i=0;i<count;++i){
+        Vehicle &v = vehicles[i];
+        MotionEstimator::Line &l = v.line;
+        l.id = i+1;
+        l.straight = prob(rng)<0.5;
+        l.p0x = coord(rng);l.p0y = coord(rng);
+        l.p1x = coord(rng);l.p1y = coord(rng);
+        l.p2x = coord(rng);l.p2y = coord(rng);
+        l.p3x = coord(rng);l.p3y = coord(rng);
+        if(l.straight){
+            v.length = std::sqrt((l.p3x-l.p0x)*(l.p3x-l.p0x)+(l.p3y-l.p0y)*(l.p3y-l.p0y));
+        }else{
+            l.arc = BezierArc(QPointF(l.p0x,l.p0y),QPointF(l.p1x,l.p1y),QPointF(l.p2x,l.p2y),QPointF(l.p3x,l.p3y));
+            v.length = l.arc.length();
+        }
+        v.baseSpeed = 0.8+prob(rng)*1.2;//0.8-2.0 m/s(地图单位是mm)
+        v.phase = prob(rng)*2*M_PI;
+        v.distance = prob(rng)*v.length;
+    }
+    return vehicles;
+}
+
+static double percentile(std::vector<double> &values, double p)
+{
+    if(values.empty())return 0;
+    size_t index = qMin(values.size()-1,(size_t)(values.size()*p/100));
+    std::nth_element(values.begin(),values.begin()+index,values.end());
+    return values[index];
+}
+
+static double mean(const std::vector<double> &values)
+{
+    double sum = 0;
+    for(size_t i=0;i<values.size();++i)sum += values[i];
+    return values.empty()?0:sum/values.size();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("MotionEstimatorBench");
+
+    QCommandLineParser cmd;
+    cmd.setApplicationDescription("published position error and cost: last report vs dead reckoning");
+    cmd.addHelpOption();
+    QCommandLineOption agvsOption("agvs","vehicles in the accuracy run.","count","200");
+    QCommandLineOption rateOption("rate","publish rate in Hz.","hz","50");
+    QCommandLineOption reportOption("report","report interval in ms.","ms","300");
+    QCommandLineOption jitterOption("jitter","report interval jitter in ms.","ms","50");
+    QCommandLineOption secondsOption("seconds","simulated seconds.","s","60");
+    cmd.addOption(agvsOption);
+    cmd.addOption(rateOption);
+    cmd.addOption(reportOption);
+    cmd.addOption(jitterOption);
+    cmd.addOption(secondsOption);
+    cmd.process(a);
+
+    int count = qMax(1,cmd.value(agvsOption).toInt());
+    int interval = 1000/qBound(1,cmd.value(rateOption).toInt(),1000);
+    int report = qMax(1,cmd.value(reportOption).toInt());
+    int jitter = qBound(0,cmd.value(jitterOption).toInt(),report-1);
+    qint64 duration = qMax(1,cmd.value(secondsOption).toInt())*1000LL;
+
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> jitterDist(-jitter,jitter);
+    std::vector<Vehicle> vehicles = makeFleet(count,rng);
+
+    //1.精度:每毫秒推进真实位置，到时间上报，到时间发布
+    MotionEstimator estimator;
+    std::vector<MotionEstimator::Pose> poses;
+    std::vector<double> holdErrors,estimateErrors;
+    for(int i=0;i<count;++i)vehicles[i].nextReport = rng()%report;
+    for(qint64 now=1;now<=duration;++now){
+        for(int i=0;i<count;++i){
+            Vehicle &v = vehicles[i];
+            v.distance += v.baseSpeed*(1+0.4*std::sin(now*2*M_PI/5000+v.phase));
+            if(v.distance>=v.length){
+                //到站:发布站点的位置，然后从头再走一遍
+                v.distance -= v.length;
+                v.reported = 0;
+                estimator.stop(i+1);
+            }
+            if(now>=v.nextReport){
+                v.reported = v.distance;
+                estimator.update(i+1,v.line,v.distance,now);
+                v.nextReport = now+report+jitterDist(rng);
+            }
+        }
+        if(now%interval!=0)continue;
+        estimator.predict(now,poses);
+        for(int i=0;i<count;++i){
+            const Vehicle &v = vehicles[i];
+            QPointF truth = positionAt(v,v.distance);
+            QPointF hold = positionAt(v,v.reported);
+            QPointF estimate = hold;
+            const MotionEstimator::Pose *pose = MotionEstimator::find(poses,i+1);
+            if(pose!=NULL)estimate = QPointF(pose->x,pose->y);
+            holdErrors.push_back(std::hypot(truth.x()-hold.x(),truth.y()-hold.y()));
+            estimateErrors.push_back(std::hypot(truth.x()-estimate.x(),truth.y()-estimate.y()));
+        }
+    }
+
+    QTextStream out(stdout);
+    out<<"agvs:"<<count<<" publish(ms):"<<interval<<" report(ms):"<<report<<"+-"<<jitter
+      <<" seconds:"<<duration/1000<<" avx2:"<<(PoseKernel::hasSimd()?"yes":"no")<<"\n";
+    out<<"hold:     error mean:"<<mean(holdErrors)<<" p50:"<<percentile(holdErrors,50)
+      <<" p99:"<<percentile(holdErrors,99)<<"\n";
+    out<<"estimate: error mean:"<<mean(estimateErrors)<<" p50:"<<percentile(estimateErrors,50)
+      <<" p99:"<<percentile(estimateErrors,99)<<"\n";
+    out.flush();
+
+    //2.开销:不同规模的车队，每次推算每辆车的耗时
+    const int sizes[] = {100,1000,10000};
+    for(int k=0;k<3;++k){
+        std::vector<Vehicle> fleet = makeFleet(sizes[k],rng);
+        MotionEstimator e;
+        for(int i=0;i<sizes[k];++i){
+            e.update(i+1,fleet[i].line,0,0);
+            e.update(i+1,fleet[i].line,fleet[i].baseSpeed*report,report);
+        }
+        int ticks = qMax(10,2000000/sizes[k]);
+        double sink = 0;
+        Clock::time_point t0 = Clock::now();
+        for(int r=0;r<ticks;++r){
+            e.predict(report+r%report,poses);
+            sink += poses[r%poses.size()].x;
+        }
+        double seconds = std::chrono::duration<double>(Clock::now()-t0).count();
+        out<<"predict agvs:"<<sizes[k]<<" ns/agv:"<<seconds*1e9/ticks/sizes[k]
+          <<" us/tick:"<<seconds*1e6/ticks<<" sink:"<<sink<<"\n";
+        out.flush();
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <chrono>
+#include <random>
+#include <vector>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <cmath>
+#include "util/posekernel.h"
+#include "benchutil.h"
+
+//整个车队的位姿计算(单线程)
+//legacy: 原来updateOdometer中逐辆车的贝塞尔公式(直线用atan2、cos、sin)
+//scalar: 批量计算，逐个
+//batch:  批量计算，编译了AVX2时一次4辆
+//批量计算的结果和legacy比较，输出最大的坐标误差和朝向误差，超出容差时返回1
+//除了随机的车队，还比较退化的输入:长度为0的线路、t=0/1，以及不是4的倍数的批量(AVX2的尾部)
+
+//坐标(mm)和朝向(度)的容差。AVX2的atan2近似误差小于1e-7弧度
+static const double POS_TOLERANCE = 1e-6;
+static const double ROT_TOLERANCE = 1e-4;
+
+struct Vehicle{
+    bool line = false;
+    double sx = 0, sy = 0, ex = 0, ey = 0;
+    double p1x = 0, p1y = 0, p2x = 0, p2y = 0;
+    double t = 0;
+};
+
+//原来的公式
+static void legacyPose(const Vehicle &v, double &x, double &y, double &rotation)
+{
+    double t = v.t;
+    if(v.line){
+        double theta = atan2(v.ey-v.sy,v.ex-v.sx);
+        double len = sqrt((v.ex-v.sx)*(v.ex-v.sx)+(v.ey-v.sy)*(v.ey-v.sy));
+        rotation = theta*180/M_PI;
+        x = v.sx+t*len*cos(theta);
+        y = v.sy+t*len*sin(theta);
+        return ;
+    }
+    x = (v.sx*(1-t)*(1-t)*(1-t)
+         +3*v.p1x*t*(1-t)*(1-t)
+         +3*v.p2x*t*t*(1-t)
+         +v.ex*t*t*t);
+    y = (v.sy*(1-t)*(1-t)*(1-t)
+         +3*v.p1y*t*(1-t)*(1-t)
+         +3*v.p2y*t*t*(1-t)
+         +v.ey*t*t*t);
+    double X = v.sx * 3 * (1 - t)*(1 - t) * (-1) +
+            3 * v.p1x * ((1 - t) * (1 - t) + t * 2 * (1 - t) * (-1)) +
+            3 * v.p2x * (2 * t * (1 - t) + t * t * (-1)) +
+            v.ex * 3 * t *t;
+    double Y =  v.sy * 3 * (1 - t)*(1 - t) * (-1) +
+            3 *v.p1y * ((1 - t) *(1 - t) + t * 2 * (1 - t) * (-1)) +
+            3 * v.p2y * (2 * t * (1 - t) + t * t * (-1)) +
+            v.ey * 3 * t *t;
+    rotation = atan2(Y, X) * 180 / M_PI;
+}
+
+static void fillBatch(const std::vector<Vehicle> &vehicles, PoseKernel::Batch &batch)
+{
+    batch.clear();
+    for(size_t i=0;i<vehicles.size();++i){
+        const Vehicle &v = vehicles[i];
+        if(v.line)batch.addLine(v.sx,v.sy,v.ex,v.ey,v.t);
+        else batch.addCurve(v.sx,v.sy,v.p1x,v.p1y,v.p2x,v.p2y,v.ex,v.ey,v.t);
+    }
+}
+
+//批量计算vehicles，和原来的公式比较，返回最大误差
+static void compare(const std::vector<Vehicle> &vehicles, double &maxPos, double &maxRot)
+{
+    PoseKernel::Batch batch;
+    fillBatch(vehicles,batch);
+    PoseKernel::evaluate(batch);
+    maxPos = 0;
+    maxRot = 0;
+    for(size_t i=0;i<vehicles.size();++i){
+        double x,y,r;
+        legacyPose(vehicles[i],x,y,r);
+        maxPos = qMax(maxPos,qMax(std::fabs(x-batch.x[i]),std::fabs(y-batch.y[i])));
+        double d = std::fabs(r-batch.rotation[i]);
+        if(d>180)d = 360-d;
+        maxRot = qMax(maxRot,d);
+    }
+}
+
+static bool withinTolerance(double maxPos, double maxRot)
+{
+    //NaN也算超出
+    return maxPos<=POS_TOLERANCE && maxRot<=ROT_TOLERANCE;
+}
+
+static Vehicle makeLine(double sx, double sy, double ex, double ey, double t)
+{
+    Vehicle v;
+    v.line = true;
+    v.sx = sx;v.sy = sy;
+    v.ex = ex;v.ey = ey;
+    v.t = t;
+    return v;
+}
+
+static Vehicle makeCurve(double sx, double sy, double p1x, double p1y, double p2x, double p2y, double ex, double ey, double t)
+{
+    Vehicle v;
+    v.sx = sx;v.sy = sy;
+    v.p1x = p1x;v.p1y = p1y;
+    v.p2x = p2x;v.p2y = p2y;
+    v.ex = ex;v.ey = ey;
+    v.t = t;
+    return v;
+}
+
+//退化的输入
+static std::vector<Vehicle> degenerateVehicles()
+{
+    std::vector<Vehicle> vehicles;
+    //长度为0的直线、所有控制点重合的曲线
+    vehicles.push_back(makeLine(500,500,500,500,0));
+    vehicles.push_back(makeLine(500,500,500,500,0.5));
+    vehicles.push_back(makeLine(500,500,500,500,1));
+    vehicles.push_back(makeCurve(700,300,700,300,700,300,700,300,0.5));
+    //线路的两端
+    vehicles.push_back(makeLine(0,0,1000,0,0));
+    vehicles.push_back(makeLine(0,0,1000,0,1));
+    vehicles.push_back(makeLine(0,0,0,-1000,0));
+    vehicles.push_back(makeLine(0,0,-1000,-1000,1));
+    vehicles.push_back(makeCurve(0,0,1000,0,1000,1000,0,1000,0));
+    vehicles.push_back(makeCurve(0,0,1000,0,1000,1000,0,1000,1));
+    vehicles.push_back(makeCurve(0,0,-500,200,-800,-600,100,-900,0));
+    vehicles.push_back(makeCurve(0,0,-500,200,-800,-600,100,-900,1));
+    return vehicles;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("PoseKernelBench");
+
+    QCommandLineParser cmd;
+    cmd.setApplicationDescription("fleet pose evaluation: per-vehicle formula vs batched kernel");
+    cmd.addHelpOption();
+    QCommandLineOption agvsOption("agvs","vehicles in the fleet.","count","1000");
+    QCommandLineOption curveOption("curves","share of vehicles on curves.","p","0.5");
+    QCommandLineOption roundsOption("rounds","evaluations of the whole fleet.","count","20000");
+    cmd.addOption(agvsOption);
+    cmd.addOption(curveOption);
+    cmd.addOption(roundsOption);
+    cmd.process(a);
+
+    int count = qMax(1,cmd.value(agvsOption).toInt());
+    double curves = qBound(0.0,cmd.value(curveOption).toDouble(),1.0);
+    int rounds = qMax(1,cmd.value(roundsOption).toInt());
+
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<double> coord(0,100000);
+    std::uniform_real_distribution<double> prob(0,1);
+    std::vector<Vehicle> vehicles(count);
+    for(int i=0;i<count;++i){
+        Vehicle &v = vehicles[i];
+        v.line = prob(rng)>=curves;
+        v.sx = coord(rng);v.sy = coord(rng);
+        v.ex = coord(rng);v.ey = coord(rng);
+        v.p1x = coord(rng);v.p1y = coord(rng);
+        v.p2x = coord(rng);v.p2y = coord(rng);
+        v.t = prob(rng);
+    }
+
+    //和原来的公式比较
+    double maxPos = 0,maxRot = 0;
+    compare(vehicles,maxPos,maxRot);
+    bool ok = withinTolerance(maxPos,maxRot);
+
+    QTextStream out(stdout);
+    out<<"agvs:"<<count<<" curves:"<<curves<<" rounds:"<<rounds<<" avx2:"<<(PoseKernel::hasSimd()?"yes":"no")
+      <<" max error pos:"<<maxPos<<" rotation(deg):"<<maxRot<<(ok?"":" FAIL")<<"\n";
+
+    std::vector<Vehicle> degenerate = degenerateVehicles();
+    compare(degenerate,maxPos,maxRot);
+    bool degenerateOk = withinTolerance(maxPos,maxRot);
+    ok = ok && degenerateOk;
+    out<<"degenerate: max error pos:"<<maxPos<<" rotation(deg):"<<maxRot<<(degenerateOk?"":" FAIL")<<"\n";
+
+    //1到9辆车:AVX2一次4辆，剩下的逐个计算
+    //退化的放在后面，落在尾部
+    std::vector<Vehicle> mixed(vehicles.begin(),vehicles.begin()+qMin(count,9));
+    mixed.insert(mixed.end(),degenerate.begin(),degenerate.end());
+    for(int n=1;n<=9;++n){
+        std::vector<Vehicle> part(mixed.end()-n,mixed.end());
+        compare(part,maxPos,maxRot);
+        if(withinTolerance(maxPos,maxRot))continue;
+        ok = false;
+        out<<"batch of "<<n<<": max error pos:"<<maxPos<<" rotation(deg):"<<maxRot<<" FAIL\n";
+    }
+    out.flush();
+    if(!ok){
+        QTextStream(stderr)<<"pose kernel differs from the per-vehicle formula beyond tolerance (pos "
+                          <<POS_TOLERANCE<<"mm, rotation "<<ROT_TOLERANCE<<"deg)\n";
+        return 1;
+    }
+
+    PoseKernel::Batch batch;
+    fillBatch(vehicles,batch);
+
+    const char *names[] = {"legacy","scalar","batch"};
+    for(int mode=0;mode<3;++mode){
+        double sink = 0;
+        Clock::time_point t0 = Clock::now();
+        for(int r=0;r<rounds;++r){
+            if(mode==0){
+                for(int i=0;i<count;++i){
+                    double x,y,rot;
+                    legacyPose(vehicles[i],x,y,rot);
+                    sink += x+rot;
+                }
+            }else{
+                if(mode==1)PoseKernel::evaluateScalar(batch);
+                else PoseKernel::evaluate(batch);
+                sink += batch.x[r%count]+batch.rotation[r%count];
+            }
+        }
+        double seconds = std::chrono::duration<double>(Clock::now()-t0).count();
+        out<<names[mode]<<": ns/agv:"<<seconds*1e9/rounds/count
+          <<" us/fleet:"<<seconds*1e6/rounds
+         <<" sink:"<<sink<<"\n";
+        out.flush();
+    }
+    return 0;
+}
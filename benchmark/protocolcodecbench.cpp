@@ -0,0 +1,224 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QByteArray>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string.h>
+#include "network/agvprotocol.h"
+#include "util/common.h"
+#include "benchutil.h"
+
+//协议编解码的微基准(单线程)
+//decode: 上报包。legacy是原来的写法(按硬编码的偏移逐个getInt32FromByte)，table是字段表生成的解码
+//encode: 调度命令包。legacy是原来的写法(QByteArray逐字节append)，table是字段表生成的编码(栈上的定长缓冲区)
+//两种写法的结果逐个比较，不一致的计入mismatch
+
+using AgvProtocol::StatusFrame;
+using AgvProtocol::DispatchFrame;
+
+struct BenchOrder{
+    int rfid = 0;
+    int order = 0;
+    int param = 0;
+};
+
+//原来的上报包解析
+static bool legacyDecode(const unsigned char *frame, AgvTelemetry &telemetry)
+{
+    if(frame[0]!=0x66 || frame[1]!=31 || frame[31]!=0x88)return false;
+    if(checkSum((unsigned char *)frame+2,27)!=frame[30])return false;
+    char *str = (char *)frame+2;
+    telemetry.mileage = getInt32FromByte(str);
+    str+=4;
+    telemetry.currentRfid = getInt32FromByte(str);
+    str+=4;
+    telemetry.nextRfid = getInt32FromByte(str);
+    str+=4;
+    telemetry.current = (int16_t)getInt16FromByte(str);//电流有正负
+    str+=2;
+    telemetry.voltage = getInt16FromByte(str);
+    str+=2;
+    telemetry.positionMagneticStripe = getInt16FromByte(str);
+    str+=2;
+    telemetry.pcbTemperature = getInt8FromByte(str);
+    str+=1;
+    telemetry.motorTemperature = getInt8FromByte(str);
+    str+=1;
+    telemetry.cpu = getInt8FromByte(str);
+    str+=1;
+    telemetry.speed = getInt8FromByte(str);
+    str+=1;
+    telemetry.angle = getInt8FromByte(str);
+    str+=1;
+    telemetry.height = getInt8FromByte(str);
+    str+=1;
+    telemetry.error_no = getInt8FromByte(str);
+    str+=1;
+    telemetry.mode = getInt8FromByte(str);
+    str+=1;
+    telemetry.recvQueueNumber = getInt8FromByte(str);
+    str+=1;
+    telemetry.orderCount = getInt8FromByte(str);
+    str+=1;
+    telemetry.CRC = getInt8FromByte(str);
+    return true;
+}
+
+static bool tableDecode(const unsigned char *frame, AgvTelemetry &telemetry)
+{
+    if(!StatusFrame::check(frame))return false;
+    StatusFrame::decode(frame,telemetry);
+    return true;
+}
+
+static QByteArray getRfidByte(int rfid)
+{
+    QByteArray qba;
+    qba.append((rfid)&0xFF);
+    qba.append((rfid>>8)&0xFF);
+    qba.append((rfid>>16)&0xFF);
+    qba.append((rfid>>24)&0xFF);
+    return qba;
+}
+
+//原来的调度命令封包
+static QByteArray legacyEncode(int seq, const BenchOrder *orders, int amount)
+{
+    QByteArray content;
+    content.append((char)0x73);
+    content.append((char)seq);
+    for(int i=0;i<3;++i){
+        if(i>=amount){
+            content.append(getRfidByte(0));
+            content.append((char)0);
+            content.append((char)0x00);
+        }else{
+            content.append(getRfidByte(orders[i].rfid));
+            content.append(orders[i].order&0xFF);
+            content.append(orders[i].param&0xFF);
+        }
+    }
+    content.append(getRfidByte(0));
+    content.append((char)0);
+    content.append((char)0x00);
+
+    QByteArray result;
+    result.append((char)0x55);
+    result.append((1+content.length()+1+1)&0xFF);
+    result.append(content);
+    result.append(checkSum((unsigned char *)content.data(),content.length()));
+    result.append((char)0xAA);
+    return result;
+}
+
+//每个字段都是随机值，按协议封包
+static std::vector<unsigned char> makeFrames(int count, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<unsigned int> word;
+    std::vector<unsigned char> frames(count*StatusFrame::LENGTH);
+    for(int i=0;i<count;++i){
+        AgvTelemetry telemetry;
+#define RANDOM_FIELD(name,offset,size) telemetry.name = (int)word(rng);
+        AGV_STATUS_FIELDS(RANDOM_FIELD)
+#undef RANDOM_FIELD
+        StatusFrame::encode(&frames[i*StatusFrame::LENGTH],telemetry);
+    }
+    return frames;
+}
+
+static quint64 sumTelemetry(const AgvTelemetry &t)
+{
+    return (quint64)(unsigned int)t.mileage+(unsigned int)t.currentRfid+(unsigned int)t.nextRfid+t.current+t.voltage
+            +t.positionMagneticStripe+t.pcbTemperature+t.motorTemperature+t.cpu+t.speed+t.angle+t.height
+            +t.error_no+t.mode+t.recvQueueNumber+t.orderCount+t.CRC;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("ProtocolCodecBench");
+
+    QCommandLineParser cmd;
+    cmd.setApplicationDescription("agv protocol encode/decode microbenchmark: hand-written vs field table");
+    cmd.addHelpOption();
+    QCommandLineOption framesOption("frames","frames to decode and encode per round.","count","2000000");
+    QCommandLineOption roundsOption("rounds","rounds, the best one is reported.","count","5");
+    cmd.addOption(framesOption);
+    cmd.addOption(roundsOption);
+    cmd.process(a);
+
+    int count = qMax(1,cmd.value(framesOption).toInt());
+    int rounds = qMax(1,cmd.value(roundsOption).toInt());
+
+    std::mt19937 rng(12345);
+    std::vector<unsigned char> frames = makeFrames(count,rng);
+    std::vector<BenchOrder> orders(count*3);
+    std::uniform_int_distribution<int> word(0,0x7FFFFFFF);
+    for(size_t i=0;i<orders.size();++i){
+        orders[i].rfid = word(rng);
+        orders[i].order = word(rng)&0xFF;
+        orders[i].param = word(rng)&0xFF;
+    }
+
+    //结果一致性
+    quint64 mismatch = 0;
+    for(int i=0;i<count;++i){
+        AgvTelemetry t1,t2;
+        const unsigned char *f = &frames[i*StatusFrame::LENGTH];
+        if(!legacyDecode(f,t1) || !tableDecode(f,t2) || sumTelemetry(t1)!=sumTelemetry(t2)
+                || t1.mileage!=t2.mileage || t1.orderCount!=t2.orderCount)
+            ++mismatch;
+        unsigned char packet[DispatchFrame::LENGTH];
+        DispatchFrame::encode(packet,i&0xFF,&orders[i*3],i%4);
+        QByteArray legacy = legacyEncode(i&0xFF,&orders[i*3],i%4);
+        if(legacy.length()!=DispatchFrame::LENGTH || memcmp(legacy.constData(),packet,DispatchFrame::LENGTH)!=0)
+            ++mismatch;
+    }
+
+    QTextStream out(stdout);
+    out<<"frames:"<<count<<" rounds:"<<rounds<<" mismatch:"<<mismatch<<"\n";
+
+    const char *names[] = {"decode legacy","decode table","encode legacy","encode table","encode table+QByteArray"};
+    for(int mode=0;mode<5;++mode){
+        double best = 0;
+        quint64 sink = 0;
+        for(int r=0;r<rounds;++r){
+            sink = 0;
+            Clock::time_point t0 = Clock::now();
+            AgvTelemetry t;
+            unsigned char packet[DispatchFrame::LENGTH];
+            for(int i=0;i<count;++i){
+                const unsigned char *f = &frames[i*StatusFrame::LENGTH];
+                switch(mode){
+                case 0:
+                    if(legacyDecode(f,t))sink += t.mileage;
+                    break;
+                case 1:
+                    if(tableDecode(f,t))sink += t.mileage;
+                    break;
+                case 2:
+                    sink += legacyEncode(i&0xFF,&orders[i*3],3).at(DispatchFrame::CHECKSUM_OFFSET);
+                    break;
+                case 3:
+                    DispatchFrame::encode(packet,i&0xFF,&orders[i*3],3);
+                    sink += packet[DispatchFrame::CHECKSUM_OFFSET];
+                    break;
+                default:
+                    DispatchFrame::encode(packet,i&0xFF,&orders[i*3],3);
+                    sink += QByteArray((const char *)packet,DispatchFrame::LENGTH).at(DispatchFrame::CHECKSUM_OFFSET);
+                    break;
+                }
+            }
+            double seconds = std::chrono::duration<double>(Clock::now()-t0).count();
+            if(best==0||seconds<best)best = seconds;
+        }
+        out<<names[mode]<<": ns/frame:"<<best*1e9/count
+          <<" frames/s:"<<(qint64)(best>0?count/best:0)
+         <<" sink:"<<sink<<"\n";
+        out.flush();
+    }
+    //两种编解码的结果不一致，说明字段表有错
+    return mismatch?1:0;
+}
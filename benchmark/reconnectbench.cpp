@@ -0,0 +1,432 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QThread>
+#include <QTextStream>
+#include <QSet>
+#include <chrono>
+#include <functional>
+#include "network/agvioengine.h"
+#include "network/agvprotocol.h"
+#include "util/histogram.h"
+#include "util/global.h"
+#include "benchutil.h"
+
+//车辆连接的断线重连测试:本机每辆车一个端口，按固定频率上报状态
+//startup: 所有车辆同时加入，同时进行中的连接有上限，统计全部连上的时间
+//kill:    所有车辆的端口关掉(连接断开、之后连不上)，过一段时间在原来的端口重新打开，统计发现断开和重新连上的时间
+//hang:    连接还在但车辆不再上报，统计靠收包超时发现断开、以及重连恢复的时间
+//dispatch: 任务中心对断开的处理(不用网络):状态、调度排除、释放占用和预留、任务放回队列或者等这辆车、重连后继续
+//任何一个阶段超时或者检查不通过，返回1
+
+static Clock::time_point benchStart;
+
+static qint64 nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now()-benchStart).count();
+}
+
+//模拟的车辆:每辆车一个端口，定时给每个连接发状态
+class FakeFleet : public QObject
+{
+    Q_OBJECT
+public:
+    FakeFleet(int _periodMs):periodMs(_periodMs){}
+
+    //主线程，移到车辆线程之前调用，返回每辆车的端口
+    QList<quint16> listen(int agvs){
+        QList<quint16> ports;
+        for(int i=0;i<agvs;++i){
+            QTcpServer *server = new QTcpServer(this);
+            connect(server,SIGNAL(newConnection()),this,SLOT(onNewConnection()));
+            server->listen(QHostAddress::LocalHost,0);
+            servers.append(server);
+            ports.append(server->serverPort());
+        }
+        portList = ports;
+        return ports;
+    }
+
+public slots:
+    void start(){
+        timer = new QTimer(this);
+        connect(timer,SIGNAL(timeout()),this,SLOT(report()));
+        timer->start(periodMs);
+    }
+
+    //车辆下线:断开所有连接，不再接受连接
+    void kill(){
+        for(int i=0;i<servers.length();++i)
+            servers.at(i)->close();
+        QList<QTcpSocket *> all = sockets;
+        sockets.clear();
+        silent.clear();
+        for(int i=0;i<all.length();++i){
+            all.at(i)->abort();
+            all.at(i)->deleteLater();
+        }
+    }
+
+    //车辆重新上线，还是原来的端口
+    void restart(){
+        for(int i=0;i<servers.length();++i)
+            servers.at(i)->listen(QHostAddress::LocalHost,portList.at(i));
+    }
+
+    //车辆卡死:现有的连接不断开，但不再上报。之后的新连接正常上报
+    void hang(){
+        for(int i=0;i<sockets.length();++i)
+            silent.insert(sockets.at(i));
+    }
+
+    void onNewConnection(){
+        QTcpServer *server = qobject_cast<QTcpServer *>(sender());
+        if(server==NULL)return ;
+        while(server->hasPendingConnections()){
+            QTcpSocket *socket = server->nextPendingConnection();
+            socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
+            connect(socket,SIGNAL(readyRead()),this,SLOT(onReadyRead()));
+            connect(socket,SIGNAL(disconnected()),this,SLOT(onDisconnected()));
+            sockets.append(socket);
+        }
+    }
+
+    void onReadyRead(){
+        QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+        if(socket!=NULL)socket->readAll();
+    }
+
+    void onDisconnected(){
+        QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+        if(socket==NULL || !sockets.contains(socket))return ;
+        sockets.removeAll(socket);
+        silent.remove(socket);
+        socket->deleteLater();
+    }
+
+    void report(){
+        AgvTelemetry telemetry;
+        telemetry.voltage = 2500;
+        telemetry.mileage = (int)nowMs();
+        QByteArray frame = makeStatusFrame(telemetry);
+        for(int i=0;i<sockets.length();++i){
+            if(silent.contains(sockets.at(i)))continue;
+            sockets.at(i)->write(frame);
+        }
+    }
+
+private:
+    int periodMs;
+    QList<QTcpServer *> servers;
+    QList<quint16> portList;
+    QList<QTcpSocket *> sockets;
+    QSet<QTcpSocket *> silent;
+    QTimer *timer = NULL;
+};
+
+//主线程收到的连接状态
+struct LinkWatch{
+    QSet<int> online;
+    qint64 phaseStartMs = 0;
+    AtomicHistogram connectMs;//从这个阶段开始到每辆车连上
+    AtomicHistogram disconnectMs;//从这个阶段开始到每辆车被发现断开
+
+    void startPhase(){
+        phaseStartMs = nowMs();
+        connectMs.reset();
+        disconnectMs.reset();
+    }
+
+    void onTelemetry(const AgvTelemetry &telemetry){
+        if(telemetry.type==AgvTelemetry::TYPE_CONNECTED){
+            online.insert(telemetry.agvId);
+            connectMs.record(nowMs()-phaseStartMs);
+        }else if(telemetry.type==AgvTelemetry::TYPE_DISCONNECTED){
+            online.remove(telemetry.agvId);
+            disconnectMs.record(nowMs()-phaseStartMs);
+        }
+    }
+};
+
+//处理主线程的事件(车辆状态在这里交给LinkWatch)，直到条件满足或超时
+static bool waitFor(std::function<bool ()> done, int timeoutMs)
+{
+    qint64 deadline = nowMs()+timeoutMs;
+    while(!done()){
+        if(nowMs()>=deadline)return false;
+        QCoreApplication::processEvents();
+        QThread::msleep(1);
+    }
+    return true;
+}
+
+static void wait(int ms)
+{
+    waitFor([](){return false;},ms);
+}
+
+//任务中心的检查，不通过的打印出来
+struct DispatchCheck{
+    QTextStream &out;
+    int failures = 0;
+
+    DispatchCheck(QTextStream &_out):out(_out){}
+
+    void expect(bool ok, const QString &what){
+        if(ok)return ;
+        ++failures;
+        out<<"  FAIL: "<<what<<"\n";
+    }
+};
+
+//和服务端的定时器一样，调用任务中心的分配
+static void dispatch()
+{
+    QMetaObject::invokeMethod(g_taskCenter,"unassignedTasksProcess",Qt::DirectConnection);
+}
+
+//车辆的连接变化走服务端的路径:车辆状态、再通知任务中心
+static void linkChange(int agvId, int type)
+{
+    AgvTelemetry telemetry;
+    telemetry.agvId = agvId;
+    telemetry.type = type;
+    g_hrgAgvCenter->onTelemetry(telemetry);
+}
+
+static Agv *addAgv(int agvId, int station, int status)
+{
+    Agv *agv = new Agv;
+    agv->id = agvId;
+    agv->name = QString("agv%1").arg(agvId);
+    agv->nowStation = station;
+    agv->status = status;
+    g_m_agvs.insert(agv->id,agv);
+    return agv;
+}
+
+static bool isIdle(Agv *agv)
+{
+    return g_hrgAgvCenter->getIdleAgvs().contains(agv);
+}
+
+//除了所在的站点，车辆不再占用、预留任何站点和线路
+static bool holdsNothing(Agv *agv)
+{
+    for(QMap<int,AgvStation *>::iterator itr=g_m_stations.begin();itr!=g_m_stations.end();++itr){
+        if(g_agvMapCenter->getStationReserveAgv(itr.key())==agv->id)return false;
+        if(itr.key()!=agv->nowStation && itr.value()->occuAgv==agv->id)return false;
+    }
+    for(QMap<int,AgvLine *>::iterator itr=g_m_lines.begin();itr!=g_m_lines.end();++itr){
+        if(itr.value()->occuAgv==agv->id)return false;
+    }
+    return true;
+}
+
+//一排9个站点，相邻的站点之间有线路(反向线路由地图生成)
+static bool setupDispatch()
+{
+    g_log = new AgvLog();
+    g_log->setPersist(false);
+    g_taskJournal = new TaskJournal;
+    g_taskJournal->init(QString());
+    g_hrgAgvCenter = new AgvCenter;
+    g_agvMapCenter = new MapCenter;
+    g_agvMapCenter->setPersist(false);
+
+    const int stations = 9;
+    QString stationStr = QString::number(stations);
+    QString lineStr = QString::number(stations-1);
+    for(int i=1;i<=stations;++i)
+        stationStr += QString(";%1,s%1,%2,0,%3,0,0,0").arg(i).arg((i-1)*1000).arg(100+i);
+    for(int i=1;i<stations;++i)
+        lineStr += QString(";%1,%1,%2,1000,0,0,0").arg(i).arg(i+1);
+    g_agvMapCenter->resetMap(stationStr,lineStr,QString(),QString());
+    if(g_m_stations.size()!=stations)return false;
+
+    g_taskCenter = new TaskCenter;
+    g_taskCenter->init();
+    return true;
+}
+
+static int checkDispatch(QTextStream &out)
+{
+    DispatchCheck check(out);
+    if(!setupDispatch()){
+        out<<"dispatch: map setup fail\n";
+        return 1;
+    }
+    Agv *agv1 = addAgv(1,1,Agv::AGV_STATUS_IDLE);
+    Agv *agv2 = addAgv(2,9,Agv::AGV_STATUS_UNCONNECT);
+    Agv *agv3 = addAgv(3,5,Agv::AGV_STATUS_UNCONNECT);
+
+    //1.空车去取货的途中断开:任务放回队列，任何车辆都可以接
+    out<<"dispatch: empty pickup leg\n";
+    int t1 = g_taskCenter->makePickupTask(7,8,6);
+    dispatch();
+    Task *task = g_taskCenter->queryDoingTask(t1);
+    check.expect(task!=NULL && task->excuteCar==agv1->id && agv1->task==t1,"agv1 takes task 1");
+    linkChange(agv1->id,AgvTelemetry::TYPE_DISCONNECTED);
+    check.expect(agv1->status==Agv::AGV_STATUS_UNCONNECT,"agv1 is UNCONNECT after disconnect");
+    check.expect(agv1->task==0,"agv1 drops task 1");
+    check.expect(holdsNothing(agv1),"agv1 releases its lines, stations and reservations");
+    task = g_taskCenter->queryUndoTask(t1);
+    check.expect(task!=NULL && task->excuteCar==0,"task 1 is back in the queue for any agv");
+    dispatch();
+    check.expect(!isIdle(agv1) && g_taskCenter->queryUndoTask(t1)!=NULL,"disconnected agv1 is not dispatched");
+    linkChange(agv2->id,AgvTelemetry::TYPE_CONNECTED);
+    dispatch();
+    task = g_taskCenter->queryDoingTask(t1);
+    check.expect(task!=NULL && task->excuteCar==agv2->id,"agv2 takes task 1 over");
+
+    //2.指定车辆的任务中断开:任务等这辆车，重连后不作为空闲车辆，从所在位置继续
+    out<<"dispatch: pinned task\n";
+    linkChange(agv1->id,AgvTelemetry::TYPE_CONNECTED);
+    check.expect(agv1->status==Agv::AGV_STATUS_IDLE,"agv1 without a task reconnects IDLE");
+    int t2 = g_taskCenter->makeAgvPickupTask(agv1->id,2,3,1);
+    dispatch();
+    task = g_taskCenter->queryDoingTask(t2);
+    check.expect(task!=NULL && task->excuteCar==agv1->id,"agv1 takes its fixed task 2");
+    linkChange(agv1->id,AgvTelemetry::TYPE_DISCONNECTED);
+    check.expect(agv1->status==Agv::AGV_STATUS_UNCONNECT,"agv1 is UNCONNECT after disconnect");
+    check.expect(holdsNothing(agv1),"agv1 releases its lines, stations and reservations");
+    task = g_taskCenter->queryUndoTask(t2);
+    check.expect(task!=NULL && task->excuteCar==agv1->id && agv1->task==t2,"task 2 waits in the queue for agv1");
+    linkChange(agv3->id,AgvTelemetry::TYPE_CONNECTED);
+    dispatch();
+    task = g_taskCenter->queryUndoTask(t2);
+    check.expect(task!=NULL && task->excuteCar==agv1->id && isIdle(agv3),"idle agv3 does not take pinned task 2");
+
+    linkChange(agv1->id,AgvTelemetry::TYPE_CONNECTED);
+    check.expect(agv1->status==Agv::AGV_STATUS_TASKING && !isIdle(agv1),"agv1 reconnects reserved for task 2, not IDLE");
+    int t3 = g_taskCenter->makeAimTask(4);
+    dispatch();
+    task = g_taskCenter->queryDoingTask(t2);
+    check.expect(task!=NULL && task->excuteCar==agv1->id && agv1->task==t2,"task 2 resumes on agv1");
+    task = g_taskCenter->queryDoingTask(t3);
+    check.expect(task!=NULL && task->excuteCar==agv3->id,"new task 3 goes to idle agv3, not agv1");
+
+    out<<"dispatch: "<<(check.failures==0?"ok":"FAIL")<<"\n";
+    out.flush();
+    return check.failures;
+}
+
+static void report(QTextStream &out, const QString &name, AtomicHistogram &h)
+{
+    AtomicHistogram::Snapshot snap = h.snapshot();
+    out<<name<<"(ms) count:"<<(qint64)snap.count<<" p50:"<<snap.percentile(50)<<" p99:"<<snap.percentile(99)<<" max:"<<snap.max;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("ReconnectBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("agv link lifecycle: connect storm, kill/restart and silent hang recovery");
+    parser.addHelpOption();
+    QCommandLineOption agvsOption("agvs","simulated agvs, one port each.","count","200");
+    QCommandLineOption threadsOption("threads","io threads.","count",QString::number(AgvIoEngine::DEFAULT_THREADS));
+    QCommandLineOption rateOption("rate","reports per agv per second.","hz","10");
+    QCommandLineOption downOption("down","how long the agvs stay down in each kill round.","ms","3000");
+    QCommandLineOption roundsOption("rounds","kill/restart rounds.","count","3");
+    parser.addOption(agvsOption);
+    parser.addOption(threadsOption);
+    parser.addOption(rateOption);
+    parser.addOption(downOption);
+    parser.addOption(roundsOption);
+    parser.process(a);
+
+    int agvs = qMax(1,parser.value(agvsOption).toInt());
+    int threads = qMax(1,parser.value(threadsOption).toInt());
+    int rate = qBound(1,parser.value(rateOption).toInt(),1000);
+    int down = qMax(0,parser.value(downOption).toInt());
+    int rounds = qMax(1,parser.value(roundsOption).toInt());
+
+    benchStart = Clock::now();
+
+    QThread fleetThread;
+    FakeFleet fleet(1000/rate);
+    QList<quint16> ports = fleet.listen(agvs);
+    fleet.moveToThread(&fleetThread);
+    fleetThread.start();
+    QMetaObject::invokeMethod(&fleet,"start",Qt::QueuedConnection);
+
+    LinkWatch watch;
+    AgvIoEngine engine;
+    engine.setTelemetryHandler([&watch](const AgvTelemetry &telemetry){watch.onTelemetry(telemetry);});
+    engine.start(threads);
+
+    QTextStream out(stdout);
+    out<<"agvs:"<<agvs<<" io threads:"<<threads<<" rate:"<<rate<<"hz down:"<<down<<"ms"
+      <<" | max connecting per thread:"<<AgvIoWorker::MAX_CONNECTING
+     <<" frame timeout:"<<AgvIoWorker::FRAME_TIMEOUT_MSECS<<"ms"
+    <<" backoff:"<<AgvIoWorker::RECONNECT_MIN_MSECS<<"-"<<AgvIoWorker::RECONNECT_MAX_MSECS<<"ms\n";
+
+    auto allOnline = [&](){return watch.online.size()==agvs;};
+    auto allOffline = [&](){return watch.online.isEmpty();};
+
+    //启动时所有车辆同时加入
+    watch.startPhase();
+    for(int i=0;i<agvs;++i)
+        engine.addAgv(i+1,"127.0.0.1",ports.at(i));
+    int failures = 0;
+    bool ok = waitFor(allOnline,60000);
+    if(!ok)++failures;
+    out<<"startup: "<<(ok?"all online":"TIMEOUT")<<" in "<<nowMs()-watch.phaseStartMs<<"ms ";
+    report(out,"connect",watch.connectMs);
+    out<<"\n";
+    out.flush();
+
+    for(int r=0;r<rounds;++r){
+        quint64 reconnects = engine.getReconnectCount();
+        watch.startPhase();
+        QMetaObject::invokeMethod(&fleet,"kill",Qt::BlockingQueuedConnection);
+        bool detected = waitFor(allOffline,10000);
+        if(!detected)++failures;
+        out<<"kill "<<r+1<<": "<<(detected?"all offline":"TIMEOUT")<<" ";
+        report(out,"detect",watch.disconnectMs);
+
+        wait(down-(int)(nowMs()-watch.phaseStartMs));
+        quint64 attempts = engine.getReconnectCount()-reconnects;
+        watch.startPhase();
+        QMetaObject::invokeMethod(&fleet,"restart",Qt::BlockingQueuedConnection);
+        bool recovered = waitFor(allOnline,60000);
+        if(!recovered)++failures;
+        out<<" | attempts while down:"<<(qint64)attempts<<" | restart: "<<(recovered?"all online":"TIMEOUT")<<" ";
+        report(out,"recover",watch.connectMs);
+        out<<"\n";
+        out.flush();
+    }
+
+    quint64 timeouts = engine.getFrameTimeoutCount();
+    watch.startPhase();
+    QMetaObject::invokeMethod(&fleet,"hang",Qt::BlockingQueuedConnection);
+    bool detected = waitFor(allOffline,AgvIoWorker::FRAME_TIMEOUT_MSECS*3);
+    if(!detected)++failures;
+    out<<"hang: "<<(detected?"all offline":"TIMEOUT")<<" ";
+    report(out,"detect",watch.disconnectMs);
+    //重新连上的时间也从车辆卡死开始算
+    bool recovered = waitFor(allOnline,60000);
+    if(!recovered)++failures;
+    out<<" frame timeouts:"<<(qint64)(engine.getFrameTimeoutCount()-timeouts)
+      <<" | "<<(recovered?"all online":"TIMEOUT")<<" ";
+    report(out,"recover",watch.connectMs);
+    out<<"\n";
+    out.flush();
+
+    engine.stop();
+    fleetThread.quit();
+    fleetThread.wait();
+
+    failures += checkDispatch(out);
+    if(failures>0){
+        QTextStream(stderr)<<failures<<" checks failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+#include "reconnectbench.moc"
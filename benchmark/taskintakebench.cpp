@@ -0,0 +1,182 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QMutex>
+#include <QTextStream>
+#include <QDateTime>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include "business/taskqueue.h"
+#include "util/concurrentqueue.h"
+#include "util/histogram.h"
+#include "benchutil.h"
+
+//任务入队的竞争测试:多个生产者(zmq工作线程)同时产生任务，一个调度线程周期性地分配
+//mutex: 原来的设计，生产者和调度线程共用一个锁，调度时整个分配过程都持有锁
+//queue: 生产者把任务放入无锁队列，调度线程取出后在自己的线程里处理，不需要锁
+
+struct BenchConfig{
+    int producers = 20;
+    int tasksPerProducer = 20000;
+    int periodUs = 10000;//调度周期
+    int holdUs = 2000;//每次调度处理的耗时(路径计算等)
+};
+
+struct BenchResult{
+    double seconds = 0;
+    AtomicHistogram latency;//生产者每次入队的耗时 ns
+};
+
+static std::vector<std::vector<Task *> > makeTasks(const BenchConfig &config)
+{
+    qint64 base = QDateTime::currentMSecsSinceEpoch();
+    std::vector<std::vector<Task *> > tasks(config.producers);
+    for(int p=0;p<config.producers;++p){
+        for(int i=0;i<config.tasksPerProducer;++i){
+            Task *task = new Task;
+            task->id = p*config.tasksPerProducer+i+1;
+            task->priority = i%(Task::PRIORITY_VERY_HIGH+1);
+            task->produceTime = QDateTime::fromMSecsSinceEpoch(base+i);
+            tasks[p].push_back(task);
+        }
+    }
+    return tasks;
+}
+
+//调度:处理一段时间，然后把队列里的任务都当作分配掉了
+static void dispatchAll(TaskQueue &queue)
+{
+    while(!queue.isEmpty()){
+        Task *task = queue.top();
+        queue.remove(task);
+        delete task;
+    }
+}
+
+static void runMutex(const BenchConfig &config, BenchResult &result)
+{
+    std::vector<std::vector<Task *> > tasks = makeTasks(config);
+    TaskQueue queue;
+    QMutex mtx;
+    std::atomic<int> running(config.producers);
+
+    Clock::time_point start = Clock::now();
+    std::thread dispatcher([&](){
+        while(true){
+            bool last = running.load()==0;
+            mtx.lock();
+            spin(config.holdUs);
+            dispatchAll(queue);
+            mtx.unlock();
+            if(last)break;
+            std::this_thread::sleep_for(std::chrono::microseconds(config.periodUs));
+        }
+    });
+
+    std::vector<std::thread> producers;
+    for(int p=0;p<config.producers;++p){
+        producers.push_back(std::thread([&,p](){
+            for(size_t i=0;i<tasks[p].size();++i){
+                Clock::time_point t0 = Clock::now();
+                mtx.lock();
+                queue.push(tasks[p][i]);
+                mtx.unlock();
+                result.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now()-t0).count());
+            }
+            --running;
+        }));
+    }
+    for(size_t i=0;i<producers.size();++i)producers[i].join();
+    result.seconds = std::chrono::duration<double>(Clock::now()-start).count();
+    dispatcher.join();
+}
+
+static void runQueue(const BenchConfig &config, BenchResult &result)
+{
+    std::vector<std::vector<Task *> > tasks = makeTasks(config);
+    TaskQueue queue;//只有调度线程访问
+    moodycamel::ConcurrentQueue<Task *> intake;
+    std::atomic<int> running(config.producers);
+
+    Clock::time_point start = Clock::now();
+    std::thread dispatcher([&](){
+        Task *buff[64];
+        while(true){
+            bool last = running.load()==0;
+            size_t count;
+            while((count = intake.try_dequeue_bulk(buff,64))>0){
+                for(size_t i=0;i<count;++i)queue.push(buff[i]);
+            }
+            spin(config.holdUs);
+            dispatchAll(queue);
+            if(last)break;
+            std::this_thread::sleep_for(std::chrono::microseconds(config.periodUs));
+        }
+    });
+
+    std::vector<std::thread> producers;
+    for(int p=0;p<config.producers;++p){
+        producers.push_back(std::thread([&,p](){
+            moodycamel::ProducerToken token(intake);
+            for(size_t i=0;i<tasks[p].size();++i){
+                Clock::time_point t0 = Clock::now();
+                intake.enqueue(token,tasks[p][i]);
+                result.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now()-t0).count());
+            }
+            --running;
+        }));
+    }
+    for(size_t i=0;i<producers.size();++i)producers[i].join();
+    result.seconds = std::chrono::duration<double>(Clock::now()-start).count();
+    dispatcher.join();
+}
+
+static void report(QTextStream &out, const QString &name, const BenchConfig &config, BenchResult &result)
+{
+    AtomicHistogram::Snapshot snap = result.latency.snapshot();
+    double total = (double)config.producers*config.tasksPerProducer;
+    out<<name<<": producers:"<<config.producers<<" tasks:"<<(qint64)total
+      <<" seconds:"<<result.seconds
+     <<" tasks/s:"<<(result.seconds>0?total/result.seconds:0)
+    <<" enqueue(us) p50:"<<snap.percentile(50)/1000.0
+    <<" p99:"<<snap.percentile(99)/1000.0
+    <<" p99.9:"<<snap.percentile(99.9)/1000.0
+    <<" max:"<<snap.max/1000.0<<"\n";
+    out.flush();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("TaskIntakeBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("task intake contention benchmark: mutex vs lock-free queue");
+    parser.addHelpOption();
+    QCommandLineOption producersOption("producers","concurrent producer threads.","count","20");
+    QCommandLineOption tasksOption("tasks","tasks per producer.","count","20000");
+    QCommandLineOption periodOption("period","dispatch period in us.","us","10000");
+    QCommandLineOption holdOption("hold","dispatch work per period in us.","us","2000");
+    parser.addOption(producersOption);
+    parser.addOption(tasksOption);
+    parser.addOption(periodOption);
+    parser.addOption(holdOption);
+    parser.process(a);
+
+    BenchConfig config;
+    config.producers = qMax(1,parser.value(producersOption).toInt());
+    config.tasksPerProducer = qMax(1,parser.value(tasksOption).toInt());
+    config.periodUs = qMax(0,parser.value(periodOption).toInt());
+    config.holdUs = qMax(0,parser.value(holdOption).toInt());
+
+    QTextStream out(stdout);
+    BenchResult mutexResult;
+    runMutex(config,mutexResult);
+    report(out,"mutex",config,mutexResult);
+
+    BenchResult queueResult;
+    runQueue(config,queueResult);
+    report(out,"queue",config,queueResult);
+    return 0;
+}
@@ -0,0 +1,153 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QMap>
+#include <chrono>
+#include <vector>
+#include <string.h>
+#include "util/global.h"
+#include "network/agvcapture.h"
+#include "network/agvframeparser.h"
+#include "benchutil.h"
+
+//用抓包文件(服务端 --capture)回放车辆上报，测量服务端处理上报的开销(单线程，尽快)
+//parse:   原始数据按抓到时的分段送入每辆车的拆包器，拆包、解析
+//process: 解析出的状态交给AgvCenter，更新里程、站点、车队状态(和服务端主线程一样)
+
+struct RoundResult{
+    quint64 frames = 0;
+    quint64 bytes = 0;
+    double parseSeconds = 0;
+    double processSeconds = 0;
+};
+
+static void createAgvs(AgvCaptureReader &reader)
+{
+    Agv::UpdateMCallback _updateM = std::bind(&AgvCenter::updateOdometer,g_hrgAgvCenter,std::placeholders::_1,std::placeholders::_2);
+    Agv::UpdateMRCallback _updateMR = std::bind(&AgvCenter::updateStationOdometer,g_hrgAgvCenter,std::placeholders::_1,std::placeholders::_2,std::placeholders::_3);
+
+    AgvCaptureRecord record;
+    const char *data;
+    reader.rewind();
+    while(reader.next(record,data)){
+        if(g_m_agvs.contains(record.agvId))continue;
+        Agv *agv = new Agv;
+        agv->id = record.agvId;
+        agv->name = QString("replay%1").arg(agv->id);
+        agv->status = Agv::AGV_STATUS_IDLE;
+        agv->updateM = _updateM;
+        agv->updateMR = _updateMR;
+        agv->fleetSlot = g_fleetState->addAgv(agv->id);
+        g_m_agvs.insert(agv->id,agv);
+    }
+    reader.rewind();
+}
+
+static void runRound(AgvCaptureReader &reader, std::vector<AgvTelemetry> &telemetries, RoundResult &result)
+{
+    QMap<int,AgvFrameParser *> parsers;
+    for(QMap<int,Agv *>::iterator itr=g_m_agvs.begin();itr!=g_m_agvs.end();++itr)
+        parsers.insert(itr.key(),new AgvFrameParser);
+    telemetries.clear();
+
+    AgvCaptureRecord record;
+    const char *data;
+    AgvTelemetry telemetry;
+    reader.rewind();
+    Clock::time_point t0 = Clock::now();
+    while(reader.next(record,data)){
+        if(record.type != AgvCaptureRecord::TYPE_DATA)continue;
+        AgvFrameParser *parser = parsers.value(record.agvId);
+        int offset = 0;
+        while(offset<record.length){
+            int space = 0;
+            char *buff = parser->writeBuffer(space);
+            int len = qMin(space,record.length-offset);
+            memcpy(buff,data+offset,len);
+            parser->commit(len);
+            offset += len;
+            while(parser->next(telemetry)){
+                telemetry.agvId = record.agvId;
+                telemetry.recvMsecs = reader.getStartMsecs()+record.offsetUsecs/1000;
+                telemetries.push_back(telemetry);
+            }
+        }
+        result.bytes += record.length;
+    }
+    Clock::time_point t1 = Clock::now();
+    for(size_t i=0;i<telemetries.size();++i)
+        g_hrgAgvCenter->onTelemetry(telemetries[i]);
+    Clock::time_point t2 = Clock::now();
+
+    result.frames = telemetries.size();
+    result.parseSeconds = std::chrono::duration<double>(t1-t0).count();
+    result.processSeconds = std::chrono::duration<double>(t2-t1).count();
+    qDeleteAll(parsers);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("TelemetryReplayBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("replay a capture file through the telemetry path and measure its cost");
+    parser.addHelpOption();
+    parser.addPositionalArgument("capture","capture file recorded by the server with --capture.");
+    QCommandLineOption mapOption("map","map file (station=/line=/arc= lines, same format as map/create).","file");
+    QCommandLineOption dbOption("db","load map from database.");
+    QCommandLineOption roundsOption("rounds","replay the capture this many times.","count","5");
+    parser.addOption(mapOption);
+    parser.addOption(dbOption);
+    parser.addOption(roundsOption);
+    parser.process(a);
+
+    if(parser.positionalArguments().length()!=1){
+        qDebug()<<"need a capture file";
+        return 1;
+    }
+    if(!parser.isSet(mapOption) && !parser.isSet(dbOption)){
+        qDebug()<<"need --map or --db";
+        return 1;
+    }
+
+    g_log = new AgvLog();
+    g_log->setPersist(false);
+    g_fleetState = new FleetState;
+    //车辆由抓包中的id创建，不从数据库载入
+    g_hrgAgvCenter = new AgvCenter;
+
+    g_agvMapCenter = new MapCenter;
+    if(parser.isSet(dbOption)){
+        g_sql = new Sql();
+        g_sql->createConnection();
+        g_agvMapCenter->load();
+    }else{
+        g_agvMapCenter->setPersist(false);
+        if(!g_agvMapCenter->loadFromFile(parser.value(mapOption)))
+            return 1;
+    }
+
+    AgvCaptureReader reader;
+    if(!reader.open(parser.positionalArguments().at(0))){
+        qDebug()<<"open capture fail:"<<reader.getErrorString();
+        return 1;
+    }
+    createAgvs(reader);
+
+    QTextStream out(stdout);
+    int rounds = qMax(1,parser.value(roundsOption).toInt());
+    std::vector<AgvTelemetry> telemetries;
+    for(int i=0;i<rounds;++i){
+        RoundResult result;
+        runRound(reader,telemetries,result);
+        double frames = qMax((quint64)1,result.frames);
+        double seconds = result.parseSeconds+result.processSeconds;
+        out<<"round "<<i+1<<": agvs:"<<g_m_agvs.size()<<" frames:"<<result.frames<<" bytes:"<<result.bytes
+          <<" parse(ns/frame):"<<result.parseSeconds*1e9/frames
+         <<" process(ns/frame):"<<result.processSeconds*1e9/frames
+        <<" frames/s:"<<(seconds>0?result.frames/seconds:0)<<"\n";
+        out.flush();
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QFile>
+#include <QEventLoop>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "util/timingwheel.h"
+#include "util/histogram.h"
+#include "benchutil.h"
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+//定时处理的对比:每辆车一个周期性的定时(命令重传检查、心跳等)，服务器空闲时
+//poll:  原来的做法，每辆车一个线程，循环sleep(--busy时用原来QyhSleep的忙等)
+//wheel: 所有定时放在一个时间轮上，一个线程，只在有定时到期时醒来
+//报告线程数、空闲时的进程CPU占用、定时的抖动，以及大量定时器的插入、取消速度
+
+struct BenchConfig{
+    int agvs = 200;
+    int periodMs = 50;
+    int seconds = 5;
+    bool busy = false;
+    int timers = 100000;
+};
+
+struct BenchResult{
+    int threads = -1;
+    double cpuSeconds = 0;
+    double wallSeconds = 0;
+    quint64 wakeups = 0;
+    AtomicHistogram jitter;//实际间隔比周期多出来的时间 us
+};
+
+static double processCpuSeconds()
+{
+#ifdef WIN32
+    FILETIME create,exit,kernel,user;
+    if(!GetProcessTimes(GetCurrentProcess(),&create,&exit,&kernel,&user))return 0;
+    ULARGE_INTEGER k,u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart+u.QuadPart)/1e7;
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF,&usage)!=0)return 0;
+    return usage.ru_utime.tv_sec+usage.ru_stime.tv_sec+(usage.ru_utime.tv_usec+usage.ru_stime.tv_usec)/1e6;
+#endif
+}
+
+//进程的线程数，不支持时返回-1
+static int processThreads()
+{
+    QFile file("/proc/self/status");
+    if(!file.open(QIODevice::ReadOnly))return -1;
+    QList<QByteArray> lines = file.readAll().split('\n');
+    for(int i=0;i<lines.length();++i){
+        if(lines.at(i).startsWith("Threads:"))
+            return lines.at(i).mid(8).trimmed().toInt();
+    }
+    return -1;
+}
+
+//测量一段空闲时间的CPU
+static void measure(const BenchConfig &config, BenchResult &result)
+{
+    //等所有线程都跑起来
+    std::this_thread::sleep_for(std::chrono::milliseconds(config.periodMs*2));
+    result.jitter.reset();
+    result.threads = processThreads();
+    double cpu0 = processCpuSeconds();
+    Clock::time_point t0 = Clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(config.seconds));
+    result.cpuSeconds = processCpuSeconds()-cpu0;
+    result.wallSeconds = std::chrono::duration<double>(Clock::now()-t0).count();
+}
+
+static void recordJitter(BenchResult &result, Clock::time_point &last, int periodMs)
+{
+    Clock::time_point now = Clock::now();
+    qint64 us = std::chrono::duration_cast<std::chrono::microseconds>(now-last).count()-periodMs*1000LL;
+    result.jitter.record(qMax((qint64)0,us));
+    last = now;
+}
+
+static void runPoll(const BenchConfig &config, BenchResult &result)
+{
+    std::atomic<bool> quit(false);
+    std::atomic<quint64> wakeups(0);
+    std::vector<std::thread> threads;
+    for(int i=0;i<config.agvs;++i){
+        threads.push_back(std::thread([&](){
+            Clock::time_point last = Clock::now();
+            while(!quit){
+                if(config.busy){
+                    //QyhSleep
+                    Clock::time_point end = Clock::now()+std::chrono::milliseconds(config.periodMs);
+                    while(Clock::now()<end)
+                        QCoreApplication::processEvents(QEventLoop::AllEvents,1);
+                }else{
+                    std::this_thread::sleep_for(std::chrono::milliseconds(config.periodMs));
+                }
+                ++wakeups;
+                recordJitter(result,last,config.periodMs);
+            }
+        }));
+    }
+    quint64 w0 = wakeups.load();
+    measure(config,result);
+    result.wakeups = wakeups.load()-w0;
+    quit = true;
+    for(size_t i=0;i<threads.size();++i)threads[i].join();
+}
+
+static void runWheel(const BenchConfig &config, BenchResult &result)
+{
+    TimingWheel wheel;
+    wheel.start();
+    std::vector<Clock::time_point> lasts(config.agvs,Clock::now());
+    std::vector<TimingWheel::TimerId> ids;
+    for(int i=0;i<config.agvs;++i){
+        //错开各车辆的定时
+        int delay = 1+i*config.periodMs/config.agvs;
+        lasts[i] = Clock::now()+std::chrono::milliseconds(delay-config.periodMs);
+        ids.push_back(wheel.schedule(delay,[&,i](){recordJitter(result,lasts[i],config.periodMs);},config.periodMs));
+    }
+    quint64 w0 = wheel.getWakeupCount();
+    measure(config,result);
+    result.wakeups = wheel.getWakeupCount()-w0;
+    for(size_t i=0;i<ids.size();++i)wheel.cancel(ids[i]);
+    wheel.stop();
+}
+
+//大量定时器(大部分在到期前被取消，比如收到应答的重传定时)
+static void runChurn(const BenchConfig &config, QTextStream &out)
+{
+    TimingWheel wheel;
+    wheel.start();
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> delays(1000,600000);
+    std::vector<TimingWheel::TimerId> ids;
+    ids.reserve(config.timers);
+
+    Clock::time_point t0 = Clock::now();
+    for(int i=0;i<config.timers;++i)
+        ids.push_back(wheel.schedule(delays(rng),[](){}));
+    double insertSeconds = std::chrono::duration<double>(Clock::now()-t0).count();
+
+    std::shuffle(ids.begin(),ids.end(),rng);
+    t0 = Clock::now();
+    for(size_t i=0;i<ids.size();++i)
+        wheel.cancel(ids[i]);
+    double cancelSeconds = std::chrono::duration<double>(Clock::now()-t0).count();
+    wheel.stop();
+
+    out<<"churn: timers:"<<config.timers
+      <<" insert(ns/op):"<<insertSeconds*1e9/config.timers
+     <<" cancel(ns/op):"<<cancelSeconds*1e9/config.timers<<"\n";
+    out.flush();
+}
+
+static void report(QTextStream &out, const QString &name, const BenchConfig &config, BenchResult &result)
+{
+    AtomicHistogram::Snapshot snap = result.jitter.snapshot();
+    out<<name<<": agvs:"<<config.agvs<<" period(ms):"<<config.periodMs
+      <<" threads:";
+    if(result.threads>=0)out<<result.threads;
+    else out<<"n/a";
+    out<<" cpu(%):"<<(result.wallSeconds>0?result.cpuSeconds*100/result.wallSeconds:0)
+      <<" wakeups/s:"<<(result.wallSeconds>0?result.wakeups/result.wallSeconds:0)
+     <<" jitter(ms) p50:"<<snap.percentile(50)/1000.0
+    <<" p99:"<<snap.percentile(99)/1000.0
+    <<" max:"<<snap.max/1000.0<<"\n";
+    out.flush();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("TimingWheelBench");
+
+    QCommandLineParser cmd;
+    cmd.setApplicationDescription("per-agv polling threads vs one shared timing wheel");
+    cmd.addHelpOption();
+    QCommandLineOption agvsOption("agvs","agvs, one periodic timer each.","count","200");
+    QCommandLineOption periodOption("period","timer period in ms.","ms","50");
+    QCommandLineOption secondsOption("seconds","idle seconds to measure.","seconds","5");
+    QCommandLineOption busyOption("busy","poll threads busy-wait like QyhSleep (uses all cores).");
+    QCommandLineOption timersOption("timers","timers for the insert/cancel test.","count","100000");
+    cmd.addOption(agvsOption);
+    cmd.addOption(periodOption);
+    cmd.addOption(secondsOption);
+    cmd.addOption(busyOption);
+    cmd.addOption(timersOption);
+    cmd.process(a);
+
+    BenchConfig config;
+    config.agvs = qMax(1,cmd.value(agvsOption).toInt());
+    config.periodMs = qMax(1,cmd.value(periodOption).toInt());
+    config.seconds = qMax(1,cmd.value(secondsOption).toInt());
+    config.busy = cmd.isSet(busyOption);
+    config.timers = qMax(1,cmd.value(timersOption).toInt());
+
+    QTextStream out(stdout);
+
+    BenchResult pollResult;
+    runPoll(config,pollResult);
+    report(out,config.busy?"poll(busy)":"poll",config,pollResult);
+
+    BenchResult wheelResult;
+    runWheel(config,wheelResult);
+    report(out,"wheel",config,wheelResult);
+
+    runChurn(config,out);
+    return 0;
+}
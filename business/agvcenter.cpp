@@ -1,6 +1,7 @@
 ﻿#include "agvcenter.h"
 #include "util/global.h"
 #include "util/common.h"
+#include <QThread>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -18,7 +19,8 @@ QList<Agv *> AgvCenter::getIdleAgvs()
 
     for(QMap<int,Agv *>::iterator itr =g_m_agvs.begin();itr!=g_m_agvs.end();++itr)
     {
-        if(itr.value()->status == Agv::AGV_STATUS_IDLE){
+        //急停中的车辆等解除后才能接任务
+        if(itr.value()->status == Agv::AGV_STATUS_IDLE && !itr.value()->isStopped()){
             result.push_back(itr.value());
         }
     }
@@ -62,48 +64,39 @@ void AgvCenter::updateOdometer(int odometer, Agv *agv)
 
     if(odometer <= line.length*line.rate)
     {
-        //计算位置
+        //走过的距离换算成线路上的参数t
+        double distance = 1.0*odometer/line.rate;
+        double t = 0;
+        BezierArc arc;
+        bool hasArc = false;
         if(line.line){
-            double theta = atan2(endStation.y-startStation.y,endStation.x-startStation.x);
-            agv->rotation = (theta*180/M_PI);
-            agv->x = (startStation.x+1.0*odometer/line.rate*cos(theta));
-            agv->y = (startStation.y+1.0*odometer/line.rate*sin(theta));
+            double len = sqrt((endStation.x-startStation.x)*(endStation.x-startStation.x)+(endStation.y-startStation.y)*(endStation.y-startStation.y));
+            if(len>0)t = distance/len;
         }else{
-
-            //在新的绘图下，计算当前坐标，以及rotation
-            double t = 1.0*odometer/line.rate/line.length;
-            if(t<0){
-                t = 0.0;
-            }
-            if(t>1){
-                t=1.0;
-            }
-            //计算坐标
-            double startX = startStation.x;
-            double startY = startStation.y;
-            double endX = endStation.x;
-            double endY = endStation.y;
-            agv->x = (startX*(1-t)*(1-t)*(1-t)
-                      +3*line.p1x*t*(1-t)*(1-t)
-                      +3*line.p2x*t*t*(1-t)
-                      +endX*t*t*t);
-
-            agv->y = (startY*(1-t)*(1-t)*(1-t)
-                      +3*line.p1y*t*(1-t)*(1-t)
-                      +3*line.p2y*t*t*(1-t)
-                      +endY*t*t*t);
-
-            double X = startX * 3 * (1 - t)*(1 - t) * (-1) +
-                    3 * line.p1x * ((1 - t) * (1 - t) + t * 2 * (1 - t) * (-1)) +
-                    3 * line.p2x * (2 * t * (1 - t) + t * t * (-1)) +
-                    endX * 3 * t *t;
-
-            double Y =  startY * 3 * (1 - t)*(1 - t) * (-1) +
-                    3 *line.p1y * ((1 - t) *(1 - t) + t * 2 * (1 - t) * (-1)) +
-                    3 * line.p2y * (2 * t * (1 - t) + t * t * (-1)) +
-                    endY * 3 * t *t;
-
-            agv->rotation = (atan2(Y, X) * 180 / M_PI);
+            //按弧长表换算(t和弧长不成比例)
+            hasArc = g_agvMapCenter->getArc(line.id,arc);
+            if(!hasArc)return ;
+            t = arc.paramAt(distance);
+        }
+        agv->poseLine = line.id;
+        agv->poseT = t;
+        agv->posePending = true;
+
+        //发布位置时从这里往前推算
+        if(g_motionEstimator!=NULL){
+            MotionEstimator::Line path;
+            path.id = line.id;
+            path.straight = line.line;
+            path.p0x = startStation.x;
+            path.p0y = startStation.y;
+            path.p1x = line.p1x;
+            path.p1y = line.p1y;
+            path.p2x = line.p2x;
+            path.p2y = line.p2y;
+            path.p3x = endStation.x;
+            path.p3y = endStation.y;
+            if(hasArc)path.arc = arc;
+            g_motionEstimator->update(agv->id,path,distance,MotionEstimator::nowMsecs());
         }
     }
 }
@@ -117,6 +110,9 @@ void AgvCenter::updateStationOdometer(int rfid, int odometer, Agv *agv)
     //到达了这么个站点
     agv->x = (sstation.x);
     agv->y = (sstation.y);
+    agv->posePending = false;
+    if(g_motionEstimator!=NULL)
+        g_motionEstimator->stop(agv->id);
 
     //设置当前站点
     agv->nowStation=sstation.id;
@@ -146,9 +142,23 @@ void AgvCenter::updateStationOdometer(int rfid, int odometer, Agv *agv)
     emit carArriveStation(agv->id,sstation.id);
 }
 
+//车辆执行完了当前这一段的命令，按任务进行到哪一段，通知任务中心
+//取货、放货完成后车辆仍然是任务中，由任务中心直接派给它下一段，避免期间被分配给别的任务
 void AgvCenter::onFinish(Agv *agv)
 {
-    //TODO
+    Task *task = g_taskCenter->queryDoingTask(agv->task);
+    if(task == NULL || (task->currentDoIndex == Task::INDEX_GOING_STANDBY && !task->circle)){
+        if(agv->status == Agv::AGV_STATUS_TASKING)
+            agv->status = Agv::AGV_STATUS_IDLE;
+    }
+    if(task == NULL)return ;
+
+    if(task->currentDoIndex == Task::INDEX_GETTING_GOOD)
+        emit pickFinish(agv->id);
+    else if(task->currentDoIndex == Task::INDEX_PUTTING_GOOD)
+        emit putFinish(agv->id);
+    else
+        emit standByFinish(agv->id);
 }
 
 void AgvCenter::onError(int code,Agv *agv)
@@ -167,6 +177,17 @@ bool AgvCenter::load()//从数据库载入所有的agv
     QList<QVariant> params;
     QList<QList<QVariant> > result = g_sql->query(querySql,params);
 
+    for(int i=0;i<result.length();++i){
+        QList<QVariant> qsl = result.at(i);
+        if(qsl.length() == 4)
+            createAgv(qsl.at(0).toInt(),qsl.at(1).toString(),qsl.at(2).toString(),qsl.at(3).toInt());
+    }
+    return true;
+}
+
+//主线程:创建车辆，分配车队状态的槽位、连接，加入车辆表
+Agv *AgvCenter::createAgv(int agvId, const QString &name, const QString &ip, int port)
+{
     Agv::TaskFinishCallback _finish = std::bind(&AgvCenter::onFinish,this,std::placeholders::_1);
     Agv::TaskErrorCallback _error = std::bind(&AgvCenter::onError,this,std::placeholders::_1,std::placeholders::_2);
     Agv::TaskInteruptCallback _interupt = std::bind(&AgvCenter::onInterupt,this,std::placeholders::_1);
@@ -174,16 +195,77 @@ bool AgvCenter::load()//从数据库载入所有的agv
     Agv::UpdateMRCallback _updateMR = std::bind(&AgvCenter::updateStationOdometer,this,std::placeholders::_1,std::placeholders::_2,std::placeholders::_3);
 
 
-    for(int i=0;i<result.length();++i){
-        QList<QVariant> qsl = result.at(i);
-        if(qsl.length() == 4){
-            Agv *agv = new Agv;
-            agv->id=(qsl.at(0).toInt());
-            agv->name=(qsl.at(1).toString());
-            agv->init(qsl.at(2).toString(),qsl.at(3).toInt(),_finish,_error,_interupt,_updateM,_updateMR);
-            g_m_agvs.insert(agv->id,agv);
-        }
-    }
+    Agv *agv = new Agv;
+    agv->id = agvId;
+    agv->name = name;
+    agv->init(ip,port,_finish,_error,_interupt,_updateM,_updateMR);
+    g_m_agvs.insert(agv->id,agv);
+    return agv;
+}
+
+bool AgvCenter::inMainThread()
+{
+    return QThread::currentThread() == thread();
+}
+
+bool AgvCenter::addAgv(int agvId, const QString &name, const QString &ip, int port)
+{
+    if(inMainThread())return doAddAgv(agvId,name,ip,port);
+    bool result = false;
+    QMetaObject::invokeMethod(this,"doAddAgv",Qt::BlockingQueuedConnection,Q_RETURN_ARG(bool,result),
+                              Q_ARG(int,agvId),Q_ARG(QString,name),Q_ARG(QString,ip),Q_ARG(int,port));
+    return result;
+}
+
+bool AgvCenter::removeAgv(int agvId)
+{
+    if(inMainThread())return doRemoveAgv(agvId);
+    bool result = false;
+    QMetaObject::invokeMethod(this,"doRemoveAgv",Qt::BlockingQueuedConnection,Q_RETURN_ARG(bool,result),Q_ARG(int,agvId));
+    return result;
+}
+
+bool AgvCenter::renameAgv(int agvId, const QString &name)
+{
+    if(inMainThread())return doRenameAgv(agvId,name);
+    bool result = false;
+    QMetaObject::invokeMethod(this,"doRenameAgv",Qt::BlockingQueuedConnection,Q_RETURN_ARG(bool,result),Q_ARG(int,agvId),Q_ARG(QString,name));
+    return result;
+}
+
+bool AgvCenter::doAddAgv(int agvId, QString name, QString ip, int port)
+{
+    if(g_m_agvs.contains(agvId))return false;
+    createAgv(agvId,name,ip,port);
+    return true;
+}
+
+//取消车辆手上的任务，释放它占用的站点、线路，断开连接后删除
+bool AgvCenter::doRemoveAgv(int agvId)
+{
+    Agv *agv = g_m_agvs.value(agvId,NULL);
+    if(agv==NULL)return false;
+    if(agv->task>0 && g_taskCenter!=NULL)
+        g_taskCenter->cancelTask(agv->task);
+    agvStopTask(agvId);
+    g_agvMapCenter->freeAgvReserve(agvId);
+    g_agvMapCenter->freeAgvLines(agvId);
+    g_agvMapCenter->freeAgvStation(agvId);
+    if(g_agvIoEngine!=NULL)
+        g_agvIoEngine->removeAgv(agvId);
+    if(g_motionEstimator!=NULL)
+        g_motionEstimator->remove(agvId);
+    g_m_agvs.remove(agvId);
+    delete agv;
+    return true;
+}
+
+bool AgvCenter::doRenameAgv(int agvId, QString name)
+{
+    Agv *agv = g_m_agvs.value(agvId,NULL);
+    if(agv==NULL)return false;
+    agv->name = name;
+    agv->commitInfo();
     return true;
 }
 
@@ -247,7 +329,62 @@ bool AgvCenter::save()//将agv保存到数据库
 
 void AgvCenter::init()
 {
+    if(g_agvIoEngine!=NULL)
+        g_agvIoEngine->setTelemetryHandler(std::bind(&AgvCenter::onTelemetry,this,std::placeholders::_1));
     load();
+
+    connect(&commitTimer,SIGNAL(timeout()),this,SLOT(commitFleetState()));
+    commitTimer.start(FLEET_COMMIT_INTERVAL);
+}
+
+//在线路上的车辆，一起算出坐标和朝向
+void AgvCenter::updatePoses()
+{
+    poseBatch.clear();
+    poseAgvs.clear();
+    for(QMap<int,Agv *>::iterator itr=g_m_agvs.begin();itr!=g_m_agvs.end();++itr){
+        Agv *agv = itr.value();
+        if(!agv->posePending)continue;
+        agv->posePending = false;
+        AgvLine *line = g_m_lines.value(agv->poseLine,NULL);
+        if(line==NULL)continue;
+        AgvStation *a = g_m_stations.value(line->startStation,NULL);
+        AgvStation *b = g_m_stations.value(line->endStation,NULL);
+        if(a==NULL||b==NULL)continue;
+        if(line->line)
+            poseBatch.addLine(a->x,a->y,b->x,b->y,agv->poseT);
+        else
+            poseBatch.addCurve(a->x,a->y,line->p1x,line->p1y,line->p2x,line->p2y,b->x,b->y,agv->poseT);
+        poseAgvs.append(agv);
+    }
+    if(poseAgvs.isEmpty())return ;
+
+    PoseKernel::evaluate(poseBatch);
+    for(int i=0;i<poseAgvs.length();++i){
+        poseAgvs[i]->x = (int)poseBatch.x[i];
+        poseAgvs[i]->y = (int)poseBatch.y[i];
+        poseAgvs[i]->rotation = (int)poseBatch.rotation[i];
+    }
+}
+
+void AgvCenter::commitFleetState()
+{
+    updatePoses();
+    for(QMap<int,Agv *>::iterator itr=g_m_agvs.begin();itr!=g_m_agvs.end();++itr)
+        itr.value()->commitState();
+}
+
+void AgvCenter::onTelemetry(const AgvTelemetry &telemetry)
+{
+    Agv *agv = g_m_agvs.value(telemetry.agvId,NULL);
+    if(agv==NULL)return ;
+    agv->onTelemetry(telemetry);
+    if(telemetry.type==AgvTelemetry::TYPE_DISCONNECTED){
+        if(g_motionEstimator!=NULL)
+            g_motionEstimator->stop(agv->id);
+        emit agvDisconnected(agv->id);
+    }
+    agv->commitState();
 }
 
 
@@ -444,26 +581,85 @@ bool AgvCenter::agvStopTask(int agvId)
     return true;
 }
 
-/*
- *leftmidright: 走完路径后，左转、右转还是直行
- *distance:走完路径后(左右转后)，前进的距离
- *height:叉板的高度
- *type: 0原地待命 1取货  -1放货
- * */
+//不经过主线程:先清空命令队列(之后不会再发出指令)，再由IO线程并行写入停止包
+//急停是锁定的:不改变任务，但解除(TaskCenter::releaseAgv)之前不接新任务、不下发命令
+int AgvCenter::emergencyStop(const QList<int> &agvIds)
+{
+    //调用者在zmq线程，从名册取命令队列，不访问主线程的车辆表
+    FleetState::RosterPtr roster = g_fleetState->getRoster();
+    QList<std::shared_ptr<AgvCmdQueue> > targets;
+    if(agvIds.isEmpty()){
+        for(FleetState::Roster::const_iterator itr=roster->begin();itr!=roster->end();++itr)
+            targets.append(itr.value().cmdQueue);
+    }else{
+        for(int i=0;i<agvIds.length();++i){
+            FleetState::Roster::const_iterator itr = roster->find(agvIds.at(i));
+            if(itr!=roster->end())targets.append(itr.value().cmdQueue);
+        }
+    }
+    for(int i=0;i<targets.length();++i){
+        if(targets.at(i))targets.at(i)->halt();
+    }
+
+    int count = 0;
+    if(g_agvIoEngine!=NULL && targets.length()>0)
+        count = g_agvIoEngine->emergencyStop(agvIds);
+    g_log->log(AGV_LOG_LEVEL_WARN,QString("emergency stop %1 agvs").arg(count));
+    return count;
+}
+
+//按车辆当前的路径生成命令:每条线路在起点的卡上前进，到达这一段的目的地后停下，再按这一段要做的事升降叉齿
+//已经在目的地上的(路径为空)，立即执行停下后的命令
 bool AgvCenter::agvStartTask(Agv *agv, Task *task)
 {
-//    if(task->currentDoIndex == Task::INDEX_GETTING_GOOD)
-//    {
-//        agv->doPick();
-//    }else if(task->currentDoIndex == Task::INDEX_PUTTING_GOOD)
-//    {
-//        agv->doPut();
-//    }else if(task->currentDoIndex == Task::INDEX_GOING_STANDBY)
-//    {
-//        agv->doStandBy();
-//    }else{
-//        return false;
-//    }
+    if(agv==NULL || task==NULL)return false;
+    if(agv->isStopped()){
+        g_log->log(AGV_LOG_LEVEL_WARN,QString("agv %1 is emergency stopped, task %2 not started").arg(agv->id).arg(task->id));
+        return false;
+    }
+
+    int aimStation = task->standByStation;
+    if(task->currentDoIndex == Task::INDEX_GETTING_GOOD)
+        aimStation = task->getGoodStation;
+    else if(task->currentDoIndex == Task::INDEX_PUTTING_GOOD)
+        aimStation = task->putGoodStation;
+
+    QList<AgvOrder> orders;
+    int stopRfid = AgvOrder::RFID_CODE_IMMEDIATELY;
+    for(int i=0;i<agv->currentPath.length();++i){
+        AgvLine line = g_agvMapCenter->getAgvLine(agv->currentPath.at(i));
+        if(line.id<=0)return false;
+        AgvOrder order;
+        order.order = AgvOrder::ORDER_FORWARD;
+        order.param = ORDER_SPEED;
+        //第一条线路立即执行，后面的在经过的站点的卡上执行
+        if(i>0){
+            AgvStation station = g_agvMapCenter->getAgvStation(line.startStation);
+            if(station.id<=0)return false;
+            order.rfid = station.rfid;
+        }
+        orders.append(order);
+        if(i==agv->currentPath.length()-1)
+            stopRfid = g_agvMapCenter->getAgvStation(line.endStation).rfid;
+    }
+    if(agv->currentPath.length()>0 && g_agvMapCenter->getAgvLine(agv->currentPath.last()).endStation!=aimStation)
+        return false;
+
+    AgvOrder stop;
+    stop.rfid = stopRfid;
+    stop.order = AgvOrder::ORDER_STOP;
+    stop.param = 0;
+    orders.append(stop);
+
+    if(task->currentDoIndex == Task::INDEX_GETTING_GOOD || task->currentDoIndex == Task::INDEX_PUTTING_GOOD){
+        AgvOrder fork;
+        fork.rfid = AgvOrder::RFID_CODE_IMMEDIATELY;
+        fork.order = AgvOrder::ORDER_UP_DOWN;
+        fork.param = task->currentDoIndex == Task::INDEX_GETTING_GOOD?FORK_PICK_HEIGHT:FORK_PUT_HEIGHT;
+        orders.append(fork);
+    }
+
+    agv->startTask(orders);
     return true;
 }
 
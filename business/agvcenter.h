@@ -5,7 +5,9 @@
 #include <QList>
 #include <QMutex>
 #include <QMap>
+#include <QTimer>
 #include "bean/agv.h"
+#include "util/posekernel.h"
 class Task;
 
 class AgvCenter : public QObject
@@ -15,18 +17,27 @@ public:
     explicit AgvCenter(QObject *parent = nullptr);
     QList<Agv *> getIdleAgvs();
 
+    //按车辆当前的路径和任务这一段要做的事生成命令，下发给车辆
     bool agvStartTask(Agv *agv, Task *task);
 
     bool agvStopTask(int agvId);
 
     bool agvCancelTask(int agvId);
 
+    //任意线程:急停。agvIds为空时是所有车辆，返回急停的车辆数
+    int emergencyStop(const QList<int> &agvIds);
+
     void init();
 
     bool load();//从数据库载入所有的agv
 
     bool save();//将agv保存到数据库
 
+    //任意线程:添加、删除、改名车辆。车辆表只在主线程中修改，其他线程调用时等主线程执行完
+    bool addAgv(int agvId, const QString &name, const QString &ip, int port);
+    bool removeAgv(int agvId);
+    bool renameAgv(int agvId, const QString &name);
+
     void agvConnectCallBack();
 
     void agvDisconnectCallBack();
@@ -44,16 +55,45 @@ public:
 
     void onInterupt(Agv *agv);
 
+    //IO引擎解析出的车辆状态(主线程)
+    void onTelemetry(const AgvTelemetry &telemetry);
+
+    enum{
+        FLEET_COMMIT_INTERVAL = 100,//ms
+    };
+
+    enum{
+        ORDER_SPEED = 5,//前进的速度代码[1,10]
+        FORK_PICK_HEIGHT = 10,//取货时叉齿抬起的高度cm
+        FORK_PUT_HEIGHT = 0,//放货时叉齿放下的高度cm
+    };
+
 signals:
     void carArriveStation(int agvId,int station);
 
     void pickFinish(int agvId);
     void putFinish(int agvId);
     void standByFinish(int agvId);
+
+    //车辆断开了(已经置为未连接)
+    void agvDisconnected(int agvId);
 public slots:
+    //任务、充电等改变的状态，定时写入车队状态
+    void commitFleetState();
 
+private slots:
+    bool doAddAgv(int agvId, QString name, QString ip, int port);
+    bool doRemoveAgv(int agvId);
+    bool doRenameAgv(int agvId, QString name);
 
 private:
+    void updatePoses();
+    Agv *createAgv(int agvId, const QString &name, const QString &ip, int port);
+    bool inMainThread();
+
+    QTimer commitTimer;
+    PoseKernel::Batch poseBatch;
+    QList<Agv *> poseAgvs;
 };
 
 #endif // AGVCENTER_H
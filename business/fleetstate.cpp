@@ -0,0 +1,158 @@
+﻿#include "fleetstate.h"
+
+FleetState::FleetState(int _capacity):
+    capacity(qMax(1,_capacity)),
+    used(0),
+    roster(std::make_shared<Roster>()),
+    usedSlots(0),
+    retryCount(0)
+{
+    seqs = new std::atomic<quint32>[capacity];
+    agvIds = new std::atomic<int>[capacity];
+    for(int i=0;i<capacity;++i){
+        seqs[i].store(0,std::memory_order_relaxed);
+        agvIds[i].store(0,std::memory_order_relaxed);
+    }
+#define FLEET_STATE_ALLOC(name) \
+    name = new std::atomic<int>[capacity]; \
+    for(int i=0;i<capacity;++i)name[i].store(0,std::memory_order_relaxed);
+    FLEET_STATE_FIELDS(FLEET_STATE_ALLOC)
+#undef FLEET_STATE_ALLOC
+}
+
+FleetState::~FleetState()
+{
+    delete[] seqs;
+    delete[] agvIds;
+#define FLEET_STATE_FREE(name) delete[] name;
+    FLEET_STATE_FIELDS(FLEET_STATE_FREE)
+#undef FLEET_STATE_FREE
+}
+
+int FleetState::findSlot(int agvId)
+{
+    if(agvId==0)return -1;
+    int n = usedSlots.load(std::memory_order_acquire);
+    for(int i=0;i<n;++i){
+        if(agvIds[i].load(std::memory_order_relaxed)==agvId)
+            return i;
+    }
+    return -1;
+}
+
+int FleetState::addAgv(int agvId)
+{
+    if(agvId==0)return -1;
+    QMutexLocker locker(&writeMtx);
+    int slot = findSlot(agvId);
+    if(slot>=0)return slot;
+    for(int i=0;i<capacity;++i){
+        if(agvIds[i].load(std::memory_order_relaxed)==0){
+            slot = i;
+            break;
+        }
+    }
+    if(slot<0)return -1;
+
+    //清空这个槽位，作为一次写入
+    quint32 seq = seqs[slot].load(std::memory_order_relaxed);
+    seqs[slot].store(seq+1,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+#define FLEET_STATE_CLEAR(name) name[slot].store(0,std::memory_order_relaxed);
+    FLEET_STATE_FIELDS(FLEET_STATE_CLEAR)
+#undef FLEET_STATE_CLEAR
+    agvIds[slot].store(agvId,std::memory_order_relaxed);
+    seqs[slot].store(seq+2,std::memory_order_release);
+
+    if(slot>=used){
+        used = slot+1;
+        usedSlots.store(used,std::memory_order_release);
+    }
+    return slot;
+}
+
+void FleetState::removeAgv(int agvId)
+{
+    QMutexLocker locker(&writeMtx);
+    if(roster->contains(agvId)){
+        std::shared_ptr<Roster> r = std::make_shared<Roster>(*roster);
+        r->remove(agvId);
+        std::atomic_store(&roster,RosterPtr(r));
+    }
+
+    int slot = findSlot(agvId);
+    if(slot<0)return ;
+    quint32 seq = seqs[slot].load(std::memory_order_relaxed);
+    seqs[slot].store(seq+1,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    agvIds[slot].store(0,std::memory_order_relaxed);
+    seqs[slot].store(seq+2,std::memory_order_release);
+}
+
+void FleetState::setAgvInfo(const AgvInfo &info)
+{
+    if(info.agvId==0)return ;
+    QMutexLocker locker(&writeMtx);
+    std::shared_ptr<Roster> r = std::make_shared<Roster>(*roster);
+    r->insert(info.agvId,info);
+    std::atomic_store(&roster,RosterPtr(r));
+}
+
+FleetState::RosterPtr FleetState::getRoster()
+{
+    return std::atomic_load(&roster);
+}
+
+void FleetState::write(int slot, const AgvState &state)
+{
+    if(slot<0||slot>=capacity)return ;
+    QMutexLocker locker(&writeMtx);
+    if(agvIds[slot].load(std::memory_order_relaxed)==0)return ;
+
+    quint32 seq = seqs[slot].load(std::memory_order_relaxed);
+    seqs[slot].store(seq+1,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+#define FLEET_STATE_STORE(name) name[slot].store(state.name,std::memory_order_relaxed);
+    FLEET_STATE_FIELDS(FLEET_STATE_STORE)
+#undef FLEET_STATE_STORE
+    seqs[slot].store(seq+2,std::memory_order_release);
+}
+
+bool FleetState::read(int slot, AgvState &state)
+{
+    if(slot<0||slot>=capacity)return false;
+    while(true){
+        quint32 seq = seqs[slot].load(std::memory_order_acquire);
+        if(seq&1)continue;//正在写入
+        state.agvId = agvIds[slot].load(std::memory_order_relaxed);
+#define FLEET_STATE_LOAD(name) state.name = name[slot].load(std::memory_order_relaxed);
+        FLEET_STATE_FIELDS(FLEET_STATE_LOAD)
+#undef FLEET_STATE_LOAD
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(seqs[slot].load(std::memory_order_relaxed)==seq){
+            state.version = seq/2;
+            return state.agvId!=0;
+        }
+        ++retryCount;
+    }
+}
+
+bool FleetState::readAgv(int agvId, AgvState &state)
+{
+    int slot = findSlot(agvId);
+    if(slot<0)return false;
+    //读的过程中槽位被重新分配了
+    return read(slot,state) && state.agvId==agvId;
+}
+
+QList<FleetState::AgvState> FleetState::snapshot()
+{
+    QList<AgvState> result;
+    int n = usedSlots.load(std::memory_order_acquire);
+    AgvState state;
+    for(int i=0;i<n;++i){
+        if(read(i,state))
+            result.append(state);
+    }
+    return result;
+}
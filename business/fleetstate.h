@@ -0,0 +1,122 @@
+﻿#ifndef FLEETSTATE_H
+#define FLEETSTATE_H
+
+#include <QtGlobal>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QMutex>
+#include <atomic>
+#include <memory>
+#include "bean/agvcmdqueue.h"
+
+//车辆的动态状态字段
+#define FLEET_STATE_FIELDS(F) \
+    F(status) \
+    F(mode) \
+    F(x) \
+    F(y) \
+    F(rotation) \
+    F(mileage) \
+    F(currentRfid) \
+    F(nextRfid) \
+    F(current) \
+    F(voltage) \
+    F(soc) \
+    F(range) \
+    F(positionMagneticStripe) \
+    F(pcbTemperature) \
+    F(motorTemperature) \
+    F(cpu) \
+    F(speed) \
+    F(angle) \
+    F(height) \
+    F(error_no) \
+    F(recvQueueNumber) \
+    F(orderCount) \
+    F(lastStation) \
+    F(nowStation) \
+    F(nextStation) \
+    F(task)
+
+//整个车队的状态，每个字段一个连续的数组，车辆按槽位(连续的下标)存放
+//1.主线程更新(写入者之间用锁互斥)，每个槽位一个seqlock
+//2.发布、查询在任意线程读取，不加锁。读到一半被改写时重读，保证x/y/rotation等是同一时刻的
+//3.扫描整个车队的某几个字段时只访问这几个数组
+//4.名字、地址这些不常变的信息放在名册中，每次修改整体替换，其他线程读到的是不变的一份
+class FleetState
+{
+public:
+    enum{
+        DEFAULT_CAPACITY = 1024,//最多的车辆数
+    };
+
+    //一辆车的状态
+    struct AgvState{
+        int agvId = 0;
+        quint32 version = 0;//每次更新加1
+#define FLEET_STATE_MEMBER(name) int name = 0;
+        FLEET_STATE_FIELDS(FLEET_STATE_MEMBER)
+#undef FLEET_STATE_MEMBER
+    };
+
+    //一辆车不常变的信息，和它的命令队列(查询链路统计、急停)
+    struct AgvInfo{
+        int agvId = 0;
+        QString name;
+        QString ip;
+        int port = 0;
+        std::shared_ptr<AgvCmdQueue> cmdQueue;
+    };
+    typedef QMap<int,AgvInfo> Roster;
+    typedef std::shared_ptr<const Roster> RosterPtr;
+
+    explicit FleetState(int capacity = DEFAULT_CAPACITY);
+    ~FleetState();
+
+    //分配一个槽位，已经有了返回原来的。满了返回-1
+    int addAgv(int agvId);
+    //释放槽位，从名册中去掉
+    void removeAgv(int agvId);
+
+    //主线程:添加或者替换一辆车的信息，发布新的名册
+    void setAgvInfo(const AgvInfo &info);
+
+    //任意线程:所有车辆的信息
+    RosterPtr getRoster();
+
+    //查找车辆的槽位，没有返回-1
+    int findSlot(int agvId);
+
+    //写入一辆车的状态(version不用填)
+    void write(int slot, const AgvState &state);
+
+    //读取一辆车一致的状态，槽位空闲返回false
+    bool read(int slot, AgvState &state);
+    bool readAgv(int agvId, AgvState &state);
+
+    //所有车辆的状态，按槽位顺序
+    QList<AgvState> snapshot();
+
+    int getCapacity(){return capacity;}
+    //读的时候遇到写入而重读的次数
+    quint64 getRetryCount(){return retryCount.load();}
+
+private:
+    int capacity;
+    int used;//用到的最大槽位+1
+
+    QMutex writeMtx;
+    std::atomic<quint32> *seqs;//奇数表示正在写入
+    std::atomic<int> *agvIds;//0表示空闲
+#define FLEET_STATE_ARRAY(name) std::atomic<int> *name;
+    FLEET_STATE_FIELDS(FLEET_STATE_ARRAY)
+#undef FLEET_STATE_ARRAY
+
+    RosterPtr roster;//只在写锁中替换，读用atomic_load
+
+    std::atomic<int> usedSlots;
+    std::atomic<quint64> retryCount;
+};
+
+#endif // FLEETSTATE_H
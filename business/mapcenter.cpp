@@ -3,14 +3,28 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include "util/global.h"
+#include <QFile>
 
 #include "util/bezierarc.h"
 
-MapCenter::MapCenter(QObject *parent) : QObject(parent)
+MapCenter::MapCenter(QObject *parent) : QObject(parent),
+    persist(true)
 {
 
 }
 
+void MapCenter::setPersist(bool _persist)
+{
+    persist = _persist;
+}
+
+//不保存到数据库时，直接当作成功
+bool MapCenter::save(QString sql, QList<QVariant> params)
+{
+    if(!persist)return true;
+    return g_sql->exeSql(sql,params);
+}
+
 void MapCenter::clear()
 {
     qDeleteAll(g_m_lines.values());
@@ -21,26 +35,32 @@ void MapCenter::clear()
     g_m_lmr.clear();
     g_m_l_adj.clear();
     g_reverseLines.clear();
+    arcsMtx.lock();
+    arcs.clear();
+    arcsMtx.unlock();
+    //推算用的是原来的线路
+    if(g_motionEstimator!=NULL)
+        g_motionEstimator->clear();
 
     QString deleteStationSql = "delete from agv_station;";
     QList<QVariant> params;
 
-    bool b = g_sql->exeSql(deleteStationSql,params);
+    bool b = save(deleteStationSql,params);
     if(!b){
         g_log->log(AGV_LOG_LEVEL_ERROR,"can not clear table agv_station!");
     }
     QString deleteLineSql = "delete from agv_line;";
-    b = g_sql->exeSql(deleteLineSql,params);
+    b = save(deleteLineSql,params);
     if(!b){
         g_log->log(AGV_LOG_LEVEL_ERROR,"can not clear table agv_line!");
     }
     QString deleteLmrSql = "delete from agv_lmr;";
-    b = g_sql->exeSql(deleteLmrSql,params);
+    b = save(deleteLmrSql,params);
     if(!b){
         g_log->log(AGV_LOG_LEVEL_ERROR,"can not clear table agv_lmr!");
     }
     QString deleteAdjSql = "delete from agv_adj;";
-    b = g_sql->exeSql(deleteAdjSql,params);
+    b = save(deleteAdjSql,params);
     if(!b){
         g_log->log(AGV_LOG_LEVEL_ERROR,"can not clear table agv_adj!");
     }
@@ -75,7 +95,7 @@ void MapCenter::addStation(QString s)
                     QList<QVariant> params;
                     params<<aStation->id<<aStation->name<<aStation->x<<aStation->y
                          <<aStation->rfid<<aStation->color_r<<aStation->color_g<<aStation->color_b;
-                    if(g_sql->exeSql(insertSql,params)){
+                    if(save(insertSql,params)){
                         g_m_stations.insert(aStation->id,aStation);
                     }else{
                         g_log->log(AGV_LOG_LEVEL_ERROR,"save agv statiom to database fail!");
@@ -133,7 +153,7 @@ void MapCenter::addLine(QString s)
                     QList<QVariant> params;
                     params<<aLine->id<<aLine->startStation<<aLine->endStation<<aLine->rate<<aLine->color_r<<aLine->color_g<<aLine->color_b<<aLine->line<<aLine->length<<aLine->draw;
 
-                    if(g_sql->exeSql(insertSql,params))
+                    if(save(insertSql,params))
                     {
                         g_m_lines.insert(aLine->id,aLine);
                     }else{
@@ -186,12 +206,13 @@ void MapCenter::addArc(QString s)
                         delete aLine;
                         continue;
                     }
-//                    double startX = g_m_stations[aLine->startStation]->x;
-//                    double startY = g_m_stations[aLine->startStation]->y;
-//                    double endX = g_m_stations[aLine->endStation]->x;
-//                    double endY = g_m_stations[aLine->endStation]->y;
+                    double startX = g_m_stations[aLine->startStation]->x;
+                    double startY = g_m_stations[aLine->startStation]->y;
+                    double endX = g_m_stations[aLine->endStation]->x;
+                    double endY = g_m_stations[aLine->endStation]->y;
 
-                    aLine->length = aLine->rate;//TODO: BezierArc::BezierArcLength(QPointF(startX,startY),QPointF(aLine->p1x,aLine->p1y),QPointF(aLine->p2x,aLine->p2y),QPointF(endX,endY));
+                    //曲线的实际长度(弧长表的总长)
+                    aLine->length = BezierArc(QPointF(startX,startY),QPointF(aLine->p1x,aLine->p1y),QPointF(aLine->p2x,aLine->p2y),QPointF(endX,endY)).length();
 
                     QString insertSql = "INSERT INTO agv_line (id,line_startStation,line_endStation,line_rate,line_color_r,line_color_g,line_color_b,line_line,line_length,line_draw,line_p1x,line_p1y,line_p2x,line_p2y) VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?);";
                     QList<QVariant> params;
@@ -210,7 +231,7 @@ void MapCenter::addArc(QString s)
                     <<aLine->p2x
                     <<aLine->p2y;
 
-                    if(g_sql->exeSql(insertSql,params))
+                    if(save(insertSql,params))
                     {
                         g_m_lines.insert(aLine->id,aLine);
                     }else{
@@ -365,7 +386,7 @@ void MapCenter::create()
             <<rLine->color_g
             <<rLine->color_b;
 
-            if(g_sql->exeSql(insertSql,params))
+            if(save(insertSql,params))
             {
                 reverseLines.insert(rLine->id,rLine);
             }else{
@@ -387,7 +408,7 @@ void MapCenter::create()
             <<rLine->color_g
             <<rLine->color_b;
 
-            if(g_sql->exeSql(insertSql,params))
+            if(save(insertSql,params))
             {
                 reverseLines.insert(rLine->id,rLine);
             }else{
@@ -405,6 +426,8 @@ void MapCenter::create()
         g_m_lines.insert(itr.key(),itr.value());
     }
 
+    buildArcs();
+
 
     //4.构建左中右信息 上一线路的key，下一下路的key，然后是 LMRN  L:left,M:middle,R:right,N:noway;就是不通的意思
     //对每个站点的所有连线进行匹配
@@ -424,7 +447,7 @@ void MapCenter::create()
                 QString insertSql = "insert into agv_lmr(lmr_lastLine,lmr_nextLine,lmr_lmr) values(?,?,?);";
                 QList<QVariant> params;
                 params<<p.lastLine<<p.nextLine<<g_m_lmr[p];
-                g_sql->exeSql(insertSql,params);
+                save(insertSql,params);
             }
         }
     }
@@ -469,7 +492,7 @@ void MapCenter::create()
             AgvLine *l = *pos;
             params.clear();
             params<<itr.key()<<l->id;
-            g_sql->exeSql(insertSql,params);
+            save(insertSql,params);
         }
     }
 }
@@ -501,6 +524,34 @@ bool MapCenter::resetMap(QString stationStr, QString lineStr, QString arcStr, QS
     return true;
 }
 
+//文件中每行一项:station=...、line=...、arc=...，格式和创建地图的请求相同，#开头的是注释
+bool MapCenter::loadFromFile(QString fileName)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text)){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"open map file fail:"+fileName);
+        return false;
+    }
+    QString stationStr,lineStr,arcStr;
+    while(!file.atEnd()){
+        QString l = QString::fromUtf8(file.readLine()).trimmed();
+        if(l.isEmpty()||l.startsWith("#"))continue;
+        int pos = l.indexOf("=");
+        if(pos<=0)continue;
+        QString key = l.left(pos).trimmed();
+        QString value = l.mid(pos+1).trimmed();
+        if(key == "station")stationStr = value;
+        else if(key == "line")lineStr = value;
+        else if(key == "arc")arcStr = value;
+    }
+    file.close();
+    if(stationStr.isEmpty()){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"map file has no station:"+fileName);
+        return false;
+    }
+    return resetMap(stationStr,lineStr,arcStr,"");
+}
+
 bool MapCenter::load()
 {
 
@@ -513,6 +564,8 @@ bool MapCenter::load()
     g_m_lmr.clear();
     g_m_l_adj.clear();
     g_reverseLines.clear();
+    if(g_motionEstimator!=NULL)
+        g_motionEstimator->clear();
 
     /// 算法 线路 QMap<int,AgvLine *> g_m_agvlines;
     /// 算法 站点 QMap<int,AgvStation *> g_m_agvstations
@@ -625,8 +678,53 @@ bool MapCenter::load()
         }
     }
 
+    buildArcs();
     return true;
 }
+
+//每条曲线建立弧长表(含反向线路)
+//曲线的长度按弧长重新计算:以前的地图存的是控制点折线的长度，载入时改正并写回数据库
+void MapCenter::buildArcs()
+{
+    QMap<int,BezierArc> built;
+    int fixed = 0;
+    for(QMap<int,AgvLine *>::iterator itr=g_m_lines.begin();itr!=g_m_lines.end();++itr){
+        AgvLine *l = itr.value();
+        if(l->line || !g_m_stations.contains(l->startStation) || !g_m_stations.contains(l->endStation))continue;
+        AgvStation *a = g_m_stations[l->startStation];
+        AgvStation *b = g_m_stations[l->endStation];
+        BezierArc arc(QPointF(a->x,a->y),QPointF(l->p1x,l->p1y),QPointF(l->p2x,l->p2y),QPointF(b->x,b->y));
+        built.insert(l->id,arc);
+
+        //数据库中存的是整数，差不到1的不算变化
+        double length = arc.length();
+        if(fabs(l->length-length)<1)continue;
+        l->length = length;
+        QList<QVariant> params;
+        params<<l->length<<l->id;
+        if(!save("update agv_line set line_length=? where id=?",params))
+            g_log->log(AGV_LOG_LEVEL_ERROR,QString("save length of line %1 fail").arg(l->id));
+        ++fixed;
+    }
+    if(fixed>0)
+        g_log->log(AGV_LOG_LEVEL_INFO,QString("recompute length of %1 arcs").arg(fixed));
+
+    arcsMtx.lock();
+    arcs = built;
+    arcsMtx.unlock();
+}
+
+//弧长表是隐式共享的，复制只是增加引用计数
+bool MapCenter::getArc(int lineId, BezierArc &arc)
+{
+    arcsMtx.lock();
+    QMap<int,BezierArc>::const_iterator itr = arcs.constFind(lineId);
+    bool found = itr!=arcs.constEnd();
+    if(found)arc = itr.value();
+    arcsMtx.unlock();
+    return found;
+}
+
 bool MapCenter::setStationOccuAgv(int station,int occuAgv)
 {
     bool ret = false;
@@ -697,6 +795,36 @@ void MapCenter::freeAgvStation(int agvId,int excepetStation)
 
 }
 
+bool MapCenter::reserveStation(int station,int agvId)
+{
+    if(!g_m_stations.contains(station))return false;
+    AgvStation *s = g_m_stations[station];
+    if(s->reserveAgv!=0 && s->reserveAgv!=agvId)return false;
+    s->reserveAgv = agvId;
+    return true;
+}
+
+void MapCenter::freeStationReserve(int station,int agvId)
+{
+    if(g_m_stations.contains(station) && g_m_stations[station]->reserveAgv == agvId)
+        g_m_stations[station]->reserveAgv = 0;
+}
+
+void MapCenter::freeAgvReserve(int agvId)
+{
+    for(QMap<int,AgvStation *>::iterator itr = g_m_stations.begin();itr!=g_m_stations.end();++itr)
+    {
+        if(itr.value()->reserveAgv == agvId)
+            itr.value()->reserveAgv = 0;
+    }
+}
+
+int MapCenter::getStationReserveAgv(int station)
+{
+    if(!g_m_stations.contains(station))return 0;
+    return g_m_stations[station]->reserveAgv;
+}
+
 int MapCenter::getLineId(int startStation,int endStation)
 {
     int id = 0;
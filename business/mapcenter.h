@@ -4,8 +4,10 @@
 #include <QObject>
 #include <QMap>
 #include <QMutex>
+#include <QVariant>
 #include "bean/agvline.h"
 #include "bean/agvstation.h"
+#include "util/bezierarc.h"
 
 //地图由四个信息描述
 //基本的绘图信息是
@@ -27,6 +29,12 @@ public:
     //2.从数据库中载入地图
     bool load();
 
+    //3.从文本文件载入地图(仿真器使用，一般配合setPersist(false)，不写数据库)
+    bool loadFromFile(QString fileName);
+
+    //创建地图时是否保存到数据库，默认保存
+    void setPersist(bool _persist);
+
     //获取最优路径
     QList<int> getBestPath(int agvId, int lastStation, int startStation, int endStation, int &distance, bool canChangeDirect = false);//最后一个参数是是否可以换个方向
 
@@ -43,6 +51,12 @@ public:
     //释放车辆占用的站点，除了某个站点【因为车辆站在某个站点上】
     void freeAgvStation(int agvId,int excepetStation = 0);
 
+    //预留站点作为车辆后续某一段任务的目的地。预留不影响其他车辆经过，只是分配任务时避开
+    bool reserveStation(int station,int agvId);
+    void freeStationReserve(int station,int agvId);
+    void freeAgvReserve(int agvId);
+    int getStationReserveAgv(int station);
+
     int getLineId(int startStation,int endStation);
 
     AgvStation getAgvStation(int id);
@@ -54,6 +68,10 @@ public:
     AgvLine getAgvLine(int id);
     QMap<int,AgvLine *> getAgvLines();
 
+    //曲线的弧长表(复制一份，地图重新载入后仍然可以用)，直线或者没有的线路返回false
+    //弧长表在zmq线程重新载入地图时重建，不返回指向内部的指针
+    bool getArc(int lineId, BezierArc &arc);
+
     int getReverseLine(int id);
 
     int getLMR(int startLineId,int nextLineId);
@@ -63,15 +81,21 @@ signals:
 public slots:
 
 private:
+    bool save(QString sql, QList<QVariant> params);
     void clear();
     void addStation(QString s);
     void addLine(QString s);
     void addArc(QString s);
     void create();
+    void buildArcs();
 
     QList<int> getPath(int agvId,int lastPoint,int startPoint,int endPoint,int &distance,bool changeDirect);
 
     int getLMR(AgvLine *lastLine,AgvLine *nextLine);
+
+    bool persist;
+    QMap<int,BezierArc> arcs;
+    QMutex arcsMtx;
 };
 
 #endif // MAPCENTER_H
@@ -9,40 +9,47 @@
 MsgCenter::MsgCenter(QObject *parent) : QObject(parent),
     positionPublisher(NULL),
     statusPublisher(NULL),
-    taskPublisher(NULL)
+    taskPublisher(NULL),
+    publishThread(NULL)
 {
 
 }
 
-void MsgCenter::init()
+void MsgCenter::init(int positionRate)
 {
 //    //启动8个线程，同时处理来自client的消息。
 //    for(int i=0;i<8;++i){
 //        UserMsgProcessor *workerThread = new UserMsgProcessor(this);
 //        workerThread->start();
 //    }
-    //启动订阅 小车状态信息的线程
+    if(publishThread==NULL){
+        publishThread = new PublishThread;
+        publishThread->start();
+    }
+
+    //启动订阅 小车状态信息的定时发布
     if(statusPublisher){
         delete statusPublisher;
         statusPublisher=NULL;
     }
     statusPublisher = new AgvStatusPublisher(this);
-    statusPublisher->start();
+    statusPublisher->start(publishThread);
 
-    //启动订阅 小车位置信息的线程
+    //启动订阅 小车位置信息的定时发布
     if(positionPublisher){
         delete positionPublisher;
         positionPublisher=NULL;
     }
     positionPublisher = new AgvPositionPublisher(this);
-    positionPublisher->start();
+    positionPublisher->setRate(positionRate);
+    positionPublisher->start(publishThread);
 
     if(taskPublisher){
         delete taskPublisher;
         taskPublisher = NULL;
     }
     taskPublisher = new AgvTaskPublisher(this);
-    taskPublisher->start();
+    taskPublisher->start(publishThread);
 }
 
 MsgCenter::~MsgCenter()
@@ -50,5 +57,6 @@ MsgCenter::~MsgCenter()
     if(positionPublisher)delete positionPublisher;
     if(statusPublisher)delete statusPublisher;
     if(taskPublisher)delete taskPublisher;
+    if(publishThread)delete publishThread;
 }
 
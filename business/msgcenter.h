@@ -6,6 +6,7 @@
 #include "publisher/agvpositionpublisher.h"
 #include "publisher/agvstatuspublisher.h"
 #include "publisher/agvtaskpublisher.h"
+#include "publisher/publishthread.h"
 //这里将会启动一个CPU个数*2的线程，用于处理用户的数据
 //保证并发量和响应时间
 
@@ -15,7 +16,8 @@ class MsgCenter : public QObject
 public:
     explicit MsgCenter(QObject *parent = nullptr);
     ~MsgCenter();
-    void init();
+    //positionRate:位置每秒发布几次
+    void init(int positionRate = AgvPositionPublisher::DEFAULT_RATE);
 signals:
 
 public slots:
@@ -24,6 +26,7 @@ private:
     AgvPositionPublisher *positionPublisher;
     AgvStatusPublisher *statusPublisher;
     AgvTaskPublisher *taskPublisher;
+    PublishThread *publishThread;//组包、发送在这个线程中，时间轮只负责触发
 };
 
 #endif // MSGCENTER_H
@@ -1,286 +1,453 @@
 ﻿#include "taskcenter.h"
 #include "util/global.h"
+#include <QThread>
+#include <QMetaObject>
 
-TaskCenter::TaskCenter(QObject *parent) : QObject(parent)
+const Task *TaskSnapshot::find(int taskId) const
+{
+    for(int i=0;i<unassigned.length();++i)
+        if(unassigned.at(i)->id == taskId)return unassigned.at(i).get();
+    for(int i=0;i<doing.length();++i)
+        if(doing.at(i)->id == taskId)return doing.at(i).get();
+    return NULL;
+}
+
+TaskCenter::TaskCenter(QObject *parent) : QObject(parent),
+    wakePending(false),
+    snapshot(std::make_shared<TaskSnapshot>()),
+    agingStepValue(TaskQueue::DEFAULT_AGING_STEP),
+    travelSpeed(DEFAULT_TRAVEL_SPEED),
+    preemptTokens(PREEMPT_BURST),
+    preemptRefillTime(0)
 {
 
 }
 
 void TaskCenter::init()
 {
+    unassignedTasks.setTravelEstimate(std::bind(&TaskCenter::expectedTravelMsecs,this,std::placeholders::_1));
+
+    //恢复上次未完成的任务
+    QList<Task *> tasks = g_taskJournal->loadUnfinishedTasks();
+    for(int i=0;i<tasks.length();++i)
+        unassignedTasks.push(tasks.at(i));
+    if(tasks.length()>0)
+        g_log->log(AGV_LOG_LEVEL_INFO,QString("restore %1 unfinished tasks").arg(tasks.length()));
+    publishSnapshot();
+
     connect(g_hrgAgvCenter,SIGNAL(carArriveStation(int,int)),this,SLOT(carArriveStation(int,int)));
     connect(g_hrgAgvCenter,SIGNAL(pickFinish(int)),this,SLOT(onPickFinish(int)));
     connect(g_hrgAgvCenter,SIGNAL(putFinish(int)),this,SLOT(onPutFinish(int)));
     connect(g_hrgAgvCenter,SIGNAL(standByFinish(int)),this,SLOT(onStandByFinish(int)));
+    connect(g_hrgAgvCenter,SIGNAL(agvDisconnected(int)),this,SLOT(onAgvDisconnected(int)));
     //每隔一秒对尚未分配进行的任务进行分配
     taskProcessTimer.setInterval(1000);
     connect(&taskProcessTimer,SIGNAL(timeout()),this,SLOT(unassignedTasksProcess()));
     taskProcessTimer.start();
 }
 
-int TaskCenter::makeAgvAimTask(int agvId, int aimStation, int priority)
+bool TaskCenter::inOwnerThread()
+{
+    return QThread::currentThread() == thread();
+}
+
+//通知调度线程处理队列。已经通知过还没处理的，不再重复通知
+void TaskCenter::wake()
+{
+    if(!wakePending.exchange(true))
+        QMetaObject::invokeMethod(this,"processQueues",Qt::QueuedConnection);
+}
+
+//新任务:分配ID，记入日志，交给调度线程放入未分配队列
+int TaskCenter::addNewTask(Task *newtask)
+{
+    newtask->id = g_taskJournal->nextTaskId();
+    newtask->queueTime = newtask->produceTime;
+    g_taskJournal->append(newtask);
+    stats.onTaskCreated(newtask);
+
+    int taskId = newtask->id;
+    if(inOwnerThread()){
+        acceptTask(newtask);
+    }else{
+        intakeQueue.enqueue(newtask);
+        wake();
+    }
+    return taskId;
+}
+
+void TaskCenter::acceptTask(Task *newtask)
+{
+    int taskId = newtask->id;
+    int pickStation = newtask->getGoodStation;
+    unassignedTasks.push(newtask);
+
+    emit sigTaskNew(taskId,pickStation);
+}
+
+//其他线程的命令放入队列，等待调度线程执行完返回结果
+int TaskCenter::runCommand(TaskCommand cmd)
+{
+    if(inOwnerThread())return doCommand(cmd);
+
+    std::promise<int> result;
+    std::future<int> future = result.get_future();
+    cmd.result = &result;
+    commandQueue.enqueue(cmd);
+    wake();
+    return future.get();
+}
+
+int TaskCenter::doCommand(const TaskCommand &cmd)
+{
+    switch(cmd.type){
+    case TaskCommand::CANCEL:
+        return doCancelTask(cmd.taskId);
+    case TaskCommand::RESCHEDULE:
+        return doRescheduleTask(cmd.taskId,cmd.priority,cmd.changeDeadline,cmd.deadline)?1:0;
+    case TaskCommand::AGING:
+        unassignedTasks.setAgingStep(cmd.agingStep);
+        agingStepValue.store(unassignedTasks.getAgingStep());
+        return 1;
+    case TaskCommand::RELEASE:
+        return doReleaseAgv(cmd.agvId,cmd.cancel);
+    default:
+        return 0;
+    }
+}
+
+void TaskCenter::processQueues()
+{
+    drainQueues();
+    publishSnapshot();
+}
+
+//调度线程:依次处理新任务、车辆事件、命令
+void TaskCenter::drainQueues()
+{
+    wakePending.store(false);
+
+    Task *tasks[64];
+    size_t count;
+    while((count = intakeQueue.try_dequeue_bulk(tasks,64))>0){
+        for(size_t i=0;i<count;++i)
+            acceptTask(tasks[i]);
+    }
+
+    TaskEvent event;
+    while(eventQueue.try_dequeue(event)){
+        switch(event.type){
+        case TaskEvent::ARRIVE_STATION:carArriveStation(event.agvId,event.station);break;
+        case TaskEvent::PICK_FINISH:onPickFinish(event.agvId);break;
+        case TaskEvent::PUT_FINISH:onPutFinish(event.agvId);break;
+        case TaskEvent::STANDBY_FINISH:onStandByFinish(event.agvId);break;
+        case TaskEvent::AGV_DISCONNECTED:onAgvDisconnected(event.agvId);break;
+        default:break;
+        }
+    }
+
+    TaskCommand cmd;
+    while(commandQueue.try_dequeue(cmd)){
+        int result = doCommand(cmd);
+        if(cmd.result!=NULL)cmd.result->set_value(result);
+    }
+}
+
+//发布任务的快照给其他线程读。只有上次发布之后改过的任务重新复制，没改过的和上一个快照共用同一份
+void TaskCenter::publishSnapshot()
+{
+    std::shared_ptr<TaskSnapshot> s = std::make_shared<TaskSnapshot>();
+    QHash<int,TaskCopyPtr> copies;
+    QList<Task *> undos = unassignedTasks.toList();
+    for(int i=0;i<undos.length();++i)
+        s->unassigned.append(copyForSnapshot(undos.at(i),copies));
+    for(int i=0;i<doingTasks.length();++i)
+        s->doing.append(copyForSnapshot(doingTasks.at(i),copies));
+    //已经不在队列中的任务的复制，随旧的快照一起释放
+    taskCopies.swap(copies);
+    changedTasks.clear();
+    std::atomic_store(&snapshot,TaskSnapshotPtr(s));
+}
+
+TaskCopyPtr TaskCenter::copyForSnapshot(Task *task, QHash<int,TaskCopyPtr> &copies)
+{
+    TaskCopyPtr copy = taskCopies.value(task->id);
+    if(!copy || changedTasks.contains(task->id))
+        copy = std::make_shared<const Task>(*task);
+    copies.insert(task->id,copy);
+    return copy;
+}
+
+//调度线程:任务改变后记入日志，下次发布快照时重新复制
+void TaskCenter::journal(Task *task)
+{
+    g_taskJournal->append(task);
+    changedTasks.insert(task->id);
+}
+
+//车辆事件来自其他线程时，放入队列由调度线程处理
+void TaskCenter::postEvent(int type, int agvId, int station)
+{
+    TaskEvent event;
+    event.type = type;
+    event.agvId = agvId;
+    event.station = station;
+    eventQueue.enqueue(event);
+    wake();
+}
+
+TaskSnapshotPtr TaskCenter::getSnapshot()
+{
+    return std::atomic_load(&snapshot);
+}
+
+QList<Task *> TaskCenter::getUnassignedTasks()
+{
+    return unassignedTasks.toList();
+}
+
+void TaskCenter::setAgingStep(qint64 agingStep)
+{
+    TaskCommand cmd;
+    cmd.type = TaskCommand::AGING;
+    cmd.agingStep = agingStep;
+    runCommand(cmd);
+}
+
+qint64 TaskCenter::getAgingStep()
+{
+    return agingStepValue.load();
+}
+
+void TaskCenter::setTravelSpeed(double mmPerSecond)
+{
+    if(mmPerSecond<=0)return ;
+    travelSpeed = mmPerSecond;
+    unassignedTasks.rebuild();
+}
+
+bool TaskCenter::rescheduleTask(int taskId, int priority, bool changeDeadline, QDateTime deadline)
+{
+    if(priority>Task::PRIORITY_VERY_HIGH)return false;
+    TaskCommand cmd;
+    cmd.type = TaskCommand::RESCHEDULE;
+    cmd.taskId = taskId;
+    cmd.priority = priority;
+    cmd.changeDeadline = changeDeadline;
+    cmd.deadline = deadline;
+    return runCommand(cmd)==1;
+}
+
+//只修改给出的字段
+bool TaskCenter::doRescheduleTask(int taskId, int priority, bool changeDeadline, QDateTime deadline)
+{
+    //未分配的，调整在队列中的位置
+    Task *task = unassignedTasks.find(taskId);
+    if(task!=NULL){
+        if(priority>=Task::PRIORITY_VERY_LOW)task->priority = priority;
+        if(changeDeadline)task->deadline = deadline;
+        unassignedTasks.update(task);
+        journal(task);
+        return true;
+    }
+
+    //正在执行的，对后续的几段生效
+    bool find = false;
+    for(int i=0;i<doingTasks.length();++i){
+        if(doingTasks.at(i)->id == taskId){
+            task = doingTasks.at(i);
+            if(priority>=Task::PRIORITY_VERY_LOW)task->priority = priority;
+            if(changeDeadline)task->deadline = deadline;
+            journal(task);
+            find = true;
+            break;
+        }
+    }
+    return find;
+}
+
+int TaskCenter::releaseAgv(int agvId, bool cancel)
+{
+    TaskCommand cmd;
+    cmd.type = TaskCommand::RELEASE;
+    cmd.agvId = agvId;
+    cmd.cancel = cancel;
+    return runCommand(cmd);
+}
+
+int TaskCenter::doReleaseAgv(int agvId, bool cancel)
+{
+    if(agvId>0){
+        Agv *agv = g_m_agvs.value(agvId,NULL);
+        if(agv==NULL)return 0;
+        return releaseOneAgv(agv,cancel)?1:0;
+    }
+    int count = 0;
+    for(QMap<int,Agv *>::iterator itr=g_m_agvs.begin();itr!=g_m_agvs.end();++itr){
+        if(releaseOneAgv(itr.value(),cancel))++count;
+    }
+    return count;
+}
+
+//急停时正在执行的任务:停下的位置可能在线路中间，和断开重连一样释放占用、放回未分配队列，
+//车辆保留agv->task，由分配时从当前位置重新规划这一段。在未分配队列中等这辆车的任务，解除后自然会继续
+bool TaskCenter::releaseOneAgv(Agv *agv, bool cancel)
+{
+    if(agv==NULL || !agv->isStopped())return false;
+    agv->releaseStop();
+    if(agv->task<=0)return true;
+
+    if(cancel){
+        int taskId = agv->task;
+        doCancelTask(taskId);
+        g_log->log(AGV_LOG_LEVEL_WARN,QString("agv %1 released from emergency stop, task %2 cancelled").arg(agv->id).arg(taskId));
+        return true;
+    }
+
+    Task *task = queryDoingTask(agv->task);
+    if(task==NULL)return true;
+    g_hrgAgvCenter->agvCancelTask(agv->id);
+    g_agvMapCenter->freeAgvReserve(agv->id);
+    agv->currentPath.clear();
+    doingTasks.removeAll(task);
+    task->status = Task::AGV_TASK_STATUS_UNEXCUTE;
+    journal(task);
+    agv->task = task->id;
+    agv->status = Agv::AGV_STATUS_TASKING;
+    unassignedTasks.push(task);
+    g_log->log(AGV_LOG_LEVEL_WARN,QString("agv %1 released from emergency stop, task %2 resumes").arg(agv->id).arg(task->id));
+    return true;
+}
+
+int TaskCenter::makeAgvAimTask(int agvId, int aimStation, int priority, QDateTime deadline)
 {
     if(agvId<=0||aimStation<=0)return -1;
 
     Task *newtask = new Task;
 
     //赋值
-    newtask->produceTime = (QDateTime::currentDateTime());
+    newtask->produceTime = (getCurrentDateTime());
     newtask->standByStation = aimStation;
     newtask->priority = priority;
+    newtask->deadline = deadline;
     newtask->excuteCar = agvId;
+    newtask->agvFixed = true;
     newtask->currentDoIndex = Task::INDEX_GOING_STANDBY;
 
-    //插入记录
-    QString insertSql = "INSERT INTO agv_task (task_produceTime,task_excuteCar,task_status,task_circle,task_priority,task_currentDoIndex,task_getGoodStation,task_getGoodDirect,task_getGoodDistance,task_putGoodStation,task_putGoodDirect,task_putGoodDistance,task_standByStation) VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?);SELECT @@Identity;";
-    QList<QVariant> params;
-    params<<newtask->produceTime
-         <<newtask->excuteCar
-        <<newtask->status
-       <<newtask->circle
-      <<newtask->priority
-     <<newtask->currentDoIndex
-    <<newtask->getGoodStation
-    <<newtask->getGoodDirect
-    <<newtask->getGoodDistance
-    <<newtask->putGoodStation
-    <<newtask->putGoodDirect
-    <<newtask->putGoodDistance
-    <<newtask->standByStation;
-    QList<QList<QVariant> > result = g_sql->query(insertSql,params);
-    if(result.length()<=0||result.at(0).length()<=0)
-    {
-        delete newtask;
-        return -1;
-    }
-    newtask->id = (result.at(0).at(0).toInt());
-
-
-    uTaskMtx.lock();
-    unassignedTasks.append(newtask);
-    qSort(unassignedTasks.begin(),unassignedTasks.end(),agvTaskLessThan);
-    uTaskMtx.unlock();
-    return newtask->id;
+    return addNewTask(newtask);
 }
 
 //由最方便的车辆到达某个站点
-int TaskCenter::makeAimTask(int aimStation,int priority)
+int TaskCenter::makeAimTask(int aimStation,int priority, QDateTime deadline)
 {
     if(aimStation<=0)return -1;
 
     Task *newtask = new Task;
 
     //赋值
-    newtask->produceTime = (QDateTime::currentDateTime());
+    newtask->produceTime = (getCurrentDateTime());
     newtask->standByStation = aimStation;
     newtask->priority = priority;
+    newtask->deadline = deadline;
     newtask->currentDoIndex = Task::INDEX_GOING_STANDBY;
 
-    //插入记录
-    QString insertSql = "INSERT INTO agv_task (task_produceTime,task_excuteCar,task_status,task_circle,task_priority,task_currentDoIndex,task_getGoodStation,task_getGoodDirect,task_getGoodDistance,task_putGoodStation,task_putGoodDirect,task_putGoodDistance,task_standByStation) VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?);SELECT @@Identity;";
-    QList<QVariant> params;
-    params<<newtask->produceTime
-         <<newtask->excuteCar
-        <<newtask->status
-       <<newtask->circle
-      <<newtask->priority
-     <<newtask->currentDoIndex
-    <<newtask->getGoodStation
-    <<newtask->getGoodDirect
-    <<newtask->getGoodDistance
-    <<newtask->putGoodStation
-    <<newtask->putGoodDirect
-    <<newtask->putGoodDistance
-    <<newtask->standByStation;
-    QList<QList<QVariant> > result = g_sql->query(insertSql,params);
-    if(result.length()<=0||result.at(0).length()<=0)
-    {
-        delete newtask;
-        return -1;
-    }
-    newtask->id = (result.at(0).at(0).toInt());
-
-    uTaskMtx.lock();
-    unassignedTasks.append(newtask);
-    qSort(unassignedTasks.begin(),unassignedTasks.end(),agvTaskLessThan);
-    uTaskMtx.unlock();
-    return newtask->id;
+    return addNewTask(newtask);
 }
 
-int TaskCenter::makeAgvPickupTask(int agvId,int pickupStation,int aimStation,int standByStation,int priority)
+int TaskCenter::makeAgvPickupTask(int agvId,int pickupStation,int aimStation,int standByStation,int priority, QDateTime deadline)
 {
     Task *newtask = new Task;
 
     //赋值
-    newtask->produceTime = (QDateTime::currentDateTime());
+    newtask->produceTime = (getCurrentDateTime());
     newtask->excuteCar = agvId;
+    newtask->agvFixed = true;
     newtask->getGoodStation = pickupStation;
     newtask->putGoodStation = aimStation;
     newtask->standByStation = standByStation;
     newtask->priority = priority;
+    newtask->deadline = deadline;
     newtask->currentDoIndex = Task::INDEX_GETTING_GOOD;
 
-    //插入记录
-    QString insertSql = "INSERT INTO agv_task (task_produceTime,task_excuteCar,task_status,task_circle,task_priority,task_currentDoIndex,task_getGoodStation,task_getGoodDirect,task_getGoodDistance,task_putGoodStation,task_putGoodDirect,task_putGoodDistance,task_standByStation) VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?);SELECT @@Identity;";
-    QList<QVariant> params;
-    params<<newtask->produceTime
-         <<newtask->excuteCar
-        <<newtask->status
-       <<newtask->circle
-      <<newtask->priority
-     <<newtask->currentDoIndex
-    <<newtask->getGoodStation
-    <<newtask->getGoodDirect
-    <<newtask->getGoodDistance
-    <<newtask->putGoodStation
-    <<newtask->putGoodDirect
-    <<newtask->putGoodDistance
-    <<newtask->standByStation;
-    QList<QList<QVariant> > result = g_sql->query(insertSql,params);
-    if(result.length()<=0||result.at(0).length()<=0)
-    {
-        delete newtask;
-        return -1;
-    }
-    newtask->id = (result.at(0).at(0).toInt());
-
-
-    uTaskMtx.lock();
-    unassignedTasks.append(newtask);
-    qSort(unassignedTasks.begin(),unassignedTasks.end(),agvTaskLessThan);
-    uTaskMtx.unlock();
-    return newtask->id;
+    return addNewTask(newtask);
 }
 
 
 ///产生一个任务，这个任务的参数可能有很多，暂时只有一个，就是目的地,返回一个任务的ID。根据这个ID。可以取消任务
-int TaskCenter::makePickupTask(int pickupStation, int aimStation, int standByStation, int priority)
+int TaskCenter::makePickupTask(int pickupStation, int aimStation, int standByStation, int priority, QDateTime deadline)
 {
     Task *newtask = new Task;
 
     //赋值
-    newtask->produceTime = (QDateTime::currentDateTime());
+    newtask->produceTime = (getCurrentDateTime());
     newtask->getGoodStation = pickupStation;
     newtask->putGoodStation = aimStation;
     newtask->standByStation = standByStation;
     newtask->priority = priority;
+    newtask->deadline = deadline;
     newtask->currentDoIndex = Task::INDEX_GETTING_GOOD;
 
-    //插入记录
-    QString insertSql = "INSERT INTO agv_task (task_produceTime,task_excuteCar,task_status,task_circle,task_priority,task_currentDoIndex,task_getGoodStation,task_getGoodDirect,task_getGoodDistance,task_putGoodStation,task_putGoodDirect,task_putGoodDistance,task_standByStation) VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?);SELECT @@Identity;";
-    QList<QVariant> params;
-    params<<newtask->produceTime
-         <<newtask->excuteCar
-        <<newtask->status
-       <<newtask->circle
-      <<newtask->priority
-     <<newtask->currentDoIndex
-    <<newtask->getGoodStation
-    <<newtask->getGoodDirect
-    <<newtask->getGoodDistance
-    <<newtask->putGoodStation
-    <<newtask->putGoodDirect
-    <<newtask->putGoodDistance
-    <<newtask->standByStation;
-    QList<QList<QVariant> > result = g_sql->query(insertSql,params);
-    if(result.length()<=0||result.at(0).length()<=0)
-    {
-        delete newtask;
-        return -1;
-    }
-    newtask->id = (result.at(0).at(0).toInt());
-
-    uTaskMtx.lock();
-    unassignedTasks.append(newtask);
-    qSort(unassignedTasks.begin(),unassignedTasks.end(),agvTaskLessThan);
-    uTaskMtx.unlock();
-    return newtask->id;
+    return addNewTask(newtask);
 }
 
 
-int TaskCenter::makeLoopTask(int agvId, int pickupStation, int aimStation, int standByStation, int priority)
+int TaskCenter::makeLoopTask(int agvId, int pickupStation, int aimStation, int standByStation, int priority, QDateTime deadline)
 {
     //产生一个一直循环的任务
     Task *newtask = new Task;
     //赋值
-    newtask->produceTime = (QDateTime::currentDateTime());
+    newtask->produceTime = (getCurrentDateTime());
     newtask->excuteCar = agvId;
+    newtask->agvFixed = true;
     newtask->getGoodStation = pickupStation;
     newtask->putGoodStation = aimStation;
     newtask->standByStation = standByStation;
     newtask->priority = priority;
+    newtask->deadline = deadline;
     newtask->currentDoIndex = Task::INDEX_GETTING_GOOD;
     newtask->circle = true;
 
-    //插入记录
-    QString insertSql = "INSERT INTO agv_task (task_produceTime,task_excuteCar,task_status,task_circle,task_priority,task_currentDoIndex,task_getGoodStation,task_getGoodDirect,task_getGoodDistance,task_putGoodStation,task_putGoodDirect,task_putGoodDistance,task_standByStation) VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?);SELECT @@Identity;";
-    QList<QVariant> params;
-    params<<newtask->produceTime
-         <<newtask->excuteCar
-        <<newtask->status
-       <<newtask->circle
-      <<newtask->priority
-     <<newtask->currentDoIndex
-    <<newtask->getGoodStation
-    <<newtask->getGoodDirect
-    <<newtask->getGoodDistance
-    <<newtask->putGoodStation
-    <<newtask->putGoodDirect
-    <<newtask->putGoodDistance
-    <<newtask->standByStation;
-    QList<QList<QVariant> > result = g_sql->query(insertSql,params);
-    if(result.length()<=0||result.at(0).length()<=0)
-    {
-        delete newtask;
-        return -1;
-    }
-    newtask->id = (result.at(0).at(0).toInt());
-
-    uTaskMtx.lock();
-    unassignedTasks.append(newtask);
-    qSort(unassignedTasks.begin(),unassignedTasks.end(),agvTaskLessThan);
-    uTaskMtx.unlock();
-    return newtask->id;
+    return addNewTask(newtask);
 }
 
 
 Task *TaskCenter::queryUndoTask(int taskId)
 {
-    Task *t = NULL;
-    uTaskMtx.lock();
-    for(int i=0;i<unassignedTasks.length();++i){
-        if(unassignedTasks.at(i)->id == taskId){
-            t = unassignedTasks.at(i);
-            break;
-        }
-    }
-    uTaskMtx.unlock();
+    Task *t = unassignedTasks.find(taskId);
     return t;
 }
 
 Task *TaskCenter::queryDoingTask(int taskId)
 {
     Task *t = NULL;
-    dTaskMtx.lock();
     for(int i=0;i<doingTasks.length();++i){
         if(doingTasks.at(i)->id == taskId){
             t = doingTasks.at(i);
         }
     }
-    dTaskMtx.unlock();
     return t;
 }
 
+//可以在任意线程调用，返回的任务由调用者释放
 Task *TaskCenter::queryDoneTask(int taskId)
 {
-    //查找已完成的任务
-    Task *result = NULL;
-    QString querySql = "select id,task_produceTime,task_doTime,task_doneTime,task_excuteCar,task_status,task_circle,task_priority,task_currentDoIndex,task_getGoodStation,task_getGoodDirect,task_getGoodDistance,task_getStartTime,task_getFinishTime,task_putGoodStation,task_putGoodDirect,task_putGoodDistance,task_putStartTime,task_putFinishTime,task_standByStation,task_standByStartTime,task_standByFinishTime from agv_task where id= ?";
+    //最近结束的任务
+    Task *result = history.find(taskId);
+    if(result!=NULL)return result;
+    //查找已完成的任务(可能还没有写入数据库)
+    result = g_taskJournal->queryUnapplied(taskId);
+    if(result!=NULL)return result;
+    //没有分配过的id，或者刚查过不存在的
+    if(taskId<=0 || taskId>g_taskJournal->getMaxTaskId() || history.isMissing(taskId))
+        return NULL;
+    QString querySql = "select id,task_produceTime,task_doTime,task_doneTime,task_excuteCar,task_status,task_circle,task_priority,task_currentDoIndex,task_getGoodStation,task_getGoodDirect,task_getGoodDistance,task_getStartTime,task_getFinishTime,task_putGoodStation,task_putGoodDirect,task_putGoodDistance,task_putStartTime,task_putFinishTime,task_standByStation,task_standByStartTime,task_standByFinishTime,task_deadline from agv_task where id= ?";
     QList<QVariant> param;
     param.append(taskId);
     QList<QList<QVariant>> queryresult = g_sql->query(querySql,param);
-    if(queryresult.length()==0 ||queryresult.at(0).length()!=22)
+    if(queryresult.length()==0 ||queryresult.at(0).length()!=23){
+        history.putMissing(taskId);
         return result;
+    }
     //这个任务是存在的
     result = new Task;
 
@@ -306,71 +473,90 @@ Task *TaskCenter::queryDoneTask(int taskId)
     result->standByStation = (queryresult.at(0).at(19).toInt());
     result->standByStartTime = (queryresult.at(0).at(20).toDateTime());
     result->standByFinishTime = (queryresult.at(0).at(21).toDateTime());
+    result->deadline = (queryresult.at(0).at(22).toDateTime());
 
+    //已经结束的任务不会再变化，放入缓存
+    if(result->status>=Task::AGV_TASK_STATUS_DONE)
+        history.put(result);
     return result;
 }
 
-//返回task的状态。
+//返回task的状态。可以在任意线程调用
 int TaskCenter::queryTaskStatus(int taskId)
 {
-    //查找未分配的任务
-    uTaskMtx.lock();
-    for(int i=0;i<unassignedTasks.length();++i){
-        if(unassignedTasks.at(i)->id == taskId){
-            uTaskMtx.unlock();
+    //查找未分配的、正在执行的任务
+    TaskSnapshotPtr s = getSnapshot();
+    for(int i=0;i<s->unassigned.length();++i){
+        if(s->unassigned.at(i)->id == taskId)
             return Task::AGV_TASK_STATUS_UNEXCUTE;
-        }
     }
-    uTaskMtx.unlock();
-    //查找正在执行的任务
-    dTaskMtx.lock();
-    for(int i=0;i<doingTasks.length();++i){
-        if(doingTasks.at(i)->id == taskId){
-            dTaskMtx.unlock();
+    for(int i=0;i<s->doing.length();++i){
+        if(s->doing.at(i)->id == taskId)
             return Task::AGV_TASK_STATUS_EXCUTING;
-        }
     }
-    dTaskMtx.unlock();
-    //查找已完成的任务
-    QString querySql = "select task_status from agv_task where id= ?";
-    QList<QVariant> param;
-    param.append(taskId);
-    QList<QList<QVariant> > queryresult = g_sql->query(querySql,param);
-    if(queryresult.length()==0 ||queryresult.at(0).length()==0)
+    //最近结束的任务
+    int status;
+    if(history.findStatus(taskId,status))
+        return status;
+    //查找已完成的任务(包括刚产生还没进入快照的任务)
+    Task *unapplied = g_taskJournal->queryUnapplied(taskId);
+    if(unapplied!=NULL){
+        status = unapplied->status;
+        delete unapplied;
+        return status;
+    }
+    //没有分配过的id，或者刚查过不存在的
+    if(taskId<=0 || taskId>g_taskJournal->getMaxTaskId() || history.isMissing(taskId))
         return Task::AGV_TASK_STATUS_UNEXIST;
-    return queryresult.at(0).at(0).toInt();
+    //从数据库查出整个任务，放入缓存，接下来的详情查询也不用再查数据库
+    Task *task = queryDoneTask(taskId);
+    if(task==NULL)
+        return Task::AGV_TASK_STATUS_UNEXIST;
+    status = task->status;
+    delete task;
+    return status;
 }
 
 //取消一个任务
 int TaskCenter::cancelTask(int taskId)
+{
+    TaskCommand cmd;
+    cmd.type = TaskCommand::CANCEL;
+    cmd.taskId = taskId;
+    return runCommand(cmd);
+}
+
+int TaskCenter::doCancelTask(int taskId)
 {
     //查找未分配的任务
-    uTaskMtx.lock();
-    for(int i=0;i<unassignedTasks.length();++i){
-        if(unassignedTasks.at(i)->id == taskId){
-            Task *task = unassignedTasks.at(i);
-            //置为取消
-            task->status = (Task::AGV_TASK_STATSU_CANCEL);
-            //移出待分配的队列
-            unassignedTasks.removeAt(i);
-            //保存数据库:
-            QString updateSql = "upadte agv_task set task_status=? where id = ?";
-            QList<QVariant> args;
-            args<<task->status<<task->id;
-            if(!g_sql->exeSql(updateSql,args))
-            {
-                g_log->log(AGV_LOG_LEVEL_ERROR,"task with ID:"+QString("%1").arg(task->id)+" has been cancel,but save it to database fail!");
+    Task *utask = unassignedTasks.find(taskId);
+    if(utask!=NULL){
+        //已经执行了一部分的任务，释放为它预留的站点。等着做下一段的车辆空闲下来
+        if(utask->excuteCar>0 && utask->doTime.isValid()){
+            g_agvMapCenter->freeAgvReserve(utask->excuteCar);
+            Agv *agv = g_m_agvs.value(utask->excuteCar,NULL);
+            if(agv!=NULL && agv->task==utask->id){
+                agv->task = 0;
+                if(agv->status==Agv::AGV_STATUS_TASKING)
+                    agv->status = Agv::AGV_STATUS_IDLE;
             }
-            //释放
-            delete task;
-            uTaskMtx.unlock();
-            return 1;
         }
+        //置为取消
+        utask->status = (Task::AGV_TASK_STATSU_CANCEL);
+        utask->doneTime = getCurrentDateTime();
+        //移出待分配的队列
+        unassignedTasks.remove(utask);
+        preemptedTasks.remove(utask->id);
+        //记入日志，由日志线程写入数据库
+        journal(utask);
+        stats.onTaskCancelled(utask);
+        history.put(utask);
+        //释放
+        delete utask;
+        return 1;
     }
-    uTaskMtx.unlock();
 
     //查找正在执行的任务
-    dTaskMtx.lock();
     for(int i=0;i<doingTasks.length();++i)
     {
         if(doingTasks.at(i)->id == taskId){
@@ -378,39 +564,55 @@ int TaskCenter::cancelTask(int taskId)
 
             ////1.告诉小车，任务取消了
             g_hrgAgvCenter->agvCancelTask(task->excuteCar);
+            g_agvMapCenter->freeAgvReserve(task->excuteCar);
 
             ////2.对任务进行状态设置
             //置为取消
             task->status = (Task::AGV_TASK_STATSU_CANCEL);
+            task->doneTime = getCurrentDateTime();
             //移出待分配的队列
             doingTasks.removeAt(i);
-            //保存数据库:
-            QString updateSql = "upadte agv_task set task_status=? where id = ?";
-            QList<QVariant> args;
-            args<<task->status<<task->id;
-            if(!g_sql->exeSql(updateSql,args))
-            {
-                g_log->log(AGV_LOG_LEVEL_ERROR,"task with ID:"+QString("%1").arg(task->id)+" has been cancel,but save it to database fail!");
-            }
+            preemptedTasks.remove(task->id);
+            //记入日志，由日志线程写入数据库
+            journal(task);
+            stats.onTaskCancelled(task);
+            history.put(task);
             //释放
             delete task;
-            dTaskMtx.unlock();
             return 2;
         }
     }
-    dTaskMtx.unlock();
     return 0;
 }
 
 //释放道路占用
 void TaskCenter::carArriveStation(int car,int station)
 {
+    if(!inOwnerThread()){
+        postEvent(TaskEvent::ARRIVE_STATION,car,station);
+        return ;
+    }
     if(!g_m_agvs.contains(car))return ;
     Agv *agv =g_m_agvs[car];
     //达到的站点
     AgvStation sstation = g_agvMapCenter->getAgvStation(station);
     if(sstation.id<=0)return ;
 
+    //到达了当前任务这一段的目的地，记录到达时间
+    Task *task = queryDoingTask(agv->task);
+    if(task!=NULL && !task->arriveTime.isValid()){
+        int aimStation = task->standByStation;
+        if(task->currentDoIndex==Task::INDEX_GETTING_GOOD)
+            aimStation = task->getGoodStation;
+        else if(task->currentDoIndex==Task::INDEX_PUTTING_GOOD)
+            aimStation = task->putGoodStation;
+        if(aimStation == station){
+            task->arriveTime = getCurrentDateTime();
+            changedTasks.insert(task->id);
+            stats.onTaskArrive(task);
+        }
+    }
+
     //小车是手动模式，那么就不管了
     if(agv->mode == Agv::AGV_MODE_HAND){
         return ;
@@ -463,92 +665,443 @@ void TaskCenter::carArriveStation(int car,int station)
 }
 
 
-//取货OK，那么把任务设置成送货状态放回未分配队列
+//取货OK，接着去送货
 void  TaskCenter::onPickFinish(int agvId)
 {
-    Agv *agv = g_m_agvs[agvId];
+    if(!inOwnerThread()){
+        postEvent(TaskEvent::PICK_FINISH,agvId);
+        return ;
+    }
+    Agv *agv = g_m_agvs.value(agvId,NULL);//车辆可能已经删除
+    if(agv==NULL)return ;
     Task *task =queryDoingTask(agv->task);
     if(task==NULL)return ;
     if(task->currentDoIndex != Task::INDEX_GETTING_GOOD)return ;
 
-    dTaskMtx.lock();
     doingTasks.removeAll(task);
-    dTaskMtx.unlock();
 
+    task->getFinishTime = getCurrentDateTime();
+    stats.onPickFinish(task);
     task->currentDoIndex = Task::INDEX_PUTTING_GOOD;
+    task->queueTime = task->getFinishTime;
+    task->arriveTime = QDateTime();
+    journal(task);
 
-    uTaskMtx.lock();
-    unassignedTasks.append(task);
-    uTaskMtx.unlock();
+    continueTask(task,agv);
 }
 
-//放货OK，那么把任务设置成去到固定地点，放回未分配队列
+//放货OK，接着去待命点
 void  TaskCenter::onPutFinish(int agvId)
 {
-    Agv *agv = g_m_agvs[agvId];
+    if(!inOwnerThread()){
+        postEvent(TaskEvent::PUT_FINISH,agvId);
+        return ;
+    }
+    Agv *agv = g_m_agvs.value(agvId,NULL);//车辆可能已经删除
+    if(agv==NULL)return ;
     Task *task =queryDoingTask(agv->task);
     if(task==NULL)return ;
     if(task->currentDoIndex != Task::INDEX_PUTTING_GOOD)return ;
 
-    dTaskMtx.lock();
     doingTasks.removeAll(task);
-    dTaskMtx.unlock();
 
+    task->putFinishTime = getCurrentDateTime();
+    stats.onTaskDelivered(task,task->putFinishTime);
     task->currentDoIndex = Task::INDEX_GOING_STANDBY;
+    task->queueTime = task->putFinishTime;
+    task->arriveTime = QDateTime();
+    journal(task);
 
-    uTaskMtx.lock();
-    unassignedTasks.append(task);
-    uTaskMtx.unlock();
+    continueTask(task,agv);
 }
 
 //任务完成了！
 void  TaskCenter::onStandByFinish(int agvId)
 {
-    Agv *agv = g_m_agvs[agvId];
+    if(!inOwnerThread()){
+        postEvent(TaskEvent::STANDBY_FINISH,agvId);
+        return ;
+    }
+    Agv *agv = g_m_agvs.value(agvId,NULL);//车辆可能已经删除
+    if(agv==NULL)return ;
     Task *task =queryDoingTask(agv->task);
     if(task==NULL)return ;
     if(task->currentDoIndex != Task::INDEX_GOING_STANDBY)return ;
 
+    task->standByFinishTime = getCurrentDateTime();
     if(task->circle){
-        dTaskMtx.lock();
         doingTasks.removeAll(task);
-        dTaskMtx.unlock();
 
+        stats.onTaskFinished(task);
         task->currentDoIndex = Task::INDEX_GETTING_GOOD;
+        task->queueTime = task->standByFinishTime;
+        task->arriveTime = QDateTime();
+        journal(task);
 
-        uTaskMtx.lock();
-        unassignedTasks.append(task);
-        uTaskMtx.unlock();
-
+        //循环任务，同一辆车直接开始下一轮
+        continueTask(task,agv);
     }else{
-        dTaskMtx.lock();
         doingTasks.removeAll(task);
-        dTaskMtx.unlock();
+        preemptedTasks.remove(task->id);
+
+        task->doneTime = task->standByFinishTime;
+        task->status = Task::AGV_TASK_STATUS_DONE;
+        journal(task);
+        history.put(task);
+        stats.onTaskFinished(task);
+        //直接去目的地的任务，到达就是送达
+        if(task->putGoodStation<=0)
+            stats.onTaskDelivered(task,task->standByFinishTime);
+        emit sigTaskFinish(task->id);
+
         delete task;
         task = NULL;
     }
 }
 
-//这里不怕unassignedTasksProcess和doingTaskProcess中两个锁死锁，是以为它俩是同在主线程中，所以不必担心死锁问题
+//车辆断开了:已经不参与调度，释放它前方的线路、站点和预留(在线路中间的保留当前线路，所在的站点保留)
+//手上的任务放回未分配队列。空车去取货还没到达的，任何车辆都可以接；
+//已经取了货的、指定车辆的、循环任务，仍然由这辆车执行:车辆保留agv->task，重连后不是空闲而是等这一段的状态，
+//不会被其他任务、抢占拿走，由未分配队列从所在位置继续这一段
+void TaskCenter::onAgvDisconnected(int agvId)
+{
+    if(!inOwnerThread()){
+        postEvent(TaskEvent::AGV_DISCONNECTED,agvId);
+        return ;
+    }
+    Agv *agv = g_m_agvs.value(agvId,NULL);
+    if(agv==NULL)return ;
+    Task *task = queryDoingTask(agv->task);
+
+    g_hrgAgvCenter->agvCancelTask(agvId);
+    g_agvMapCenter->freeAgvReserve(agvId);
+    agv->task = 0;
+    agv->currentPath.clear();
+    if(task==NULL)return ;
+
+    bool reassign = task->currentDoIndex==Task::INDEX_GETTING_GOOD && !task->arriveTime.isValid()
+            && !task->agvFixed && !task->circle;
+    doingTasks.removeAll(task);
+    task->status = Task::AGV_TASK_STATUS_UNEXCUTE;
+    if(reassign){
+        task->excuteCar = 0;
+        task->getStartTime = QDateTime();
+        task->arriveTime = QDateTime();
+    }else{
+        agv->task = task->id;
+    }
+    journal(task);
+    unassignedTasks.push(task);
+    g_log->log(AGV_LOG_LEVEL_WARN,QString("agv %1 disconnected, task %2 back to queue%3")
+               .arg(agvId).arg(task->id).arg(reassign?"":", wait for the agv to reconnect"));
+}
+
+int TaskCenter::legAimStation(Task *task)
+{
+    if(task->currentDoIndex==Task::INDEX_GETTING_GOOD)
+        return task->getGoodStation;
+    if(task->currentDoIndex==Task::INDEX_PUTTING_GOOD)
+        return task->putGoodStation;
+    return task->standByStation;
+}
+
+//松弛时间 = 截止时间 - 还要走的时间。只算已经确定的部分:
+//还没取货的，取货点到放货点；已经取货的，执行车辆当前位置到放货点。去取货的空车还不确定是哪一辆，不算
+qint64 TaskCenter::expectedTravelMsecs(const Task *task)
+{
+    if(!task->deadline.isValid() || travelSpeed<=0 || task->putGoodStation<=0)return 0;
+    int from = 0;
+    if(task->currentDoIndex==Task::INDEX_GETTING_GOOD){
+        from = task->getGoodStation;
+    }else if(task->currentDoIndex==Task::INDEX_PUTTING_GOOD){
+        Agv *agv = g_m_agvs.value(task->excuteCar,NULL);
+        if(agv!=NULL)from = agv->nowStation>0?agv->nowStation:agv->nextStation;
+    }
+    if(from<=0 || from==task->putGoodStation)return 0;
+
+    int dis = distance_infinity;
+    QList<int> path = g_agvMapCenter->getBestPath(0,0,from,task->putGoodStation,dis,true);
+    if(dis==distance_infinity)return 0;
+    double mm = 0;
+    for(int i=0;i<path.length();++i){
+        AgvLine line = g_agvMapCenter->getAgvLine(path.at(i));
+        mm += line.length*line.rate;
+    }
+    return (qint64)(mm/travelSpeed*1000);
+}
+
+//路径的最后一条线路的起点，就是到达终点时的上一站
+static int lastStationOfPath(const QList<int> &path,int defaultStation)
+{
+    if(path.length()<=0)return defaultStation;
+    AgvLine line = g_agvMapCenter->getAgvLine(path.last());
+    if(line.id<=0)return defaultStation;
+    return line.startStation;
+}
+
+//站点被其他车辆预留为后续某一段的目的地
+static bool stationClaimedByOther(int station,int agvId)
+{
+    if(station<=0)return false;
+    int reserveAgv = g_agvMapCenter->getStationReserveAgv(station);
+    return reserveAgv!=0 && reserveAgv!=agvId;
+}
+
+//整条任务链的代价:车辆到取货点+取货点到放货点+放货点到待命点
+//后两段的目的地被其他车辆预留的，这条任务链不能接，返回-1
+//返回走得通的几段的总距离。后两段暂时走不通(被占用)的，不计距离，在penalty中加一个很大的代价，这样优先选择整条链路都可达的车辆
+qint64 TaskCenter::planChain(Task *task, Agv *agv, QList<int> &firstPath, int &firstDistance, qint64 &penalty)
+{
+    penalty = 0;
+    firstDistance = distance_infinity;
+    if(agv->nowStation>0){
+        firstPath = g_agvMapCenter->getBestPath(agv->id,agv->lastStation,agv->nowStation,task->getGoodStation,firstDistance,false);
+    }else{
+        firstPath = g_agvMapCenter->getBestPath(agv->id,agv->lastStation,agv->nextStation,task->getGoodStation,firstDistance,false);
+    }
+    if(firstPath.length()<=0||firstDistance==distance_infinity)return -1;
+
+    qint64 distance = firstDistance;
+    int fromStation = task->getGoodStation;
+    int lastStation = lastStationOfPath(firstPath,agv->lastStation);
+    int aims[2] = {task->putGoodStation,task->standByStation};
+    for(int i=0;i<2;++i){
+        if(aims[i]<=0)continue;
+        if(stationClaimedByOther(aims[i],agv->id))return -1;
+        int dis = distance_infinity;
+        QList<int> path = g_agvMapCenter->getBestPath(agv->id,lastStation,fromStation,aims[i],dis,false);
+        if(dis==distance_infinity){
+            penalty += CHAIN_BLOCKED_COST;
+            lastStation = 0;//方向未知
+        }else{
+            distance += dis;
+            lastStation = lastStationOfPath(path,lastStation);
+        }
+        fromStation = aims[i];
+    }
+    return distance;
+}
+
+//把任务当前这一段派给车辆
+void TaskCenter::startLeg(Task *task, Agv *agv, int aimStation, const QList<int> &path)
+{
+    //将起点释放，将终点占领
+    g_agvMapCenter->freeStationIfAgvOccu(agv->nowStation,agv->id);
+    g_agvMapCenter->setStationOccuAgv(aimStation,agv->id);
+
+    //这一段的目的地不再需要预留。刚开始的任务链，预留后面几段的目的地
+    g_agvMapCenter->freeStationReserve(aimStation,agv->id);
+    if(task->currentDoIndex==Task::INDEX_GETTING_GOOD && task->putGoodStation>0){
+        g_agvMapCenter->reserveStation(task->putGoodStation,agv->id);
+        g_agvMapCenter->reserveStation(task->standByStation,agv->id);
+    }
+
+    //对任务属性进行赋值
+    //doTime是任务第一次开始执行的时间
+    QDateTime now = getCurrentDateTime();
+    bool firstAssign = !task->doTime.isValid();
+    if(firstAssign)
+        task->doTime = now;
+    task->status = (Task::AGV_TASK_STATUS_EXCUTING);
+    task->excuteCar = (agv->id);
+    if(task->currentDoIndex==Task::INDEX_GETTING_GOOD){
+        task->getStartTime = now;
+    }else if(task->currentDoIndex==Task::INDEX_PUTTING_GOOD){
+        task->putStartTime = now;
+    }else{
+        task->standByStartTime = now;
+    }
+    journal(task);
+    stats.onTaskAssigned(task,now,firstAssign);
+
+    //把线路的反方向线路定为占用
+    for(int i=0;i<path.length();++i){
+        g_agvMapCenter->setReverseOccuAgv(path[i],(agv->id));
+    }
+    //把这个车辆置为 非空闲,对车辆的其他信息进行更新
+    agv->status = (Agv::AGV_STATUS_TASKING);
+    agv->task = (task->id);
+    agv->currentPath = (path);
+    //把这个任务定为doing。
+    doingTasks.append(task);
+    //命令下发不了的(地图上找不到线路、站点)，车辆停在原地，由取消任务释放
+    if(!g_hrgAgvCenter->agvStartTask(agv,task))
+        g_log->log(AGV_LOG_LEVEL_ERROR,QString("agv %1 can not make orders for task %2").arg(agv->id).arg(task->id));
+
+    emit sigTaskStart(task->id,task->excuteCar);
+}
+
+//上一段完成后，同一辆车直接开始下一段，不用等下一次分配
+//下一段暂时走不通的，放回未分配队列。车辆仍然是任务中(可能载着货)，不会被分配给别的任务，由分配时重试这一段
+void TaskCenter::continueTask(Task *task, Agv *agv)
+{
+    int aimStation = legAimStation(task);
+    int dis = distance_infinity;
+    QList<int> path;
+    if(agv->nowStation>0){
+        path = g_agvMapCenter->getBestPath(agv->id,agv->lastStation,agv->nowStation,aimStation,dis,false);
+    }else{
+        path = g_agvMapCenter->getBestPath(agv->id,agv->lastStation,agv->nextStation,aimStation,dis,false);
+    }
+    //已经在目的地上时，路径为空，距离为0
+    if(dis!=distance_infinity){
+        startLeg(task,agv,aimStation,path);
+        return ;
+    }
+
+    task->status = Task::AGV_TASK_STATUS_UNEXCUTE;
+    journal(task);
+    agv->task = task->id;
+    agv->currentPath.clear();
+    unassignedTasks.push(task);
+}
+
+//令牌桶限制抢占的频率，避免车辆来回被改派
+bool TaskCenter::takePreemptToken()
+{
+    qint64 now = getCurrentDateTime().toMSecsSinceEpoch();
+    if(preemptRefillTime<=0)preemptRefillTime = now;
+    preemptTokens = qMin((double)PREEMPT_BURST,preemptTokens+(double)(now-preemptRefillTime)/PREEMPT_REFILL_MS);
+    preemptRefillTime = now;
+    if(preemptTokens<1)return false;
+    preemptTokens -= 1;
+    return true;
+}
+
+//剩余路径+后面几段+最后一站到aimStation(不计取货、放货的时间)
+//和分配时一样按车辆的行驶方向计算，不允许掉头
+qint64 TaskCenter::distanceAfterWork(Task *task, Agv *agv, int aimStation)
+{
+    qint64 distance = 0;
+    for(int i=0;i<agv->currentPath.length();++i){
+        AgvLine line = g_agvMapCenter->getAgvLine(agv->currentPath.at(i));
+        distance += (qint64)line.length;
+    }
+
+    QList<int> stations;
+    if(task->currentDoIndex==Task::INDEX_GETTING_GOOD){
+        stations<<task->getGoodStation<<task->putGoodStation<<task->standByStation;
+    }else if(task->currentDoIndex==Task::INDEX_PUTTING_GOOD){
+        stations<<task->putGoodStation<<task->standByStation;
+    }else{
+        stations<<task->standByStation;
+    }
+    stations<<aimStation;
+
+    int from = 0;
+    int lastStation = lastStationOfPath(agv->currentPath,agv->lastStation);
+    for(int i=0;i<stations.length();++i){
+        if(stations.at(i)<=0)continue;
+        if(from>0 && from!=stations.at(i)){
+            int dis = distance_infinity;
+            QList<int> path = g_agvMapCenter->getBestPath(agv->id,lastStation,from,stations.at(i),dis,false);
+            if(dis==distance_infinity)return -1;
+            distance += dis;
+            lastStation = lastStationOfPath(path,lastStation);
+        }
+        from = stations.at(i);
+    }
+    return distance;
+}
+
+//抢占:车辆正在空车去取货(还没到)，而且它去执行紧急任务比等别的车辆做完快得多
+//原任务的占用全部释放，放回未分配队列，车辆从当前位置改去紧急任务的目的地
+bool TaskCenter::tryPreempt(Task *task, int aimStation)
+{
+    Agv *bestCar = NULL;
+    Task *victim = NULL;
+    QList<int> bestPath;
+    int minDis = distance_infinity;
+    qint64 waitDis = -1;//不抢占时，最快的车辆做完手上的任务再过来的距离
+
+    for(int i=0;i<doingTasks.length();++i){
+        Task *t = doingTasks.at(i);
+        if(!g_m_agvs.contains(t->excuteCar))continue;
+        Agv *agv = g_m_agvs[t->excuteCar];
+
+        qint64 after = distanceAfterWork(t,agv,aimStation);
+        if(after>=0 && (waitDis<0 || after<waitDis))waitDis = after;
+
+        //可以抢占的:空车去取货，还没到达，不是指定车辆的，没被抢占过，优先级更低
+        if(t->currentDoIndex!=Task::INDEX_GETTING_GOOD || t->arriveTime.isValid())continue;
+        if(t->agvFixed || t->circle || preemptedTasks.contains(t->id))continue;
+        if(t->priority>=task->priority)continue;
+        if(agv->status!=Agv::AGV_STATUS_TASKING || agv->isStopped())continue;
+
+        //从车辆当前位置出发。在线路中间的，先走完当前这条线路
+        int dis = distance_infinity;
+        QList<int> path;
+        int lineId = 0;
+        if(agv->nowStation>0){
+            path = g_agvMapCenter->getBestPath(agv->id,agv->lastStation,agv->nowStation,aimStation,dis,false);
+        }else{
+            lineId = g_agvMapCenter->getLineId(agv->lastStation,agv->nextStation);
+            if(lineId<=0)continue;
+            path = g_agvMapCenter->getBestPath(agv->id,agv->lastStation,agv->nextStation,aimStation,dis,false);
+            if(dis!=distance_infinity){
+                path.prepend(lineId);
+                dis += (int)g_agvMapCenter->getAgvLine(lineId).length;
+            }
+        }
+        if(dis==distance_infinity || path.length()<=0)continue;
+        if(g_chargeScheduler!=NULL && !g_chargeScheduler->canTake(agv->id,dis))continue;
+        if(dis<minDis){
+            minDis = dis;
+            bestCar = agv;
+            victim = t;
+            bestPath = path;
+        }
+    }
+    if(bestCar==NULL)return false;
+    if(waitDis>=0 && minDis>waitDis*PREEMPT_GAIN_RATIO)return false;
+    if(!takePreemptToken())return false;
+
+    g_log->log(AGV_LOG_LEVEL_INFO,QString("task %1 preempt agv %2 from task %3").arg(task->id).arg(bestCar->id).arg(victim->id));
+
+    //1.车辆停下，释放原任务占用的站点、线路和预留(在线路中间的保留当前线路)
+    g_hrgAgvCenter->agvCancelTask(bestCar->id);
+    g_agvMapCenter->freeAgvReserve(bestCar->id);
+
+    //2.原任务放回未分配队列，保留进入队列的时间，老化后会尽快被重新分配
+    doingTasks.removeAll(victim);
+    victim->status = Task::AGV_TASK_STATUS_UNEXCUTE;
+    victim->excuteCar = 0;
+    victim->getStartTime = QDateTime();
+    victim->arriveTime = QDateTime();
+    journal(victim);
+    stats.onTaskPreempted(victim);
+    preemptedTasks.insert(victim->id);
+    unassignedTasks.push(victim);
+
+    //3.车辆改去紧急任务
+    bestCar->task = 0;
+    startLeg(task,bestCar,aimStation,bestPath);
+    return true;
+}
+
+//任务状态只在调度线程中修改，不需要加锁
 void TaskCenter::unassignedTasksProcess()
 {
+    //先把其他线程送来的新任务、事件、命令处理掉
+    drainQueues();
+
     //遍历所有的未分配的任务，对他们和空闲车辆进行匹配。找到最合适的后，执行去
-    uTaskMtx.lock();
-    for(int mmm=0;mmm<unassignedTasks.length();++mmm)
+    QList<Task *> orderedTasks = unassignedTasks.toList();
+    for(int mmm=0;mmm<orderedTasks.length();++mmm)
     {
-        Task *ttask = unassignedTasks.at(mmm);
+        Task *ttask = orderedTasks.at(mmm);
 
-        int aimStation = 0;
-        if(ttask->currentDoIndex==Task::INDEX_GETTING_GOOD){
-            aimStation=ttask->getGoodStation;
-        }else if(ttask->currentDoIndex==Task::INDEX_PUTTING_GOOD){
-            aimStation = ttask->putGoodStation;
-        }else{
-            aimStation = ttask->standByStation;
-        }
+        int aimStation = legAimStation(ttask);
+
+        //目的地被其他车辆预留了，等它用完，也不抢占
+        if(stationClaimedByOther(aimStation,ttask->excuteCar))continue;
+
+        //还没开始的取货送货任务，按整条任务链选择车辆
+        bool chain = (ttask->currentDoIndex==Task::INDEX_GETTING_GOOD && ttask->putGoodStation>0);
 
         Agv *bestCar = NULL;
         int minDis = distance_infinity;
+        qint64 minCost = -1;
         QList<int> path;
         int tempDis = distance_infinity;
 
@@ -556,7 +1109,11 @@ void TaskCenter::unassignedTasksProcess()
             if(!g_m_agvs.contains(ttask->excuteCar))continue;
             Agv *excutecar = g_m_agvs[ttask->excuteCar];
             if(excutecar==NULL)continue;
-            if(excutecar->status!=Agv::AGV_STATUS_IDLE)continue;
+            //空闲的，或者上一段做完后一直在等这一段的
+            bool waiting = excutecar->status==Agv::AGV_STATUS_TASKING && excutecar->task==ttask->id;
+            if(excutecar->status!=Agv::AGV_STATUS_IDLE && !waiting)continue;
+            //急停中的，等解除
+            if(excutecar->isStopped())continue;
             QList<int> result;
 
             if(excutecar->nowStation>0){
@@ -564,21 +1121,37 @@ void TaskCenter::unassignedTasksProcess()
             }else{
                 result = g_agvMapCenter->getBestPath(excutecar->id,excutecar->lastStation,excutecar->nextStation, aimStation,tempDis,false);
             }
-            if(result.length()>0&&tempDis!=distance_infinity){
+            //断开重连的车辆可能已经在这一段的目的地上，路径为空
+            if((result.length()>0||excutecar->nowStation==aimStation)&&tempDis!=distance_infinity){
                 bestCar = excutecar;
                 minDis = tempDis;
                 path=result;
             }
         }else{
             //寻找最优车辆去执行任务
+            //暂时没有可用车辆时，下面只尝试抢占
             QList<Agv *> idleAgvs = g_hrgAgvCenter->getIdleAgvs();
-            if(idleAgvs.length()<=0)//暂时没有可用车辆，直接退出对未分配的任务的操作
-                continue ;
             QList<Agv *>::iterator ppos;
             for(ppos = idleAgvs.begin();ppos!=idleAgvs.end();++ppos)
             {
                 Agv *agv = *ppos;
                 QList<int> result;
+                if(chain){
+                    qint64 penalty = 0;
+                    qint64 distance = planChain(ttask,agv,result,tempDis,penalty);
+                    if(distance<0)continue;
+                    //电量不够跑完整条任务链的车辆不接(走不通的后几段不计)
+                    if(g_chargeScheduler!=NULL && !g_chargeScheduler->canTake(agv->id,distance))
+                        continue;
+                    qint64 cost = distance+penalty;
+                    if(minCost<0 || cost<minCost){
+                        bestCar = agv;
+                        minCost = cost;
+                        minDis = tempDis;
+                        path = result;
+                    }
+                    continue;
+                }
                 if(agv->nowStation>0){
                     result = g_agvMapCenter->getBestPath(agv->id,agv->lastStation,agv->nowStation, aimStation,tempDis,false);
                 }else{
@@ -586,6 +1159,9 @@ void TaskCenter::unassignedTasksProcess()
                 }
                 if(result.length()>0&&tempDis!=distance_infinity)
                 {
+                    //电量不够的车辆不接
+                    if(g_chargeScheduler!=NULL && !g_chargeScheduler->canTake(agv->id,tempDis))
+                        continue;
                     //一个可用线路的结果//当然并不一定是最优的线路
                     if(tempDis < minDis){
                         bestCar = agv;
@@ -597,46 +1173,19 @@ void TaskCenter::unassignedTasksProcess()
         }
 
         //判断是否找到了最优的车辆和最优的线路
-        if(bestCar!=NULL && minDis != distance_infinity && path.length()>0)
+        if(bestCar!=NULL && minDis != distance_infinity && (path.length()>0 || bestCar->nowStation==aimStation))
         {
-            //这个任务要派给这个车了！接下来的事情是这些：
-            //TODO:!!!要求一下操作可以回滚，因为车辆可能不接受该任务！！！！！！！！！！！！！！
-
-            //将终点，占领
-            g_agvMapCenter->setStationOccuAgv(aimStation,bestCar->id);
-
-            //将起点，释放 这里释放起点其实是不合适的，应该在小车启动的时候，释放这个位置,虽然这里就差几行
-            g_agvMapCenter->freeStationIfAgvOccu(bestCar->nowStation,bestCar->id);
-
-            //if(g_m_stations[bestCar->nowStation]->occuAgv == bestCar->id)g_m_stations[bestCar->nowStation]->occuAgv = (0);
-
-            //对任务属性进行赋值
-            ttask->doTime = (QDateTime::currentDateTime());
-            ttask->status = (Task::AGV_TASK_STATUS_EXCUTING);
-            ttask->excuteCar = (bestCar->id);
-
-            //对线路属性进行赋值         //4.把线路的反方向线路定为占用
-            for(int i=0;i<path.length();++i){
-                g_agvMapCenter->setReverseOccuAgv(path[i],(bestCar->id));
-            }
-            //对车子属性进行赋值        //5.把这个车辆置为 非空闲,对车辆的其他信息进行更新
-            bestCar->status = (Agv::AGV_STATUS_TASKING);
-            bestCar->task = (ttask->id);
-            bestCar->currentPath = (path);
-            //将任务移动到正在执行的任务//6.把这个任务定为doing。
-            unassignedTasks.removeAt(mmm);
-            mmm--;
-            dTaskMtx.lock();
-            doingTasks.append(ttask);
-            dTaskMtx.unlock();
-            //要看返回的结果的！！！！！！ 如果失败了，要回滚上述所有操作！太难了
-            //TODO:
-            g_hrgAgvCenter->agvStartTask(bestCar,ttask);
-
-            emit sigTaskStart(ttask->id,ttask->excuteCar);
+            //这个任务要派给这个车了！
+            unassignedTasks.remove(ttask);
+            startLeg(ttask,bestCar,aimStation,path);
+        }else if(ttask->priority==Task::PRIORITY_VERY_HIGH && ttask->excuteCar<=0){
+            //最高优先级的任务没有可用车辆，尝试抢占
+            if(tryPreempt(ttask,aimStation))
+                unassignedTasks.remove(ttask);
         }
     }
-    uTaskMtx.unlock();
+
+    publishSnapshot();
 }
 
 
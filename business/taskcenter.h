@@ -3,10 +3,85 @@
 
 #include <QObject>
 #include <QTimer>
-#include <QMutex>
+#include <QSet>
+#include <QHash>
+#include <memory>
+#include <future>
+#include <atomic>
 #include "bean/task.h"
+#include "taskstats.h"
+#include "taskqueue.h"
+#include "taskhistorycache.h"
+#include "util/concurrentqueue.h"
 //#include "bean/agv.h"
+class Agv;
 
+//任务链中后面几段暂时走不通时的代价
+#define CHAIN_BLOCKED_COST  ((qint64)1<<40)
+
+//抢占:抢来的车辆到达距离不超过等待其他车辆完成的这个比例，才抢占
+#define PREEMPT_GAIN_RATIO  0.5
+//抢占的令牌桶:最多连续抢占几次，多久恢复一次
+#define PREEMPT_BURST   2
+#define PREEMPT_REFILL_MS   (2*60*1000)
+
+//估算有截止时间的任务还要走多久时，车辆的默认速度 mm/s
+#define DEFAULT_TRAVEL_SPEED    1000
+
+//快照中任务的只读复制，没有改变的任务在前后两个快照之间共用
+typedef std::shared_ptr<const Task> TaskCopyPtr;
+
+//任务的只读快照，由调度线程发布，给其他线程(发布者、用户消息)读
+class TaskSnapshot
+{
+public:
+    TaskSnapshot(){}
+    const Task *find(int taskId) const;
+
+    QList<TaskCopyPtr> unassigned;//按分配的先后顺序
+    QList<TaskCopyPtr> doing;
+private:
+    TaskSnapshot(const TaskSnapshot &);
+    TaskSnapshot &operator =(const TaskSnapshot &);
+};
+typedef std::shared_ptr<const TaskSnapshot> TaskSnapshotPtr;
+
+//其他线程送给调度线程的车辆事件
+struct TaskEvent{
+    enum{
+        ARRIVE_STATION = 0,
+        PICK_FINISH = 1,
+        PUT_FINISH = 2,
+        STANDBY_FINISH = 3,
+        AGV_DISCONNECTED = 4,
+    };
+    int type = ARRIVE_STATION;
+    int agvId = 0;
+    int station = 0;
+};
+
+//其他线程送给调度线程的命令，执行完通过result返回
+struct TaskCommand{
+    enum{
+        CANCEL = 0,
+        RESCHEDULE = 1,
+        AGING = 2,
+        RELEASE = 3,
+    };
+    int type = CANCEL;
+    int taskId = 0;
+    int agvId = 0;
+    bool cancel = false;
+    int priority = 0;
+    bool changeDeadline = false;
+    QDateTime deadline;
+    qint64 agingStep = 0;
+    std::promise<int> *result = NULL;
+};
+
+//任务中心
+//所有的任务状态只由调度线程(TaskCenter所在的线程，即主线程)修改。
+//其他线程(zmq的工作线程等)产生的新任务、车辆事件、命令，通过无锁队列交给调度线程；读取任务用getSnapshot
 
 class TaskCenter : public QObject
 {
@@ -17,33 +92,57 @@ public:
     void init();
 
     //产生一个固定某辆车去到目的地的任务，车辆是agvId，目的地是aimStation
-    int makeAgvAimTask(int agvId, int aimStation,int priority = Task::PRIORITY_NORMAL);
+    int makeAgvAimTask(int agvId, int aimStation,int priority = Task::PRIORITY_NORMAL, QDateTime deadline = QDateTime());
 
     //产生一个直接去到目的地的任务[车辆随意]，目的地是aimStation
-    int makeAimTask(int aimStation,int priority = Task::PRIORITY_NORMAL);
+    int makeAimTask(int aimStation,int priority = Task::PRIORITY_NORMAL, QDateTime deadline = QDateTime());
 
     //产生一个指定车辆 取货送货的任务,pickupStation是取货点，aimStation是送货点
-    int makeAgvPickupTask(int agvId, int pickupStation, int aimStation,int standByStation,int priority = Task::PRIORITY_NORMAL);
+    int makeAgvPickupTask(int agvId, int pickupStation, int aimStation,int standByStation,int priority = Task::PRIORITY_NORMAL, QDateTime deadline = QDateTime());
 
     //产生一个取货送货的任务,pickupStation是取货点，aimStation是送货点
-    int makePickupTask(int pickupStation,int aimStation,int standByStation,int priority = Task::PRIORITY_NORMAL);
+    int makePickupTask(int pickupStation,int aimStation,int standByStation,int priority = Task::PRIORITY_NORMAL, QDateTime deadline = QDateTime());
 
     //产生一个循环任务【制定车辆执行一个任务】
-    int makeLoopTask(int agvId, int pickupStation, int aimStation, int standByStation, int priority = Task::PRIORITY_NORMAL);
+    int makeLoopTask(int agvId, int pickupStation, int aimStation, int standByStation, int priority = Task::PRIORITY_NORMAL, QDateTime deadline = QDateTime());
 
     int queryTaskStatus(int taskId);//返回task的状态。
 
-    int cancelTask(int taskId);//取消一个任务
+    int cancelTask(int taskId);//取消一个任务。其他线程调用时，等待调度线程执行完
+
+    //修改未完成任务的优先级和截止时间。priority<0表示不修改优先级
+    //changeDeadline为false时不修改截止时间，为true时deadline无效表示取消截止时间
+    bool rescheduleTask(int taskId, int priority, bool changeDeadline, QDateTime deadline);
 
+    //解除车辆的急停(agvId为0是所有急停的车辆)，返回解除的车辆数。其他线程调用时，等待调度线程执行完
+    //急停时手上的任务:cancel为true的取消，否则从车辆当前位置重新下发这一段
+    int releaseAgv(int agvId, bool cancel);
+
+    //未分配任务的老化步长:优先级每高一级，相当于提前多少毫秒
+    void setAgingStep(qint64 agingStep);
+    qint64 getAgingStep();
+
+    //车辆的平均速度(mm/s)，用来估算有截止时间的任务还要走多久。只能在调度线程中调用
+    void setTravelSpeed(double mmPerSecond);
+
+    //以下四个返回的是调度线程中的任务，只能在调度线程中调用
     Task *queryUndoTask(int taskId);
 
     Task *queryDoingTask(int taskId);
 
+    QList<Task *> getUnassignedTasks();//按分配的先后顺序
+    QList<Task *> getDoingTasks(){return  doingTasks;}
+
+    //任意线程:最近发布的任务快照
+    TaskSnapshotPtr getSnapshot();
+
+    //任意线程:查询已经结束的任务(先查缓存)，返回的任务由调用者释放
     Task *queryDoneTask(int taskId);
 
-    QList<Task *> getUnassignedTasks(){return unassignedTasks;}
-    QList<Task *> getDoingTasks(){return  doingTasks;}
+    //任务各阶段耗时和吞吐量统计
+    const TaskStats &getStats(){return stats;}
 signals:
+    void sigTaskNew(int,int);//新任务:任务ID、取货点(没有取货点的为0)
     void sigTaskStart(int,int);
     void sigTaskFinish(int);
 public slots:
@@ -51,22 +150,78 @@ public slots:
     void onPickFinish(int agvId);
     void onPutFinish(int agvId);
     void onStandByFinish(int agvId);
+    void onAgvDisconnected(int agvId);
 private slots:
+    void processQueues();
     void unassignedTasksProcess();//未分配的任务
     //void doingTaskProcess();//正在执行的任务(由于线路占用的问题，导致小车停在了某个位置，需要启动它)
 
 private:
+    int addNewTask(Task *newtask);
+
+    bool inOwnerThread();
+    void wake();
+    void acceptTask(Task *newtask);
+    void postEvent(int type, int agvId, int station = 0);
+    int runCommand(TaskCommand cmd);
+    int doCommand(const TaskCommand &cmd);
+    int doCancelTask(int taskId);
+    bool doRescheduleTask(int taskId, int priority, bool changeDeadline, QDateTime deadline);
+    int doReleaseAgv(int agvId, bool cancel);
+    bool releaseOneAgv(Agv *agv, bool cancel);
+    void drainQueues();
+    void publishSnapshot();
+    TaskCopyPtr copyForSnapshot(Task *task, QHash<int,TaskCopyPtr> &copies);
+    //任务改变后记入日志，标记快照中要重新复制
+    void journal(Task *task);
+
+    //任务当前这一段的目的地
+    int legAimStation(Task *task);
+    //有截止时间的任务还要走多久才能送达(ms)，排序时从截止时间中扣除
+    qint64 expectedTravelMsecs(const Task *task);
+    //为车辆规划整条任务链(取货->放货->待命)，返回走得通的几段的总距离，后面几段走不通的代价放在penalty中
+    //第一段走不通、或者后面的目的地被其他车辆预留时返回-1
+    qint64 planChain(Task *task, Agv *agv, QList<int> &firstPath, int &firstDistance, qint64 &penalty);
+    //把任务当前这一段派给车辆
+    void startLeg(Task *task, Agv *agv, int aimStation, const QList<int> &path);
+    //上一段完成后，直接开始下一段。走不通的，车辆保持任务中等待重试
+    void continueTask(Task *task, Agv *agv);
+
+    //最高优先级的任务没有空闲车辆时，抢占一辆正在空车去取货的车辆
+    bool tryPreempt(Task *task, int aimStation);
+    //车辆做完手上的任务后，再到达aimStation的距离
+    qint64 distanceAfterWork(Task *task, Agv *agv, int aimStation);
+    bool takePreemptToken();
+
     //这里可以对任务进行扩展。将任务要做的事情做成一个不定的
     //对于C类任务(直接去往目的地).它会先被放入todoAimtask中，等待分配车辆执行。如果分配到车辆了，这个任务会放入doingtasks中
     //对于AB类任务(去A地装货，然后送到B地)，它会先被放入todoPickTasks中，等待分配车辆，如果分配到的车辆了，这个任务会放入doingtasks中，如果完成了装货，它会被放入todoAimTasks中，等待有可行线路去往目的地
-    QList<Task *> unassignedTasks;           //未分配的任务
-    QMutex uTaskMtx;
+    TaskQueue unassignedTasks;               //未分配的任务(按截止时间和老化后的优先级排序)
 
     QList<Task *> doingTasks;                //正在执行的任务
-    QMutex dTaskMtx;
+
+    //多个生产者、调度线程一个消费者的无锁队列
+    moodycamel::ConcurrentQueue<Task *> intakeQueue;
+    moodycamel::ConcurrentQueue<TaskEvent> eventQueue;
+    moodycamel::ConcurrentQueue<TaskCommand> commandQueue;
+    std::atomic<bool> wakePending;
+
+    TaskSnapshotPtr snapshot;
+    QHash<int,TaskCopyPtr> taskCopies;//上一个快照中的复制
+    QSet<int> changedTasks;//上次发布快照之后改变过的任务
+    std::atomic<qint64> agingStepValue;
+    double travelSpeed;//mm/s
 
     QTimer taskProcessTimer;
 
+    TaskStats stats;
+
+    TaskHistoryCache history;//最近结束的任务
+
+    double preemptTokens;
+    qint64 preemptRefillTime;
+    QSet<int> preemptedTasks;//被抢占过的任务不再被抢占
+
     int doneTasksAmount;
 };
 
@@ -0,0 +1,63 @@
+﻿#include "taskhistorycache.h"
+#include <QDateTime>
+
+TaskHistoryCache::TaskHistoryCache():
+    tasks(DEFAULT_CAPACITY),
+    missing(DEFAULT_MISSING_CAPACITY)
+{
+}
+
+void TaskHistoryCache::put(const Task *task)
+{
+    if(task==NULL||task->id<=0)return ;
+    Task *copy = new Task(*task);
+    mtx.lock();
+    missing.remove(task->id);
+    tasks.insert(task->id,copy);
+    mtx.unlock();
+}
+
+Task *TaskHistoryCache::find(int taskId)
+{
+    Task *result = NULL;
+    mtx.lock();
+    Task *task = tasks.object(taskId);
+    if(task!=NULL)result = new Task(*task);
+    mtx.unlock();
+    return result;
+}
+
+bool TaskHistoryCache::findStatus(int taskId, int &status)
+{
+    bool find = false;
+    mtx.lock();
+    Task *task = tasks.object(taskId);
+    if(task!=NULL){
+        status = task->status;
+        find = true;
+    }
+    mtx.unlock();
+    return find;
+}
+
+void TaskHistoryCache::putMissing(int taskId)
+{
+    mtx.lock();
+    missing.insert(taskId,new qint64(QDateTime::currentMSecsSinceEpoch()+DEFAULT_MISSING_TTL));
+    mtx.unlock();
+}
+
+bool TaskHistoryCache::isMissing(int taskId)
+{
+    bool result = false;
+    mtx.lock();
+    qint64 *expire = missing.object(taskId);
+    if(expire!=NULL){
+        if(*expire>QDateTime::currentMSecsSinceEpoch())
+            result = true;
+        else
+            missing.remove(taskId);
+    }
+    mtx.unlock();
+    return result;
+}
@@ -0,0 +1,43 @@
+﻿#ifndef TASKHISTORYCACHE_H
+#define TASKHISTORYCACHE_H
+
+#include <QCache>
+#include <QMutex>
+#include "bean/task.h"
+
+//最近结束(完成、取消)的任务的缓存
+//客户端会频繁轮询刚结束的任务的状态和详情，这些查询尽量不访问数据库
+//1.结束的任务不会再变化，按LRU保留最近的若干个(完整复制一份)
+//2.查不到的任务id记一小段时间，避免反复查询不存在的任务
+//可以在任意线程调用
+class TaskHistoryCache
+{
+public:
+    enum{
+        DEFAULT_CAPACITY = 4096,//缓存的任务个数
+        DEFAULT_MISSING_CAPACITY = 1024,//缓存的不存在的任务id个数
+        DEFAULT_MISSING_TTL = 10*1000,//不存在的任务id缓存多久(ms)
+    };
+
+    TaskHistoryCache();
+
+    //任务结束时放入缓存
+    void put(const Task *task);
+
+    //返回一份复制，由调用者释放。不在缓存中返回NULL
+    Task *find(int taskId);
+
+    //只查状态，不复制任务
+    bool findStatus(int taskId, int &status);
+
+    //记录、查询不存在的任务id
+    void putMissing(int taskId);
+    bool isMissing(int taskId);
+
+private:
+    QMutex mtx;
+    QCache<int,Task> tasks;
+    QCache<int,qint64> missing;//任务id -> 过期时间
+};
+
+#endif // TASKHISTORYCACHE_H
@@ -0,0 +1,107 @@
+﻿#include "taskqueue.h"
+
+TaskQueue::TaskQueue():
+    agingStep(DEFAULT_AGING_STEP),
+    travelEstimate(nullptr)
+{
+}
+
+void TaskQueue::setAgingStep(qint64 _agingStep)
+{
+    if(_agingStep<0)_agingStep = 0;
+    if(_agingStep == agingStep)return ;
+    agingStep = _agingStep;
+    rebuild();
+}
+
+void TaskQueue::setTravelEstimate(TravelEstimate _travelEstimate)
+{
+    travelEstimate = _travelEstimate;
+    rebuild();
+}
+
+qint64 TaskQueue::keyOf(const Task *task) const
+{
+    QDateTime enterTime = task->queueTime.isValid()?task->queueTime:task->produceTime;
+    qint64 key = enterTime.toMSecsSinceEpoch() + agingStep*(Task::PRIORITY_VERY_HIGH-task->priority);
+    if(task->deadline.isValid()){
+        qint64 latest = task->deadline.toMSecsSinceEpoch();
+        if(travelEstimate!=nullptr)latest -= travelEstimate(task);
+        if(latest<key)key = latest;
+    }
+    return key;
+}
+
+TaskQueue::Node TaskQueue::makeNode(Task *task) const
+{
+    Node n;
+    n.key = keyOf(task);
+    n.priority = task->priority;
+    n.id = task->id;
+    n.task = task;
+    return n;
+}
+
+void TaskQueue::push(Task *task)
+{
+    if(task==NULL)return ;
+    if(index.contains(task->id)){
+        update(task);
+        return ;
+    }
+    Node n = makeNode(task);
+    nodes.insert(n);
+    index.insert(n.id,n);
+}
+
+bool TaskQueue::remove(Task *task)
+{
+    if(task==NULL || !index.contains(task->id))return false;
+    nodes.erase(index.take(task->id));
+    return true;
+}
+
+void TaskQueue::update(Task *task)
+{
+    if(task==NULL || !index.contains(task->id))return ;
+    nodes.erase(index.value(task->id));
+    Node n = makeNode(task);
+    nodes.insert(n);
+    index.insert(n.id,n);
+}
+
+Task *TaskQueue::top() const
+{
+    if(nodes.empty())return NULL;
+    return nodes.begin()->task;
+}
+
+Task *TaskQueue::find(int taskId) const
+{
+    QHash<int,Node>::const_iterator itr = index.find(taskId);
+    if(itr==index.end())return NULL;
+    return itr.value().task;
+}
+
+bool TaskQueue::contains(int taskId) const
+{
+    return index.contains(taskId);
+}
+
+QList<Task *> TaskQueue::toList() const
+{
+    QList<Task *> result;
+    result.reserve((int)nodes.size());
+    for(std::set<Node,NodeLess>::const_iterator itr=nodes.begin();itr!=nodes.end();++itr)
+        result.append(itr->task);
+    return result;
+}
+
+void TaskQueue::rebuild()
+{
+    QList<Task *> tasks = toList();
+    nodes.clear();
+    index.clear();
+    for(int i=0;i<tasks.length();++i)
+        push(tasks.at(i));
+}
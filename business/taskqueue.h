@@ -0,0 +1,89 @@
+﻿#ifndef TASKQUEUE_H
+#define TASKQUEUE_H
+
+#include <QList>
+#include <QHash>
+#include <set>
+#include <functional>
+#include "bean/task.h"
+
+//未分配任务的优先队列(按键排序，带索引，可以重新排序)
+//排序键是一个绝对时间(ms)，越小越先分配:
+//  老化键 = 进入队列的时间 + agingStep*(最高优先级-优先级)
+//  有截止时间的任务，取 min(截止时间-预计还要走的时间,老化键)，即松弛时间少的先做
+//相当于优先级每高一级，提前agingStep毫秒。低优先级的任务等待的时间足够长以后，会排到新来的高优先级任务前面，不会饿死
+//键是绝对时间，时间流逝不需要重新计算，只有任务的优先级、截止时间改变，或者修改agingStep、预计时间的算法时才需要重新排序
+//始终有序，按顺序遍历不需要排序
+//不加锁，只在调度线程中访问
+class TaskQueue
+{
+public:
+    //任务还要走多久才能送达(ms)，从截止时间中扣除
+    typedef std::function<qint64 (const Task *)> TravelEstimate;
+
+    TaskQueue();
+
+    //默认每级优先级相当于5分钟
+    enum{
+        DEFAULT_AGING_STEP = 5*60*1000,
+    };
+
+    void setAgingStep(qint64 _agingStep);
+    qint64 getAgingStep() const {return agingStep;}
+
+    //设置以后所有任务重新计算键
+    void setTravelEstimate(TravelEstimate _travelEstimate);
+
+    void push(Task *task);
+
+    //移出队列，不释放任务
+    bool remove(Task *task);
+
+    //任务的优先级、截止时间、进入队列时间改变后，调整位置
+    void update(Task *task);
+
+    //所有任务重新计算键(预计时间的参数改变后)
+    void rebuild();
+
+    Task *top() const;
+
+    Task *find(int taskId) const;
+
+    bool contains(int taskId) const;
+
+    int length() const {return index.size();}
+
+    bool isEmpty() const {return index.isEmpty();}
+
+    //按分配的先后顺序
+    QList<Task *> toList() const;
+
+    qint64 keyOf(const Task *task) const;
+
+private:
+    //排序用到的字段在入队时记下，任务的字段被修改后仍然能找到原来的位置
+    struct Node{
+        qint64 key;
+        int priority;
+        int id;
+        Task *task;
+    };
+
+    //键相同时，优先级高的在前，再按ID(先产生的在前)
+    struct NodeLess{
+        bool operator()(const Node &a, const Node &b) const{
+            if(a.key!=b.key)return a.key<b.key;
+            if(a.priority!=b.priority)return a.priority>b.priority;
+            return a.id<b.id;
+        }
+    };
+
+    Node makeNode(Task *task) const;
+
+    std::set<Node,NodeLess> nodes;
+    QHash<int,Node> index;//任务ID到入队时的排序字段
+    qint64 agingStep;
+    TravelEstimate travelEstimate;
+};
+
+#endif // TASKQUEUE_H
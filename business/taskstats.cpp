@@ -0,0 +1,181 @@
+﻿#include "taskstats.h"
+#include "util/global.h"
+
+TaskStats::TaskStats():
+    agvDropped(0)
+{
+    for(int i=0;i<AGV_SLOT_COUNT;++i){
+        agvSlotIds[i].store(0);
+        byAgv[i].store(NULL);
+    }
+}
+
+TaskStats::~TaskStats()
+{
+    for(int i=0;i<AGV_SLOT_COUNT;++i)
+        delete byAgv[i].load();
+}
+
+QString TaskStats::metricName(int metric)
+{
+    switch(metric){
+    case METRIC_QUEUE_WAIT:return "queueWait";
+    case METRIC_TIME_TO_ASSIGN:return "timeToAssign";
+    case METRIC_TRAVEL_TO_PICK:return "travelToPick";
+    case METRIC_PICK:return "pick";
+    case METRIC_TRAVEL_TO_PUT:return "travelToPut";
+    case METRIC_END_TO_END:return "endToEnd";
+    case METRIC_LATENESS:return "lateness";
+    case METRIC_TIME_TO_PICKUP:return "timeToPickup";
+    default:return "";
+    }
+}
+
+void TaskStats::onTaskCreated(const Task *task)
+{
+    counters[COUNTER_CREATED].add(task->produceTime.toMSecsSinceEpoch());
+}
+
+void TaskStats::onTaskAssigned(const Task *task, const QDateTime &assignTime, bool firstAssign)
+{
+    if(task->queueTime.isValid())
+        record(METRIC_QUEUE_WAIT,task->priority,task->excuteCar,task->queueTime.msecsTo(assignTime));
+    if(firstAssign && task->produceTime.isValid())
+        record(METRIC_TIME_TO_ASSIGN,task->priority,task->excuteCar,task->produceTime.msecsTo(assignTime));
+}
+
+void TaskStats::onTaskArrive(const Task *task)
+{
+    if(!task->arriveTime.isValid())return ;
+    if(task->currentDoIndex == Task::INDEX_GETTING_GOOD && task->getStartTime.isValid()){
+        record(METRIC_TRAVEL_TO_PICK,task->priority,task->excuteCar,task->getStartTime.msecsTo(task->arriveTime));
+        //循环任务的产生时间是第一轮的，不计
+        if(!task->circle && task->produceTime.isValid())
+            record(METRIC_TIME_TO_PICKUP,task->priority,task->excuteCar,task->produceTime.msecsTo(task->arriveTime));
+    }else if(task->currentDoIndex == Task::INDEX_PUTTING_GOOD && task->putStartTime.isValid()){
+        record(METRIC_TRAVEL_TO_PUT,task->priority,task->excuteCar,task->putStartTime.msecsTo(task->arriveTime));
+    }
+}
+
+void TaskStats::onPickFinish(const Task *task)
+{
+    if(task->arriveTime.isValid() && task->getFinishTime.isValid())
+        record(METRIC_PICK,task->priority,task->excuteCar,task->arriveTime.msecsTo(task->getFinishTime));
+}
+
+void TaskStats::onTaskFinished(const Task *task)
+{
+    QDateTime finishTime = task->doneTime.isValid()?task->doneTime:task->standByFinishTime;
+    if(!task->circle && task->produceTime.isValid() && finishTime.isValid())
+        record(METRIC_END_TO_END,task->priority,task->excuteCar,task->produceTime.msecsTo(finishTime));
+    //循环任务每跑完一圈都会到这里，单独计数，不算完成的任务
+    counters[task->circle?COUNTER_CIRCLE_LAPS:COUNTER_FINISHED].add(finishTime.toMSecsSinceEpoch());
+}
+
+void TaskStats::onTaskCancelled(const Task *task)
+{
+    Q_UNUSED(task);
+    counters[COUNTER_CANCELLED].add(getCurrentDateTime().toMSecsSinceEpoch());
+}
+
+void TaskStats::onTaskPreempted(const Task *task)
+{
+    Q_UNUSED(task);
+    counters[COUNTER_PREEMPTED].add(getCurrentDateTime().toMSecsSinceEpoch());
+}
+
+void TaskStats::onTaskDelivered(const Task *task, const QDateTime &deliverTime)
+{
+    if(!task->deadline.isValid() || !deliverTime.isValid())return ;
+    qint64 late = task->deadline.msecsTo(deliverTime);
+    record(METRIC_LATENESS,task->priority,task->excuteCar,late>0?late:0);
+    counters[late>0?COUNTER_DEADLINE_MISSED:COUNTER_DEADLINE_MET].add(deliverTime.toMSecsSinceEpoch());
+}
+
+void TaskStats::record(int metric, int priority, int agvId, qint64 ms)
+{
+    if(metric<0||metric>=METRIC_COUNT)return ;
+    total[metric].record(ms);
+    if(priority>=0&&priority<PRIORITY_COUNT)
+        byPriority[metric][priority].record(ms);
+    if(agvId>0){
+        int slot = agvSlot(agvId,true);
+        if(slot>=0){
+            agvHistograms(slot)->metrics[metric].record(ms);
+        }else if(agvDropped.fetch_add(1)==0){
+            g_log->log(AGV_LOG_LEVEL_WARN,QString("task stats: more than %1 agvs, agv %2 only counted in total").arg(AGV_SLOT_COUNT).arg(agvId));
+        }
+    }
+}
+
+AtomicHistogram::Snapshot TaskStats::snapshot(int metric, int priority, int agvId) const
+{
+    if(metric<0||metric>=METRIC_COUNT)return AtomicHistogram::Snapshot();
+    if(priority>=0){
+        if(priority>=PRIORITY_COUNT)return AtomicHistogram::Snapshot();
+        return byPriority[metric][priority].snapshot();
+    }
+    if(agvId>0){
+        int slot = findAgvSlot(agvId);
+        if(slot<0)return AtomicHistogram::Snapshot();
+        AgvHistograms *h = byAgv[slot].load();
+        if(h==NULL)return AtomicHistogram::Snapshot();
+        return h->metrics[metric].snapshot();
+    }
+    return total[metric].snapshot();
+}
+
+QList<int> TaskStats::agvIds() const
+{
+    QList<int> ids;
+    for(int i=0;i<AGV_SLOT_COUNT;++i){
+        int id = agvSlotIds[i].load();
+        if(id>0)ids.append(id);
+    }
+    return ids;
+}
+
+quint64 TaskStats::perHour(int counter) const
+{
+    if(counter<0||counter>=COUNTER_COUNT)return 0;
+    return counters[counter].sum(getCurrentDateTime().toMSecsSinceEpoch());
+}
+
+//车辆ID到统计槽位。槽位一旦占用不再释放，满了以后新车辆只计入总体和优先级
+int TaskStats::agvSlot(int agvId, bool create)
+{
+    for(int i=0;i<AGV_SLOT_COUNT;++i){
+        int slot = (agvId+i)%AGV_SLOT_COUNT;
+        int id = agvSlotIds[slot].load();
+        if(id==agvId)return slot;
+        if(id==0){
+            if(!create)return -1;
+            int expected = 0;
+            if(agvSlotIds[slot].compare_exchange_strong(expected,agvId))return slot;
+            if(expected==agvId)return slot;
+        }
+    }
+    return -1;
+}
+
+//同时有两个线程分配的，留下先放进去的
+TaskStats::AgvHistograms *TaskStats::agvHistograms(int slot)
+{
+    AgvHistograms *h = byAgv[slot].load();
+    if(h!=NULL)return h;
+    AgvHistograms *created = new AgvHistograms;
+    if(byAgv[slot].compare_exchange_strong(h,created))return created;
+    delete created;
+    return h;
+}
+
+int TaskStats::findAgvSlot(int agvId) const
+{
+    for(int i=0;i<AGV_SLOT_COUNT;++i){
+        int slot = (agvId+i)%AGV_SLOT_COUNT;
+        int id = agvSlotIds[slot].load();
+        if(id==agvId)return slot;
+        if(id==0)return -1;
+    }
+    return -1;
+}
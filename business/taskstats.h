@@ -0,0 +1,95 @@
+﻿#ifndef TASKSTATS_H
+#define TASKSTATS_H
+
+#include <QList>
+#include <QString>
+#include <QDateTime>
+#include <atomic>
+#include "util/histogram.h"
+#include "bean/task.h"
+#include "fleetstate.h"
+
+//任务生命周期各阶段的耗时统计(ms)，按优先级和车辆细分，外加最近一小时的吞吐量
+//所有记录都是原子操作，不需要加锁，也不访问数据库
+class TaskStats
+{
+public:
+    TaskStats();
+    ~TaskStats();
+
+    enum{
+        METRIC_QUEUE_WAIT = 0,//每一段在未分配队列中的等待时间
+        METRIC_TIME_TO_ASSIGN = 1,//从产生到第一次分配到车辆
+        METRIC_TRAVEL_TO_PICK = 2,//开始去取货到到达取货点
+        METRIC_PICK = 3,//到达取货点到取货完成
+        METRIC_TRAVEL_TO_PUT = 4,//开始去放货到到达放货点
+        METRIC_END_TO_END = 5,//从产生到完成
+        METRIC_LATENESS = 6,//有截止时间的任务，送达时超过截止时间多久(按时送达的记0)
+        METRIC_TIME_TO_PICKUP = 7,//从产生到车辆到达取货点
+        METRIC_COUNT = 8,
+    };
+
+    enum{
+        PRIORITY_COUNT = Task::PRIORITY_VERY_HIGH+1,
+        AGV_SLOT_COUNT = FleetState::DEFAULT_CAPACITY,//按车辆细分时最多统计的车辆数，和车队的容量一致
+    };
+
+    enum{
+        COUNTER_CREATED = 0,
+        COUNTER_FINISHED = 1,//完成的任务，不含循环任务
+        COUNTER_CANCELLED = 2,
+        COUNTER_DEADLINE_MET = 3,//按时送达
+        COUNTER_DEADLINE_MISSED = 4,//超过截止时间送达
+        COUNTER_PREEMPTED = 5,//去取货途中被紧急任务抢占
+        COUNTER_CIRCLE_LAPS = 6,//循环任务跑完的圈数
+        COUNTER_COUNT = 7,
+    };
+
+    static QString metricName(int metric);
+
+    //任务事件
+    void onTaskCreated(const Task *task);
+    void onTaskAssigned(const Task *task, const QDateTime &assignTime, bool firstAssign);
+    void onTaskArrive(const Task *task);
+    void onPickFinish(const Task *task);
+    void onTaskFinished(const Task *task);
+    void onTaskCancelled(const Task *task);
+    void onTaskPreempted(const Task *task);
+    //送达(放货完成，或者直接去目的地的任务到达)，检查截止时间
+    void onTaskDelivered(const Task *task, const QDateTime &deliverTime);
+
+    //直接记录一个耗时
+    void record(int metric, int priority, int agvId, qint64 ms);
+
+    //查询。priority和agvId都<0时为总体
+    AtomicHistogram::Snapshot snapshot(int metric, int priority = -1, int agvId = -1) const;
+
+    //有统计数据的车辆
+    QList<int> agvIds() const;
+
+    //车辆数超过槽位数后，没能按车辆细分的记录数(仍然计入总体和优先级)
+    quint64 getAgvDropped() const {return agvDropped.load();}
+
+    //最近一小时的计数
+    quint64 perHour(int counter) const;
+
+private:
+    int agvSlot(int agvId, bool create);
+    int findAgvSlot(int agvId) const;
+
+    AtomicHistogram total[METRIC_COUNT];
+    AtomicHistogram byPriority[METRIC_COUNT][PRIORITY_COUNT];
+    //一辆车的各项指标，槽位第一次使用时才分配(每辆车几十KB，按容量全部预先分配太大)
+    struct AgvHistograms{
+        AtomicHistogram metrics[METRIC_COUNT];
+    };
+    AgvHistograms *agvHistograms(int slot);
+
+    std::atomic<AgvHistograms *> byAgv[AGV_SLOT_COUNT];
+    std::atomic<int> agvSlotIds[AGV_SLOT_COUNT];//开放寻址，0表示空
+    std::atomic<quint64> agvDropped;
+
+    RollingCounter counters[COUNTER_COUNT];
+};
+
+#endif // TASKSTATS_H
@@ -4,9 +4,15 @@
 #include <sstream>
 #include <iostream>
 #include <QUuid>
+#include <QSet>
 #include <stdarg.h>
+#include <algorithm>
 #include <QDebug>
 
+//分页查询历史任务、日志时每页的条数
+#define HISTORY_PAGE_SIZE_DEFAULT   100
+#define HISTORY_PAGE_SIZE_MAX       1000
+
 UserMsgProcessor::UserMsgProcessor(QObject *parent) : QObject(parent)
 {
 }
@@ -245,6 +251,18 @@ std::string UserMsgProcessor::clientMsgAgvProcess(zmq::context_t *ctx,QMap<QStri
     else  if(requestDatas["todo"]=="turnright"){
         //Agv_Light(item,requestDatas,datalists,responseParams,responseDatalists);
     }
+    /// 链路统计
+    else  if(requestDatas["todo"]=="linkstats"){
+        Agv_LinkStats(ctx,requestDatas,datalists,responseParams,responseDatalists);
+    }
+    /// 急停
+    else  if(requestDatas["todo"]=="estop"){
+        Agv_EStop(ctx,requestDatas,datalists,responseParams,responseDatalists);
+    }
+    /// 解除急停
+    else  if(requestDatas["todo"]=="estoprelease"){
+        Agv_EStopRelease(ctx,requestDatas,datalists,responseParams,responseDatalists);
+    }
 
     return getResponseXml(responseParams,responseDatalists);
 }
@@ -349,10 +367,26 @@ std::string UserMsgProcessor::clientMsgTaskProcess(zmq::context_t *ctx,QMap<QStr
     else  if(requestDatas["todo"]=="listDuring"){
         Task_ListDoneDuring(ctx,requestDatas,datalists,responseParams,responseDatalists);
     }
+    /// 已经完成任务列表(分页)
+    else  if(requestDatas["todo"]=="listDonePage"){
+        Task_ListDonePage(ctx,requestDatas,datalists,responseParams,responseDatalists);
+    }
     /// 查询任务详情
     else  if(requestDatas["todo"]=="detail"){
         Task_Detail(ctx,requestDatas,datalists,responseParams,responseDatalists);
     }
+    /// 任务耗时、吞吐量统计
+    else  if(requestDatas["todo"]=="stats"){
+        Task_Stats(ctx,requestDatas,datalists,responseParams,responseDatalists);
+    }
+    /// 修改任务的优先级和截止时间
+    else  if(requestDatas["todo"]=="reschedule"){
+        Task_Reschedule(ctx,requestDatas,datalists,responseParams,responseDatalists);
+    }
+    /// 查询、设置未分配任务的老化步长
+    else  if(requestDatas["todo"]=="aging"){
+        Task_Aging(ctx,requestDatas,datalists,responseParams,responseDatalists);
+    }
     return getResponseXml(responseParams,responseDatalists);
 }
 
@@ -376,6 +410,9 @@ std::string UserMsgProcessor::clientMsgLogProcess(zmq::context_t *ctx,QMap<QStri
     else  if(requestDatas["todo"]=="listAll"){
         Log_ListAll(ctx,requestDatas,datalists,responseParams,responseDatalists);
     }
+    else  if(requestDatas["todo"]=="listPage"){
+        Log_ListPage(ctx,requestDatas,datalists,responseParams,responseDatalists);
+    }
     return getResponseXml(responseParams,responseDatalists);
 }
 
@@ -713,12 +750,13 @@ void UserMsgProcessor:: AgvManage_List(zmq::context_t *ctx, QMap<QString, QStrin
     responseParams.insert(QString("info"),QString(""));
     responseParams.insert(QString("result"),QString("success"));
 
-    for(QMap<int,Agv *>::iterator itr = g_m_agvs.begin();itr!=g_m_agvs.end();++itr){
+    //车辆表只在主线程修改，这里读车队状态里的车辆名单
+    FleetState::RosterPtr roster = g_fleetState->getRoster();
+    for(FleetState::Roster::const_iterator itr = roster->begin();itr!=roster->end();++itr){
         QMap<QString,QString> list;
-        Agv *agv = itr.value();
 
-        list.insert(QString("id"),QString("%1").arg(agv->id));
-        list.insert(QString("name"),QString("%1").arg(agv->name));
+        list.insert(QString("id"),QString("%1").arg(itr.value().agvId));
+        list.insert(QString("name"),QString("%1").arg(itr.value().name));
 
         responseDatalists.push_back(list);
     }
@@ -739,12 +777,8 @@ void UserMsgProcessor:: AgvManage_Add(zmq::context_t *ctx, QMap<QString, QString
             if(queryresult.length()>0 &&queryresult.at(0).length()>0)
             {
                 newId = queryresult.at(0).at(0).toInt();
-                Agv *agv = new Agv;
-                agv->id = (newId);
-                agv->name = (requestDatas["name"]);
-                agv->ip = (requestDatas["ip"]);
-                agv->port = requestDatas["port"].toInt();
-                g_m_agvs.insert(agv->id,agv);
+                //由主线程创建车辆并连接
+                g_hrgAgvCenter->addAgv(newId,requestDatas["name"],requestDatas["ip"],requestDatas["port"].toInt());
                 responseParams.insert(QString("info"),QString(""));
                 responseParams.insert(QString("result"),QString("success"));
                 responseParams.insert(QString("id"),queryresult.at(0).at(0).toString());
@@ -766,17 +800,15 @@ void UserMsgProcessor:: AgvManage_Delete(zmq::context_t *ctx, QMap<QString, QStr
         int iAgvId = requestDatas["agvid"].toInt();
 
         //查找是否存在
-        if(g_m_agvs.contains(iAgvId)){
+        if(g_fleetState->getRoster()->contains(iAgvId)){
             //从数据库中清除
             QString deleteSql = "delete from agv_agv where id=?";
             QList<QVariant> tempParams;
             tempParams<<iAgvId;
             if(g_sql->exeSql(deleteSql,tempParams))
             {
-                //从列表中清楚
-                if(g_m_agvs.contains(iAgvId)){
-                    g_m_agvs.remove(iAgvId);
-                }
+                //由主线程取消它的任务、断开连接，从列表中清除
+                g_hrgAgvCenter->removeAgv(iAgvId);
                 responseParams.insert(QString("info"),QString(""));
                 responseParams.insert(QString("result"),QString("success"));
             }else{
@@ -794,17 +826,16 @@ void UserMsgProcessor:: AgvManage_Modify(zmq::context_t *ctx, QMap<QString, QStr
     if(checkParamExistAndNotNull(requestDatas,responseParams,"agvid","name","ip",NULL)){
         int iAgvId = requestDatas["agvid"].toInt();
 
-        if(!g_m_agvs.contains(iAgvId)){
+        if(!g_fleetState->getRoster()->contains(iAgvId)){
             //不存在这辆车
             responseParams.insert(QString("info"),QString("not exist of this agvid."));
             responseParams.insert(QString("result"),QString("fail"));
         }else{
-            Agv *agv = g_m_agvs[iAgvId];
             QString updateSql = "update agv_agv set agv_name=?,agv_ip=? where id=?";
             QList<QVariant> params;
             params<<(requestDatas["name"])<<(requestDatas["ip"])<<(requestDatas["agvid"]);
             if(g_sql->exeSql(updateSql,params)){
-                agv->name = (requestDatas["name"]);
+                g_hrgAgvCenter->renameAgv(iAgvId,requestDatas["name"]);
                 //agv->setIp(requestDatas["ip"]);
                 responseParams.insert(QString("info"),QString(""));
                 responseParams.insert(QString("result"),QString("success"));
@@ -846,11 +877,14 @@ void UserMsgProcessor::Task_Excute(zmq::context_t *ctx, QMap<QString, QString> &
 void UserMsgProcessor::Task_CreateToX(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists){
     if(checkParamExistAndNotNull(requestDatas,responseParams,"x",NULL))
     {
+        int priority = Task::PRIORITY_NORMAL;
+        QDateTime deadline;
+        if(!getTaskSchedule(requestDatas,responseParams,priority,deadline))return ;
         int iX = requestDatas["x"].toInt();
         AgvStation station =  g_agvMapCenter->getAgvStation(iX);
 
         if(station.id>0){
-            int id = g_taskCenter->makeAimTask(iX);
+            int id = g_taskCenter->makeAimTask(iX,priority,deadline);
             responseParams.insert(QString("info"),QString(""));
             responseParams.insert(QString("result"),QString("success"));
             responseParams.insert(QString("id"),QString("%1").arg(id));
@@ -864,6 +898,9 @@ void UserMsgProcessor::Task_CreateToX(zmq::context_t *ctx, QMap<QString, QString
 //创建任务(创建指定车辆到X点的任务)
 void UserMsgProcessor::Task_CreateAgvToX(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists){
     if(checkParamExistAndNotNull(requestDatas,responseParams,"x","agvid",NULL)){
+        int priority = Task::PRIORITY_NORMAL;
+        QDateTime deadline;
+        if(!getTaskSchedule(requestDatas,responseParams,priority,deadline))return ;
         int iX = requestDatas["x"].toInt();
         int iAgvId = requestDatas["agvid"].toInt();
 
@@ -872,11 +909,11 @@ void UserMsgProcessor::Task_CreateAgvToX(zmq::context_t *ctx, QMap<QString, QStr
         if(station.id<=0){
             responseParams.insert(QString("result"),QString("fail"));
             responseParams.insert(QString("info"),QString("not found station"));
-        }else if(!g_m_agvs.contains(iAgvId)){
+        }else if(!g_fleetState->getRoster()->contains(iAgvId)){
             responseParams.insert(QString("result"),QString("fail"));
             responseParams.insert(QString("info"),QString("not found agv"));
         }else{
-            int id = g_taskCenter->makeAgvAimTask(iAgvId,iX);
+            int id = g_taskCenter->makeAgvAimTask(iAgvId,iX,priority,deadline);
             responseParams.insert(QString("info"),QString(""));
             responseParams.insert(QString("result"),QString("success"));
             responseParams.insert(QString("id"),QString("%1").arg(id));
@@ -887,6 +924,9 @@ void UserMsgProcessor::Task_CreateAgvToX(zmq::context_t *ctx, QMap<QString, QStr
 //创建任务(创建经过Y点到X点的任务)
 void UserMsgProcessor::Task_CreateYToX(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists){
     if(checkParamExistAndNotNull(requestDatas,responseParams,"x","y","z",NULL)){
+        int priority = Task::PRIORITY_NORMAL;
+        QDateTime deadline;
+        if(!getTaskSchedule(requestDatas,responseParams,priority,deadline))return ;
         int iX = requestDatas["x"].toInt();
         int iY = requestDatas["y"].toInt();
         int iZ = requestDatas["z"].toInt();
@@ -906,7 +946,7 @@ void UserMsgProcessor::Task_CreateYToX(zmq::context_t *ctx, QMap<QString, QStrin
             responseParams.insert(QString("result"),QString("fail"));
             responseParams.insert(QString("info"),QString("not found station z"));
         }else{
-            int id = g_taskCenter->makePickupTask(iX,iY,iZ);
+            int id = g_taskCenter->makePickupTask(iX,iY,iZ,priority,deadline);
             responseParams.insert(QString("info"),QString(""));
             responseParams.insert(QString("result"),QString("success"));
             responseParams.insert(QString("id"),QString("%1").arg(id));
@@ -918,6 +958,9 @@ void UserMsgProcessor::Task_CreateYToX(zmq::context_t *ctx, QMap<QString, QStrin
 void UserMsgProcessor::Task_CreateAgvYToX(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists){
 
     if(checkParamExistAndNotNull(requestDatas,responseParams,"x","y","z","agvid",NULL)){
+        int priority = Task::PRIORITY_NORMAL;
+        QDateTime deadline;
+        if(!getTaskSchedule(requestDatas,responseParams,priority,deadline))return ;
         int iX = requestDatas["x"].toInt();
         int iY = requestDatas["y"].toInt();
         int iZ = requestDatas["z"].toInt();
@@ -937,11 +980,11 @@ void UserMsgProcessor::Task_CreateAgvYToX(zmq::context_t *ctx, QMap<QString, QSt
         }else if(zStation.id<=0){
             responseParams.insert(QString("result"),QString("fail"));
             responseParams.insert(QString("info"),QString("not found station z"));
-        }else if(g_m_agvs.contains(agvId)){
+        }else if(!g_fleetState->getRoster()->contains(agvId)){
             responseParams.insert(QString("result"),QString("fail"));
             responseParams.insert(QString("info"),QString("not found agv"));
         }else{
-            int id = g_taskCenter->makeAgvPickupTask(agvId,iX,iY,iZ);
+            int id = g_taskCenter->makeAgvPickupTask(agvId,iX,iY,iZ,priority,deadline);
             responseParams.insert(QString("info"),QString(""));
             responseParams.insert(QString("result"),QString("success"));
             responseParams.insert(QString("id"),QString("%1").arg(id));
@@ -953,6 +996,9 @@ void UserMsgProcessor::Task_CreateAgvYToX(zmq::context_t *ctx, QMap<QString, QSt
 void UserMsgProcessor::Task_CreateAgvYToXCircle(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists){
 
     if(checkParamExistAndNotNull(requestDatas,responseParams,"x","y","z","agvid",NULL)){
+        int priority = Task::PRIORITY_NORMAL;
+        QDateTime deadline;
+        if(!getTaskSchedule(requestDatas,responseParams,priority,deadline))return ;
         int iX = requestDatas["x"].toInt();
         int iY = requestDatas["y"].toInt();
         int iZ = requestDatas["z"].toInt();
@@ -972,11 +1018,11 @@ void UserMsgProcessor::Task_CreateAgvYToXCircle(zmq::context_t *ctx, QMap<QStrin
         }else if(zStation.id<=0){
             responseParams.insert(QString("result"),QString("fail"));
             responseParams.insert(QString("info"),QString("not found station z"));
-        }else if(g_m_agvs.contains(agvId)){
+        }else if(!g_fleetState->getRoster()->contains(agvId)){
             responseParams.insert(QString("result"),QString("fail"));
             responseParams.insert(QString("info"),QString("not found agv"));
         }else{
-            int id = g_taskCenter->makeLoopTask(agvId,iX,iY,iZ);
+            int id = g_taskCenter->makeLoopTask(agvId,iX,iY,iZ,priority,deadline);
             responseParams.insert(QString("info"),QString(""));
             responseParams.insert(QString("result"),QString("success"));
             responseParams.insert(QString("id"),QString("%1").arg(id));
@@ -1014,15 +1060,18 @@ void UserMsgProcessor::Task_ListUnassigned(zmq::context_t *ctx, QMap<QString, QS
     responseParams.insert(QString("info"),QString(""));
     responseParams.insert(QString("result"),QString("success"));
     //添加列表
-    QList<Task *> tasks = g_taskCenter->getUnassignedTasks();
-    for(QList<Task *>::iterator itr = tasks.begin();itr!=tasks.end();++itr){
-        Task * task = *itr;
+    TaskSnapshotPtr snapshot = g_taskCenter->getSnapshot();
+    QList<TaskCopyPtr> tasks = snapshot->unassigned;
+    for(QList<TaskCopyPtr>::iterator itr = tasks.begin();itr!=tasks.end();++itr){
+        const Task * task = itr->get();
         QMap<QString,QString> onetask;
 
         onetask.insert(QString("id"),QString("%1").arg(task->id));
         onetask.insert(QString("produceTime"),task->produceTime.toString(DATE_TIME_FORMAT));
         onetask.insert(QString("excuteCar"),QString("%1").arg(task->excuteCar));
         onetask.insert(QString("status"),QString("%1").arg(task->status));
+        onetask.insert(QString("priority"),QString("%1").arg(task->priority));
+        onetask.insert(QString("deadline"),task->deadline.toString(DATE_TIME_FORMAT));
 
         responseDatalists.push_back(onetask);
     }
@@ -1033,9 +1082,10 @@ void UserMsgProcessor::Task_ListDoing(zmq::context_t *ctx, QMap<QString, QString
     responseParams.insert(QString("info"),QString(""));
     responseParams.insert(QString("result"),QString("success"));
     //添加列表
-    QList<Task *> tasks = g_taskCenter->getDoingTasks();
-    for(QList<Task *>::iterator itr = tasks.begin();itr!=tasks.end();++itr){
-        Task * task = *itr;
+    TaskSnapshotPtr snapshot = g_taskCenter->getSnapshot();
+    QList<TaskCopyPtr> tasks = snapshot->doing;
+    for(QList<TaskCopyPtr>::iterator itr = tasks.begin();itr!=tasks.end();++itr){
+        const Task * task = itr->get();
         QMap<QString,QString> onetask;
 
         onetask.insert(QString("id"),QString("%1").arg(task->id));
@@ -1148,6 +1198,129 @@ void UserMsgProcessor::Task_ListDoneDuring(zmq::context_t *ctx, QMap<QString, QS
     }
 }
 
+//分页参数:pageSize(默认100，最大1000)，游标afterTime+afterId(上一页最后一条的时间和id，第一页不带)
+static bool getPageParams(QMap<QString,QString> &requestDatas,QMap<QString,QString> &responseParams,int &pageSize,int &afterId,QDateTime &afterTime)
+{
+    pageSize = HISTORY_PAGE_SIZE_DEFAULT;
+    afterId = 0;
+    if(requestDatas.contains("pageSize") && requestDatas["pageSize"].length()>0){
+        bool ok = false;
+        pageSize = requestDatas["pageSize"].toInt(&ok);
+        if(!ok || pageSize<=0){
+            responseParams.insert(QString("result"),QString("fail"));
+            responseParams.insert(QString("info"),QString("pageSize must be a positive number"));
+            return false;
+        }
+        if(pageSize>HISTORY_PAGE_SIZE_MAX)pageSize = HISTORY_PAGE_SIZE_MAX;
+    }
+    bool hasId = requestDatas.contains("afterId") && requestDatas["afterId"].length()>0;
+    bool hasTime = requestDatas.contains("afterTime") && requestDatas["afterTime"].length()>0;
+    if(hasId!=hasTime){
+        responseParams.insert(QString("result"),QString("fail"));
+        responseParams.insert(QString("info"),QString("afterId and afterTime must be given together"));
+        return false;
+    }
+    if(hasId){
+        bool ok = false;
+        afterId = requestDatas["afterId"].toInt(&ok);
+        afterTime = QDateTime::fromString(requestDatas["afterTime"],DATE_TIME_FORMAT);
+        if(!ok || afterId<=0 || !afterTime.isValid()){
+            responseParams.insert(QString("result"),QString("fail"));
+            responseParams.insert(QString("info"),QString("invalid cursor"));
+            return false;
+        }
+    }
+    return true;
+}
+
+//可选的时间范围from、to，不带的为无效时间。格式不对的返回失败，不能当作不带
+static bool getTimeRange(QMap<QString,QString> &requestDatas,QMap<QString,QString> &responseParams,QDateTime &from,QDateTime &to)
+{
+    from = QDateTime();
+    to = QDateTime();
+    if(requestDatas.contains("from") && requestDatas["from"].length()>0){
+        from = QDateTime::fromString(requestDatas["from"],DATE_TIME_FORMAT);
+        if(!from.isValid()){
+            responseParams.insert(QString("result"),QString("fail"));
+            responseParams.insert(QString("info"),QString("invalid from, must be ")+DATE_TIME_FORMAT);
+            return false;
+        }
+    }
+    if(requestDatas.contains("to") && requestDatas["to"].length()>0){
+        to = QDateTime::fromString(requestDatas["to"],DATE_TIME_FORMAT);
+        if(!to.isValid()){
+            responseParams.insert(QString("result"),QString("fail"));
+            responseParams.insert(QString("info"),QString("invalid to, must be ")+DATE_TIME_FORMAT);
+            return false;
+        }
+    }
+    return true;
+}
+
+//已经完成任务列表(分页)
+//按完成时间倒序，走agv_task(task_status,task_doneTime)索引，每次最多查pageSize+1行
+void UserMsgProcessor::Task_ListDonePage(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists)
+{
+    int pageSize,afterId;
+    QDateTime afterTime;
+    if(!getPageParams(requestDatas,responseParams,pageSize,afterId,afterTime))return ;
+    QDateTime from,to;
+    if(!getTimeRange(requestDatas,responseParams,from,to))return ;
+
+    QString querySql = "select id,task_produceTime,task_doneTime,task_doTime,task_excuteCar,task_status from agv_task where task_status = ? and task_doneTime is not null ";
+    QList<QVariant> params;
+    if(requestDatas.contains("status") && requestDatas["status"].length()>0)
+        params<<requestDatas["status"].toInt();
+    else
+        params<<Task::AGV_TASK_STATUS_DONE;
+
+    if(requestDatas.contains("excuteCar") && requestDatas["excuteCar"].length()>0){
+        querySql += "and task_excuteCar = ? ";
+        params<<requestDatas["excuteCar"].toInt();
+    }
+    if(from.isValid()){
+        querySql += "and task_doneTime >= ? ";
+        params<<from;
+    }
+    if(to.isValid()){
+        querySql += "and task_doneTime <= ? ";
+        params<<to;
+    }
+    if(afterId>0){
+        querySql += "and (task_doneTime < ? or (task_doneTime = ? and id < ?)) ";
+        params<<afterTime<<afterTime<<afterId;
+    }
+    querySql += "order by task_doneTime desc,id desc limit ?;";
+    params<<pageSize+1;
+
+    QList<QList<QVariant> > result = g_sql->query(querySql,params);
+
+    responseParams.insert(QString("info"),QString(""));
+    responseParams.insert(QString("result"),QString("success"));
+    responseParams.insert(QString("hasMore"),result.length()>pageSize?"1":"0");
+
+    for(int i=0;i<result.length() && i<pageSize;++i)
+    {
+        QList<QVariant> qsl = result.at(i);
+        if(qsl.length() == 6)
+        {
+            QMap<QString,QString> task;
+            task.insert(QString("id"),qsl.at(0).toString());
+            task.insert(QString("produceTime"),qsl.at(1).toDateTime().toString(DATE_TIME_FORMAT));
+            task.insert(QString("doneTime"),qsl.at(2).toDateTime().toString(DATE_TIME_FORMAT));
+            task.insert(QString("doTime"),qsl.at(3).toDateTime().toString(DATE_TIME_FORMAT));
+            task.insert(QString("excuteCar"),qsl.at(4).toString());
+            task.insert(QString("status"),qsl.at(5).toString());
+            responseDatalists.push_back(task);
+        }
+    }
+    if(result.length()>pageSize){
+        QList<QVariant> last = result.at(pageSize-1);
+        responseParams.insert(QString("nextAfterId"),last.at(0).toString());
+        responseParams.insert(QString("nextAfterTime"),last.at(2).toDateTime().toString(DATE_TIME_FORMAT));
+    }
+}
+
 void UserMsgProcessor::Task_Detail(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists)
 {
     //要求带有taskid
@@ -1156,14 +1329,14 @@ void UserMsgProcessor::Task_Detail(zmq::context_t *ctx, QMap<QString, QString> &
     if(checkParamExistAndNotNull(requestDatas,responseParams,"taskid",NULL)){
         int taskId = requestDatas["taskid"].toInt();
 
-        task = g_taskCenter->queryUndoTask(taskId);
-        if(task == NULL){
-            task = g_taskCenter->queryDoingTask(taskId);
-            if(task == NULL){
-                task = g_taskCenter->queryDoneTask(taskId);
-                needDelete = true;
-            }
+        //未完成的任务从快照中复制一份
+        const Task *liveTask = g_taskCenter->getSnapshot()->find(taskId);
+        if(liveTask != NULL){
+            task = new Task(*liveTask);
+        }else{
+            task = g_taskCenter->queryDoneTask(taskId);
         }
+        needDelete = true;
 
         if(task == NULL){
             //未找到该任务
@@ -1205,6 +1378,280 @@ void UserMsgProcessor::Task_Detail(zmq::context_t *ctx, QMap<QString, QString> &
     }
 }
 
+//任务耗时、吞吐量统计(内存中的统计，不查询数据库)
+//每个指标一行:总体、每个优先级、每辆车各一行
+void UserMsgProcessor::Task_Stats(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists)
+{
+    const TaskStats &stats = g_taskCenter->getStats();
+
+    responseParams.insert(QString("info"),QString(""));
+    responseParams.insert(QString("result"),QString("success"));
+    responseParams.insert(QString("createdPerHour"),QString("%1").arg(stats.perHour(TaskStats::COUNTER_CREATED)));
+    responseParams.insert(QString("finishedPerHour"),QString("%1").arg(stats.perHour(TaskStats::COUNTER_FINISHED)));
+    responseParams.insert(QString("cancelledPerHour"),QString("%1").arg(stats.perHour(TaskStats::COUNTER_CANCELLED)));
+    responseParams.insert(QString("deadlineMetPerHour"),QString("%1").arg(stats.perHour(TaskStats::COUNTER_DEADLINE_MET)));
+    responseParams.insert(QString("deadlineMissedPerHour"),QString("%1").arg(stats.perHour(TaskStats::COUNTER_DEADLINE_MISSED)));
+    responseParams.insert(QString("preemptedPerHour"),QString("%1").arg(stats.perHour(TaskStats::COUNTER_PREEMPTED)));
+    responseParams.insert(QString("circleLapsPerHour"),QString("%1").arg(stats.perHour(TaskStats::COUNTER_CIRCLE_LAPS)));
+    //车辆太多，没能按车辆统计的记录数
+    responseParams.insert(QString("agvStatsDropped"),QString("%1").arg(stats.getAgvDropped()));
+
+    QList<int> agvIds = stats.agvIds();
+    for(int metric=0;metric<TaskStats::METRIC_COUNT;++metric)
+    {
+        //可以只查询某一个指标
+        if(requestDatas.contains("metric") && requestDatas["metric"].length()>0 && requestDatas["metric"]!=TaskStats::metricName(metric))
+            continue;
+
+        QList<QPair<QString,int> > dimensions;//维度名称,key
+        dimensions.append(qMakePair(QString("all"),0));
+        for(int p=0;p<TaskStats::PRIORITY_COUNT;++p)
+            dimensions.append(qMakePair(QString("priority"),p));
+        for(int i=0;i<agvIds.length();++i)
+            dimensions.append(qMakePair(QString("agv"),agvIds.at(i)));
+
+        for(int i=0;i<dimensions.length();++i)
+        {
+            AtomicHistogram::Snapshot snapshot;
+            if(dimensions.at(i).first=="priority")
+                snapshot = stats.snapshot(metric,dimensions.at(i).second);
+            else if(dimensions.at(i).first=="agv")
+                snapshot = stats.snapshot(metric,-1,dimensions.at(i).second);
+            else
+                snapshot = stats.snapshot(metric);
+            if(snapshot.count==0)continue;
+
+            QMap<QString,QString> onestat;
+            onestat.insert(QString("metric"),TaskStats::metricName(metric));
+            onestat.insert(QString("dimension"),dimensions.at(i).first);
+            onestat.insert(QString("key"),QString("%1").arg(dimensions.at(i).second));
+            onestat.insert(QString("count"),QString("%1").arg(snapshot.count));
+            onestat.insert(QString("mean"),QString("%1").arg((qint64)snapshot.mean()));
+            onestat.insert(QString("min"),QString("%1").arg(snapshot.min));
+            onestat.insert(QString("p50"),QString("%1").arg(snapshot.percentile(50)));
+            onestat.insert(QString("p90"),QString("%1").arg(snapshot.percentile(90)));
+            onestat.insert(QString("p99"),QString("%1").arg(snapshot.percentile(99)));
+            onestat.insert(QString("max"),QString("%1").arg(snapshot.max));
+            responseDatalists.push_back(onestat);
+        }
+    }
+}
+
+//急停:在zmq线程中直接交给IO线程，不经过主线程和命令队列
+//可选参数 ids(逗号分隔的车辆) 或者 stations(逗号分隔的站点，停在、驶离、驶向这些站点的车辆)，都没有是所有车辆
+void UserMsgProcessor::Agv_EStop(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists)
+{
+    QList<int> agvIds;
+    if(requestDatas.contains("ids") && requestDatas["ids"].length()>0){
+        QStringList ids = requestDatas["ids"].split(",");
+        for(int i=0;i<ids.length();++i){
+            bool ok = false;
+            int id = ids.at(i).trimmed().toInt(&ok);
+            if(ok && id>0)agvIds.append(id);
+        }
+        //给了车辆但是都不对，不能当作所有车辆
+        if(agvIds.isEmpty()){
+            responseParams.insert(QString("info"),QString("invalid ids"));
+            responseParams.insert(QString("result"),QString("fail"));
+            return ;
+        }
+    }else if(requestDatas.contains("stations") && requestDatas["stations"].length()>0){
+        QStringList ids = requestDatas["stations"].split(",");
+        QSet<int> stations;
+        for(int i=0;i<ids.length();++i){
+            bool ok = false;
+            int id = ids.at(i).trimmed().toInt(&ok);
+            if(ok && id>0)stations.insert(id);
+        }
+        QList<FleetState::AgvState> states;
+        if(g_fleetState!=NULL)states = g_fleetState->snapshot();
+        for(int i=0;i<states.length();++i){
+            const FleetState::AgvState &state = states.at(i);
+            if(stations.contains(state.nowStation)||stations.contains(state.lastStation)||stations.contains(state.nextStation))
+                agvIds.append(state.agvId);
+        }
+        //区域内没有车辆
+        if(agvIds.isEmpty()){
+            responseParams.insert(QString("count"),QString("0"));
+            responseParams.insert(QString("info"),QString(""));
+            responseParams.insert(QString("result"),QString("success"));
+            return ;
+        }
+    }
+
+    int count = g_hrgAgvCenter->emergencyStop(agvIds);
+    responseParams.insert(QString("count"),QString("%1").arg(count));
+    responseParams.insert(QString("info"),QString(""));
+    responseParams.insert(QString("result"),QString("success"));
+}
+
+//解除急停:急停是锁定的，解除之前车辆不接任务、不下发命令
+//可选参数 id(只解除一辆车，没有是所有急停的车辆)、task(急停时手上的任务 resume:从当前位置重新下发(默认) cancel:取消)
+void UserMsgProcessor::Agv_EStopRelease(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists)
+{
+    int agvId = 0;
+    if(requestDatas.contains("id") && requestDatas["id"].length()>0){
+        bool ok = false;
+        agvId = requestDatas["id"].toInt(&ok);
+        if(!ok || agvId<=0){
+            responseParams.insert(QString("info"),QString("invalid id"));
+            responseParams.insert(QString("result"),QString("fail"));
+            return ;
+        }
+    }
+    bool cancel = false;
+    if(requestDatas.contains("task") && requestDatas["task"].length()>0){
+        if(requestDatas["task"]=="cancel"){
+            cancel = true;
+        }else if(requestDatas["task"]!="resume"){
+            responseParams.insert(QString("info"),QString("invalid task"));
+            responseParams.insert(QString("result"),QString("fail"));
+            return ;
+        }
+    }
+
+    int count = g_taskCenter->releaseAgv(agvId,cancel);
+    if(agvId>0 && count==0){
+        responseParams.insert(QString("info"),QString("agv not emergency stopped"));
+        responseParams.insert(QString("result"),QString("fail"));
+        return ;
+    }
+    responseParams.insert(QString("count"),QString("%1").arg(count));
+    responseParams.insert(QString("info"),QString(""));
+    responseParams.insert(QString("result"),QString("success"));
+}
+
+//车辆链路统计:往返时间、重传次数、上报间隔的分布(内存中的统计)
+//每辆车一行，往返时间的p99从大到小排列，信号差的车辆在前面。可选参数id只查询一辆车
+void UserMsgProcessor::Agv_LinkStats(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists)
+{
+    int agvId = 0;
+    if(requestDatas.contains("id") && requestDatas["id"].length()>0)
+        agvId = requestDatas["id"].toInt();
+
+    //zmq线程:从名册读车辆和它的命令队列，不访问主线程的车辆表
+    QList<QPair<qint64,QMap<QString,QString> > > rows;
+    FleetState::RosterPtr roster = g_fleetState->getRoster();
+    for(FleetState::Roster::const_iterator itr=roster->begin();itr!=roster->end();++itr)
+    {
+        const FleetState::AgvInfo &info = itr.value();
+        if(agvId>0 && info.agvId!=agvId)continue;
+        AgvCmdQueue *queue = info.cmdQueue.get();
+        if(queue==NULL)continue;
+
+        QMap<QString,QString> onestat;
+        onestat.insert(QString("id"),QString("%1").arg(info.agvId));
+        onestat.insert(QString("name"),info.name);
+        onestat.insert(QString("srtt"),QString("%1").arg(queue->getSrtt()));
+        onestat.insert(QString("rto"),QString("%1").arg(queue->getRto()));
+        onestat.insert(QString("retransmitCount"),QString("%1").arg(queue->getRetransmitCount()));
+        qint64 rttP99 = 0;
+        for(int metric=0;metric<AgvCmdQueue::LINK_METRIC_COUNT;++metric)
+        {
+            AtomicHistogram::Snapshot snapshot = queue->linkSnapshot(metric);
+            QString name = AgvCmdQueue::linkMetricName(metric);
+            onestat.insert(name+"Count",QString("%1").arg(snapshot.count));
+            onestat.insert(name+"Mean",QString("%1").arg(snapshot.mean()));
+            onestat.insert(name+"P50",QString("%1").arg(snapshot.percentile(50)));
+            onestat.insert(name+"P90",QString("%1").arg(snapshot.percentile(90)));
+            onestat.insert(name+"P99",QString("%1").arg(snapshot.percentile(99)));
+            onestat.insert(name+"Max",QString("%1").arg(snapshot.max));
+            if(metric==AgvCmdQueue::LINK_RTT)
+                rttP99 = snapshot.percentile(99);
+        }
+        rows.append(qMakePair(rttP99,onestat));
+    }
+    std::stable_sort(rows.begin(),rows.end(),[](const QPair<qint64,QMap<QString,QString> > &a,const QPair<qint64,QMap<QString,QString> > &b){
+        return a.first>b.first;
+    });
+    for(int i=0;i<rows.length();++i)
+        responseDatalists.push_back(rows.at(i).second);
+
+    //急停从发出到所有IO线程写完的耗时(us)
+    if(g_agvIoEngine!=NULL){
+        AtomicHistogram::Snapshot estop = g_agvIoEngine->getEStopLatency();
+        responseParams.insert(QString("estopCount"),QString("%1").arg(estop.count));
+        responseParams.insert(QString("estopP50"),QString("%1").arg(estop.percentile(50)));
+        responseParams.insert(QString("estopP99"),QString("%1").arg(estop.percentile(99)));
+        responseParams.insert(QString("estopMax"),QString("%1").arg(estop.max));
+    }
+
+    if(agvId>0 && rows.isEmpty()){
+        responseParams.insert(QString("info"),QString("not found agv"));
+        responseParams.insert(QString("result"),QString("fail"));
+        return ;
+    }
+    responseParams.insert(QString("info"),QString(""));
+    responseParams.insert(QString("result"),QString("success"));
+}
+
+//可选参数 priority(0~4) 和 deadline(yyyy-MM-dd hh:mm:ss，为空表示没有截止时间)
+bool UserMsgProcessor::getTaskSchedule(QMap<QString, QString> &requestDatas, QMap<QString, QString> &responseParams, int &priority, QDateTime &deadline)
+{
+    if(requestDatas.contains("priority") && requestDatas["priority"].length()>0){
+        bool ok = false;
+        priority = requestDatas["priority"].toInt(&ok);
+        if(!ok || priority<Task::PRIORITY_VERY_LOW || priority>Task::PRIORITY_VERY_HIGH){
+            responseParams.insert(QString("result"),QString("fail"));
+            responseParams.insert(QString("info"),QString("priority must be in [0,4]"));
+            return false;
+        }
+    }
+    if(requestDatas.contains("deadline") && requestDatas["deadline"].length()>0){
+        deadline = QDateTime::fromString(requestDatas["deadline"],DATE_TIME_FORMAT);
+        if(!deadline.isValid()){
+            responseParams.insert(QString("result"),QString("fail"));
+            responseParams.insert(QString("info"),QString("deadline format error"));
+            return false;
+        }
+    }
+    return true;
+}
+
+//修改任务的优先级和截止时间
+void UserMsgProcessor::Task_Reschedule(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists)
+{
+    if(checkParamExistAndNotNull(requestDatas,responseParams,"taskid",NULL)){
+        int taskid = requestDatas["taskid"].toInt();
+        //没有给出的字段不修改。给出了空的deadline表示取消截止时间
+        int priority = -1;
+        QDateTime deadline;
+        if(!getTaskSchedule(requestDatas,responseParams,priority,deadline))return ;
+        bool changeDeadline = requestDatas.contains("deadline");
+        if(priority<0 && !changeDeadline){
+            responseParams.insert(QString("info"),QString("need priority or deadline"));
+            responseParams.insert(QString("result"),QString("fail"));
+            return ;
+        }
+
+        if(g_taskCenter->rescheduleTask(taskid,priority,changeDeadline,deadline)){
+            responseParams.insert(QString("info"),QString(""));
+            responseParams.insert(QString("result"),QString("success"));
+        }else{
+            responseParams.insert(QString("info"),QString("not find taskid in unassigned or doging tasks list"));
+            responseParams.insert(QString("result"),QString("fail"));
+        }
+    }
+}
+
+//带agingStep(ms)时设置，返回当前的值
+void UserMsgProcessor::Task_Aging(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists)
+{
+    if(requestDatas.contains("agingStep") && requestDatas["agingStep"].length()>0){
+        bool ok = false;
+        qint64 agingStep = requestDatas["agingStep"].toLongLong(&ok);
+        if(!ok || agingStep<0){
+            responseParams.insert(QString("result"),QString("fail"));
+            responseParams.insert(QString("info"),QString("agingStep must be a non-negative number"));
+            return ;
+        }
+        g_taskCenter->setAgingStep(agingStep);
+    }
+    responseParams.insert(QString("agingStep"),QString("%1").arg(g_taskCenter->getAgingStep()));
+    responseParams.insert(QString("info"),QString(""));
+    responseParams.insert(QString("result"),QString("success"));
+}
+
 //查询日志 from to时间
 void UserMsgProcessor::Log_ListDuring(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists)
 {
@@ -1356,6 +1803,72 @@ void UserMsgProcessor::Log_ListAll(zmq::context_t *ctx, QMap<QString, QString> &
     }
 }
 
+//查询日志(分页)
+//按时间倒序，走agv_log(log_time,log_level)索引，每次最多查pageSize+1行
+//可选from to时间，trace debug info warn error fatal为1的级别(都不带表示所有级别)
+void UserMsgProcessor::Log_ListPage(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists)
+{
+    int pageSize,afterId;
+    QDateTime afterTime;
+    if(!getPageParams(requestDatas,responseParams,pageSize,afterId,afterTime))return ;
+    QDateTime from,to;
+    if(!getTimeRange(requestDatas,responseParams,from,to))return ;
+
+    QString querySql = "select id,log_level,log_time,log_msg from agv_log where log_time is not null ";
+    QList<QVariant> params;
+    if(from.isValid()){
+        querySql += "and log_time >= ? ";
+        params<<from;
+    }
+    if(to.isValid()){
+        querySql += "and log_time <= ? ";
+        params<<to;
+    }
+
+    const char *levelNames[] = {"trace","debug","info","warn","error","fatal"};
+    const int levels[] = {AGV_LOG_LEVEL_TRACE,AGV_LOG_LEVEL_DEBUG,AGV_LOG_LEVEL_INFO,AGV_LOG_LEVEL_WARN,AGV_LOG_LEVEL_ERROR,AGV_LOG_LEVEL_FATAL};
+    QStringList levelHolders;
+    for(int i=0;i<6;++i){
+        if(requestDatas.value(levelNames[i])=="1"){
+            levelHolders<<"?";
+            params<<levels[i];
+        }
+    }
+    if(levelHolders.length()>0)
+        querySql += QString("and log_level in (%1) ").arg(levelHolders.join(","));
+
+    if(afterId>0){
+        querySql += "and (log_time < ? or (log_time = ? and id < ?)) ";
+        params<<afterTime<<afterTime<<afterId;
+    }
+    querySql += "order by log_time desc,id desc limit ?;";
+    params<<pageSize+1;
+
+    QList<QList<QVariant> > result = g_sql->query(querySql,params);
+
+    responseParams.insert(QString("info"),QString(""));
+    responseParams.insert(QString("result"),QString("success"));
+    responseParams.insert(QString("hasMore"),result.length()>pageSize?"1":"0");
+
+    for(int i=0;i<result.length() && i<pageSize;++i){
+        QList<QVariant> qsl = result.at(i);
+        if(qsl.length() == 4)
+        {
+            QMap<QString,QString> log;
+            log.insert(QString("id"),qsl.at(0).toString());
+            log.insert(QString("level"),qsl.at(1).toString());
+            log.insert(QString("time"),qsl.at(2).toDateTime().toString(DATE_TIME_FORMAT));
+            log.insert(QString("msg"),qsl.at(3).toString());
+            responseDatalists.push_back(log);
+        }
+    }
+    if(result.length()>pageSize){
+        QList<QVariant> last = result.at(pageSize-1);
+        responseParams.insert(QString("nextAfterId"),last.at(0).toString());
+        responseParams.insert(QString("nextAfterTime"),last.at(2).toDateTime().toString(DATE_TIME_FORMAT));
+    }
+}
+
 
 
 
@@ -5,6 +5,7 @@
 #include <QMutex>
 #include <QThread>
 #include <QObject>
+#include <QDateTime>
 #include <zmq.hpp>
 
 
@@ -41,6 +42,9 @@ private:
     //检查请求的参数里是否包含应该包含的参数，并且不为空。如果不包含或者为空，直接将fail和错误信息写入responseParams中。
     bool checkParamExistAndNotNull(QMap<QString, QString> &requestDatas, QMap<QString, QString> &responseParams, const char *s,...);
 
+    //解析创建任务时可选的优先级和截止时间，格式错误时直接将fail和错误信息写入responseParams中
+    bool getTaskSchedule(QMap<QString, QString> &requestDatas, QMap<QString, QString> &responseParams, int &priority, QDateTime &deadline);
+
     //检查access_token，如果不正确，那就直接写入response中。如果正确，返回这个登录用户的信息
     bool checkAccessToken(zmq::context_t *ctx,QMap<QString,QString> &requestDatas,QMap<QString,QString> &responseParams,LoginUserInfo &loginUserinfo);
 
@@ -98,6 +102,12 @@ private:
     //    void Agv_Turnright(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
     //灯带
     void Agv_Light(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
+    //急停
+    void Agv_EStop(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
+    //解除急停
+    void Agv_EStopRelease(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
+    //链路统计
+    void Agv_LinkStats(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
 
     /////////////////////////////////车辆管理部分
     //列表
@@ -138,14 +148,24 @@ private:
     void Task_ListDoneAll(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
     //已经完成任务列表(from to 时间)
     void Task_ListDoneDuring(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
+    //已经完成任务列表(分页，pageSize afterTime afterId)
+    void Task_ListDonePage(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
     //单个任务的详细情况
     void Task_Detail(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
+    //任务耗时、吞吐量统计
+    void Task_Stats(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
+    //修改任务的优先级和截止时间
+    void Task_Reschedule(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
+    //查询、设置未分配任务的老化步长
+    void Task_Aging(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
 
     ////////////////////////////////////日志管理
     //查询日志 from to时间
     void Log_ListDuring(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
     //查询所有日志
     void Log_ListAll(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
+    //查询日志(分页，pageSize afterTime afterId)
+    void Log_ListPage(zmq::context_t *ctx, QMap<QString, QString> &requestDatas, QList<QMap<QString, QString> > &datalists,QMap<QString,QString> &responseParams,QList<QMap<QString,QString> > &responseDatalists);
 private:
 
     ///登录的客户端的id和它对应的sock
@@ -0,0 +1,26 @@
+QT += core sql network
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = AgvEmulator
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += \
+    main.cpp \
+    agvemulator.cpp \
+    virtualagv.cpp \
+    capturereplayer.cpp
+
+HEADERS += \
+    agvemulator.h \
+    virtualagv.h \
+    capturereplayer.h
+
+#地图载入和服务端共用
+include(../AgvServer.pri)
+
+DEFINES += QT_DEPRECATED_WARNINGS
@@ -0,0 +1,168 @@
+﻿#include "agvemulator.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include "util/global.h"
+
+AgvEmulator::AgvEmulator(const Config &_config, QObject *parent) : QObject(parent),
+    config(_config),
+    rng(12345)
+{
+}
+
+AgvEmulator::~AgvEmulator()
+{
+    for(int i=0;i<vehicles.length();++i)
+        delete vehicles[i].agv;
+}
+
+bool AgvEmulator::start()
+{
+    map.load();
+    if(map.stations.isEmpty()){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"emulator: map has no station");
+        return false;
+    }
+    QList<int> stationIds = map.stations.keys();
+
+    clock.start();
+    int period = 1000/qMax(1,config.reportHz);
+    for(int i=0;i<config.agvCount;++i){
+        Vehicle v;
+        //车辆依次停在各个站点
+        v.agv = new VirtualAgv(config.firstId+i,&map,stationIds.at(i%stationIds.length()),config.agv);
+        v.server = new QTcpServer(this);
+        v.server->setProperty("index",i);
+        if(!v.server->listen(QHostAddress(config.host),config.basePort+i)){
+            g_log->log(AGV_LOG_LEVEL_ERROR,QString("emulator: listen %1:%2 fail:%3").arg(config.host).arg(config.basePort+i).arg(v.server->errorString()));
+            delete v.agv;
+            return false;
+        }
+        connect(v.server,SIGNAL(newConnection()),this,SLOT(onNewConnection()));
+        //错开各车辆的上报
+        v.nextReport = i*period/qMax(1,config.agvCount);
+        vehicles.append(v);
+    }
+
+    connect(&tickTimer,SIGNAL(timeout()),this,SLOT(onTick()));
+    tickTimer.start(config.tickMsecs);
+    if(config.statsSeconds>0){
+        connect(&statsTimer,SIGNAL(timeout()),this,SLOT(printStats()));
+        statsTimer.start(config.statsSeconds*1000);
+    }
+    g_log->log(AGV_LOG_LEVEL_INFO,QString("emulator: %1 agvs listening on %2:%3-%4")
+               .arg(config.agvCount).arg(config.host).arg(config.basePort).arg(config.basePort+config.agvCount-1));
+    return true;
+}
+
+QString AgvEmulator::makeSql()
+{
+    QString sql;
+    for(int i=0;i<config.agvCount;++i){
+        int id = config.firstId+i;
+        sql += QString("update agv_agv set agv_ip='%1',agv_port=%2 where id=%3;\n").arg(config.host).arg(config.basePort+i).arg(id);
+    }
+    return sql;
+}
+
+int AgvEmulator::delay()
+{
+    int d = config.delayMsecs;
+    if(config.jitterMsecs>0)
+        d += std::uniform_int_distribution<int>(0,config.jitterMsecs)(rng);
+    return d;
+}
+
+void AgvEmulator::onNewConnection()
+{
+    QTcpServer *server = qobject_cast<QTcpServer *>(sender());
+    if(server==NULL)return ;
+    int index = server->property("index").toInt();
+    while(server->hasPendingConnections()){
+        QTcpSocket *socket = server->nextPendingConnection();
+        //一辆车只保留最新的连接
+        if(vehicles[index].socket!=NULL){
+            vehicles[index].socket->disconnect(this);
+            vehicles[index].socket->abort();
+            vehicles[index].socket->deleteLater();
+        }
+        socket->setProperty("index",index);
+        socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
+        connect(socket,SIGNAL(readyRead()),this,SLOT(onReadyRead()));
+        connect(socket,SIGNAL(disconnected()),this,SLOT(onDisconnected()));
+        vehicles[index].socket = socket;
+    }
+}
+
+void AgvEmulator::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if(socket==NULL)return ;
+    int index = socket->property("index").toInt();
+    QByteArray data = socket->readAll();
+    int d = delay();
+    if(d<=0){
+        vehicles[index].agv->onRecv(data.constData(),data.length(),clock.elapsed());
+        return ;
+    }
+    QTimer::singleShot(d,this,[this,index,data](){
+        vehicles[index].agv->onRecv(data.constData(),data.length(),clock.elapsed());
+    });
+}
+
+void AgvEmulator::onDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if(socket==NULL)return ;
+    int index = socket->property("index").toInt();
+    if(vehicles[index].socket == socket)
+        vehicles[index].socket = NULL;
+    socket->deleteLater();
+}
+
+void AgvEmulator::send(int index, const QByteArray &frame)
+{
+    QTcpSocket *socket = vehicles[index].socket;
+    if(socket!=NULL && socket->state()==QAbstractSocket::ConnectedState)
+        socket->write(frame);
+}
+
+void AgvEmulator::onTick()
+{
+    qint64 now = clock.elapsed();
+    int period = 1000/qMax(1,config.reportHz);
+    for(int i=0;i<vehicles.length();++i){
+        Vehicle &v = vehicles[i];
+        v.agv->tick(now);
+        if(now<v.nextReport)continue;
+        v.nextReport += period;
+        if(v.nextReport<=now)v.nextReport = now+period;
+        if(v.socket==NULL)continue;
+
+        QByteArray frame = v.agv->makeReport();
+        if(frame.isEmpty())continue;//丢包
+        ++v.reportCount;
+        int d = delay();
+        if(d<=0){
+            send(i,frame);
+        }else{
+            QTimer::singleShot(d,this,[this,i,frame](){send(i,frame);});
+        }
+    }
+}
+
+void AgvEmulator::printStats()
+{
+    int connected = 0;
+    quint64 reports = 0,commands = 0,bad = 0,executed = 0,stations = 0;
+    for(int i=0;i<vehicles.length();++i){
+        if(vehicles[i].socket!=NULL)++connected;
+        reports += vehicles[i].reportCount;
+        commands += vehicles[i].agv->getCommandCount();
+        bad += vehicles[i].agv->getBadPacketCount();
+        executed += vehicles[i].agv->getExecutedCount();
+        stations += vehicles[i].agv->getStationCount();
+    }
+    g_log->log(AGV_LOG_LEVEL_INFO,QString("emulator: connected %1/%2 reports %3 commands %4 bad %5 executed %6 stations %7")
+               .arg(connected).arg(vehicles.length()).arg(reports).arg(commands).arg(bad).arg(executed).arg(stations));
+}
@@ -0,0 +1,72 @@
+﻿#ifndef AGVEMULATOR_H
+#define AGVEMULATOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <QList>
+#include <QElapsedTimer>
+#include <random>
+#include "virtualagv.h"
+
+class QTcpServer;
+class QTcpSocket;
+
+//本地的车辆模拟器:每辆虚拟车辆监听一个TCP端口，服务端像连接真车一样连接它
+//一个线程，定时推进所有车辆的行驶，按设定的频率上报
+class AgvEmulator : public QObject
+{
+    Q_OBJECT
+public:
+    struct Config{
+        int agvCount = 10;
+        int firstId = 1;//第一辆车的id
+        QString host = "127.0.0.1";
+        int basePort = 9000;//第i辆车监听basePort+i
+        int reportHz = 10;//每秒上报次数
+        int tickMsecs = 20;//行驶推进的周期
+        int delayMsecs = 0;//收发的延迟
+        int jitterMsecs = 0;//延迟的随机抖动
+        int statsSeconds = 10;//打印统计的周期，0不打印
+        VirtualAgv::Config agv;
+    };
+
+    explicit AgvEmulator(const Config &_config, QObject *parent = nullptr);
+    ~AgvEmulator();
+
+    //地图已经载入后调用，开始监听
+    bool start();
+
+    //把agv_agv中的车辆指向模拟器的sql
+    QString makeSql();
+
+signals:
+
+public slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+    void onTick();
+    void printStats();
+
+private:
+    struct Vehicle{
+        VirtualAgv *agv = NULL;
+        QTcpServer *server = NULL;
+        QTcpSocket *socket = NULL;
+        qint64 nextReport = 0;
+        quint64 reportCount = 0;
+    };
+
+    int delay();
+    void send(int index, const QByteArray &frame);
+
+    Config config;
+    EmulatorMap map;
+    QList<Vehicle> vehicles;
+    QTimer tickTimer;
+    QTimer statsTimer;
+    QElapsedTimer clock;
+    std::mt19937 rng;
+};
+
+#endif // AGVEMULATOR_H
@@ -0,0 +1,176 @@
+﻿#include "capturereplayer.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include "util/global.h"
+
+#define REPLAY_TICK_MSECS   2
+//尽快回放时，每次最多发送的记录数，让事件循环有机会处理socket
+#define REPLAY_BATCH        4096
+
+CaptureReplayer::CaptureReplayer(const Config &_config, QObject *parent) : QObject(parent),
+    config(_config),
+    replaying(false),
+    hasRecord(false),
+    data(NULL),
+    firstOffset(0),
+    recordCount(0),
+    byteCount(0),
+    skipCount(0),
+    maxLagUsecs(0)
+{
+}
+
+bool CaptureReplayer::start(const QString &fileName)
+{
+    if(!reader.open(fileName)){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"replay: open capture fail:"+fileName+" "+reader.getErrorString());
+        return false;
+    }
+
+    //先扫一遍，找出抓包里有哪些车辆
+    quint64 total = 0;
+    while(reader.next(record,data)){
+        if(!agvIndex.contains(record.agvId))agvIndex.insert(record.agvId,0);
+        if(total==0)firstOffset = record.offsetUsecs;
+        ++total;
+    }
+    reader.rewind();
+    if(total==0){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"replay: capture is empty:"+fileName);
+        return false;
+    }
+
+    for(QMap<int,int>::iterator itr=agvIndex.begin();itr!=agvIndex.end();++itr){
+        Vehicle v;
+        v.agvId = itr.key();
+        itr.value() = vehicles.length();
+        v.server = new QTcpServer(this);
+        v.server->setProperty("index",vehicles.length());
+        int port = config.basePort+vehicles.length();
+        if(!v.server->listen(QHostAddress(config.host),port)){
+            g_log->log(AGV_LOG_LEVEL_ERROR,QString("replay: listen %1:%2 fail:%3").arg(config.host).arg(port).arg(v.server->errorString()));
+            return false;
+        }
+        connect(v.server,SIGNAL(newConnection()),this,SLOT(onNewConnection()));
+        vehicles.append(v);
+    }
+
+    g_log->log(AGV_LOG_LEVEL_INFO,QString("replay: %1 records of %2 agvs, listening on %3:%4-%5, waiting for connections")
+               .arg(total).arg(vehicles.length()).arg(config.host).arg(config.basePort).arg(config.basePort+vehicles.length()-1));
+    waitClock.start();
+    connect(&tickTimer,SIGNAL(timeout()),this,SLOT(onTick()));
+    tickTimer.start(REPLAY_TICK_MSECS);
+    return true;
+}
+
+QString CaptureReplayer::makeSql()
+{
+    QString sql;
+    for(int i=0;i<vehicles.length();++i)
+        sql += QString("update agv_agv set agv_ip='%1',agv_port=%2 where id=%3;\n").arg(config.host).arg(config.basePort+i).arg(vehicles.at(i).agvId);
+    return sql;
+}
+
+void CaptureReplayer::onNewConnection()
+{
+    QTcpServer *server = qobject_cast<QTcpServer *>(sender());
+    if(server==NULL)return ;
+    int index = server->property("index").toInt();
+    while(server->hasPendingConnections()){
+        QTcpSocket *socket = server->nextPendingConnection();
+        if(vehicles[index].socket!=NULL){
+            vehicles[index].socket->disconnect(this);
+            vehicles[index].socket->abort();
+            vehicles[index].socket->deleteLater();
+        }
+        socket->setProperty("index",index);
+        socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
+        connect(socket,SIGNAL(disconnected()),this,SLOT(onDisconnected()));
+        vehicles[index].socket = socket;
+    }
+}
+
+void CaptureReplayer::onDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if(socket==NULL)return ;
+    int index = socket->property("index").toInt();
+    if(vehicles[index].socket == socket)
+        vehicles[index].socket = NULL;
+    socket->deleteLater();
+}
+
+void CaptureReplayer::begin()
+{
+    int connected = 0;
+    for(int i=0;i<vehicles.length();++i)
+        if(vehicles.at(i).socket!=NULL)++connected;
+    g_log->log(AGV_LOG_LEVEL_INFO,QString("replay: start, connected %1/%2, speed %3").arg(connected).arg(vehicles.length()).arg(config.speed));
+    replaying = true;
+    clock.start();
+    //尽快回放时不用等定时器
+    if(config.speed<=0)tickTimer.setInterval(0);
+}
+
+qint64 CaptureReplayer::pendingBytes()
+{
+    qint64 bytes = 0;
+    for(int i=0;i<vehicles.length();++i)
+        if(vehicles.at(i).socket!=NULL)bytes += vehicles.at(i).socket->bytesToWrite();
+    return bytes;
+}
+
+void CaptureReplayer::onTick()
+{
+    if(!replaying){
+        bool all = true;
+        for(int i=0;i<vehicles.length() && all;++i)
+            all = vehicles.at(i).socket!=NULL;
+        if(!all && waitClock.elapsed()<config.waitSeconds*1000LL)return ;
+        begin();
+    }
+
+    qint64 due = 0;
+    if(config.speed>0)
+        due = firstOffset+(qint64)(clock.nsecsElapsed()/1000*config.speed);
+    else if(pendingBytes()>config.maxPendingBytes)
+        return ;
+
+    for(int n=0;config.speed>0 || n<REPLAY_BATCH;++n){
+        if(!hasRecord){
+            hasRecord = reader.next(record,data);
+            if(!hasRecord){
+                tickTimer.stop();
+                report();
+                emit finished();
+                return ;
+            }
+        }
+        if(config.speed>0){
+            if(record.offsetUsecs>due)break;
+            maxLagUsecs = qMax(maxLagUsecs,(qint64)((due-record.offsetUsecs)/config.speed));
+        }
+        hasRecord = false;
+
+        //连接、断开只是记录，回放时由服务端自己连接
+        if(record.type!=AgvCaptureRecord::TYPE_DATA || record.length==0)continue;
+        Vehicle &v = vehicles[agvIndex.value(record.agvId)];
+        if(v.socket==NULL || v.socket->state()!=QAbstractSocket::ConnectedState){
+            ++skipCount;
+            continue;
+        }
+        v.socket->write(data,record.length);
+        v.bytes += record.length;
+        ++recordCount;
+        byteCount += record.length;
+    }
+}
+
+void CaptureReplayer::report()
+{
+    double seconds = clock.nsecsElapsed()/1e9;
+    g_log->log(AGV_LOG_LEVEL_INFO,QString("replay: finished, records %1 bytes %2 skipped %3 seconds %4 records/s %5 max lag(ms) %6")
+               .arg(recordCount).arg(byteCount).arg(skipCount).arg(seconds)
+               .arg(seconds>0?recordCount/seconds:0).arg(maxLagUsecs/1000.0));
+}
@@ -0,0 +1,77 @@
+﻿#ifndef CAPTUREREPLAYER_H
+#define CAPTUREREPLAYER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QList>
+#include <QMap>
+#include <QElapsedTimer>
+#include "network/agvcapture.h"
+
+class QTcpServer;
+class QTcpSocket;
+
+//把抓包文件里车辆上报的原始数据，按原来的时间间隔(或者尽快)发回给服务端
+//每辆车监听一个端口，和模拟器一样，服务端的agv_agv指向这里即可
+class CaptureReplayer : public QObject
+{
+    Q_OBJECT
+public:
+    struct Config{
+        QString host = "127.0.0.1";
+        int basePort = 9000;//抓包中第i辆车(按id排序)监听basePort+i
+        double speed = 1;//回放速度倍数，0表示尽快
+        int waitSeconds = 30;//等待服务端连上所有车辆，超时就开始回放
+        int maxPendingBytes = 1024*1024;//尽快回放时，socket未发出的数据超过这么多就等一下
+    };
+
+    explicit CaptureReplayer(const Config &_config, QObject *parent = nullptr);
+
+    //读取抓包文件，开始监听
+    bool start(const QString &fileName);
+
+    //把agv_agv中的车辆指向回放器的sql
+    QString makeSql();
+
+signals:
+    void finished();
+
+public slots:
+    void onNewConnection();
+    void onDisconnected();
+    void onTick();
+
+private:
+    struct Vehicle{
+        int agvId = 0;
+        QTcpServer *server = NULL;
+        QTcpSocket *socket = NULL;
+        quint64 bytes = 0;
+    };
+
+    void begin();
+    qint64 pendingBytes();
+    void report();
+
+    Config config;
+    AgvCaptureReader reader;
+    QList<Vehicle> vehicles;
+    QMap<int,int> agvIndex;//agvId -> vehicles的下标
+
+    QTimer tickTimer;
+    QElapsedTimer clock;//开始回放的时间
+    QElapsedTimer waitClock;
+    bool replaying;
+
+    bool hasRecord;//record是读出来还没有发送的记录
+    AgvCaptureRecord record;
+    const char *data;
+    qint64 firstOffset;
+
+    quint64 recordCount;
+    quint64 byteCount;
+    quint64 skipCount;//车辆没有连接，没有发出的
+    qint64 maxLagUsecs;//按时间回放时最多落后多少
+};
+
+#endif // CAPTUREREPLAYER_H
@@ -0,0 +1,120 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include "util/global.h"
+#include "agvemulator.h"
+#include "capturereplayer.h"
+
+//本地压测用的车辆模拟器:按真实的协议收发，服务端的agv_agv指向这里即可
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("AgvEmulator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("AGV wire protocol emulator for local load testing");
+    parser.addHelpOption();
+    QCommandLineOption mapOption("map","map file (station=/line=/arc= lines, same format as map/create).","file");
+    QCommandLineOption dbOption("db","load map from database.");
+    QCommandLineOption agvsOption("agvs","number of virtual agvs.","count","10");
+    QCommandLineOption firstIdOption("first-id","id of the first agv.","id","1");
+    QCommandLineOption hostOption("host","listen address.","host","127.0.0.1");
+    QCommandLineOption portOption("port","port of the first agv, the others follow.","port","9000");
+    QCommandLineOption hzOption("hz","reports per second of each agv.","hz","10");
+    QCommandLineOption speedOption("speed","speed at speed code 10 in mm/s.","speed","1000");
+    QCommandLineOption lossOption("loss","probability of losing a command or a report.","p","0");
+    QCommandLineOption corruptOption("corrupt","probability of a report with a bad checksum.","p","0");
+    QCommandLineOption delayOption("delay","delay of every command and report in ms.","ms","0");
+    QCommandLineOption jitterOption("jitter","random extra delay in ms.","ms","0");
+    QCommandLineOption errorOption("errors","injected errors per agv per hour.","count","0");
+    QCommandLineOption statsOption("stats","print stats every these seconds (0 for never).","seconds","10");
+    QCommandLineOption sqlOption("print-sql","print the sql pointing agv_agv at the emulator and exit.");
+    QCommandLineOption replayOption("replay","replay the raw reports of a capture file (server --capture) instead of emulating.","file");
+    QCommandLineOption replaySpeedOption("replay-speed","replay speed, 1 for the recorded timing, 0 for as fast as possible.","x","1");
+    QCommandLineOption replayWaitOption("replay-wait","seconds to wait for the server to connect every agv before replaying.","seconds","30");
+    parser.addOption(mapOption);
+    parser.addOption(dbOption);
+    parser.addOption(agvsOption);
+    parser.addOption(firstIdOption);
+    parser.addOption(hostOption);
+    parser.addOption(portOption);
+    parser.addOption(hzOption);
+    parser.addOption(speedOption);
+    parser.addOption(lossOption);
+    parser.addOption(corruptOption);
+    parser.addOption(delayOption);
+    parser.addOption(jitterOption);
+    parser.addOption(errorOption);
+    parser.addOption(statsOption);
+    parser.addOption(sqlOption);
+    parser.addOption(replayOption);
+    parser.addOption(replaySpeedOption);
+    parser.addOption(replayWaitOption);
+    parser.process(a);
+
+    AgvEmulator::Config config;
+    config.agvCount = qMax(1,parser.value(agvsOption).toInt());
+    config.firstId = parser.value(firstIdOption).toInt();
+    config.host = parser.value(hostOption);
+    config.basePort = parser.value(portOption).toInt();
+    config.reportHz = qMax(1,parser.value(hzOption).toInt());
+    config.delayMsecs = qMax(0,parser.value(delayOption).toInt());
+    config.jitterMsecs = qMax(0,parser.value(jitterOption).toInt());
+    config.statsSeconds = qMax(0,parser.value(statsOption).toInt());
+    config.agv.maxSpeed = parser.value(speedOption).toDouble();
+    config.agv.loss = qBound(0.0,parser.value(lossOption).toDouble(),1.0);
+    config.agv.corrupt = qBound(0.0,parser.value(corruptOption).toDouble(),1.0);
+    config.agv.errorRate = qMax(0.0,parser.value(errorOption).toDouble());
+
+    //回放抓包，不需要地图
+    if(parser.isSet(replayOption)){
+        g_log = new AgvLog();
+        g_log->setPersist(false);
+        CaptureReplayer::Config replayConfig;
+        replayConfig.host = config.host;
+        replayConfig.basePort = config.basePort;
+        replayConfig.speed = qMax(0.0,parser.value(replaySpeedOption).toDouble());
+        replayConfig.waitSeconds = qMax(0,parser.value(replayWaitOption).toInt());
+        CaptureReplayer replayer(replayConfig);
+        if(!replayer.start(parser.value(replayOption)))
+            return 1;
+        if(parser.isSet(sqlOption)){
+            QTextStream(stdout)<<replayer.makeSql();
+            return 0;
+        }
+        //留一点时间让socket发完
+        QObject::connect(&replayer,&CaptureReplayer::finished,[&a](){QTimer::singleShot(1000,&a,SLOT(quit()));});
+        return a.exec();
+    }
+
+    if(parser.isSet(sqlOption)){
+        AgvEmulator emulator(config);
+        QTextStream(stdout)<<emulator.makeSql();
+        return 0;
+    }
+
+    if(!parser.isSet(mapOption) && !parser.isSet(dbOption)){
+        qDebug()<<"need --map or --db";
+        return 1;
+    }
+
+    g_log = new AgvLog();
+    g_log->setPersist(false);
+
+    //地图只读，不写数据库
+    g_agvMapCenter = new MapCenter;
+    if(parser.isSet(dbOption)){
+        g_sql = new Sql();
+        g_sql->createConnection();
+        g_agvMapCenter->load();
+    }else{
+        g_agvMapCenter->setPersist(false);
+        if(!g_agvMapCenter->loadFromFile(parser.value(mapOption)))
+            return 1;
+    }
+
+    AgvEmulator emulator(config);
+    if(!emulator.start())
+        return 1;
+    return a.exec();
+}
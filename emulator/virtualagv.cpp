@@ -0,0 +1,296 @@
+﻿#include "virtualagv.h"
+#include "util/global.h"
+#include "util/common.h"
+#include "network/agvprotocol.h"
+#include <QtMath>
+#include <cmath>
+
+using AgvProtocol::DispatchFrame;
+using AgvProtocol::StatusFrame;
+
+void EmulatorMap::load()
+{
+    stations.clear();
+    lines.clear();
+    outLines.clear();
+    for(QMap<int,AgvStation *>::iterator itr=g_m_stations.begin();itr!=g_m_stations.end();++itr){
+        Station s;
+        s.id = itr.value()->id;
+        s.rfid = itr.value()->rfid;
+        s.x = itr.value()->x;
+        s.y = itr.value()->y;
+        stations.insert(s.id,s);
+    }
+    for(QMap<int,AgvLine *>::iterator itr=g_m_lines.begin();itr!=g_m_lines.end();++itr){
+        AgvLine *l = itr.value();
+        if(!stations.contains(l->startStation)||!stations.contains(l->endStation))continue;
+        Line line;
+        line.id = l->id;
+        line.startStation = l->startStation;
+        line.endStation = l->endStation;
+        line.length = l->length*l->rate;
+        if(line.length<=0){
+            const Station &a = stations[l->startStation];
+            const Station &b = stations[l->endStation];
+            line.length = std::sqrt((a.x-b.x)*(a.x-b.x)+(a.y-b.y)*(a.y-b.y));
+        }
+        if(line.length<1)line.length = 1;
+        lines.insert(line.id,line);
+        outLines[line.startStation].append(line.id);
+    }
+}
+
+VirtualAgv::VirtualAgv(int _id, const EmulatorMap *_map, int startStation, const Config &_config):
+    id(_id),
+    map(_map),
+    config(_config),
+    rng(_id),
+    prob(0,1),
+    station(startStation)
+{
+    if(map->stations.contains(station))
+        currentRfid = map->stations[station].rfid;
+}
+
+void VirtualAgv::onRecv(const char *data, int len, qint64 nowMsecs)
+{
+    recvBuffer.append(data,len);
+    while(recvBuffer.length()>0){
+        int head = recvBuffer.indexOf((char)DispatchFrame::HEAD);
+        if(head<0){
+            recvBuffer.clear();
+            break;
+        }
+        if(head>0)recvBuffer.remove(0,head);
+        if(recvBuffer.length()<2)break;
+
+        //包头 包长 内容 校验和 包尾，包长不含包头
+        int total = (recvBuffer.at(1)&0xFF)+1;
+        if(total<6){
+            ++badPacketCount;
+            recvBuffer.remove(0,1);
+            continue;
+        }
+        if(recvBuffer.length()<total)break;
+        const unsigned char *p = (const unsigned char *)recvBuffer.constData();
+        if(p[total-1]!=DispatchFrame::END || checkSum((unsigned char *)p+2,total-4)!=p[total-2]){
+            ++badPacketCount;
+            recvBuffer.remove(0,1);
+            continue;
+        }
+        onPacket(p+2,total-4,nowMsecs);
+        recvBuffer.remove(0,total);
+    }
+}
+
+void VirtualAgv::onPacket(const unsigned char *content, int len, qint64 nowMsecs)
+{
+    //只处理调度模式的命令
+    if(len<2 || content[0]!=DispatchFrame::CODE)return ;
+    if(config.loss>0 && prob(rng)<config.loss)return ;
+
+    ++commandCount;
+    //新的包替换掉缓存的指令，最后一条是结束的停止指令，不执行
+    orders.clear();
+    int groupsOffset = DispatchFrame::GROUPS_OFFSET-DispatchFrame::CONTENT_OFFSET;
+    for(int i=0;i<WINDOW_ORDERS && groupsOffset+(i+1)*DispatchFrame::GROUP_SIZE<=len;++i){
+        const unsigned char *o = content+groupsOffset+i*DispatchFrame::GROUP_SIZE;
+        Order order;
+        order.rfid = DispatchFrame::Rfid::get(o);
+        order.order = DispatchFrame::Order::get(o);
+        order.param = DispatchFrame::Param::get(o);
+        orders.append(order);
+    }
+    executed = 0;
+    recvQueueNumber = content[1];
+    executeOrders(nowMsecs);
+}
+
+//按顺序执行触发了的指令:立即执行的，或者卡号是当前站点的
+void VirtualAgv::executeOrders(qint64 nowMsecs)
+{
+    while(errorNo==0 && executed<orders.length() && nowMsecs>=busyUntil){
+        const Order &o = orders.at(executed);
+        bool immediately = o.rfid==AgvOrder::RFID_CODE_IMMEDIATELY || o.rfid==(int)AgvOrder::RFID_CODE_EMPTY;
+        if(!immediately && (station<=0 || map->stations[station].rfid!=o.rfid))break;
+        execute(o,nowMsecs);
+        ++executed;
+        ++executedCount;
+    }
+}
+
+void VirtualAgv::execute(const Order &o, qint64 nowMsecs)
+{
+    switch(o.order){
+    case AgvOrder::ORDER_FORWARD:
+    case AgvOrder::ORDER_BACKWARD:
+        speedCode = qBound(1,o.param,10);
+        moving = true;
+        break;
+    case AgvOrder::ORDER_FORWARD_STRIPE:
+    case AgvOrder::ORDER_BACKWARD_PLATE:
+        speedCode = 3;
+        moving = true;
+        break;
+    case AgvOrder::ORDER_STOP:
+        moving = false;
+        speedCode = 0;
+        busyUntil = nowMsecs+o.param*1000;
+        break;
+    case AgvOrder::ORDER_TURN_LEFT:
+    case AgvOrder::ORDER_TURN_RIGHT:
+    {
+        moving = false;
+        double angle = (o.param==0?90:o.param)*M_PI/180;
+        lastHeading += o.order==AgvOrder::ORDER_TURN_LEFT?angle:-angle;
+        busyUntil = nowMsecs+config.turnMsecs;
+        break;
+    }
+    case AgvOrder::ORDER_UP_DOWN:
+        targetHeight = o.param;
+        busyUntil = nowMsecs+qAbs(targetHeight-height)*1000/qMax(1,config.liftSpeed);
+        break;
+    default:
+        break;
+    }
+}
+
+double VirtualAgv::heading(const EmulatorMap::Line &l)
+{
+    const EmulatorMap::Station &a = map->stations[l.startStation];
+    const EmulatorMap::Station &b = map->stations[l.endStation];
+    return std::atan2(b.y-a.y,b.x-a.x);
+}
+
+//从站点出发选一条线路:后面的指令要去的卡号所在的站点，没有的话沿着原来的方向直行
+bool VirtualAgv::chooseLine(int from)
+{
+    QList<int> outs = map->outLines.value(from);
+    if(outs.isEmpty())return false;
+
+    int target = 0;
+    for(int i=executed;i<orders.length();++i){
+        if(orders.at(i).rfid!=AgvOrder::RFID_CODE_IMMEDIATELY && orders.at(i).rfid!=(int)AgvOrder::RFID_CODE_EMPTY){
+            target = orders.at(i).rfid;
+            break;
+        }
+    }
+
+    int best = 0;
+    if(target!=0){
+        for(int i=0;i<outs.length();++i){
+            const EmulatorMap::Line &l = map->lines[outs.at(i)];
+            if(map->stations[l.endStation].rfid == target){
+                best = l.id;
+                break;
+            }
+        }
+    }
+    if(best==0){
+        double minDiff = M_PI/4;
+        for(int i=0;i<outs.length();++i){
+            const EmulatorMap::Line &l = map->lines[outs.at(i)];
+            double diff = std::fabs(std::remainder(heading(l)-lastHeading,2*M_PI));
+            if(diff<=minDiff){
+                minDiff = diff;
+                best = l.id;
+            }
+        }
+        //第一次出发，只有一条路
+        if(best==0 && mileage==0 && outs.length()==1)
+            best = outs.at(0);
+    }
+    if(best==0)return false;
+
+    const EmulatorMap::Line &l = map->lines[best];
+    line = best;
+    station = 0;
+    progress = 0;
+    lastHeading = heading(l);
+    nextRfid = map->stations[l.endStation].rfid;
+    return true;
+}
+
+void VirtualAgv::arrive(int to, qint64 nowMsecs)
+{
+    station = to;
+    line = 0;
+    progress = 0;
+    currentRfid = map->stations[to].rfid;
+    nextRfid = 0;
+    ++stationCount;
+    executeOrders(nowMsecs);
+}
+
+void VirtualAgv::tick(qint64 nowMsecs)
+{
+    if(lastTick==0){
+        lastTick = nowMsecs;
+        return ;
+    }
+    qint64 dt = nowMsecs-lastTick;
+    lastTick = nowMsecs;
+    if(dt<=0)return ;
+
+    //故障
+    if(errorNo!=0){
+        if(nowMsecs>=errorUntil)errorNo = 0;
+    }else if(config.errorRate>0 && prob(rng)<config.errorRate*dt/3600000.0){
+        errorNo = ERROR_CODE;
+        errorUntil = nowMsecs+config.errorMsecs;
+        moving = false;
+        speedCode = 0;
+    }
+
+    if(nowMsecs>=busyUntil)height = targetHeight;
+    executeOrders(nowMsecs);
+
+    double dist = config.maxSpeed*speedCode/10.0*dt/1000.0;
+    while(moving && errorNo==0 && nowMsecs>=busyUntil && dist>0){
+        if(station>0 && !chooseLine(station)){
+            //没有路了
+            moving = false;
+            speedCode = 0;
+            break;
+        }
+        const EmulatorMap::Line &l = map->lines[line];
+        double remain = l.length-progress;
+        if(dist<remain){
+            progress += dist;
+            mileage += dist;
+            break;
+        }
+        mileage += remain;
+        dist -= remain;
+        arrive(l.endStation,nowMsecs);
+    }
+}
+
+QByteArray VirtualAgv::makeReport()
+{
+    if(config.loss>0 && prob(rng)<config.loss)return QByteArray();
+
+    bool running = moving && errorNo==0;
+    AgvTelemetry t;
+    t.mileage = (int)mileage;
+    t.currentRfid = currentRfid;
+    t.nextRfid = nextRfid;
+    t.current = running?150:20;//电流 0.1A
+    t.voltage = qMax(2200,2600-(int)(mileage/100000));//电压 0.01V
+    t.positionMagneticStripe = 0;
+    t.pcbTemperature = 35;
+    t.motorTemperature = running?45:35;
+    t.cpu = 20;
+    t.speed = running?speedCode:0;
+    t.angle = 0;
+    t.height = height;
+    t.error_no = errorNo;
+    t.mode = 0;//自动模式
+    t.recvQueueNumber = recvQueueNumber;
+    t.orderCount = executed;
+
+    unsigned char frame[StatusFrame::LENGTH];
+    StatusFrame::encode(frame,t);
+    if(config.corrupt>0 && prob(rng)<config.corrupt)frame[StatusFrame::CHECKSUM_OFFSET] ^= 0x5A;
+    return QByteArray((const char *)frame,StatusFrame::LENGTH);
+}
@@ -0,0 +1,124 @@
+﻿#ifndef VIRTUALAGV_H
+#define VIRTUALAGV_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <random>
+
+//仿真器使用的地图(从MapCenter载入后复制一份，只读)
+struct EmulatorMap
+{
+    struct Station{
+        int id = 0;
+        int rfid = 0;
+        double x = 0;
+        double y = 0;
+    };
+    struct Line{
+        int id = 0;
+        int startStation = 0;
+        int endStation = 0;
+        double length = 0;//mm，和服务端计算位置用的一样(length*rate)
+    };
+    QMap<int,Station> stations;
+    QMap<int,Line> lines;
+    QMap<int,QList<int> > outLines;//站点 -> 从它出发的线路
+
+    //从g_m_stations、g_m_lines复制
+    void load();
+};
+
+//一辆虚拟车辆，按真实的协议收发
+//1.收命令包(0x55...0xAA)，按序号替换缓存的指令，按卡号(RFID)触发执行
+//2.沿着地图的线路行驶，经过站点时上报卡号、里程
+//3.上报包(0x66...0x88)带着最后收到的包序号和执行到了第几条
+//不涉及网络，由AgvEmulator驱动
+class VirtualAgv
+{
+public:
+    struct Config{
+        double maxSpeed = 1000;//速度代码10对应的速度 mm/s
+        int turnMsecs = 2000;//转向的耗时
+        int liftSpeed = 10;//升降速度 cm/s
+        double loss = 0;//命令包、上报包丢失的概率
+        double corrupt = 0;//上报包校验和错误的概率
+        double errorRate = 0;//每辆车每小时发生故障的次数
+        int errorMsecs = 5000;//故障持续的时间
+    };
+
+    enum{
+        WINDOW_ORDERS = 3,//一个包的指令数(后面还有一条结束的停止指令)
+        ERROR_CODE = 0xD1,//注入的故障:磁传感器断线
+    };
+
+    VirtualAgv(int _id, const EmulatorMap *_map, int startStation, const Config &_config);
+
+    int getId(){return id;}
+
+    //收到的数据(可能是不完整的包或者多个包)
+    void onRecv(const char *data, int len, qint64 nowMsecs);
+
+    //推进到nowMsecs
+    void tick(qint64 nowMsecs);
+
+    //上报包，丢失时返回空
+    QByteArray makeReport();
+
+    quint64 getCommandCount(){return commandCount;}
+    quint64 getBadPacketCount(){return badPacketCount;}
+    quint64 getExecutedCount(){return executedCount;}
+    quint64 getStationCount(){return stationCount;}
+
+private:
+    struct Order{
+        int rfid = 0;
+        int order = 0;
+        int param = 0;
+    };
+
+    void onPacket(const unsigned char *content, int len, qint64 nowMsecs);
+    void executeOrders(qint64 nowMsecs);
+    void execute(const Order &o, qint64 nowMsecs);
+    bool chooseLine(int station);
+    void arrive(int station, qint64 nowMsecs);
+    double heading(const EmulatorMap::Line &line);
+
+    int id;
+    const EmulatorMap *map;
+    Config config;
+    std::mt19937 rng;
+    std::uniform_real_distribution<double> prob;
+
+    QByteArray recvBuffer;
+
+    //缓存的指令
+    QList<Order> orders;
+    int executed = 0;
+    int recvQueueNumber = 0;
+    qint64 busyUntil = 0;//转向、升降完成的时间
+
+    //位置
+    int station = 0;//停在站点上，0表示在线路上
+    int line = 0;//行驶的线路
+    double progress = 0;//在线路上走过的距离 mm
+    double lastHeading = 0;
+    bool moving = false;
+    int speedCode = 0;
+    int currentRfid = 0;
+    int nextRfid = 0;
+    double mileage = 0;
+    int height = 0;
+    int targetHeight = 0;
+
+    int errorNo = 0;
+    qint64 errorUntil = 0;
+    qint64 lastTick = 0;
+
+    quint64 commandCount = 0;
+    quint64 badPacketCount = 0;
+    quint64 executedCount = 0;
+    quint64 stationCount = 0;
+};
+
+#endif // VIRTUALAGV_H
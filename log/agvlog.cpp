@@ -3,7 +3,8 @@
 #include <QDebug>
 #include "util/global.h"
 
-AgvLog::AgvLog(QObject *parent):QObject(parent)
+AgvLog::AgvLog(QObject *parent):QObject(parent),
+    persist(true)
 {
 
 }
@@ -41,11 +42,14 @@ void AgvLog::log(AGV_LOG_LEVEL level, QString msg)
     qDebug() <<now.toString(DATE_TIME_FORMAT)<<strLevel<<msg;
 
     //2.入队一个消息
+    if(!persist)return ;
     OneLog onelog;
     onelog.level = level;
     onelog.time = now;
     onelog.msg = msg;
 
     g_log_queue.enqueue(onelog);
+    if(g_logProcess!=NULL)
+        g_logProcess->onLogQueued();
 }
 
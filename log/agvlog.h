@@ -27,9 +27,15 @@ public:
     explicit AgvLog(QObject *parent = nullptr);
 
     void log(AGV_LOG_LEVEL level, QString msg);
+
+    //没有日志线程的程序(仿真、模拟车辆)只打印，不入队，否则队列只增不减
+    void setPersist(bool _persist){persist = _persist;}
 signals:
 
 public slots:
+
+private:
+    bool persist;
 };
 
 #endif // AGVLOG_H
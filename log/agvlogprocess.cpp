@@ -2,14 +2,41 @@
 #include "util/global.h"
 #include <sstream>
 
-AgvLogProcess::AgvLogProcess(QObject *parent) : QThread(parent),isQuit(false)
+AgvLogProcess::AgvLogProcess(QObject *parent) : QThread(parent),isQuit(false),flushPending(false),flushTimer(0),hasLog(false)
 {
 
 }
 
+//不再安排新的唤醒，取消等待中的唤醒(回调用到了this)，等线程退出
 AgvLogProcess::~AgvLogProcess()
 {
     isQuit = true;
+    flushPending = true;
+    if(g_timingWheel!=NULL)
+        g_timingWheel->cancel(flushTimer.load());
+    mtx.lock();
+    cond.wakeOne();
+    mtx.unlock();
+    wait();
+}
+
+void AgvLogProcess::onLogQueued()
+{
+    //已经有一次唤醒在等待了，这条日志一起处理
+    if(isQuit || flushPending.exchange(true))return ;
+    if(g_timingWheel!=NULL)
+        flushTimer = g_timingWheel->schedule(FLUSH_DELAY,[this](){wake();});
+    else
+        wake();
+}
+
+void AgvLogProcess::wake()
+{
+    flushPending = false;
+    mtx.lock();
+    hasLog = true;
+    cond.wakeOne();
+    mtx.unlock();
 }
 
 void AgvLogProcess::run()
@@ -24,12 +51,16 @@ void AgvLogProcess::run()
     //处理方法如下:
     //取出消息，存入数据库
     //并且看有没有订阅，如果有发送
-    while(true)
+    while(!isQuit)
     {
         OneLog onelog;
         if(!g_log_queue.try_dequeue(onelog))
         {
-            QyhSleep(50);
+            mtx.lock();
+            if(!hasLog && !isQuit)
+                cond.wait(&mtx);
+            hasLog = false;
+            mtx.unlock();
             continue;
         }
 
@@ -62,7 +93,5 @@ void AgvLogProcess::run()
             memcpy (message.data(), xml.data(), xml.size());
             publisher.send (message);
         }
-
-        QyhSleep(20);
     }
 }
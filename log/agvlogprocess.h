@@ -5,6 +5,9 @@
 #include <QThread>
 #include <QMap>
 #include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include "util/timingwheel.h"
 
 
 struct SubNode{
@@ -16,21 +19,37 @@ struct SubNode{
     bool fatal = false;
 };
 
+//日志存库、publish的线程
+//没有日志时一直等待。有日志入队后，由时间轮延迟一小段时间唤醒，一次处理这段时间内的所有日志
 class AgvLogProcess : public QThread
 {
     Q_OBJECT
 public:
+    enum{
+        FLUSH_DELAY = 20,//ms
+    };
+
     explicit AgvLogProcess(QObject *parent = nullptr);
 
     ~AgvLogProcess();
 
     void run() override;
+
+    //任意线程:入队了日志
+    void onLogQueued();
 signals:
 
 public slots:
 
 private:
+    void wake();
+
     volatile bool isQuit;
+    std::atomic<bool> flushPending;
+    std::atomic<TimingWheel::TimerId> flushTimer;//等待中的唤醒，析构时取消
+    QMutex mtx;
+    QWaitCondition cond;
+    bool hasLog;
 };
 
 #endif // AGVLOGPROCESS_H
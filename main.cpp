@@ -1,5 +1,8 @@
 ﻿#include <QCoreApplication>
 #include <QDir>
+#include <QCommandLineParser>
+#include "network/agvcapture.h"
+#include "business/msgcenter.h"
 #include "util/global.h"
 
 #include <iostream>
@@ -11,6 +14,18 @@ int main(int argc, char *argv[])
     QString g_strExeRoot = QCoreApplication::applicationDirPath();
     QDir::setCurrent(g_strExeRoot);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption captureOption("capture","record raw agv reports to this file, for replay.","file");
+    parser.addOption(captureOption);
+    QCommandLineOption positionRateOption("position-rate","agv position publish rate in Hz (1-50).","hz","10");
+    parser.addOption(positionRateOption);
+    parser.process(a);
+
+    //共享的定时器
+    g_timingWheel = new TimingWheel;
+    g_timingWheel->start();
+
     //初始化日志
     g_log = new AgvLog();
     g_logProcess = new AgvLogProcess();
@@ -20,6 +35,33 @@ int main(int argc, char *argv[])
     g_sql = new Sql();
     g_sql->createConnection();
 
+    //初始化任务日志(回放上次未入库的任务记录)
+    g_taskJournal = new TaskJournal;
+    g_taskJournal->init();
+    g_taskJournal->start();
+
+    //车辆连接的IO线程
+    g_agvIoEngine = new AgvIoEngine;
+    g_agvIoEngine->start();
+
+    //抓包
+    AgvCapture *capture = NULL;
+    if(parser.isSet(captureOption)){
+        capture = new AgvCapture;
+        if(capture->open(parser.value(captureOption))){
+            g_agvIoEngine->setCapture(capture);
+            g_log->log(AGV_LOG_LEVEL_INFO,"capture agv reports to "+parser.value(captureOption));
+        }else{
+            g_log->log(AGV_LOG_LEVEL_ERROR,"capture open file fail:"+capture->getErrorString());
+        }
+    }
+
+    //车队状态
+    g_fleetState = new FleetState;
+
+    //车辆位置推算(两次上报之间发布推算的位置)
+    g_motionEstimator = new MotionEstimator;
+
     //初始化agv_center
     g_hrgAgvCenter = new AgvCenter;
     g_hrgAgvCenter->init();//载入车辆
@@ -30,10 +72,21 @@ int main(int argc, char *argv[])
     g_taskCenter = new TaskCenter;
     g_taskCenter->init();//任务中心
 
+    //空闲车辆按历史和最近的取货需求预先调配
+    g_agvRebalancer = new AgvRebalancer;
+    g_agvRebalancer->init();
+
+    //电量估算和充电调度
+    g_chargeScheduler = new ChargeScheduler;
+    g_chargeScheduler->init();
 
 
     userMsgProcessor = new UserMsgProcessor;//消息处理
 
+    //位置、状态、任务的定时发布
+    MsgCenter *msgCenter = new MsgCenter;
+    msgCenter->init(parser.value(positionRateOption).toInt());
+
     g_server = new QyhZmqServer;
     std::thread(std::bind(&QyhZmqServer::run, g_server)).detach();//zmq server
 
@@ -44,5 +97,10 @@ int main(int argc, char *argv[])
     //        g_log->log(AGV_LOG_LEVEL_ERROR,"task make fail init,check your sqlserver connection!");
     //    }
 
-    return a.exec();
+    int ret = a.exec();
+    if(capture!=NULL){
+        g_agvIoEngine->setCapture(NULL);
+        capture->close();
+    }
+    return ret;
 }
@@ -0,0 +1,162 @@
+#include "agvcapture.h"
+#include <QDateTime>
+#include <QtEndian>
+
+#define CAPTURE_MAGIC       "AGVCAP01"
+#define CAPTURE_HEAD_SIZE   16
+
+static int paddedLength(int len)
+{
+    return (len+7)&~7;
+}
+
+AgvCapture::AgvCapture(QObject *parent) : QThread(parent),
+    isQuit(false),
+    recordCount(0),
+    droppedCount(0),
+    writeErrorCount(0)
+{
+}
+
+AgvCapture::~AgvCapture()
+{
+    close();
+}
+
+bool AgvCapture::open(const QString &fileName)
+{
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::WriteOnly|QIODevice::Truncate)){
+        errorString = file.errorString();
+        return false;
+    }
+    uchar head[CAPTURE_HEAD_SIZE];
+    memcpy(head,CAPTURE_MAGIC,8);
+    qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch(),head+8);
+    file.write((const char *)head,CAPTURE_HEAD_SIZE);
+    file.flush();
+
+    clock.start();
+    isQuit = false;
+    start();
+    return true;
+}
+
+void AgvCapture::close()
+{
+    if(isRunning()){
+        mtx.lock();
+        isQuit = true;
+        cond.wakeOne();
+        mtx.unlock();
+        wait();
+    }
+    if(file.isOpen())file.close();
+}
+
+void AgvCapture::record(int agvId, int type, const char *data, int len)
+{
+    len = qBound(0,len,0xFFFF);
+    uchar head[AgvCaptureRecord::HEADER_SIZE];
+    qToLittleEndian<qint64>(clock.nsecsElapsed()/1000,head);
+    qToLittleEndian<qint32>(agvId,head+8);
+    qToLittleEndian<quint16>(type,head+12);
+    qToLittleEndian<quint16>(len,head+14);
+    static const char zeros[8] = {0};
+
+    mtx.lock();
+    if(pending.length()+AgvCaptureRecord::HEADER_SIZE+len+8>MAX_PENDING){
+        mtx.unlock();
+        ++droppedCount;
+        return ;
+    }
+    pending.append((const char *)head,AgvCaptureRecord::HEADER_SIZE);
+    if(len>0)pending.append(data,len);
+    pending.append(zeros,paddedLength(len)-len);
+    mtx.unlock();
+    ++recordCount;
+}
+
+void AgvCapture::run()
+{
+    QByteArray buff;
+    while(true){
+        mtx.lock();
+        if(!isQuit)cond.wait(&mtx,FLUSH_INTERVAL);
+        buff.swap(pending);
+        bool quit = isQuit;
+        mtx.unlock();
+
+        if(buff.length()>0){
+            if(file.write(buff)!=buff.length())
+                ++writeErrorCount;
+            file.flush();
+            buff.clear();
+        }
+        if(quit)break;
+    }
+}
+
+AgvCaptureReader::AgvCaptureReader():
+    base(NULL),
+    size(0),
+    pos(0),
+    startMsecs(0)
+{
+}
+
+AgvCaptureReader::~AgvCaptureReader()
+{
+    close();
+}
+
+bool AgvCaptureReader::open(const QString &fileName)
+{
+    close();
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::ReadOnly)){
+        errorString = file.errorString();
+        return false;
+    }
+    size = file.size();
+    if(size>=CAPTURE_HEAD_SIZE)base = file.map(0,size);
+    if(base==NULL || memcmp(base,CAPTURE_MAGIC,8)!=0){
+        errorString = base==NULL && size>=CAPTURE_HEAD_SIZE?file.errorString():QString("not a capture file");
+        close();
+        return false;
+    }
+    startMsecs = qFromLittleEndian<qint64>(base+8);
+    pos = CAPTURE_HEAD_SIZE;
+    return true;
+}
+
+void AgvCaptureReader::close()
+{
+    if(base!=NULL){
+        file.unmap((uchar *)base);
+        base = NULL;
+    }
+    if(file.isOpen())file.close();
+    size = 0;
+    pos = 0;
+}
+
+bool AgvCaptureReader::next(AgvCaptureRecord &record, const char *&data)
+{
+    if(base==NULL || pos+AgvCaptureRecord::HEADER_SIZE>size)return false;
+    const uchar *p = base+pos;
+    record.offsetUsecs = qFromLittleEndian<qint64>(p);
+    record.agvId = qFromLittleEndian<qint32>(p+8);
+    record.type = qFromLittleEndian<quint16>(p+12);
+    record.length = qFromLittleEndian<quint16>(p+14);
+    //最后一条可能没写完(进程被杀掉)
+    if(pos+AgvCaptureRecord::HEADER_SIZE+record.length>size)return false;
+    data = (const char *)p+AgvCaptureRecord::HEADER_SIZE;
+    pos += AgvCaptureRecord::HEADER_SIZE+paddedLength(record.length);
+    return true;
+}
+
+void AgvCaptureReader::rewind()
+{
+    pos = CAPTURE_HEAD_SIZE;
+}
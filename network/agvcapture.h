@@ -0,0 +1,104 @@
+#ifndef AGVCAPTURE_H
+#define AGVCAPTURE_H
+
+#include <QThread>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <atomic>
+
+//车辆上报的原始数据的抓包文件(离线回放，性能回归用)
+//文件头16字节: "AGVCAP01" + 开始时间(qint64 ms)
+//每条记录: 16字节的记录头 + 数据，补齐到8字节
+//全部小端，只追加。读取时整个文件映射到内存顺序遍历
+struct AgvCaptureRecord
+{
+    enum{
+        TYPE_DATA = 0,//socket读到的数据(原样，不拆包)
+        TYPE_CONNECTED = 1,
+        TYPE_DISCONNECTED = 2,
+    };
+    enum{
+        HEADER_SIZE = 16,
+    };
+    qint64 offsetUsecs = 0;//距开始的时间 us
+    qint32 agvId = 0;
+    quint16 type = TYPE_DATA;
+    quint16 length = 0;
+};
+
+//抓包:IO线程记录到内存，后台线程定时写盘
+class AgvCapture : public QThread
+{
+    Q_OBJECT
+public:
+    enum{
+        FLUSH_INTERVAL = 100,//ms
+        MAX_PENDING = 64*1024*1024,//写盘跟不上时，内存中最多积累这么多，再多的丢弃
+    };
+
+    explicit AgvCapture(QObject *parent = nullptr);
+    ~AgvCapture();
+
+    //创建文件，启动写盘线程。失败时getErrorString()是原因
+    bool open(const QString &fileName);
+    QString getErrorString(){return errorString;}
+
+    //写完剩下的记录，关闭文件
+    void close();
+
+    //任意线程:记录一段数据
+    void record(int agvId, int type, const char *data = NULL, int len = 0);
+
+    quint64 getRecordCount(){return recordCount.load();}
+    quint64 getDroppedCount(){return droppedCount.load();}
+    quint64 getWriteErrorCount(){return writeErrorCount.load();}
+
+    void run() override;
+
+private:
+    QFile file;
+    QElapsedTimer clock;
+
+    QMutex mtx;
+    QWaitCondition cond;
+    QByteArray pending;
+    volatile bool isQuit;
+
+    std::atomic<quint64> recordCount;
+    std::atomic<quint64> droppedCount;
+    std::atomic<quint64> writeErrorCount;
+    QString errorString;
+};
+
+//读取抓包文件
+class AgvCaptureReader
+{
+public:
+    AgvCaptureReader();
+    ~AgvCaptureReader();
+
+    bool open(const QString &fileName);
+    void close();
+    QString getErrorString(){return errorString;}
+
+    qint64 getStartMsecs(){return startMsecs;}
+
+    //下一条记录，data指向映射的内存(文件关闭前有效)。读完或者遇到不完整的记录返回false
+    bool next(AgvCaptureRecord &record, const char *&data);
+
+    //回到第一条记录
+    void rewind();
+
+private:
+    QFile file;
+    const uchar *base;
+    qint64 size;
+    qint64 pos;
+    qint64 startMsecs;
+    QString errorString;
+};
+
+#endif // AGVCAPTURE_H
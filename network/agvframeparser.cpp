@@ -0,0 +1,84 @@
+#include "agvframeparser.h"
+#include <string.h>
+
+AgvFrameParser::AgvFrameParser():
+    readPos(0),
+    writePos(0),
+    frameCount(0),
+    crcErrorCount(0),
+    droppedBytes(0)
+{
+}
+
+char *AgvFrameParser::writeBuffer(int &space)
+{
+    int index = writePos&MASK;
+    space = qMin(CAPACITY-size(),CAPACITY-index);
+    return (char *)buff+index;
+}
+
+void AgvFrameParser::commit(int len)
+{
+    if(len>0)writePos += len;
+}
+
+void AgvFrameParser::drop(int len)
+{
+    readPos += len;
+    droppedBytes += len;
+}
+
+void AgvFrameParser::clear()
+{
+    readPos = writePos = 0;
+}
+
+bool AgvFrameParser::next(AgvTelemetry &telemetry)
+{
+    while(size()>0){
+        //找包头:在连续的一段中找，找不到整段丢掉
+        if(at(0)!=FRAME_HEAD){
+            int index = readPos&MASK;
+            int len = qMin(size(),CAPACITY-index);
+            const void *head = memchr(buff+index,FRAME_HEAD,len);
+            drop(head==NULL?len:(int)((const unsigned char *)head-(buff+index)));
+            continue;
+        }
+        if(size()<2)return false;
+        if(at(1)!=FRAME_LENGTH-1){
+            drop(1);
+            continue;
+        }
+        if(size()<FRAME_LENGTH)return false;
+        if(at(FRAME_LENGTH-1)!=FRAME_END){
+            drop(1);
+            continue;
+        }
+
+        //包在缓冲区末尾绕回的，拷贝到栈上
+        const unsigned char *frame;
+        unsigned char wrapped[FRAME_LENGTH];
+        int index = readPos&MASK;
+        if(index+FRAME_LENGTH<=CAPACITY){
+            frame = buff+index;
+        }else{
+            int first = CAPACITY-index;
+            memcpy(wrapped,buff+index,first);
+            memcpy(wrapped+first,buff,FRAME_LENGTH-first);
+            frame = wrapped;
+        }
+
+        if(AgvProtocol::checksum<AgvProtocol::StatusFrame::CHECKSUM_LENGTH>(frame+AgvProtocol::StatusFrame::CHECKSUM_BEGIN)
+                !=frame[AgvProtocol::StatusFrame::CHECKSUM_OFFSET]){
+            ++crcErrorCount;
+            drop(1);
+            continue;
+        }
+
+        decode(frame,telemetry);
+        readPos += FRAME_LENGTH;
+        ++frameCount;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,57 @@
+#ifndef AGVFRAMEPARSER_H
+#define AGVFRAMEPARSER_H
+
+#include <QtGlobal>
+#include "bean/agvtelemetry.h"
+#include "agvprotocol.h"
+
+//车辆上报包的拆包(每个连接一个)
+//包格式: 包头0x66 包长(不含包头) 内容 校验和 包尾0x88，定长32字节
+//固定大小的环形缓冲区，socket直接读进缓冲区，按包长取包，在缓冲区中直接解析，不为每个包分配内存
+//包头、包长、包尾、校验和任何一个不对，都只丢掉一个字节，从下一个0x66重新找包头
+class AgvFrameParser
+{
+public:
+    enum{
+        CAPACITY = 4096,//必须是2的幂
+        FRAME_LENGTH = AgvProtocol::StatusFrame::LENGTH,
+        FRAME_HEAD = AgvProtocol::StatusFrame::HEAD,
+        FRAME_END = AgvProtocol::StatusFrame::END,
+    };
+
+    AgvFrameParser();
+
+    //可以直接写入的连续空间，写入后调用commit
+    char *writeBuffer(int &space);
+    void commit(int len);
+
+    //取出下一个完整的包并解析，没有完整的包返回false
+    bool next(AgvTelemetry &telemetry);
+
+    void clear();
+
+    quint64 getFrameCount() const {return frameCount;}
+    quint64 getCrcErrorCount() const {return crcErrorCount;}
+    quint64 getDroppedBytes() const {return droppedBytes;}
+
+    //解析一个完整的包(已经检查过包头包尾、校验和)
+    static void decode(const unsigned char *frame, AgvTelemetry &telemetry){AgvProtocol::StatusFrame::decode(frame,telemetry);}
+
+private:
+    enum{ MASK = CAPACITY-1 };
+    static_assert((CAPACITY&MASK)==0 && CAPACITY>=FRAME_LENGTH,"capacity must be a power of 2 and hold a frame");
+
+    int size() const {return (int)(writePos-readPos);}
+    unsigned char at(int i) const {return buff[(readPos+i)&MASK];}
+    void drop(int len);
+
+    unsigned char buff[CAPACITY];
+    unsigned int readPos;//只增不减，取模得到下标
+    unsigned int writePos;
+
+    quint64 frameCount;
+    quint64 crcErrorCount;
+    quint64 droppedBytes;
+};
+
+#endif // AGVFRAMEPARSER_H
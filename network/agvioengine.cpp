@@ -0,0 +1,201 @@
+#include "agvioengine.h"
+#include <chrono>
+
+static qint64 steadyUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+AgvIoEngine::AgvIoEngine(QObject *parent) : QObject(parent),
+    handler(nullptr),
+    wakePending(false),
+    telemetryCount(0),
+    capture(NULL),
+    sendStamp(0)
+{
+}
+
+AgvIoEngine::~AgvIoEngine()
+{
+    stop();
+}
+
+void AgvIoEngine::start(int threadAmount)
+{
+    if(threadAmount<1)threadAmount = 1;
+    for(int i=0;i<threadAmount;++i){
+        QThread *thread = new QThread;
+        AgvIoWorker *worker = new AgvIoWorker(this);
+        worker->moveToThread(thread);
+        //线程结束前在IO线程中删除，连接、定时器都属于这个线程
+        connect(thread,&QThread::finished,[worker](){delete worker;});
+        thread->start();
+        threads.append(thread);
+        workers.append(worker);
+    }
+}
+
+void AgvIoEngine::stop()
+{
+    for(int i=0;i<threads.length();++i){
+        threads.at(i)->quit();
+        threads.at(i)->wait();
+        delete threads.at(i);
+    }
+    threads.clear();
+    workers.clear();
+    agvWorkersLock.lockForWrite();
+    agvWorkers.clear();
+    agvWorkersLock.unlock();
+}
+
+bool AgvIoEngine::addAgv(int agvId, const QString &ip, int port, AgvIoWorker::AckCallback ack)
+{
+    if(workers.length()<=0)return false;
+
+    agvWorkersLock.lockForWrite();
+    if(agvWorkers.contains(agvId)){
+        agvWorkersLock.unlock();
+        return false;
+    }
+    AgvIoWorker *worker = workers.at(0);
+    for(int i=1;i<workers.length();++i){
+        if(workers.at(i)->getConnectionCount()<worker->getConnectionCount())
+            worker = workers.at(i);
+    }
+    agvWorkers.insert(agvId,worker);
+    agvWorkersLock.unlock();
+
+    AgvIoWorker::Request request;
+    request.type = AgvIoWorker::Request::CONNECT;
+    request.agvId = agvId;
+    request.ip = ip;
+    request.port = port;
+    request.ack = ack;
+    worker->post(request);
+    return true;
+}
+
+bool AgvIoEngine::removeAgv(int agvId)
+{
+    agvWorkersLock.lockForWrite();
+    AgvIoWorker *worker = agvWorkers.take(agvId);
+    agvWorkersLock.unlock();
+    if(worker==NULL)return false;
+
+    AgvIoWorker::Request request;
+    request.type = AgvIoWorker::Request::REMOVE;
+    request.agvId = agvId;
+    worker->post(request);
+    return true;
+}
+
+bool AgvIoEngine::send(int agvId, const QByteArray &data)
+{
+    agvWorkersLock.lockForRead();
+    AgvIoWorker *worker = agvWorkers.value(agvId,NULL);
+    agvWorkersLock.unlock();
+    if(worker==NULL)return false;
+
+    AgvIoWorker::Request request;
+    request.type = AgvIoWorker::Request::SEND;
+    request.agvId = agvId;
+    request.data = data;
+    request.stamp = ++sendStamp;
+    worker->post(request);
+    return true;
+}
+
+//每个IO线程一个请求，车辆按所在的IO线程分组
+int AgvIoEngine::emergencyStop(const QList<int> &agvIds)
+{
+    QHash<AgvIoWorker *,QList<int> > groups;
+    int count = 0;
+    agvWorkersLock.lockForRead();
+    if(agvIds.isEmpty()){
+        for(int i=0;i<workers.length();++i)
+            groups.insert(workers.at(i),QList<int>());
+        count = agvWorkers.size();
+    }else{
+        for(int i=0;i<agvIds.length();++i){
+            AgvIoWorker *worker = agvWorkers.value(agvIds.at(i),NULL);
+            if(worker==NULL)continue;
+            groups[worker].append(agvIds.at(i));
+            ++count;
+        }
+    }
+    agvWorkersLock.unlock();
+    if(groups.isEmpty())return 0;
+
+    std::shared_ptr<AgvIoWorker::EStop> estop = std::make_shared<AgvIoWorker::EStop>();
+    estop->startUs = steadyUs();
+    estop->pending.store(groups.size());
+    quint64 stamp = ++sendStamp;
+    for(QHash<AgvIoWorker *,QList<int> >::iterator itr=groups.begin();itr!=groups.end();++itr){
+        AgvIoWorker::Request request;
+        request.type = AgvIoWorker::Request::ESTOP;
+        request.stamp = stamp;
+        request.agvIds = itr.value();
+        request.estop = estop;
+        itr.key()->postUrgent(request);
+    }
+    return count;
+}
+
+void AgvIoEngine::onEStopDone(qint64 startUs)
+{
+    estopLatency.record(steadyUs()-startUs);
+}
+
+quint64 AgvIoEngine::getCrcErrorCount()
+{
+    quint64 count = 0;
+    for(int i=0;i<workers.length();++i)
+        count += workers.at(i)->getCrcErrorCount();
+    return count;
+}
+
+int AgvIoEngine::getOnlineCount()
+{
+    int count = 0;
+    for(int i=0;i<workers.length();++i)
+        count += workers.at(i)->getOnlineCount();
+    return count;
+}
+
+quint64 AgvIoEngine::getReconnectCount()
+{
+    quint64 count = 0;
+    for(int i=0;i<workers.length();++i)
+        count += workers.at(i)->getReconnectCount();
+    return count;
+}
+
+quint64 AgvIoEngine::getFrameTimeoutCount()
+{
+    quint64 count = 0;
+    for(int i=0;i<workers.length();++i)
+        count += workers.at(i)->getFrameTimeoutCount();
+    return count;
+}
+
+//通知主线程处理。已经通知过还没处理的，不再重复通知
+void AgvIoEngine::postTelemetry(const AgvTelemetry &telemetry)
+{
+    telemetryQueue.enqueue(telemetry);
+    ++telemetryCount;
+    if(!wakePending.exchange(true))
+        QMetaObject::invokeMethod(this,"processTelemetry",Qt::QueuedConnection);
+}
+
+void AgvIoEngine::processTelemetry()
+{
+    wakePending.store(false);
+    AgvTelemetry buff[64];
+    size_t count;
+    while((count = telemetryQueue.try_dequeue_bulk(buff,64))>0){
+        if(handler==nullptr)continue;
+        for(size_t i=0;i<count;++i)
+            handler(buff[i]);
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef AGVIOENGINE_H
+#define AGVIOENGINE_H
+
+#include <QObject>
+#include <QThread>
+#include <QList>
+#include <QHash>
+#include <QReadWriteLock>
+#include <atomic>
+#include <functional>
+#include "agvioworker.h"
+#include "util/histogram.h"
+
+class AgvCapture;
+
+//车辆连接的IO引擎
+//所有车辆的TCP连接分散在几个IO线程中(各自的事件循环)，收包、拆包、解析都不在主线程
+//命令应答直接在IO线程回调，不受主线程调度耗时的影响
+//解析出的状态放入无锁队列，由主线程批量取出交给业务层
+//连接的断开、重连由IO线程自己处理，业务层只收到连接上、断开两种状态
+class AgvIoEngine : public QObject
+{
+    Q_OBJECT
+public:
+    enum{
+        DEFAULT_THREADS = 2,
+    };
+
+    //主线程中调用，处理车辆状态
+    typedef std::function<void (const AgvTelemetry &)> TelemetryHandler;
+
+    explicit AgvIoEngine(QObject *parent = nullptr);
+    ~AgvIoEngine();
+
+    void setTelemetryHandler(TelemetryHandler _handler){handler = _handler;}
+
+    //启动IO线程
+    void start(int threadAmount = DEFAULT_THREADS);
+
+    //停止IO线程
+    void stop();
+
+    //添加一辆车的连接，分配给连接数最少的IO线程
+    bool addAgv(int agvId, const QString &ip, int port, AgvIoWorker::AckCallback ack = nullptr);
+
+    //删除一辆车的连接，不再重连，不再上报
+    bool removeAgv(int agvId);
+
+    //任意线程:发送数据给车辆
+    bool send(int agvId, const QByteArray &data);
+
+    //任意线程:急停。不经过命令队列，各IO线程优先于排队的请求，并行写入预先封装好的停止包
+    //急停之前提交还没有发出的数据丢弃。agvIds为空时是所有车辆，返回急停的车辆数
+    int emergencyStop(const QList<int> &agvIds = QList<int>());
+
+    //IO线程:一次急停所有IO线程都写完了
+    void onEStopDone(qint64 startUs);
+
+    //急停从调用到所有IO线程写完的耗时(us)
+    AtomicHistogram::Snapshot getEStopLatency(){return estopLatency.snapshot();}
+
+    //IO线程:解析出的车辆状态放入队列
+    void postTelemetry(const AgvTelemetry &telemetry);
+
+    quint64 getTelemetryCount(){return telemetryCount.load();}
+
+    //所有连接校验和不对的包
+    quint64 getCrcErrorCount();
+
+    //已连接的车辆、重连次数、因为收不到包而断开的次数
+    int getOnlineCount();
+    quint64 getReconnectCount();
+    quint64 getFrameTimeoutCount();
+
+    //抓包:IO线程把收到的原始数据记录到capture，NULL表示不记录
+    void setCapture(AgvCapture *_capture){capture.store(_capture);}
+    AgvCapture *getCapture(){return capture.load();}
+
+private slots:
+    void processTelemetry();
+
+private:
+    TelemetryHandler handler;
+
+    QList<QThread *> threads;
+    QList<AgvIoWorker *> workers;
+
+    QReadWriteLock agvWorkersLock;
+    QHash<int,AgvIoWorker *> agvWorkers;
+
+    moodycamel::ConcurrentQueue<AgvTelemetry> telemetryQueue;
+    std::atomic<bool> wakePending;
+    std::atomic<quint64> telemetryCount;
+    std::atomic<AgvCapture *> capture;
+
+    std::atomic<quint64> sendStamp;
+    AtomicHistogram estopLatency;
+};
+
+#endif // AGVIOENGINE_H
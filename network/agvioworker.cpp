@@ -0,0 +1,255 @@
+#include "agvioworker.h"
+#include "agvioengine.h"
+#include "agvcapture.h"
+#include <QDateTime>
+
+AgvIoWorker::AgvIoWorker(AgvIoEngine *_engine) : QObject(),
+    engine(_engine),
+    wakePending(false),
+    connectionCount(0),
+    crcErrorCount(0),
+    connecting(0),
+    tickTimer(NULL),
+    jitter((unsigned int)QDateTime::currentMSecsSinceEpoch()),
+    onlineCount(0),
+    reconnectCount(0),
+    frameTimeoutCount(0)
+{
+    AgvProtocol::DispatchFrame::encodeStop(stopFrame,AgvProtocol::DispatchFrame::ESTOP_SEQ);
+}
+
+void AgvIoWorker::post(const Request &request)
+{
+    requests.enqueue(request);
+    if(!wakePending.exchange(true))
+        QMetaObject::invokeMethod(this,"processRequests",Qt::QueuedConnection);
+}
+
+//正在处理请求时，下一个请求之前就会处理急停；否则排在已经通知的processRequests中
+void AgvIoWorker::postUrgent(const Request &request)
+{
+    urgentRequests.enqueue(request);
+    if(!wakePending.exchange(true))
+        QMetaObject::invokeMethod(this,"processRequests",Qt::QueuedConnection);
+}
+
+void AgvIoWorker::processRequests()
+{
+    wakePending.store(false);
+    Request request;
+    while(true){
+        processUrgent();
+        if(!requests.try_dequeue(request))break;
+        if(request.type == Request::CONNECT){
+            if(agvs.contains(request.agvId))continue;
+            Connection *conn = new Connection;
+            conn->agvId = request.agvId;
+            conn->ack = request.ack;
+            conn->ip = request.ip;
+            conn->port = request.port;
+            conn->socket = new QTcpSocket(this);
+            connect(conn->socket,SIGNAL(connected()),this,SLOT(onConnected()));
+            connect(conn->socket,SIGNAL(disconnected()),this,SLOT(onDisconnected()));
+            connect(conn->socket,SIGNAL(error(QAbstractSocket::SocketError)),this,SLOT(onError(QAbstractSocket::SocketError)));
+            connect(conn->socket,SIGNAL(readyRead()),this,SLOT(onReadyRead()));
+            sockets.insert(conn->socket,conn);
+            agvs.insert(conn->agvId,conn);
+            ++connectionCount;
+            conn->pending = true;
+            connectQueue.append(conn);
+        }else if(request.type == Request::REMOVE){
+            Connection *conn = agvs.value(request.agvId,NULL);
+            if(conn!=NULL)removeConnection(conn);
+        }else{
+            Connection *conn = agvs.value(request.agvId,NULL);
+            if(conn!=NULL && request.stamp>=conn->stopStamp && conn->socket->state()==QAbstractSocket::ConnectedState)
+                conn->socket->write(request.data);
+        }
+    }
+
+    if(tickTimer==NULL && !agvs.isEmpty()){
+        tickTimer = new QTimer(this);
+        connect(tickTimer,SIGNAL(timeout()),this,SLOT(onTick()));
+        tickTimer->start(TICK_MSECS);
+    }
+    startConnects();
+}
+
+//按排队的顺序发起连接，同时进行中的不超过MAX_CONNECTING，连上或失败一个再发起下一个
+void AgvIoWorker::startConnects()
+{
+    qint64 nowMsecs = QDateTime::currentMSecsSinceEpoch();
+    while(connecting<MAX_CONNECTING && !connectQueue.isEmpty()){
+        Connection *conn = connectQueue.takeFirst();
+        conn->pending = false;
+        if(conn->state!=Connection::STATE_WAITING)continue;
+        conn->state = Connection::STATE_CONNECTING;
+        conn->dueMsecs = nowMsecs;
+        ++connecting;
+        conn->socket->connectToHost(conn->ip,conn->port);
+    }
+}
+
+//断开、连接失败都到这里:关闭socket，等待一段时间后重连，等待时间每次翻倍
+//连接上过的才通知业务层断开了
+void AgvIoWorker::dropConnection(Connection *conn)
+{
+    if(conn->state==Connection::STATE_WAITING)return ;
+    bool wasConnected = conn->state==Connection::STATE_CONNECTED;
+    if(wasConnected)--onlineCount;
+    else --connecting;
+    conn->state = Connection::STATE_WAITING;
+    conn->parser.clear();
+    conn->socket->abort();
+
+    int half = conn->backoffMsecs/2;
+    conn->dueMsecs = QDateTime::currentMSecsSinceEpoch()+half+(int)(jitter()%(unsigned int)(half+1));
+    conn->backoffMsecs = qMin(conn->backoffMsecs*2,(int)RECONNECT_MAX_MSECS);
+
+    if(wasConnected){
+        AgvCapture *capture = engine->getCapture();
+        if(capture!=NULL)capture->record(conn->agvId,AgvCaptureRecord::TYPE_DISCONNECTED);
+        postState(conn,AgvTelemetry::TYPE_DISCONNECTED);
+    }
+    startConnects();
+}
+
+//车辆删除了:关闭连接，不通知业务层
+void AgvIoWorker::removeConnection(Connection *conn)
+{
+    if(conn->state==Connection::STATE_CONNECTED)--onlineCount;
+    else if(conn->state==Connection::STATE_CONNECTING)--connecting;
+    connectQueue.removeAll(conn);
+    sockets.remove(conn->socket);
+    agvs.remove(conn->agvId);
+    --connectionCount;
+    conn->socket->disconnect(this);
+    conn->socket->abort();
+    conn->socket->deleteLater();
+    delete conn;
+    startConnects();
+}
+
+//到期的重连放入待连接队列；连接超时的、连接上但收不到包的断开
+void AgvIoWorker::onTick()
+{
+    qint64 nowMsecs = QDateTime::currentMSecsSinceEpoch();
+    for(QHash<int,Connection *>::iterator itr=agvs.begin();itr!=agvs.end();++itr){
+        Connection *conn = itr.value();
+        if(conn->state==Connection::STATE_WAITING){
+            if(!conn->pending && nowMsecs>=conn->dueMsecs){
+                conn->pending = true;
+                connectQueue.append(conn);
+                ++reconnectCount;
+            }
+        }else if(conn->state==Connection::STATE_CONNECTING){
+            if(nowMsecs-conn->dueMsecs>=CONNECT_TIMEOUT_MSECS)
+                dropConnection(conn);
+        }else if(nowMsecs-conn->lastFrameMsecs>=FRAME_TIMEOUT_MSECS){
+            ++frameTimeoutCount;
+            dropConnection(conn);
+        }
+    }
+    startConnects();
+}
+
+//急停:每个连接写入停止包后立即flush，不等事件循环
+void AgvIoWorker::processUrgent()
+{
+    Request request;
+    while(urgentRequests.try_dequeue(request)){
+        if(request.agvIds.isEmpty()){
+            for(QHash<int,Connection *>::iterator itr=agvs.begin();itr!=agvs.end();++itr)
+                writeStop(itr.value(),request.stamp);
+        }else{
+            for(int i=0;i<request.agvIds.length();++i){
+                Connection *conn = agvs.value(request.agvIds.at(i),NULL);
+                if(conn!=NULL)writeStop(conn,request.stamp);
+            }
+        }
+        if(request.estop && request.estop->pending.fetch_sub(1)==1)
+            engine->onEStopDone(request.estop->startUs);
+    }
+}
+
+void AgvIoWorker::writeStop(Connection *conn, quint64 stamp)
+{
+    conn->stopStamp = stamp;
+    if(conn->socket->state()!=QAbstractSocket::ConnectedState)return ;
+    conn->socket->write((const char *)stopFrame,AgvProtocol::DispatchFrame::LENGTH);
+    conn->socket->flush();
+}
+
+void AgvIoWorker::postState(Connection *conn, int type)
+{
+    AgvTelemetry telemetry;
+    telemetry.type = type;
+    telemetry.agvId = conn->agvId;
+    telemetry.recvMsecs = QDateTime::currentMSecsSinceEpoch();
+    engine->postTelemetry(telemetry);
+}
+
+//连上后开始计算收包超时。收到第一个完整的包才认为连接可用，重连等待恢复到最短
+void AgvIoWorker::onConnected()
+{
+    Connection *conn = sockets.value(qobject_cast<QTcpSocket *>(sender()),NULL);
+    if(conn==NULL || conn->state!=Connection::STATE_CONNECTING)return ;
+    --connecting;
+    ++onlineCount;
+    conn->state = Connection::STATE_CONNECTED;
+    conn->lastFrameMsecs = QDateTime::currentMSecsSinceEpoch();
+    conn->alive = false;
+    startConnects();
+    AgvCapture *capture = engine->getCapture();
+    if(capture!=NULL)capture->record(conn->agvId,AgvCaptureRecord::TYPE_CONNECTED);
+    postState(conn,AgvTelemetry::TYPE_CONNECTED);
+}
+
+void AgvIoWorker::onDisconnected()
+{
+    Connection *conn = sockets.value(qobject_cast<QTcpSocket *>(sender()),NULL);
+    if(conn==NULL)return ;
+    dropConnection(conn);
+}
+
+void AgvIoWorker::onError(QAbstractSocket::SocketError error)
+{
+    Q_UNUSED(error);
+    Connection *conn = sockets.value(qobject_cast<QTcpSocket *>(sender()),NULL);
+    if(conn==NULL)return ;
+    dropConnection(conn);
+}
+
+//socket的数据直接读进环形缓冲区，取出完整的包
+void AgvIoWorker::onReadyRead()
+{
+    Connection *conn = sockets.value(qobject_cast<QTcpSocket *>(sender()),NULL);
+    if(conn==NULL || conn->state!=Connection::STATE_CONNECTED)return ;
+
+    qint64 nowMsecs = QDateTime::currentMSecsSinceEpoch();
+    quint64 crcErrors = conn->parser.getCrcErrorCount();
+    AgvCapture *capture = engine->getCapture();
+    AgvTelemetry telemetry;
+    while(true){
+        int space = 0;
+        char *buff = conn->parser.writeBuffer(space);
+        qint64 len = conn->socket->read(buff,space);
+        if(len<=0)break;
+        if(capture!=NULL)capture->record(conn->agvId,AgvCaptureRecord::TYPE_DATA,buff,(int)len);
+        conn->parser.commit((int)len);
+
+        while(conn->parser.next(telemetry)){
+            conn->lastFrameMsecs = nowMsecs;
+            if(!conn->alive){
+                conn->alive = true;
+                conn->backoffMsecs = RECONNECT_MIN_MSECS;
+            }
+            telemetry.agvId = conn->agvId;
+            telemetry.recvMsecs = nowMsecs;
+            if(conn->ack!=nullptr)
+                conn->ack(telemetry);
+            engine->postTelemetry(telemetry);
+        }
+    }
+    crcErrorCount += conn->parser.getCrcErrorCount()-crcErrors;
+}
@@ -0,0 +1,145 @@
+#ifndef AGVIOWORKER_H
+#define AGVIOWORKER_H
+
+#include <QObject>
+#include <QHash>
+#include <QByteArray>
+#include <QTcpSocket>
+#include <QTimer>
+#include <atomic>
+#include <random>
+#include <functional>
+#include <memory>
+#include "bean/agvtelemetry.h"
+#include "agvframeparser.h"
+#include "agvprotocol.h"
+#include "util/concurrentqueue.h"
+
+class AgvIoEngine;
+
+//一个IO线程:拥有一部分车辆的TCP连接，收包、拆包、解析
+//其他线程通过无锁队列提交连接、发送请求，不直接访问socket
+//急停请求在单独的队列中，优先于所有排队的请求处理
+//连接断开、连不上、长时间没有收到完整的包，都按指数退避重连。同时发起的连接数有上限，启动时不会一下子连几百辆车
+class AgvIoWorker : public QObject
+{
+    Q_OBJECT
+public:
+    enum{
+        RECONNECT_MIN_MSECS = 500,//第一次重连的等待
+        RECONNECT_MAX_MSECS = 30000,//重连等待的上限
+        CONNECT_TIMEOUT_MSECS = 5000,//连接这么久还没连上，放弃重来
+        FRAME_TIMEOUT_MSECS = 3000,//连接上这么久没有收到一个完整的包，认为连接已经死了
+        MAX_CONNECTING = 32,//同时进行中的连接
+        TICK_MSECS = 200,//检查超时、到期重连的周期
+    };
+
+    //IO线程中调用，只做命令应答这类很快的处理
+    typedef std::function<void (const AgvTelemetry &)> AckCallback;
+
+    //一次急停，各IO线程共用
+    struct EStop{
+        qint64 startUs = 0;
+        std::atomic<int> pending;//还没有写完的IO线程
+    };
+
+    struct Request{
+        enum{
+            CONNECT = 0,
+            SEND = 1,
+            ESTOP = 2,
+            REMOVE = 3,
+        };
+        int type = SEND;
+        int agvId = 0;
+        QString ip;
+        int port = 0;
+        QByteArray data;
+        AckCallback ack;
+        quint64 stamp = 0;//提交的顺序，急停之前提交的发送请求丢弃
+        QList<int> agvIds;//急停的车辆，空表示这个线程的所有车辆
+        std::shared_ptr<EStop> estop;
+    };
+
+    explicit AgvIoWorker(AgvIoEngine *_engine);
+
+    //任意线程:提交请求
+    void post(const Request &request);
+
+    //任意线程:提交急停请求
+    void postUrgent(const Request &request);
+
+    int getConnectionCount(){return connectionCount.load();}
+
+    //已连接的车辆
+    int getOnlineCount(){return onlineCount.load();}
+
+    //发起的重连次数(不含第一次连接)
+    quint64 getReconnectCount(){return reconnectCount.load();}
+
+    //因为收不到包而断开的次数
+    quint64 getFrameTimeoutCount(){return frameTimeoutCount.load();}
+
+    //校验和不对而丢弃的包
+    quint64 getCrcErrorCount(){return crcErrorCount.load();}
+
+public slots:
+    void processRequests();
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onError(QAbstractSocket::SocketError error);
+    void onReadyRead();
+    void onTick();
+
+private:
+    struct Connection{
+        enum{
+            STATE_WAITING = 0,//等待重连、或者排队等待发起连接
+            STATE_CONNECTING = 1,
+            STATE_CONNECTED = 2,
+        };
+        int agvId = 0;
+        QTcpSocket *socket = NULL;
+        AgvFrameParser parser;
+        AckCallback ack;
+        quint64 stopStamp = 0;//最近一次急停
+        QString ip;
+        int port = 0;
+        int state = STATE_WAITING;
+        bool pending = false;//在待连接的队列中
+        int backoffMsecs = RECONNECT_MIN_MSECS;//下一次重连的等待
+        qint64 dueMsecs = 0;//等待中的:到这个时间重连。连接中的:开始连接的时间
+        qint64 lastFrameMsecs = 0;//最近收到完整包的时间
+        bool alive = false;//这次连接收到过完整的包
+    };
+
+    void postState(Connection *conn, int type);
+    void processUrgent();
+    void writeStop(Connection *conn, quint64 stamp);
+    void startConnects();
+    void dropConnection(Connection *conn);
+    void removeConnection(Connection *conn);
+
+    AgvIoEngine *engine;
+    QHash<QTcpSocket *,Connection *> sockets;
+    QHash<int,Connection *> agvs;
+
+    moodycamel::ConcurrentQueue<Request> requests;
+    moodycamel::ConcurrentQueue<Request> urgentRequests;
+    unsigned char stopFrame[AgvProtocol::DispatchFrame::LENGTH];//预先封装好的急停包
+    std::atomic<bool> wakePending;
+    std::atomic<int> connectionCount;
+    std::atomic<quint64> crcErrorCount;
+
+    QList<Connection *> connectQueue;//等待发起连接的，先到先连
+    int connecting;
+    QTimer *tickTimer;//IO线程中创建
+    std::minstd_rand jitter;//重连等待的随机抖动，避免同时断开的车辆同时重连
+    std::atomic<int> onlineCount;
+    std::atomic<quint64> reconnectCount;
+    std::atomic<quint64> frameTimeoutCount;
+};
+
+#endif // AGVIOWORKER_H
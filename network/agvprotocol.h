@@ -0,0 +1,207 @@
+#ifndef AGVPROTOCOL_H
+#define AGVPROTOCOL_H
+
+#include <string.h>
+#include <stdint.h>
+#include "bean/agvtelemetry.h"
+
+//车辆通信协议的包格式，只在这里声明一次，编解码和长度检查都由它生成
+//多字节字段都是小端。编解码都在调用者给的定长缓冲区中进行，不分配内存，没有分支
+namespace AgvProtocol {
+
+//包中的一个字段:偏移、字节数
+//4字节的是有符号数，2字节、1字节的是无符号数(和原来的解析一致)。字节数写成-2的是有符号的2字节
+template<int Offset,int Size> struct Field;
+
+template<int Offset> struct Field<Offset,1>
+{
+    enum{OFFSET = Offset, SIZE = 1, END = Offset+1};
+    static int get(const unsigned char *p){return p[Offset];}
+    static void put(unsigned char *p, int v){p[Offset] = (unsigned char)v;}
+};
+
+template<int Offset> struct Field<Offset,2>
+{
+    enum{OFFSET = Offset, SIZE = 2, END = Offset+2};
+    static int get(const unsigned char *p){return p[Offset]|(p[Offset+1]<<8);}
+    static void put(unsigned char *p, int v){
+        p[Offset] = (unsigned char)v;
+        p[Offset+1] = (unsigned char)(v>>8);
+    }
+};
+
+template<int Offset> struct Field<Offset,-2>
+{
+    enum{OFFSET = Offset, SIZE = 2, END = Offset+2};
+    static int get(const unsigned char *p){return (int16_t)(p[Offset]|(p[Offset+1]<<8));}
+    static void put(unsigned char *p, int v){
+        p[Offset] = (unsigned char)v;
+        p[Offset+1] = (unsigned char)(v>>8);
+    }
+};
+
+template<int Offset> struct Field<Offset,4>
+{
+    enum{OFFSET = Offset, SIZE = 4, END = Offset+4};
+    static int get(const unsigned char *p){
+        return (int)((unsigned int)p[Offset]|((unsigned int)p[Offset+1]<<8)|((unsigned int)p[Offset+2]<<16)|((unsigned int)p[Offset+3]<<24));
+    }
+    static void put(unsigned char *p, int v){
+        p[Offset] = (unsigned char)v;
+        p[Offset+1] = (unsigned char)(v>>8);
+        p[Offset+2] = (unsigned char)(v>>16);
+        p[Offset+3] = (unsigned char)(v>>24);
+    }
+};
+
+//校验和:各字节相加取低8位。长度是常量，编译器可以展开、向量化
+template<int N> inline unsigned char checksum(const unsigned char *p)
+{
+    unsigned int sum = 0;
+    for(int i=0;i<N;++i)sum += p[i];
+    return (unsigned char)sum;
+}
+
+//编译期检查字段表:从offset开始首尾相接，返回最后一个字段的结尾，不相接返回-1
+struct FieldDesc{
+    int offset;
+    int size;
+};
+constexpr int layoutEnd(const FieldDesc *f, int n, int offset)
+{
+    return n==0?offset:(f->offset==offset?layoutEnd(f+1,n-1,offset+f->size):-1);
+}
+
+//上报包的内容: AgvTelemetry的成员、偏移、字节数
+#define AGV_STATUS_FIELDS(F) \
+    F(mileage,                  2,  4) \
+    F(currentRfid,              6,  4) \
+    F(nextRfid,                 10, 4) \
+    F(current,                  14, -2) \
+    F(voltage,                  16, 2) \
+    F(positionMagneticStripe,   18, 2) \
+    F(pcbTemperature,           20, 1) \
+    F(motorTemperature,         21, 1) \
+    F(cpu,                      22, 1) \
+    F(speed,                    23, 1) \
+    F(angle,                    24, 1) \
+    F(height,                   25, 1) \
+    F(error_no,                 26, 1) \
+    F(mode,                     27, 1) \
+    F(recvQueueNumber,          28, 1) \
+    F(orderCount,               29, 1)
+
+#define AGV_FIELD_DESC(name,offset,size) {offset,(size)<0?-(size):(size)},
+constexpr FieldDesc statusFields[] = { AGV_STATUS_FIELDS(AGV_FIELD_DESC) };
+#undef AGV_FIELD_DESC
+
+//上报包: 包头0x66 包长(不含包头) 内容 校验和 包尾0x88，定长32字节
+struct StatusFrame
+{
+    enum{
+        LENGTH = 32,
+        HEAD = 0x66,
+        END = 0x88,
+        BODY_OFFSET = 2,
+        CHECKSUM_OFFSET = LENGTH-2,
+        END_OFFSET = LENGTH-1,
+        //校验和是包长之后的27个字节(不含orderCount，协议如此)
+        CHECKSUM_BEGIN = 2,
+        CHECKSUM_LENGTH = LENGTH-5,
+    };
+
+    //包头、包长、包尾、校验和都对
+    static bool check(const unsigned char *frame){
+        return (frame[0]==HEAD) & (frame[1]==LENGTH-1) & (frame[END_OFFSET]==END)
+                & (checksum<CHECKSUM_LENGTH>(frame+CHECKSUM_BEGIN)==frame[CHECKSUM_OFFSET]);
+    }
+
+    //解析一个完整的包(已经检查过)
+    static void decode(const unsigned char *frame, AgvTelemetry &telemetry){
+#define AGV_STATUS_DECODE(name,offset,size) telemetry.name = Field<offset,size>::get(frame);
+        AGV_STATUS_FIELDS(AGV_STATUS_DECODE)
+#undef AGV_STATUS_DECODE
+        telemetry.CRC = frame[CHECKSUM_OFFSET];
+    }
+
+    //封装一个上报包，frame至少LENGTH字节
+    static void encode(unsigned char *frame, const AgvTelemetry &telemetry){
+        frame[0] = HEAD;
+        frame[1] = LENGTH-1;
+#define AGV_STATUS_ENCODE(name,offset,size) Field<offset,size>::put(frame,telemetry.name);
+        AGV_STATUS_FIELDS(AGV_STATUS_ENCODE)
+#undef AGV_STATUS_ENCODE
+        frame[CHECKSUM_OFFSET] = checksum<CHECKSUM_LENGTH>(frame+CHECKSUM_BEGIN);
+        frame[END_OFFSET] = END;
+    }
+};
+
+static_assert(layoutEnd(statusFields,sizeof(statusFields)/sizeof(statusFields[0]),StatusFrame::BODY_OFFSET)==StatusFrame::CHECKSUM_OFFSET,
+              "status fields must fill the frame between the length byte and the checksum");
+
+//调度模式的命令包: 包头0x55 包长(不含包头) 内容 校验和 包尾0xAA
+//内容: 功能码0x73 包序号 4组指令(卡号 命令 参数)，没有用到的组是立即执行的停止
+struct DispatchFrame
+{
+    enum{
+        HEAD = 0x55,
+        END = 0xAA,
+        CODE = 0x73,
+        GROUPS = 4,
+        GROUP_SIZE = 6,
+        CONTENT_OFFSET = 2,
+        GROUPS_OFFSET = CONTENT_OFFSET+2,
+        CONTENT_LENGTH = 2+GROUPS*GROUP_SIZE,
+        LENGTH = CONTENT_LENGTH+4,
+        CHECKSUM_OFFSET = LENGTH-2,
+        END_OFFSET = LENGTH-1,
+        ESTOP_SEQ = 0,//急停包专用的包序号，命令队列不使用
+    };
+
+    typedef Field<CONTENT_OFFSET,1> Code;
+    typedef Field<CONTENT_OFFSET+1,1> Seq;
+
+    //一组指令中的字段(相对于组的开头)
+    typedef Field<0,4> Rfid;
+    typedef Field<4,1> Order;
+    typedef Field<5,1> Param;
+
+    //封装一个4组都是立即停止的命令包，packet至少LENGTH字节
+    static void encodeStop(unsigned char *packet, int seq){
+        memset(packet,0,LENGTH);
+        packet[0] = HEAD;
+        packet[1] = LENGTH-1;
+        Code::put(packet,CODE);
+        Seq::put(packet,seq);
+        packet[CHECKSUM_OFFSET] = checksum<CONTENT_LENGTH>(packet+CONTENT_OFFSET);
+        packet[END_OFFSET] = END;
+    }
+
+    //封装一个命令包，packet至少LENGTH字节。T要有rfid、order、param成员
+    //最后一组总是停止，最多GROUPS-1条指令
+    template<typename T>
+    static void encode(unsigned char *packet, int seq, const T *orders, int amount){
+        memset(packet,0,LENGTH);
+        packet[0] = HEAD;
+        packet[1] = LENGTH-1;
+        Code::put(packet,CODE);
+        Seq::put(packet,seq);
+        if(amount>GROUPS-1)amount = GROUPS-1;
+        for(int i=0;i<amount;++i){
+            unsigned char *group = packet+GROUPS_OFFSET+i*GROUP_SIZE;
+            Rfid::put(group,orders[i].rfid);
+            Order::put(group,orders[i].order);
+            Param::put(group,orders[i].param);
+        }
+        packet[CHECKSUM_OFFSET] = checksum<CONTENT_LENGTH>(packet+CONTENT_OFFSET);
+        packet[END_OFFSET] = END;
+    }
+};
+
+static_assert((int)DispatchFrame::Param::END==(int)DispatchFrame::GROUP_SIZE,"dispatch group fields must fill the group");
+static_assert((int)DispatchFrame::Seq::END==(int)DispatchFrame::GROUPS_OFFSET,"dispatch groups follow the sequence number");
+static_assert(DispatchFrame::LENGTH-1<=0xFF,"dispatch frame length must fit in one byte");
+
+}
+
+#endif // AGVPROTOCOL_H
@@ -4,51 +4,103 @@
 #include "util/global.h"
 
 
-AgvPositionPublisher::AgvPositionPublisher(QObject *parent) : QThread(parent),isQuit(false)
+AgvPositionPublisher::AgvPositionPublisher(QObject *parent) : QObject(parent),
+    context(NULL),
+    publisher(NULL),
+    publishThread(NULL),
+    jobId(0),
+    interval(1000/DEFAULT_RATE)
 {
-
 }
 
 AgvPositionPublisher::~AgvPositionPublisher()
 {
-    isQuit = true;
+    stop();
 }
 
+void AgvPositionPublisher::setRate(int rate)
+{
+    interval = 1000/qBound(1,rate,(int)MAX_RATE);
+}
+
+void AgvPositionPublisher::start(PublishThread *thread)
+{
+    if(jobId!=0 || thread==NULL)return ;
+    publishThread = thread;
+    jobId = publishThread->add(interval,[this](){publish();});
+}
 
-void AgvPositionPublisher::run()
+void AgvPositionPublisher::stop()
 {
-    zmq::context_t context(1);
-    zmq::socket_t publisher(context, ZMQ_PUB);
-    std::string portStr = intToStdString(GLOBAL_PORT_AGV_POSITION);
-    std::string url = "tcp://*:"+portStr;
-    publisher.bind(url.c_str());
-
-    while(!isQuit){
-        //组装订阅信息
-        QMap<QString,QString> responseDatas;
-        QList<QMap<QString,QString> > responseDatalists;
-
-        responseDatas.insert(QString("type"),QString("map"));
-        responseDatas.insert(QString("todo"),QString("periodica"));
-
-        for(QMap<int,Agv *>::iterator itr = g_m_agvs.begin();itr!=g_m_agvs.end();++itr)
-        {
-            QMap<QString,QString> mm;
-            mm.insert(QString("x"),QString("%1").arg(itr.value()->x));
-            mm.insert(QString("y"),QString("%1").arg(itr.value()->y));
-            mm.insert(QString("id"),QString("%1").arg(itr.value()->id));
-            mm.insert(QString("name"),QString("%1").arg(itr.value()->name));
-            mm.insert(QString("rotation"),QString("%1").arg(itr.value()->rotation));
-            mm.insert(QString("status"),QString("%1").arg(itr.value()->status));
-
-            responseDatalists.push_back(mm);
+    //移除后不会再有发布在执行，可以释放socket
+    if(jobId!=0 && publishThread!=NULL)
+        publishThread->remove(jobId);
+    jobId = 0;
+    if(publisher){
+        delete publisher;
+        publisher = NULL;
+    }
+    if(context){
+        delete context;
+        context = NULL;
+    }
+}
+
+
+void AgvPositionPublisher::publish()
+{
+    if(g_fleetState==NULL)return ;
+    if(publisher==NULL){
+        context = new zmq::context_t(1);
+        publisher = new zmq::socket_t(*context, ZMQ_PUB);
+        std::string portStr = intToStdString(GLOBAL_PORT_AGV_POSITION);
+        std::string url = "tcp://*:"+portStr;
+        publisher->bind(url.c_str());
+    }
+
+    //组装订阅信息
+    QMap<QString,QString> responseDatas;
+    QList<QMap<QString,QString> > responseDatalists;
+
+    responseDatas.insert(QString("type"),QString("map"));
+    responseDatas.insert(QString("todo"),QString("periodica"));
+
+    //位置、状态从车队状态一致地读取
+    QList<FleetState::AgvState> states = g_fleetState->snapshot();
+    FleetState::RosterPtr roster = g_fleetState->getRoster();
+
+    //在线路上的车辆，用推算的当前位置代替上次上报的位置
+    if(g_motionEstimator!=NULL)
+        g_motionEstimator->predict(MotionEstimator::nowMsecs(),poses);
+
+    for(int i=0;i<states.length();++i)
+    {
+        const FleetState::AgvState &s = states.at(i);
+        FleetState::Roster::const_iterator info = roster->find(s.agvId);
+        if(info==roster->end())continue;
+        int x = s.x;
+        int y = s.y;
+        int rotation = s.rotation;
+        const MotionEstimator::Pose *pose = MotionEstimator::find(poses,s.agvId);
+        if(pose!=NULL && s.nowStation<=0){
+            x = (int)pose->x;
+            y = (int)pose->y;
+            rotation = (int)pose->rotation;
         }
-        std::string xml = getResponseXml(responseDatas,responseDatalists);
+        QMap<QString,QString> mm;
+        mm.insert(QString("x"),QString("%1").arg(x));
+        mm.insert(QString("y"),QString("%1").arg(y));
+        mm.insert(QString("id"),QString("%1").arg(s.agvId));
+        mm.insert(QString("name"),QString("%1").arg(info.value().name));
+        mm.insert(QString("rotation"),QString("%1").arg(rotation));
+        mm.insert(QString("status"),QString("%1").arg(s.status));
 
-        //发送订阅信息
-        zmq::message_t message(xml.size());
-        memcpy (message.data(), xml.data(), xml.size());
-        publisher.send (message);
-        QyhSleep(100);
+        responseDatalists.push_back(mm);
     }
+    std::string xml = getResponseXml(responseDatas,responseDatalists);
+
+    //发送订阅信息
+    zmq::message_t message(xml.size());
+    memcpy (message.data(), xml.data(), xml.size());
+    publisher->send(message);
 }
@@ -2,24 +2,47 @@
 #define AGVPOSITIONPUBLISHER_H
 
 #include <QObject>
-#include <QThread>
 #include <QList>
 #include <QMutex>
+#include <vector>
+#include "publishthread.h"
+#include "util/motionestimator.h"
 
+namespace zmq{
+class context_t;
+class socket_t;
+}
 
 //其实可以将它定义未观察者模式
-class AgvPositionPublisher : public QThread
+class AgvPositionPublisher : public QObject
 {
     Q_OBJECT
 public:
+    enum{
+        DEFAULT_RATE = 10,//Hz
+        MAX_RATE = 50,
+    };
+
     explicit AgvPositionPublisher(QObject *parent = nullptr);
     ~AgvPositionPublisher();
-    void run();
+    //每秒发布几次(1-50)，start之前设置
+    void setRate(int rate);
+    //在发布线程中定时发布
+    void start(PublishThread *thread);
+    void stop();
 signals:
 
 public slots:
 private:
-    volatile bool isQuit;
+    //发布线程
+    void publish();
+
+    zmq::context_t *context;
+    zmq::socket_t *publisher;
+    PublishThread *publishThread;
+    PublishThread::JobId jobId;
+    int interval;//ms
+    std::vector<MotionEstimator::Pose> poses;//推算的位姿，每次发布复用
 };
 
 #endif // AGVPOSITIONPUBLISHER_H
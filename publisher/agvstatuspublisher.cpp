@@ -3,68 +3,107 @@
 #include <sstream>
 #include "util/global.h"
 
-AgvStatusPublisher::AgvStatusPublisher(QObject *parent) : QThread(parent),isQuit(false)
+AgvStatusPublisher::AgvStatusPublisher(QObject *parent) : QObject(parent),
+    context(NULL),
+    publisher(NULL),
+    publishThread(NULL),
+    jobId(0)
 {
-
 }
 
 AgvStatusPublisher::~AgvStatusPublisher()
 {
-    isQuit = true;
+    stop();
 }
 
-void AgvStatusPublisher::run()
+void AgvStatusPublisher::start(PublishThread *thread)
 {
-    zmq::context_t context(1);
-    zmq::socket_t publisher(context, ZMQ_PUB);
+    if(jobId!=0 || thread==NULL)return ;
+    publishThread = thread;
+    jobId = publishThread->add(PUBLISH_INTERVAL,[this](){publish();});
+}
 
-    std::string portStr = intToStdString(GLOBAL_PORT_AGV_STATUS);
-    std::string url = "tcp://*:"+portStr;
-    publisher.bind(url.c_str());
+void AgvStatusPublisher::stop()
+{
+    //移除后不会再有发布在执行，可以释放socket
+    if(jobId!=0 && publishThread!=NULL)
+        publishThread->remove(jobId);
+    jobId = 0;
+    if(publisher){
+        delete publisher;
+        publisher = NULL;
+    }
+    if(context){
+        delete context;
+        context = NULL;
+    }
+}
 
-    publisher.bind("tcp://*:5563");
+void AgvStatusPublisher::publish()
+{
+    if(g_fleetState==NULL)return ;
+    //第一次发布时在发布线程中创建socket，之后只在这个线程使用
+    if(publisher==NULL){
+        context = new zmq::context_t(1);
+        publisher = new zmq::socket_t(*context, ZMQ_PUB);
+        std::string portStr = intToStdString(GLOBAL_PORT_AGV_STATUS);
+        std::string url = "tcp://*:"+portStr;
+        publisher->bind(url.c_str());
 
-    while(!isQuit)
-    {
-        //组装订阅信息
-        QMap<QString,QString> responseDatas;
-        QList<QMap<QString,QString> > responseDatalists;
+        publisher->bind("tcp://*:5563");
+    }
+
+    //组装订阅信息
+    QMap<QString,QString> responseDatas;
+    QList<QMap<QString,QString> > responseDatalists;
 
-        responseDatas.insert(QString("type"),QString("agv"));
-        responseDatas.insert(QString("todo"),QString("periodica"));
+    responseDatas.insert(QString("type"),QString("agv"));
+    responseDatas.insert(QString("todo"),QString("periodica"));
 
-        for(QMap<int,Agv *>::iterator itr = g_m_agvs.begin();itr!=g_m_agvs.end();++itr)
-        {
-            QMap<QString,QString> responseData;
-            responseData.insert(QString("id"),QString("%1").arg(itr.value()->id));
-            responseData.insert(QString("name"),QString("%1").arg(itr.value()->name));
-            responseData.insert(QString("ip"),QString("%1").arg(itr.value()->ip));
-            responseData.insert(QString("port"),QString("%1").arg(itr.value()->port));
-            responseData.insert(QString("mode"),QString("%1").arg(itr.value()->mode));
-            responseData.insert(QString("mileage"),QString("%1").arg(itr.value()->mileage));
-            responseData.insert(QString("currentRfid"),QString("%1").arg(itr.value()->currentRfid));
-            responseData.insert(QString("current"),QString("%1").arg(itr.value()->current));
-            responseData.insert(QString("voltage"),QString("%1").arg(itr.value()->voltage));
-            responseData.insert(QString("positionMagneticStripe"),QString("%1").arg(itr.value()->positionMagneticStripe));
-            responseData.insert(QString("pcbTemperature"),QString("%1").arg(itr.value()->pcbTemperature));
-            responseData.insert(QString("motorTemperature"),QString("%1").arg(itr.value()->motorTemperature));
-            responseData.insert(QString("cpu"),QString("%1").arg(itr.value()->cpu));
-            responseData.insert(QString("speed"),QString("%1").arg(itr.value()->speed));
-            responseData.insert(QString("angle"),QString("%1").arg(itr.value()->angle));
-            responseData.insert(QString("error_no"),QString("%1").arg(itr.value()->error_no));
-            responseData.insert(QString("currentQueueNumber"),QString("%1").arg(itr.value()->recvQueueNumber));
-            responseData.insert(QString("orderCount"),QString("%1").arg(itr.value()->orderCount));
-            responseData.insert(QString("nextRfid"),QString("%1").arg(itr.value()->nextRfid));
-            responseData.insert(QString("status"),QString("%1").arg(itr.value()->status));
-            responseDatalists.append(responseData);
+    QList<FleetState::AgvState> states = g_fleetState->snapshot();
+    FleetState::RosterPtr roster = g_fleetState->getRoster();
+    for(int i=0;i<states.length();++i)
+    {
+        const FleetState::AgvState &s = states.at(i);
+        FleetState::Roster::const_iterator info = roster->find(s.agvId);
+        if(info==roster->end())continue;
+        QMap<QString,QString> responseData;
+        responseData.insert(QString("id"),QString("%1").arg(s.agvId));
+        responseData.insert(QString("name"),QString("%1").arg(info.value().name));
+        responseData.insert(QString("ip"),QString("%1").arg(info.value().ip));
+        responseData.insert(QString("port"),QString("%1").arg(info.value().port));
+        responseData.insert(QString("mode"),QString("%1").arg(s.mode));
+        responseData.insert(QString("mileage"),QString("%1").arg(s.mileage));
+        responseData.insert(QString("currentRfid"),QString("%1").arg(s.currentRfid));
+        responseData.insert(QString("current"),QString("%1").arg(s.current));
+        responseData.insert(QString("voltage"),QString("%1").arg(s.voltage));
+        responseData.insert(QString("soc"),QString("%1").arg(s.soc));
+        responseData.insert(QString("range"),QString("%1").arg(s.range));
+        responseData.insert(QString("positionMagneticStripe"),QString("%1").arg(s.positionMagneticStripe));
+        responseData.insert(QString("pcbTemperature"),QString("%1").arg(s.pcbTemperature));
+        responseData.insert(QString("motorTemperature"),QString("%1").arg(s.motorTemperature));
+        responseData.insert(QString("cpu"),QString("%1").arg(s.cpu));
+        responseData.insert(QString("speed"),QString("%1").arg(s.speed));
+        responseData.insert(QString("angle"),QString("%1").arg(s.angle));
+        responseData.insert(QString("error_no"),QString("%1").arg(s.error_no));
+        responseData.insert(QString("currentQueueNumber"),QString("%1").arg(s.recvQueueNumber));
+        responseData.insert(QString("orderCount"),QString("%1").arg(s.orderCount));
+        responseData.insert(QString("nextRfid"),QString("%1").arg(s.nextRfid));
+        responseData.insert(QString("status"),QString("%1").arg(s.status));
+        //链路:平滑的往返时间、重传超时、累计重传次数(分布用agv/linkstats查询)
+        AgvCmdQueue *queue = info.value().cmdQueue.get();
+        if(queue!=NULL){
+            responseData.insert(QString("srtt"),QString("%1").arg(queue->getSrtt()));
+            responseData.insert(QString("rto"),QString("%1").arg(queue->getRto()));
+            responseData.insert(QString("retransmits"),QString("%1").arg(queue->getRetransmitCount()));
         }
+        responseDatalists.append(responseData);
+    }
 
-        std::string xml = getResponseXml(responseDatas,responseDatalists);
+    std::string xml = getResponseXml(responseDatas,responseDatalists);
 
-        //发送订阅信息
-        zmq::message_t message(xml.size());
-        memcpy (message.data(), xml.data(), xml.size());
-        publisher.send (message);
-        QyhSleep(500);
-    }
+    //发送订阅信息
+    zmq::message_t message(xml.size());
+    memcpy (message.data(), xml.data(), xml.size());
+    publisher->send(message);
 }
@@ -2,22 +2,40 @@
 #define AGVSTATUSPUBLISHER_H
 
 #include <QObject>
-#include <QThread>
 #include <QMap>
 #include <QMutex>
+#include "publishthread.h"
 
-class AgvStatusPublisher : public QThread
+namespace zmq{
+class context_t;
+class socket_t;
+}
+
+//周期性发布车辆状态。定时由共享的时间轮完成，不再占用一个线程
+class AgvStatusPublisher : public QObject
 {
     Q_OBJECT
 public:
+    enum{
+        PUBLISH_INTERVAL = 500,
+    };
+
     explicit AgvStatusPublisher(QObject *parent = nullptr);
     ~AgvStatusPublisher();
-    void run();
+    //在发布线程中定时发布
+    void start(PublishThread *thread);
+    void stop();
 signals:
 
 public slots:
 private:
-    volatile bool isQuit;
+    //发布线程
+    void publish();
+
+    zmq::context_t *context;
+    zmq::socket_t *publisher;
+    PublishThread *publishThread;
+    PublishThread::JobId jobId;
 };
 
 #endif // AGVSTATUSPUBLISHER_H
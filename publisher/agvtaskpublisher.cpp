@@ -2,68 +2,91 @@
 #include <algorithm>
 #include <sstream>
 #include "util/global.h"
-AgvTaskPublisher::AgvTaskPublisher(QObject *parent) : QThread(parent),isQuit(false)
+AgvTaskPublisher::AgvTaskPublisher(QObject *parent) : QObject(parent),
+    context(NULL),
+    publisher(NULL),
+    publishThread(NULL),
+    jobId(0)
 {
-
 }
 
 AgvTaskPublisher::~AgvTaskPublisher()
 {
-    isQuit = true;
+    stop();
 }
 
-void AgvTaskPublisher::run()
+void AgvTaskPublisher::start(PublishThread *thread)
 {
-    zmq::context_t context(1);
-    zmq::socket_t publisher(context, ZMQ_PUB);
+    if(jobId!=0 || thread==NULL)return ;
+    publishThread = thread;
+    jobId = publishThread->add(PUBLISH_INTERVAL,[this](){publish();});
+}
 
+void AgvTaskPublisher::stop()
+{
+    //移除后不会再有发布在执行，可以释放socket
+    if(jobId!=0 && publishThread!=NULL)
+        publishThread->remove(jobId);
+    jobId = 0;
+    if(publisher){
+        delete publisher;
+        publisher = NULL;
+    }
+    if(context){
+        delete context;
+        context = NULL;
+    }
+}
 
-    std::string portStr = intToStdString(GLOBAL_PORT_TASK);
-    std::string url = "tcp://*:"+portStr;
-    publisher.bind(url.c_str());
+void AgvTaskPublisher::publish()
+{
+    if(publisher==NULL){
+        context = new zmq::context_t(1);
+        publisher = new zmq::socket_t(*context, ZMQ_PUB);
+        std::string portStr = intToStdString(GLOBAL_PORT_TASK);
+        std::string url = "tcp://*:"+portStr;
+        publisher->bind(url.c_str());
+    }
 
-    while(!isQuit){
-        //组装订阅信息
-        QMap<QString,QString> responseDatas;
-        QList<QMap<QString,QString> > responseDatalists;
+    //组装订阅信息
+    QMap<QString,QString> responseDatas;
+    QList<QMap<QString,QString> > responseDatalists;
 
-        responseDatas.insert(QString("type"),QString("task"));
-        responseDatas.insert(QString("todo"),QString("periodica"));
+    responseDatas.insert(QString("type"),QString("task"));
+    responseDatas.insert(QString("todo"),QString("periodica"));
 
-        QList<Task *> undos =  g_taskCenter->getUnassignedTasks();
-        QList<Task *> doings = g_taskCenter->getDoingTasks();
+    TaskSnapshotPtr snapshot = g_taskCenter->getSnapshot();
+    QList<TaskCopyPtr> undos =  snapshot->unassigned;
+    QList<TaskCopyPtr> doings = snapshot->doing;
 
-        for(int i=0;i<undos.length();++i){
-            QMap<QString,QString> mm;
-            Task *t = undos.at(i);
-            if(t!=NULL){
-                mm.insert(QString("status"),QString("%1").arg(t->status));
-                mm.insert(QString("excutecar"),QString("%1").arg(t->excuteCar));
-                mm.insert(QString("id"),QString("%1").arg(t->id));
-                responseDatalists.push_back(mm);
-            }
+    for(int i=0;i<undos.length();++i){
+        QMap<QString,QString> mm;
+        const Task *t = undos.at(i).get();
+        if(t!=NULL){
+            mm.insert(QString("status"),QString("%1").arg(t->status));
+            mm.insert(QString("excutecar"),QString("%1").arg(t->excuteCar));
+            mm.insert(QString("id"),QString("%1").arg(t->id));
+            responseDatalists.push_back(mm);
         }
-        for(int i=0;i<doings.length();++i)
+    }
+    for(int i=0;i<doings.length();++i)
+    {
+        QMap<QString,QString> mm;
+        const Task *t = doings.at(i).get();
+        if(t!=NULL)
         {
-            QMap<QString,QString> mm;
-            Task *t = doings.at(i);
-            if(t!=NULL)
-            {
-                mm.insert(QString("status"),QString("%1").arg(t->status));
-                mm.insert(QString("excutecar"),QString("%1").arg(t->excuteCar));
-                mm.insert(QString("id"),QString("%1").arg(t->id));
-                responseDatalists.push_back(mm);
-            }
+            mm.insert(QString("status"),QString("%1").arg(t->status));
+            mm.insert(QString("excutecar"),QString("%1").arg(t->excuteCar));
+            mm.insert(QString("id"),QString("%1").arg(t->id));
+            responseDatalists.push_back(mm);
         }
+    }
 
-        std::string xml = getResponseXml(responseDatas,responseDatalists);
-
-        //发送订阅信息
-        zmq::message_t message(xml.size());
-        memcpy (message.data(), xml.data(), xml.size());
-        publisher.send (message);
+    std::string xml = getResponseXml(responseDatas,responseDatalists);
 
-        QyhSleep(1000);
-    }
+    //发送订阅信息
+    zmq::message_t message(xml.size());
+    memcpy (message.data(), xml.data(), xml.size());
+    publisher->send(message);
 }
 
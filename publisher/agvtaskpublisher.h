@@ -2,23 +2,39 @@
 #define AGVTASKPUBLISHER_H
 
 #include <QObject>
-#include <QThread>
 #include <QList>
 #include <QMutex>
+#include "publishthread.h"
 
+namespace zmq{
+class context_t;
+class socket_t;
+}
 
-class AgvTaskPublisher : public QThread
+class AgvTaskPublisher : public QObject
 {
     Q_OBJECT
 public:
+    enum{
+        PUBLISH_INTERVAL = 1000,
+    };
+
     explicit AgvTaskPublisher(QObject *parent = nullptr);
     ~AgvTaskPublisher();
-    void run();
+    //在发布线程中定时发布
+    void start(PublishThread *thread);
+    void stop();
 signals:
 
 public slots:
 private:
-    volatile bool isQuit;
+    //发布线程
+    void publish();
+
+    zmq::context_t *context;
+    zmq::socket_t *publisher;
+    PublishThread *publishThread;
+    PublishThread::JobId jobId;
 };
 
 #endif // AGVTASKPUBLISHER_H
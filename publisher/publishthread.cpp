@@ -0,0 +1,100 @@
+﻿#include "publishthread.h"
+#include "util/global.h"
+
+PublishThread::PublishThread(QObject *parent) : QThread(parent),
+    runningId(0),
+    nextId(0),
+    isQuit(false)
+{
+}
+
+PublishThread::~PublishThread()
+{
+    QList<JobId> ids;
+    mtx.lock();
+    ids = entries.keys();
+    mtx.unlock();
+    for(int i=0;i<ids.length();++i)
+        remove(ids.at(i));
+
+    mtx.lock();
+    isQuit = true;
+    cond.wakeOne();
+    mtx.unlock();
+    wait();
+}
+
+PublishThread::JobId PublishThread::add(int interval, Job job)
+{
+    if(g_timingWheel==NULL)return 0;
+    mtx.lock();
+    JobId id = ++nextId;
+    entries[id].job = job;
+    mtx.unlock();
+
+    TimingWheel::TimerId timerId = g_timingWheel->schedule(interval,[this,id](){trigger(id);},interval);
+    mtx.lock();
+    if(entries.contains(id))
+        entries[id].timerId = timerId;
+    mtx.unlock();
+    return id;
+}
+
+void PublishThread::remove(JobId id)
+{
+    //先取消定时器。取消时会等触发回调执行完，触发回调要加锁，所以这里不能持有锁
+    mtx.lock();
+    TimingWheel::TimerId timerId = entries.value(id).timerId;
+    mtx.unlock();
+    if(timerId!=0 && g_timingWheel!=NULL)
+        g_timingWheel->cancel(timerId);
+
+    mtx.lock();
+    entries.remove(id);
+    while(runningId==id && QThread::currentThread()!=this)
+        idle.wait(&mtx);
+    mtx.unlock();
+}
+
+void PublishThread::trigger(JobId id)
+{
+    mtx.lock();
+    QMap<JobId,Entry>::iterator itr = entries.find(id);
+    if(itr!=entries.end() && !itr.value().pending){
+        itr.value().pending = true;
+        cond.wakeOne();
+    }
+    mtx.unlock();
+}
+
+void PublishThread::run()
+{
+    mtx.lock();
+    while(!isQuit)
+    {
+        JobId id = 0;
+        for(QMap<JobId,Entry>::iterator itr = entries.begin();itr!=entries.end();++itr){
+            if(itr.value().pending){
+                id = itr.key();
+                break;
+            }
+        }
+        if(id==0){
+            cond.wait(&mtx);
+            continue;
+        }
+
+        Entry &entry = entries[id];
+        entry.pending = false;
+        Job job = entry.job;
+        runningId = id;
+        mtx.unlock();
+
+        job();
+
+        mtx.lock();
+        runningId = 0;
+        idle.wakeAll();
+    }
+    mtx.unlock();
+}
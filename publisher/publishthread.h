@@ -0,0 +1,50 @@
+﻿#ifndef PUBLISHTHREAD_H
+#define PUBLISHTHREAD_H
+
+#include <QThread>
+#include <QMap>
+#include <QMutex>
+#include <QWaitCondition>
+#include <functional>
+#include "util/timingwheel.h"
+
+//发布线程:时间轮只负责定时触发，组包、zmq发送都在这个线程中执行，不占用时间轮线程
+//同一个发布上一次触发还没执行的，这次触发合并掉
+class PublishThread : public QThread
+{
+    Q_OBJECT
+public:
+    typedef int JobId;
+    typedef std::function<void ()> Job;
+
+    explicit PublishThread(QObject *parent = nullptr);
+    ~PublishThread();
+
+    //任意线程:每interval毫秒执行一次job，返回的id用于移除
+    JobId add(int interval, Job job);
+
+    //任意线程:移除。正在执行时等它执行完再返回，返回后不会再执行
+    void remove(JobId id);
+
+    void run() override;
+
+private:
+    struct Entry{
+        Job job;
+        TimingWheel::TimerId timerId = 0;
+        bool pending = false;
+    };
+
+    //时间轮线程:只标记要执行，唤醒发布线程
+    void trigger(JobId id);
+
+    QMutex mtx;
+    QWaitCondition cond;//有发布要执行，或者退出
+    QWaitCondition idle;//正在执行的发布执行完了
+    QMap<JobId,Entry> entries;
+    JobId runningId;
+    JobId nextId;
+    bool isQuit;
+};
+
+#endif // PUBLISHTHREAD_H
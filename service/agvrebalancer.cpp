@@ -0,0 +1,229 @@
+﻿#include "agvrebalancer.h"
+#include "util/global.h"
+#include <cmath>
+#include <algorithm>
+
+//历史需求和最近需求的权重(两者都有时)
+#define REBALANCE_HISTORY_WEIGHT    0.5
+//挪车任务这么多个周期还没有分配到车辆，就取消掉
+#define REBALANCE_MOVE_TIMEOUT_PERIODS  4
+
+AgvRebalancer::AgvRebalancer(QObject *parent) : QObject(parent),
+    historyFirst(0),
+    historyLast(0),
+    moveCount(0),
+    moveDistance(0)
+{
+}
+
+void AgvRebalancer::init(int historyDays)
+{
+    if(historyDays>0 && !loadHistory(historyDays))
+        g_log->log(AGV_LOG_LEVEL_WARN,"rebalancer: load task history fail, use live arrivals only");
+
+    connect(g_taskCenter,SIGNAL(sigTaskNew(int,int)),this,SLOT(onTaskNew(int,int)));
+    connect(g_taskCenter,SIGNAL(sigTaskFinish(int)),this,SLOT(onTaskFinish(int)));
+
+    connect(&timer,SIGNAL(timeout()),this,SLOT(rebalance()));
+    timer.start(config.interval*1000);
+}
+
+bool AgvRebalancer::loadHistory(int days)
+{
+    if(g_sql==NULL)return false;
+    QString querySql = "select task_getGoodStation,task_produceTime from agv_task where task_getGoodStation>0 and task_produceTime>=?";
+    QList<QVariant> params;
+    params<<getCurrentDateTime().addDays(-days);
+    QList<QList<QVariant> > result = g_sql->query(querySql,params);
+    for(int i=0;i<result.length();++i){
+        if(result.at(i).length()!=2)continue;
+        addHistory(result.at(i).at(0).toInt(),result.at(i).at(1).toDateTime());
+    }
+    g_log->log(AGV_LOG_LEVEL_INFO,QString("rebalancer: load %1 pickups of last %2 days").arg(result.length()).arg(days));
+    return true;
+}
+
+void AgvRebalancer::addHistory(int station, const QDateTime &time)
+{
+    if(station<=0||!time.isValid())return ;
+    if(!historyHourly.contains(station)){
+        QList<int> hourly;
+        for(int i=0;i<24;++i)hourly.append(0);
+        historyHourly.insert(station,hourly);
+    }
+    historyHourly[station][time.time().hour()] += 1;
+
+    qint64 msecs = time.toMSecsSinceEpoch();
+    if(historyFirst==0 || msecs<historyFirst)historyFirst = msecs;
+    if(msecs>historyLast)historyLast = msecs;
+}
+
+double AgvRebalancer::expectedDemand(int station, qint64 nowMsecs)
+{
+    double hours = config.horizonMinutes/60.0;
+
+    //历史:这个小时平均每天的取货数
+    bool hasHistory = historyFirst>0;
+    double historyRate = 0;
+    if(hasHistory && historyHourly.contains(station)){
+        qint64 days = (historyLast-historyFirst)/(24*3600*1000LL)+1;
+        int hour = QDateTime::fromMSecsSinceEpoch(nowMsecs).time().hour();
+        historyRate = historyHourly[station].at(hour)/(double)days;
+    }
+
+    //最近:衰减计数换算成每小时的到达率
+    bool hasLive = !live.isEmpty();
+    double liveRate = 0;
+    if(hasLive && live.contains(station) && config.halfLifeMinutes>0){
+        const LiveDemand &l = live[station];
+        double halfLives = (nowMsecs-l.lastMsecs)/(config.halfLifeMinutes*60*1000);
+        liveRate = l.weight*std::pow(0.5,halfLives)*std::log(2.0)/(config.halfLifeMinutes/60.0);
+    }
+
+    if(hasHistory && hasLive)
+        return hours*(REBALANCE_HISTORY_WEIGHT*historyRate+(1-REBALANCE_HISTORY_WEIGHT)*liveRate);
+    if(hasHistory)
+        return hours*historyRate;
+    return hours*liveRate;
+}
+
+void AgvRebalancer::onTaskNew(int taskId, int pickStation)
+{
+    Q_UNUSED(taskId);
+    if(pickStation<=0||config.halfLifeMinutes<=0)return ;
+    qint64 nowMsecs = getCurrentDateTime().toMSecsSinceEpoch();
+    LiveDemand &l = live[pickStation];
+    if(l.lastMsecs>0)
+        l.weight *= std::pow(0.5,(nowMsecs-l.lastMsecs)/(config.halfLifeMinutes*60*1000));
+    l.weight += 1;
+    l.lastMsecs = nowMsecs;
+}
+
+void AgvRebalancer::onTaskFinish(int taskId)
+{
+    moves.remove(taskId);
+}
+
+//已经完成、取消的挪车任务移除。长时间分配不到车辆的(路被占了)，取消掉
+void AgvRebalancer::cleanMoves()
+{
+    QDateTime now = getCurrentDateTime();
+    QList<int> ids = moves.keys();
+    for(int i=0;i<ids.length();++i){
+        Task *task = g_taskCenter->queryUndoTask(ids.at(i));
+        if(task!=NULL){
+            if(task->produceTime.msecsTo(now)>=(qint64)config.interval*1000*REBALANCE_MOVE_TIMEOUT_PERIODS){
+                g_taskCenter->cancelTask(ids.at(i));
+                moves.remove(ids.at(i));
+            }
+            continue;
+        }
+        if(g_taskCenter->queryDoingTask(ids.at(i))==NULL)
+            moves.remove(ids.at(i));
+    }
+}
+
+//这一小时还能挪车的距离，-1表示不限制
+int AgvRebalancer::travelBudget(qint64 nowMsecs)
+{
+    while(travels.length()>0 && travels.first().first<=nowMsecs-3600*1000LL)
+        travels.removeFirst();
+    if(config.maxTravelPerHour<=0)return -1;
+    qint64 spent = 0;
+    for(int i=0;i<travels.length();++i)spent += travels.at(i).second;
+    return spent>=config.maxTravelPerHour?0:(int)(config.maxTravelPerHour-spent);
+}
+
+//按预计需求从高到低，给每个没有车辆的站点找最近的空闲车辆挪过去
+void AgvRebalancer::rebalance()
+{
+    if(!config.enable)return ;
+    cleanMoves();
+
+    //有任务在等待车辆时，空闲车辆留给任务
+    QList<Task *> waiting = g_taskCenter->getUnassignedTasks();
+    for(int i=0;i<waiting.length();++i){
+        if(!moves.contains(waiting.at(i)->id))return ;
+    }
+
+    qint64 nowMsecs = getCurrentDateTime().toMSecsSinceEpoch();
+    int budget = travelBudget(nowMsecs);
+    if(budget==0)return ;
+
+    //可以挪的车辆:空闲的、停在站点上、没有挪车任务的
+    QList<int> movingAgvs;
+    QList<int> targets;
+    for(QMap<int,Move>::iterator itr=moves.begin();itr!=moves.end();++itr){
+        movingAgvs.append(itr.value().agvId);
+        targets.append(itr.value().station);
+    }
+    QList<Agv *> candidates;
+    QList<Agv *> idleAgvs = g_hrgAgvCenter->getIdleAgvs();
+    for(int i=0;i<idleAgvs.length();++i){
+        if(idleAgvs.at(i)->nowStation<=0 || movingAgvs.contains(idleAgvs.at(i)->id))continue;
+        //要去充电的、电量危急的不挪
+        if(g_chargeScheduler!=NULL && !g_chargeScheduler->canTake(idleAgvs.at(i)->id,0))continue;
+        candidates.append(idleAgvs.at(i));
+    }
+    if(candidates.length()<=0)return ;
+
+    QList<QPair<double,int> > demands;
+    for(QMap<int,AgvStation *>::iterator itr=g_m_stations.begin();itr!=g_m_stations.end();++itr){
+        double d = expectedDemand(itr.key(),nowMsecs);
+        if(d>=config.minDemand)
+            demands.append(qMakePair(d,itr.key()));
+    }
+    std::sort(demands.begin(),demands.end(),[](const QPair<double,int> &a,const QPair<double,int> &b){
+        if(a.first==b.first)return a.second<b.second;
+        return a.first>b.first;
+    });
+
+    for(int i=0;i<demands.length() && candidates.length()>0;++i){
+        int station = demands.at(i).second;
+        if(targets.contains(station))continue;
+
+        //已经有空闲车辆停在这里，留下它
+        bool stay = false;
+        for(int j=0;j<candidates.length();++j){
+            if(candidates.at(j)->nowStation == station){
+                candidates.removeAt(j);
+                stay = true;
+                break;
+            }
+        }
+        if(stay)continue;
+
+        AgvStation s = g_agvMapCenter->getAgvStation(station);
+        if(s.occuAgv!=0 || s.reserveAgv!=0)continue;
+
+        Agv *best = NULL;
+        int minDis = distance_infinity;
+        for(int j=0;j<candidates.length();++j){
+            Agv *agv = candidates.at(j);
+            int dis = distance_infinity;
+            QList<int> path = g_agvMapCenter->getBestPath(agv->id,agv->lastStation,agv->nowStation,station,dis,false);
+            if(path.length()>0 && dis<minDis){
+                best = agv;
+                minDis = dis;
+            }
+        }
+        if(best==NULL)continue;
+        if(config.maxMoveDistance>0 && minDis>config.maxMoveDistance)continue;
+        if(budget>=0 && minDis>budget)continue;
+
+        int taskId = g_taskCenter->makeAgvAimTask(best->id,station,Task::PRIORITY_VERY_LOW);
+        if(taskId<=0)continue;
+
+        Move move;
+        move.agvId = best->id;
+        move.station = station;
+        moves.insert(taskId,move);
+        targets.append(station);
+        candidates.removeAll(best);
+        travels.append(qMakePair(nowMsecs,minDis));
+        if(budget>=0)budget -= minDis;
+        ++moveCount;
+        moveDistance += minDis;
+        g_log->log(AGV_LOG_LEVEL_INFO,QString("rebalancer: move agv %1 to station %2, expected pickups %3").arg(best->id).arg(station).arg(demands.at(i).first));
+    }
+}
@@ -0,0 +1,89 @@
+﻿#ifndef AGVREBALANCER_H
+#define AGVREBALANCER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QMap>
+#include <QList>
+#include <QPair>
+#include <QDateTime>
+
+//空闲车辆的预先调配
+//按各站点的取货需求(历史任务的按小时分布 + 最近到达的任务)，定时把空闲车辆以低优先级任务挪到预计繁忙的站点附近，
+//这样下一波任务来时，去取货的空跑距离更短。挪车的行驶距离有上限
+class AgvRebalancer : public QObject
+{
+    Q_OBJECT
+public:
+    struct Config{
+        bool enable = true;
+        int interval = 30;//调配周期 s
+        double horizonMinutes = 15;//预测未来多长时间内的需求
+        double halfLifeMinutes = 30;//最近到达的任务，权重的半衰期
+        double minDemand = 0.5;//预计需求(任务数)低于这个值的站点不调车
+        int maxMoveDistance = 0;//单次挪车的最大距离(和路径距离单位相同)，0表示不限制
+        int maxTravelPerHour = 0;//每小时挪车的总距离上限，0表示不限制
+    };
+
+    explicit AgvRebalancer(QObject *parent = nullptr);
+
+    void setConfig(const Config &_config){config = _config;}
+    const Config &getConfig(){return config;}
+
+    //服务端:载入最近几天的历史任务，连接任务中心，启动定时器
+    void init(int historyDays = 7);
+
+    //从agv_task表载入最近几天的取货记录
+    bool loadHistory(int days);
+
+    //加入一条历史取货记录
+    void addHistory(int station, const QDateTime &time);
+
+    //站点在未来horizonMinutes内预计的取货任务数
+    double expectedDemand(int station, qint64 nowMsecs);
+
+    //是否是调配产生的挪车任务
+    bool isRebalanceTask(int taskId){return moves.contains(taskId);}
+
+    int getMoveCount(){return moveCount;}
+    qint64 getMoveDistance(){return moveDistance;}
+
+signals:
+
+public slots:
+    void onTaskNew(int taskId, int pickStation);
+    void onTaskFinish(int taskId);
+    void rebalance();
+
+private:
+    struct Move{
+        int agvId = 0;
+        int station = 0;
+    };
+
+    //最近到达的任务，按半衰期衰减的计数
+    struct LiveDemand{
+        double weight = 0;
+        qint64 lastMsecs = 0;
+    };
+
+    void cleanMoves();
+    int travelBudget(qint64 nowMsecs);
+
+    Config config;
+    QTimer timer;
+
+    QMap<int,QList<int> > historyHourly;//站点 -> 24个小时的历史取货数
+    qint64 historyFirst;
+    qint64 historyLast;
+
+    QMap<int,LiveDemand> live;
+
+    QMap<int,Move> moves;//未完成的挪车任务
+    QList<QPair<qint64,int> > travels;//最近一小时的挪车:时间、距离
+
+    int moveCount;
+    qint64 moveDistance;
+};
+
+#endif // AGVREBALANCER_H
@@ -0,0 +1,297 @@
+﻿#include "chargescheduler.h"
+#include "util/global.h"
+#include <climits>
+#include <cmath>
+#include <algorithm>
+
+//静止时电压估算的电量，每次校正的比例
+#define CHARGE_VOLTAGE_CORRECT  0.05
+//行驶这么远(mm)更新一次耗电率
+#define CHARGE_RATE_SAMPLE_MM   10000
+
+ChargeScheduler::ChargeScheduler(QObject *parent) : QObject(parent),
+    lastSendMsecs(0),
+    lineRate(0)
+{
+}
+
+void ChargeScheduler::init()
+{
+    if(!loadChargers())
+        g_log->log(AGV_LOG_LEVEL_WARN,"charge scheduler: load chargers fail");
+
+    connect(g_taskCenter,SIGNAL(sigTaskStart(int,int)),this,SLOT(onTaskStart(int,int)));
+    connect(g_taskCenter,SIGNAL(sigTaskFinish(int)),this,SLOT(onTaskFinish(int)));
+
+    //地图重新载入后，线路的换算比例重新计算
+    connect(g_agvMapCenter,SIGNAL(mapUpdate()),this,SLOT(onMapUpdate()));
+
+    connect(&timer,SIGNAL(timeout()),this,SLOT(process()));
+    timer.start(1000);
+}
+
+bool ChargeScheduler::loadChargers()
+{
+    if(g_sql==NULL)return false;
+    QString querySql = "select id,charger_station from agv_charger";
+    QList<QList<QVariant> > result = g_sql->query(querySql,QList<QVariant>());
+    for(int i=0;i<result.length();++i){
+        if(result.at(i).length()!=2)continue;
+        addCharger(result.at(i).at(0).toInt(),result.at(i).at(1).toInt());
+    }
+    g_log->log(AGV_LOG_LEVEL_INFO,QString("charge scheduler: %1 chargers").arg(chargers.length()));
+    return true;
+}
+
+void ChargeScheduler::addCharger(int chargerId, int station)
+{
+    if(!g_m_stations.contains(station)){
+        g_log->log(AGV_LOG_LEVEL_WARN,QString("charge scheduler: charger %1 station %2 not exist").arg(chargerId).arg(station));
+        return ;
+    }
+    Charger c;
+    c.id = chargerId;
+    c.station = station;
+    chargers.append(c);
+}
+
+bool ChargeScheduler::canTake(int agvId, qint64 distance)
+{
+    //已经安排去充电的
+    if(chargingAgvs.contains(agvId))return false;
+
+    //没有电量数据的车辆不限制
+    if(!batteries.contains(agvId) || batteries[agvId].soc<0)return true;
+    Agv *agv = g_m_agvs.value(agvId,NULL);
+    if(agv==NULL)return true;
+
+    if(agv->soc<config.criticalSoc)return false;
+    return agv->range >= distance*mmPerUnit()*config.rangeMargin;
+}
+
+void ChargeScheduler::onTaskStart(int taskId, int agvId)
+{
+    if(!chargeTasks.contains(taskId))return ;
+    Agv *agv = g_m_agvs.value(agvId,NULL);
+    if(agv!=NULL)agv->status = Agv::AGV_STATUS_GO_CHARGING;
+}
+
+//到达充电桩，开始充电
+void ChargeScheduler::onTaskFinish(int taskId)
+{
+    if(!chargeTasks.contains(taskId))return ;
+    Agv *agv = g_m_agvs.value(chargeTasks[taskId],NULL);
+    chargingAgvs.remove(chargeTasks[taskId]);
+    chargeTasks.remove(taskId);
+    if(agv!=NULL){
+        agv->status = Agv::AGV_STATUS_CHARGING;
+        g_log->log(AGV_LOG_LEVEL_INFO,QString("charge scheduler: agv %1 start charging, soc %2%").arg(agv->id).arg(agv->soc));
+    }
+}
+
+//安时积分估算电量，静止(电流很小)时向电压对应的电量校正。行驶时统计每mm的耗电
+void ChargeScheduler::estimate(Agv *agv, qint64 nowMsecs)
+{
+    if(agv->voltage<=0)return ;
+    Battery &b = batteries[agv->id];
+    double v = agv->voltage/100.0;
+    double i = agv->current/10.0;//放电为正，充电为负
+    double voltageSoc = 100.0*(v-config.emptyVoltage)/(config.fullVoltage-config.emptyVoltage);
+    voltageSoc = qBound(0.0,voltageSoc,100.0);
+
+    if(b.soc<0){
+        b.soc = voltageSoc;
+        b.lastSoc = b.soc;
+        b.lastMileage = agv->mileage;
+    }else{
+        b.soc -= i*(nowMsecs-b.lastMsecs)/1000.0/3600.0/config.capacityAh*100;
+        if(fabs(i)<config.restCurrent)
+            b.soc += (voltageSoc-b.soc)*CHARGE_VOLTAGE_CORRECT;
+        b.soc = qBound(0.0,b.soc,100.0);
+    }
+    b.lastMsecs = nowMsecs;
+
+    int mm = agv->mileage-b.lastMileage;
+    if(agv->status == Agv::AGV_STATUS_CHARGING || mm<0){
+        b.lastMileage = agv->mileage;
+        b.lastSoc = b.soc;
+    }else if(mm>=CHARGE_RATE_SAMPLE_MM){
+        double drop = b.lastSoc-b.soc;
+        if(drop>0){
+            double rate = drop/mm;
+            b.socPerMm = b.socPerMm>0?(0.8*b.socPerMm+0.2*rate):rate;
+        }
+        b.lastMileage = agv->mileage;
+        b.lastSoc = b.soc;
+    }
+
+    double socPerMm = b.socPerMm>0?b.socPerMm:100.0/config.fullRangeMm;
+    agv->soc = (int)b.soc;
+    agv->range = b.soc>config.reserveSoc?(int)qMin((b.soc-config.reserveSoc)/socPerMm,(double)INT_MAX):0;
+}
+
+//去充电的任务:长时间分配不到车辆的取消，被用户取消的恢复车辆状态
+void ChargeScheduler::checkChargeTasks()
+{
+    QDateTime now = getCurrentDateTime();
+    QList<int> ids = chargeTasks.keys();
+    for(int i=0;i<ids.length();++i){
+        int taskId = ids.at(i);
+        Task *task = g_taskCenter->queryUndoTask(taskId);
+        if(task!=NULL){
+            if(task->produceTime.secsTo(now)<config.chargeTaskTimeout)continue;
+            g_taskCenter->cancelTask(taskId);
+        }else if(g_taskCenter->queryDoingTask(taskId)!=NULL){
+            continue;
+        }
+
+        Agv *agv = g_m_agvs.value(chargeTasks[taskId],NULL);
+        if(agv!=NULL && agv->status == Agv::AGV_STATUS_GO_CHARGING)
+            agv->status = Agv::AGV_STATUS_IDLE;
+        for(int j=0;j<chargers.length();++j){
+            if(chargers[j].agvId == chargeTasks[taskId])
+                chargers[j].agvId = 0;
+        }
+        chargingAgvs.remove(chargeTasks[taskId]);
+        chargeTasks.remove(taskId);
+    }
+}
+
+//充满的离开充电桩。有任务在等却没有空闲车辆时，电量够用的提前离开
+void ChargeScheduler::releaseChargers(int waitingTasks, int idleAgvs)
+{
+    for(int i=0;i<chargers.length();++i){
+        if(chargers[i].agvId<=0)continue;
+        Agv *agv = g_m_agvs.value(chargers[i].agvId,NULL);
+        if(agv==NULL){
+            chargers[i].agvId = 0;
+            continue;
+        }
+        if(agv->status != Agv::AGV_STATUS_CHARGING){
+            //去充电的路上
+            if(chargingAgvs.contains(agv->id))continue;
+            chargers[i].agvId = 0;
+            continue;
+        }
+        bool full = agv->soc>=config.fullSoc;
+        bool needed = waitingTasks>0 && idleAgvs<=0 && agv->soc>=config.releaseSoc;
+        if(!full && !needed)continue;
+
+        agv->status = Agv::AGV_STATUS_IDLE;
+        chargers[i].agvId = 0;
+        ++idleAgvs;
+        g_log->log(AGV_LOG_LEVEL_INFO,QString("charge scheduler: agv %1 leave charger %2, soc %3%").arg(agv->id).arg(chargers[i].id).arg(agv->soc));
+    }
+}
+
+bool ChargeScheduler::sendToCharge(Agv *agv)
+{
+    int best = -1;
+    int minDis = distance_infinity;
+    for(int i=0;i<chargers.length();++i){
+        if(chargers[i].agvId>0)continue;
+        AgvStation s = g_agvMapCenter->getAgvStation(chargers[i].station);
+        if(s.id<=0)continue;
+        //充电桩上停着别的车辆(比如已经充满的)，或者被预留了
+        if(s.occuAgv!=0 && s.occuAgv!=agv->id)continue;
+        if(s.reserveAgv!=0 && s.reserveAgv!=agv->id)continue;
+        if(agv->nowStation == s.id){
+            best = i;
+            minDis = 0;
+            break;
+        }
+        int dis = distance_infinity;
+        QList<int> path = g_agvMapCenter->getBestPath(agv->id,agv->lastStation,agv->nowStation,s.id,dis,false);
+        if(path.length()>0 && dis<minDis){
+            best = i;
+            minDis = dis;
+        }
+    }
+    if(best<0)return false;
+
+    chargers[best].agvId = agv->id;
+    lastSendMsecs = getCurrentDateTime().toMSecsSinceEpoch();
+    if(agv->nowStation == chargers[best].station){
+        agv->status = Agv::AGV_STATUS_CHARGING;
+        g_log->log(AGV_LOG_LEVEL_INFO,QString("charge scheduler: agv %1 start charging, soc %2%").arg(agv->id).arg(agv->soc));
+        return true;
+    }
+
+    int taskId = g_taskCenter->makeAgvAimTask(agv->id,chargers[best].station,Task::PRIORITY_VERY_HIGH);
+    if(taskId<=0){
+        chargers[best].agvId = 0;
+        return false;
+    }
+    chargeTasks.insert(taskId,agv->id);
+    chargingAgvs.insert(agv->id);
+    g_log->log(AGV_LOG_LEVEL_INFO,QString("charge scheduler: agv %1 go to charger %2, soc %3%").arg(agv->id).arg(chargers[best].id).arg(agv->soc));
+    return true;
+}
+
+//未来一段时间预计的任务数。有调配器时用它的站点需求预测，否则用最近一小时的任务产生速度
+double ChargeScheduler::forecastDemand()
+{
+    if(g_agvRebalancer!=NULL){
+        qint64 nowMsecs = getCurrentDateTime().toMSecsSinceEpoch();
+        double demand = 0;
+        for(QMap<int,AgvStation *>::iterator itr=g_m_stations.begin();itr!=g_m_stations.end();++itr)
+            demand += g_agvRebalancer->expectedDemand(itr.key(),nowMsecs);
+        return demand*config.horizonMinutes/g_agvRebalancer->getConfig().horizonMinutes;
+    }
+    return g_taskCenter->getStats().perHour(TaskStats::COUNTER_CREATED)*config.horizonMinutes/60.0;
+}
+
+void ChargeScheduler::onMapUpdate()
+{
+    lineRate = 0;
+}
+
+//地图线路长度到里程计(mm)的平均换算比例，地图更新后重新计算
+double ChargeScheduler::mmPerUnit()
+{
+    if(lineRate>0)return lineRate;
+    double length = 0;
+    double mm = 0;
+    for(QMap<int,AgvLine *>::iterator itr=g_m_lines.begin();itr!=g_m_lines.end();++itr){
+        length += itr.value()->length;
+        mm += itr.value()->length*itr.value()->rate;
+    }
+    lineRate = (length>0&&mm>0)?mm/length:1;
+    return lineRate;
+}
+
+void ChargeScheduler::process()
+{
+    qint64 nowMsecs = getCurrentDateTime().toMSecsSinceEpoch();
+    for(QMap<int,Agv *>::iterator itr=g_m_agvs.begin();itr!=g_m_agvs.end();++itr)
+        estimate(itr.value(),nowMsecs);
+
+    checkChargeTasks();
+
+    int waitingTasks = g_taskCenter->getUnassignedTasks().length();
+    QList<Agv *> idleAgvs = g_hrgAgvCenter->getIdleAgvs();
+    releaseChargers(waitingTasks,idleAgvs.length());
+    idleAgvs = g_hrgAgvCenter->getIdleAgvs();
+
+    //电量低的空闲车辆，电量最低的优先
+    QList<Agv *> lowAgvs;
+    for(int i=0;i<idleAgvs.length();++i){
+        Agv *agv = idleAgvs.at(i);
+        if(agv->soc<0 || agv->soc>=config.chargeSoc || agv->nowStation<=0)continue;
+        if(chargingAgvs.contains(agv->id))continue;
+        lowAgvs.append(agv);
+    }
+    std::sort(lowAgvs.begin(),lowAgvs.end(),[](Agv *a,Agv *b){return a->soc<b->soc;});
+
+    int spare = idleAgvs.length()-(int)std::ceil(forecastDemand());
+    for(int i=0;i<lowAgvs.length();++i){
+        Agv *agv = lowAgvs.at(i);
+        //电量危急的直接去充电。其他的错开时间，而且只在空闲车辆多于预计需求时去
+        if(agv->soc>=config.criticalSoc){
+            if(waitingTasks>0 || spare<=0)break;
+            if(nowMsecs-lastSendMsecs<(qint64)config.staggerSeconds*1000)break;
+        }
+        if(!sendToCharge(agv))break;
+        --spare;
+    }
+}
@@ -0,0 +1,97 @@
+﻿#ifndef CHARGESCHEDULER_H
+#define CHARGESCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QMap>
+#include <QSet>
+#include <QList>
+
+class Agv;
+
+//充电调度
+//1.由上报的电压、电流估算每辆车的剩余电量和续航(安时积分，静止时用电压校正)
+//2.电量不足以跑完一个任务的车辆，不分配这个任务
+//3.充电桩是有限的资源，按预计的任务需求错开各车辆的充电时间，需求高峰时尽量多留可用车辆
+class ChargeScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    struct Config{
+        double capacityAh = 100;//电池容量 Ah
+        double emptyVoltage = 22.0;//电量为0时的静止电压 V
+        double fullVoltage = 26.0;//充满时的静止电压 V
+        double restCurrent = 2.0;//电流低于这个值(A)认为是静止状态，用电压校正电量
+        double fullRangeMm = 10000000;//没有行驶数据时，满电的续航里程 mm
+        int criticalSoc = 20;//低于这个电量必须去充电，不再接任务
+        int chargeSoc = 60;//空闲时，低于这个电量可以去充电
+        int releaseSoc = 50;//有任务在等待车辆时，充到这个电量就可以离开充电桩
+        int fullSoc = 95;//充满
+        int reserveSoc = 10;//计算续航时保留的电量(要能开到充电桩)
+        double rangeMargin = 1.2;//任务距离的安全系数
+        int staggerSeconds = 120;//两辆车开始去充电的最小间隔(电量危急的除外)
+        double horizonMinutes = 15;//预计多长时间内的任务需求
+        int chargeTaskTimeout = 60;//去充电的任务这么多秒还没有分配到车辆，取消重来
+    };
+
+    explicit ChargeScheduler(QObject *parent = nullptr);
+
+    void setConfig(const Config &_config){config = _config;}
+    const Config &getConfig(){return config;}
+
+    //载入充电桩，连接任务中心，启动定时器
+    void init();
+
+    //从agv_charger表载入充电桩
+    bool loadChargers();
+
+    //不使用数据库时添加充电桩
+    void addCharger(int chargerId, int station);
+
+    //车辆的电量能否接这个任务，distance是路径距离(单位和地图线路长度相同)
+    bool canTake(int agvId, qint64 distance);
+
+signals:
+
+public slots:
+    void onTaskStart(int taskId, int agvId);
+    void onTaskFinish(int taskId);
+    void process();
+    void onMapUpdate();
+
+private:
+    struct Charger{
+        int id = 0;
+        int station = 0;
+        int agvId = 0;//分配给了哪辆车
+    };
+
+    //每辆车的电量估算
+    struct Battery{
+        double soc = -1;
+        qint64 lastMsecs = 0;
+        int lastMileage = 0;
+        double lastSoc = -1;//上次计算耗电率时的电量
+        double socPerMm = 0;//每mm耗电(%)，0表示还没有数据
+    };
+
+    void estimate(Agv *agv, qint64 nowMsecs);
+    void checkChargeTasks();
+    void releaseChargers(int waitingTasks, int idleAgvs);
+    bool sendToCharge(Agv *agv);
+    double forecastDemand();
+    double mmPerUnit();
+
+    Config config;
+    QTimer timer;
+
+    QList<Charger> chargers;
+    QMap<int,Battery> batteries;
+    QMap<int,int> chargeTasks;//去充电的任务 -> 车辆
+    QSet<int> chargingAgvs;//有去充电的任务的车辆，和chargeTasks一起维护
+
+    qint64 lastSendMsecs;
+    double lineRate;
+};
+
+#endif // CHARGESCHEDULER_H
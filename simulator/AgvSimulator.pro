@@ -0,0 +1,22 @@
+QT += core sql network
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = AgvSimulator
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += \
+    main.cpp \
+    fleetsimulator.cpp
+
+HEADERS += \
+    fleetsimulator.h
+
+#和服务端共用业务代码
+include(../AgvServer.pri)
+
+DEFINES += QT_DEPRECATED_WARNINGS
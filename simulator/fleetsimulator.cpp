@@ -0,0 +1,418 @@
+﻿#include "fleetsimulator.h"
+#include "util/global.h"
+#include <QFile>
+#include <QTextStream>
+#include <QMetaObject>
+
+//连续这么长时间(ms)有任务在等待，却没有车辆在行驶或作业，就认为调度卡死了
+#define SIM_STALL_TIMEOUT   (60*1000)
+//调度周期(ms)
+#define SIM_DISPATCH_INTERVAL   1000
+
+FleetSimulator::FleetSimulator(const Config &_config, QObject *parent) : QObject(parent),
+    config(_config),
+    seq(0),
+    now(0),
+    endTime(0),
+    startMsecs(QDateTime::currentMSecsSinceEpoch()),
+    random(_config.seed),
+    rebalancer(NULL),
+    arrivedTasks(0),
+    finishedTasks(0),
+    emptyOdometer(0),
+    loadedOdometer(0),
+    lastProgressTime(0),
+    stalled(false),
+    stallCount(0)
+{
+}
+
+FleetSimulator::~FleetSimulator()
+{
+    setVirtualClock(nullptr);
+}
+
+bool FleetSimulator::init()
+{
+    endTime = (qint64)(config.hours*3600*1000);
+    stationIds = g_m_stations.keys();
+    if(stationIds.length()<=0){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"simulator: map has no station");
+        return false;
+    }
+    if(config.agvCount<=0 || config.agvCount>stationIds.length()){
+        g_log->log(AGV_LOG_LEVEL_ERROR,QString("simulator: agv count must be in [1,%1]").arg(stationIds.length()));
+        return false;
+    }
+    if(config.speed<=0){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"simulator: speed must be positive");
+        return false;
+    }
+    //有截止时间的任务按仿真的车速估算松弛时间
+    g_taskCenter->setTravelSpeed(config.speed);
+
+    //所有任务相关的时间都走虚拟时钟
+    setVirtualClock([this](){return startMsecs+now;});
+
+    //虚拟车辆，每辆车放在一个不同的站点上
+    for(int i=0;i<config.agvCount;++i){
+        Agv *agv = new Agv;
+        agv->id = i+1;
+        agv->name = QString("sim%1").arg(agv->id);
+        agv->status = Agv::AGV_STATUS_IDLE;
+        agv->nowStation = stationIds.at(i);
+        g_m_agvs.insert(agv->id,agv);
+        g_agvMapCenter->setStationOccuAgv(agv->nowStation,agv->id);
+        simAgvs.insert(agv->id,SimAgv());
+    }
+
+    connect(g_taskCenter,SIGNAL(sigTaskStart(int,int)),this,SLOT(onTaskStart(int,int)));
+    connect(g_taskCenter,SIGNAL(sigTaskFinish(int)),this,SLOT(onTaskFinish(int)));
+
+    if(config.arrivalFile.length()>0){
+        if(!loadArrivals())return false;
+    }else{
+        if(stationIds.length()<3){
+            g_log->log(AGV_LOG_LEVEL_ERROR,"simulator: random tasks need at least 3 stations");
+            return false;
+        }
+        makeArrivals();
+    }
+
+    Event dispatch;
+    dispatch.type = EVENT_DISPATCH;
+    schedule(dispatch);
+
+    //调配器在仿真器之后连接任务完成信号，这样仿真器统计时还能认出挪车任务
+    if(config.rebalance){
+        rebalancer = new AgvRebalancer(this);
+        rebalancer->setConfig(config.rebalancer);
+        if(config.historyFile.length()>0 && !loadHistory())return false;
+        connect(g_taskCenter,SIGNAL(sigTaskNew(int,int)),rebalancer,SLOT(onTaskNew(int,int)));
+        connect(g_taskCenter,SIGNAL(sigTaskFinish(int)),rebalancer,SLOT(onTaskFinish(int)));
+        Event e;
+        e.type = EVENT_REBALANCE;
+        schedule(e);
+    }
+    return true;
+}
+
+//每行一个任务: 到达时间(s),取货点,放货点,待命点[,优先级[,到达后多少秒内送达]]，#开头的是注释
+bool FleetSimulator::loadArrivals()
+{
+    QFile file(config.arrivalFile);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text)){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"simulator: open arrival file fail:"+config.arrivalFile);
+        return false;
+    }
+    int lineNumber = 0;
+    while(!file.atEnd()){
+        QString l = QString::fromUtf8(file.readLine()).trimmed();
+        ++lineNumber;
+        if(l.isEmpty()||l.startsWith("#"))continue;
+        QStringList pp = l.split(",");
+        if(pp.length()<4){
+            g_log->log(AGV_LOG_LEVEL_WARN,QString("simulator: arrival file line %1 ignored").arg(lineNumber));
+            continue;
+        }
+        Event e;
+        e.type = EVENT_TASK_ARRIVE;
+        e.time = (qint64)(pp.at(0).toDouble()*1000);
+        e.pick = pp.at(1).toInt();
+        e.put = pp.at(2).toInt();
+        e.standBy = pp.at(3).toInt();
+        e.priority = pp.length()>4?pp.at(4).toInt():Task::PRIORITY_NORMAL;
+        e.deadline = pp.length()>5?(qint64)(pp.at(5).toDouble()*1000):0;
+        if(e.time<0 || !g_m_stations.contains(e.pick) || !g_m_stations.contains(e.put) || !g_m_stations.contains(e.standBy)){
+            g_log->log(AGV_LOG_LEVEL_WARN,QString("simulator: arrival file line %1 ignored").arg(lineNumber));
+            continue;
+        }
+        schedule(e);
+    }
+    file.close();
+    return true;
+}
+
+//历史任务的到达时间同样相对于仿真开始，只用到取货点
+bool FleetSimulator::loadHistory()
+{
+    QFile file(config.historyFile);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text)){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"simulator: open history file fail:"+config.historyFile);
+        return false;
+    }
+    while(!file.atEnd()){
+        QString l = QString::fromUtf8(file.readLine()).trimmed();
+        if(l.isEmpty()||l.startsWith("#"))continue;
+        QStringList pp = l.split(",");
+        if(pp.length()<2)continue;
+        qint64 offset = (qint64)(pp.at(0).toDouble()*1000);
+        rebalancer->addHistory(pp.at(1).toInt(),QDateTime::fromMSecsSinceEpoch(startMsecs+offset));
+    }
+    file.close();
+    return true;
+}
+
+//泊松到达，取货点、放货点、待命点随机选取且互不相同
+void FleetSimulator::makeArrivals()
+{
+    if(config.taskRate<=0)return ;
+    std::exponential_distribution<double> interval(config.taskRate/3600.0);
+    std::uniform_int_distribution<int> pickStation(0,stationIds.length()-1);
+    double t = 0;
+    while(true){
+        t += interval(random);
+        if(t*1000>endTime)break;
+        Event e;
+        e.type = EVENT_TASK_ARRIVE;
+        e.time = (qint64)(t*1000);
+        e.pick = stationIds.at(pickStation(random));
+        do{
+            e.put = stationIds.at(pickStation(random));
+        }while(e.put == e.pick);
+        do{
+            e.standBy = stationIds.at(pickStation(random));
+        }while(e.standBy == e.pick || e.standBy == e.put);
+        e.priority = Task::PRIORITY_NORMAL;
+        e.deadline = (qint64)(config.deadlineSeconds*1000);
+        schedule(e);
+    }
+}
+
+void FleetSimulator::schedule(Event e)
+{
+    e.seq = seq++;
+    events.push(e);
+}
+
+void FleetSimulator::run()
+{
+    while(!events.empty()){
+        Event e = events.top();
+        if(e.time>endTime)break;
+        events.pop();
+        now = e.time;
+
+        switch(e.type){
+        case EVENT_TASK_ARRIVE:
+        {
+            ++arrivedTasks;
+            QDateTime deadline;
+            if(e.deadline>0)
+                deadline = QDateTime::fromMSecsSinceEpoch(startMsecs+now+e.deadline);
+            g_taskCenter->makePickupTask(e.pick,e.put,e.standBy,e.priority,deadline);
+            break;
+        }
+        case EVENT_DISPATCH:
+        {
+            //和服务端的定时器一样，调用任务中心的分配
+            QMetaObject::invokeMethod(g_taskCenter,"unassignedTasksProcess",Qt::DirectConnection);
+            sampleOdometer();
+            checkStall();
+            Event next;
+            next.type = EVENT_DISPATCH;
+            next.time = now+SIM_DISPATCH_INTERVAL;
+            schedule(next);
+            break;
+        }
+        case EVENT_AGV_ARRIVE:
+            if(g_m_agvs.contains(e.agvId))
+                onAgvArrive(g_m_agvs[e.agvId]);
+            break;
+        case EVENT_REBALANCE:
+        {
+            rebalancer->rebalance();
+            Event next;
+            next.type = EVENT_REBALANCE;
+            next.time = now+qMax(1,config.rebalancer.interval)*1000;
+            schedule(next);
+            break;
+        }
+        case EVENT_WORK_DONE:
+            if(g_m_agvs.contains(e.agvId)){
+                simAgvs[e.agvId].working = false;
+                progress();
+                g_hrgAgvCenter->onFinish(g_m_agvs[e.agvId]);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    now = endTime;
+}
+
+//任务中心把一段任务分配给了车辆，车辆沿着路径出发
+void FleetSimulator::onTaskStart(int taskId, int agvId)
+{
+    if(!g_m_agvs.contains(agvId))return ;
+    Agv *agv = g_m_agvs[agvId];
+    Task *task = g_taskCenter->queryDoingTask(taskId);
+    simAgvs[agvId].loaded = (task!=NULL && task->currentDoIndex == Task::INDEX_PUTTING_GOOD);
+    progress();
+
+    //被抢占改派的车辆正在线路上行驶，到站后按新的路径继续
+    if(simAgvs[agvId].moving)return ;
+
+    //车辆停在站点上时，路径的第一条线路可能是到达这个站点的线路，已经走过了
+    while(agv->currentPath.length()>0 && agv->nowStation>0){
+        AgvLine line = g_agvMapCenter->getAgvLine(agv->currentPath.at(0));
+        if(line.endStation != agv->nowStation)break;
+        agv->currentPath.removeFirst();
+    }
+
+    departNextLine(agv);
+}
+
+void FleetSimulator::onTaskFinish(int taskId)
+{
+    if(rebalancer!=NULL && rebalancer->isRebalanceTask(taskId))return ;
+    ++finishedTasks;
+}
+
+//驶上路径中的下一条线路。路径走完了，开始取货、放货(去待命点的直接完成)
+void FleetSimulator::departNextLine(Agv *agv)
+{
+    SimAgv &s = simAgvs[agv->id];
+    if(agv->currentPath.length()<=0){
+        s.moving = false;
+        s.working = true;
+        qint64 dwell = 0;
+        Task *task = g_taskCenter->queryDoingTask(agv->task);
+        if(task!=NULL && task->currentDoIndex != Task::INDEX_GOING_STANDBY)
+            dwell = (qint64)(config.pickSeconds*1000);
+        Event e;
+        e.type = EVENT_WORK_DONE;
+        e.agvId = agv->id;
+        e.time = now+dwell;
+        schedule(e);
+        return ;
+    }
+
+    AgvLine line = g_agvMapCenter->getAgvLine(agv->currentPath.at(0));
+    if(agv->nowStation>0)
+        agv->lastStation = agv->nowStation;
+    agv->nowStation = 0;
+    agv->nextStation = line.endStation;
+
+    qint64 odometer = lineOdometer(line.id);
+    if(s.loaded)
+        loadedOdometer += odometer;
+    else
+        emptyOdometer += odometer;
+
+    s.moving = true;
+    s.legLine = line.id;
+    s.legStartTime = now;
+
+    Event e;
+    e.type = EVENT_AGV_ARRIVE;
+    e.agvId = agv->id;
+    e.time = now+qMax((qint64)1,(qint64)(odometer*1000/config.speed));
+    schedule(e);
+}
+
+void FleetSimulator::onAgvArrive(Agv *agv)
+{
+    SimAgv &s = simAgvs[agv->id];
+    s.moving = false;
+    progress();
+
+    AgvLine line = g_agvMapCenter->getAgvLine(s.legLine);
+    AgvStation station = g_agvMapCenter->getAgvStation(line.endStation);
+    agv->mileage += lineOdometer(line.id);
+
+    //和真实车辆一样，按地标上报到站，由车辆中心、任务中心更新位置和线路占用
+    if(g_agvMapCenter->getAgvStationByRfid(station.rfid).id == station.id){
+        g_hrgAgvCenter->updateStationOdometer(station.rfid,agv->mileage,agv);
+    }else{
+        //地图中的地标号有重复，直接设置站点
+        agv->x = station.x;
+        agv->y = station.y;
+        agv->nowStation = station.id;
+        agv->lastStationOdometer = agv->mileage;
+        g_taskCenter->carArriveStation(agv->id,station.id);
+    }
+
+    departNextLine(agv);
+}
+
+//行驶中的车辆按里程计更新坐标
+void FleetSimulator::sampleOdometer()
+{
+    for(QMap<int,SimAgv>::iterator itr=simAgvs.begin();itr!=simAgvs.end();++itr){
+        if(!itr.value().moving)continue;
+        Agv *agv = g_m_agvs[itr.key()];
+        int odometer = agv->lastStationOdometer + (int)((now-itr.value().legStartTime)*config.speed/1000);
+        g_hrgAgvCenter->updateOdometer(odometer,agv);
+    }
+}
+
+void FleetSimulator::checkStall()
+{
+    if(stalled)return ;
+    if(g_taskCenter->getUnassignedTasks().length()<=0)return ;
+    for(QMap<int,SimAgv>::iterator itr=simAgvs.begin();itr!=simAgvs.end();++itr){
+        if(itr.value().moving || itr.value().working)return ;
+    }
+    if(now-lastProgressTime<SIM_STALL_TIMEOUT)return ;
+
+    stalled = true;
+    ++stallCount;
+    g_log->log(AGV_LOG_LEVEL_WARN,QString("simulator: dispatch stalled at %1s, %2 tasks waiting").arg(now/1000).arg(g_taskCenter->getUnassignedTasks().length()));
+}
+
+//有车辆出发、到站或者作业完成
+void FleetSimulator::progress()
+{
+    lastProgressTime = now;
+    stalled = false;
+}
+
+//线路的实际长度，单位和里程计相同
+qint64 FleetSimulator::lineOdometer(int lineId)
+{
+    AgvLine line = g_agvMapCenter->getAgvLine(lineId);
+    if(line.id<=0)return 0;
+    return (qint64)(line.length*line.rate);
+}
+
+void FleetSimulator::report()
+{
+    QTextStream out(stdout);
+    double hours = endTime/3600000.0;
+    const TaskStats &stats = g_taskCenter->getStats();
+
+    out<<"agvs:"<<config.agvCount<<" hours:"<<hours<<" speed(mm/s):"<<config.speed<<"\n";
+    out<<"tasks arrived:"<<arrivedTasks<<" finished:"<<finishedTasks
+      <<" waiting:"<<g_taskCenter->getUnassignedTasks().length()
+     <<" doing:"<<g_taskCenter->getDoingTasks().length()<<"\n";
+    out<<"tasks/hour:"<<(hours>0?finishedTasks/hours:0)<<"\n";
+
+    qint64 total = emptyOdometer+loadedOdometer;
+    out<<"empty travel ratio:"<<(total>0?100.0*emptyOdometer/total:0)<<"%"
+      <<" (empty:"<<emptyOdometer<<" loaded:"<<loadedOdometer<<")\n";
+
+    int metrics[] = {TaskStats::METRIC_TIME_TO_ASSIGN,TaskStats::METRIC_TIME_TO_PICKUP,TaskStats::METRIC_QUEUE_WAIT,TaskStats::METRIC_END_TO_END};
+    for(int i=0;i<4;++i){
+        AtomicHistogram::Snapshot snap = stats.snapshot(metrics[i]);
+        out<<TaskStats::metricName(metrics[i])<<"(s) count:"<<snap.count
+          <<" mean:"<<snap.mean()/1000
+         <<" p50:"<<snap.percentile(50)/1000.0
+        <<" p90:"<<snap.percentile(90)/1000.0
+        <<" p99:"<<snap.percentile(99)/1000.0
+        <<" max:"<<snap.max/1000.0<<"\n";
+    }
+    AtomicHistogram::Snapshot lateness = stats.snapshot(TaskStats::METRIC_LATENESS);
+    if(lateness.count>0){
+        quint64 met = lateness.buckets.at(0);
+        out<<"deadline met:"<<met<<" missed:"<<(lateness.count-met)
+          <<" lateness(s) p90:"<<lateness.percentile(90)/1000.0
+         <<" max:"<<lateness.max/1000.0<<"\n";
+    }
+    if(rebalancer!=NULL)
+        out<<"rebalance moves:"<<rebalancer->getMoveCount()<<" distance:"<<rebalancer->getMoveDistance()<<"\n";
+    out<<"aging step(s):"<<g_taskCenter->getAgingStep()/1000.0<<"\n";
+    out<<"deadlocks:"<<stallCount<<(stalled?" (still stalled at end)":"")<<"\n";
+    out.flush();
+}
@@ -0,0 +1,127 @@
+﻿#ifndef FLEETSIMULATOR_H
+#define FLEETSIMULATOR_H
+
+#include <QObject>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <queue>
+#include <vector>
+#include <random>
+#include "service/agvrebalancer.h"
+
+class Agv;
+
+//离散事件的车队仿真
+//虚拟车辆沿着地图中的线路按设定速度行驶，任务按泊松过程(或者记录的到达文件)送入TaskCenter
+//时间由事件队列推进，不需要真的等待，8小时的班次几秒钟就能跑完
+class FleetSimulator : public QObject
+{
+    Q_OBJECT
+public:
+    struct Config{
+        int agvCount = 5;//车辆数
+        double taskRate = 60;//每小时的任务数
+        double hours = 8;//仿真时长
+        double speed = 1000;//行驶速度 mm/s
+        double pickSeconds = 10;//取货、放货的耗时 s
+        unsigned int seed = 0;//随机数种子
+        QString arrivalFile;//记录的任务到达文件，为空时随机产生
+        double deadlineSeconds = 0;//随机产生的任务，要求在到达后多少秒内送达，0表示没有截止时间
+        bool rebalance = false;//是否启用空闲车辆预先调配
+        QString historyFile;//调配用的历史任务(格式和到达文件相同)
+        AgvRebalancer::Config rebalancer;
+    };
+
+    explicit FleetSimulator(const Config &_config, QObject *parent = nullptr);
+
+    ~FleetSimulator();
+
+    //地图已经载入后调用:放置车辆，准备任务到达事件
+    bool init();
+
+    void run();
+
+    //输出仿真结果
+    void report();
+
+signals:
+
+public slots:
+    void onTaskStart(int taskId, int agvId);
+    void onTaskFinish(int taskId);
+
+private:
+    enum{
+        EVENT_TASK_ARRIVE = 0,//任务到达
+        EVENT_DISPATCH = 1,//调度周期(和服务端一样，每秒分配一次)
+        EVENT_AGV_ARRIVE = 2,//车辆到达线路的终点
+        EVENT_WORK_DONE = 3,//取货、放货完成
+        EVENT_REBALANCE = 4,//空闲车辆调配周期
+    };
+
+    struct Event{
+        qint64 time = 0;
+        qint64 seq = 0;//同一时刻按产生的先后处理
+        int type = EVENT_DISPATCH;
+        int agvId = 0;
+        int pick = 0;
+        int put = 0;
+        int standBy = 0;
+        int priority = 0;
+        qint64 deadline = 0;//相对于到达时间的截止时间(ms)，0表示没有
+    };
+
+    struct EventLater{
+        bool operator()(const Event &a,const Event &b) const {
+            if(a.time == b.time)return a.seq>b.seq;
+            return a.time>b.time;
+        }
+    };
+
+    //每辆虚拟车辆的运动状态
+    struct SimAgv{
+        bool moving = false;
+        bool working = false;
+        bool loaded = false;//当前这一段是否载货
+        qint64 legStartTime = 0;//当前线路的出发时间
+        int legLine = 0;//当前行驶的线路
+    };
+
+    bool loadArrivals();
+    bool loadHistory();
+    void makeArrivals();
+    void schedule(Event e);
+
+    void onAgvArrive(Agv *agv);
+    void departNextLine(Agv *agv);
+    void sampleOdometer();
+    void checkStall();
+    void progress();
+
+    qint64 lineOdometer(int lineId);
+
+    Config config;
+
+    std::priority_queue<Event,std::vector<Event>,EventLater> events;
+    qint64 seq;
+    qint64 now;//仿真时间(ms，从0开始)
+    qint64 endTime;
+    qint64 startMsecs;//仿真开始对应的时间戳
+
+    QList<int> stationIds;
+    QMap<int,SimAgv> simAgvs;
+    std::mt19937 random;
+    AgvRebalancer *rebalancer;
+
+    //统计
+    int arrivedTasks;
+    int finishedTasks;
+    qint64 emptyOdometer;
+    qint64 loadedOdometer;
+    qint64 lastProgressTime;
+    bool stalled;
+    int stallCount;
+};
+
+#endif // FLEETSIMULATOR_H
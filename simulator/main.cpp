@@ -0,0 +1,98 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include "util/global.h"
+#include "fleetsimulator.h"
+
+//离线的调度仿真:不连接真实车辆，不写任务日志，地图从数据库或者地图文件载入
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("AgvSimulator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("AGV fleet dispatch simulator");
+    parser.addHelpOption();
+    QCommandLineOption mapOption("map","map file (station=/line=/arc= lines, same format as map/create).","file");
+    QCommandLineOption dbOption("db","load map from database.");
+    QCommandLineOption agvsOption("agvs","number of virtual agvs.","count","5");
+    QCommandLineOption rateOption("rate","random tasks per hour.","tasks","60");
+    QCommandLineOption hoursOption("hours","simulated hours.","hours","8");
+    QCommandLineOption speedOption("speed","agv speed in mm/s.","speed","1000");
+    QCommandLineOption pickOption("pick","seconds for each pick or put.","seconds","10");
+    QCommandLineOption seedOption("seed","random seed.","seed","0");
+    QCommandLineOption csvOption("csv","recorded arrivals (offsetSec,pick,put,standby[,priority[,deadlineSec]]).","file");
+    QCommandLineOption deadlineOption("deadline","random tasks must be delivered within these seconds (0 for none).","seconds","0");
+    QCommandLineOption agingOption("aging","aging step in seconds per priority level.","seconds");
+    QCommandLineOption rebalanceOption("rebalance","move idle agvs toward stations with expected pickups.");
+    QCommandLineOption historyOption("history","past arrivals for rebalance demand (same format as --csv).","file");
+    QCommandLineOption moveCapOption("move-cap","max distance of one rebalance move (0 for no limit).","distance","0");
+    QCommandLineOption travelCapOption("travel-cap","max rebalance distance per hour (0 for no limit).","distance","0");
+    parser.addOption(mapOption);
+    parser.addOption(dbOption);
+    parser.addOption(agvsOption);
+    parser.addOption(rateOption);
+    parser.addOption(hoursOption);
+    parser.addOption(speedOption);
+    parser.addOption(pickOption);
+    parser.addOption(seedOption);
+    parser.addOption(csvOption);
+    parser.addOption(deadlineOption);
+    parser.addOption(agingOption);
+    parser.addOption(rebalanceOption);
+    parser.addOption(historyOption);
+    parser.addOption(moveCapOption);
+    parser.addOption(travelCapOption);
+    parser.process(a);
+
+    if(!parser.isSet(mapOption) && !parser.isSet(dbOption)){
+        qDebug()<<"need --map or --db";
+        return 1;
+    }
+
+    g_log = new AgvLog();
+    g_log->setPersist(false);
+
+    //任务只在内存中，不写日志文件也不写数据库
+    g_taskJournal = new TaskJournal;
+    g_taskJournal->init(QString());
+
+    //车辆由仿真器创建，不从数据库载入
+    g_hrgAgvCenter = new AgvCenter;
+
+    g_agvMapCenter = new MapCenter;
+    if(parser.isSet(dbOption)){
+        g_sql = new Sql();
+        g_sql->createConnection();
+        g_agvMapCenter->load();
+    }else{
+        g_agvMapCenter->setPersist(false);
+        if(!g_agvMapCenter->loadFromFile(parser.value(mapOption)))
+            return 1;
+    }
+
+    g_taskCenter = new TaskCenter;
+    g_taskCenter->init();
+    if(parser.isSet(agingOption))
+        g_taskCenter->setAgingStep((qint64)(parser.value(agingOption).toDouble()*1000));
+
+    FleetSimulator::Config config;
+    config.agvCount = parser.value(agvsOption).toInt();
+    config.taskRate = parser.value(rateOption).toDouble();
+    config.hours = parser.value(hoursOption).toDouble();
+    config.speed = parser.value(speedOption).toDouble();
+    config.pickSeconds = parser.value(pickOption).toDouble();
+    config.seed = parser.value(seedOption).toUInt();
+    config.arrivalFile = parser.value(csvOption);
+    config.deadlineSeconds = parser.value(deadlineOption).toDouble();
+    config.rebalance = parser.isSet(rebalanceOption);
+    config.historyFile = parser.value(historyOption);
+    config.rebalancer.maxMoveDistance = parser.value(moveCapOption).toInt();
+    config.rebalancer.maxTravelPerHour = parser.value(travelCapOption).toInt();
+
+    FleetSimulator simulator(config);
+    if(!simulator.init())
+        return 1;
+    simulator.run();
+    simulator.report();
+    return 0;
+}
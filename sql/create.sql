@@ -27,6 +27,13 @@ CREATE TABLE agv_user(id INTEGER PRIMARY KEY AUTO_INCREMENT,user_username text,u
 #创建 agv 表
 CREATE TABLE agv_agv(id INTEGER PRIMARY KEY AUTO_INCREMENT,agv_name text,agv_ip text,agv_port int);
 
+#创建 charger 表(充电桩所在的站点)
+CREATE TABLE agv_charger(id INTEGER PRIMARY KEY AUTO_INCREMENT,charger_name text,charger_station int);
+
+#历史任务、日志分页查询用的索引
+create index idx_task_status_doneTime on agv_task (task_status,task_doneTime);
+create index idx_log_time_level on agv_log (log_time,log_level);
+
 ###############查询表是否存在
 #select count(*) from INFORMATION_SCHEMA.TABLES where TABLE_NAME='agv_agv' ;
 
@@ -32,6 +32,7 @@ bool Sql::checkTables()
     /// 7.agv_agv
     /// 8.agv_task
     /// 9.agv_bkg
+    /// 10.agv_charger
 
     args.clear();
     args<<"agv_station";
@@ -132,12 +133,31 @@ bool Sql::checkTables()
     qsl = query(querySql,args);
     if(qsl.length()==1&&qsl[0].length()==1&&qsl[0][0].toInt()>0){
         //存在了
+        //老版本的表没有截止时间，补上
+        QString queryColumnSql = "select count(*) from INFORMATION_SCHEMA.COLUMNS where TABLE_NAME=? and COLUMN_NAME=?;";
+        args.clear();
+        args<<"agv_task"<<"task_deadline";
+        qsl = query(queryColumnSql,args);
+        if(qsl.length()==1&&qsl[0].length()==1&&qsl[0][0].toInt()==0){
+            args.clear();
+            bool b = exeSql("alter table agv_task add task_deadline datetime;",args);
+            if(!b)return false;
+        }
+        //没有指定车辆的，补上(重启后指定车辆的任务不能被改派、抢占)
+        args.clear();
+        args<<"agv_task"<<"task_agvFixed";
+        qsl = query(queryColumnSql,args);
+        if(qsl.length()==1&&qsl[0].length()==1&&qsl[0][0].toInt()==0){
+            args.clear();
+            bool b = exeSql("alter table agv_task add task_agvFixed bool default false;",args);
+            if(!b)return false;
+        }
     }else{
         //不存在.创建
         QString createSql = "create table agv_task ( id INTEGER PRIMARY KEY AUTO_INCREMENT, task_produceTime datetime,task_doTime datetime,task_doneTime datetime,task_excuteCar integer,task_status integer,task_circle bool,task_priority integer,task_currentDoIndex integer,"
                             "task_getGoodStation integer,task_getGoodDirect integer,task_getGoodDistance integer,task_getStartTime datetime,task_getFinishTime datetime,"
                             "task_putGoodStation integer,task_putGoodDirect integer,task_putGoodDistance integer,task_putStartTime datetime,task_putFinishTime datetime,"
-                            "task_standByStation integer,task_standByStartTime datetime,task_standByFinishTime datetime);";
+                            "task_standByStation integer,task_standByStartTime datetime,task_standByFinishTime datetime,task_deadline datetime,task_agvFixed bool default false);";
         args.clear();
         bool b = exeSql(createSql,args);
         if(!b)return false;
@@ -155,9 +175,41 @@ bool Sql::checkTables()
         bool b = exeSql(createSql,args);
         if(!b)return false;
     }
+
+    args.clear();
+    args<<"agv_charger";
+    qsl = query(querySql,args);
+    if(qsl.length()==1&&qsl[0].length()==1&&qsl[0][0].toInt()>0){
+        //存在了
+    }else{
+        //不存在.创建
+        QString createSql = "CREATE TABLE agv_charger (id INTEGER PRIMARY KEY auto_increment,charger_name text,charger_station int);";
+        args.clear();
+        bool b = exeSql(createSql,args);
+        if(!b)return false;
+    }
+
+    //历史任务、日志分页查询用的索引
+    if(!checkIndex("agv_task","idx_task_status_doneTime","task_status,task_doneTime"))return false;
+    if(!checkIndex("agv_log","idx_log_time_level","log_time,log_level"))return false;
     return true;
 }
 
+//检查索引，不存在就创建
+bool Sql::checkIndex(QString table, QString index, QString columns)
+{
+    QString querySql = "select count(*) from INFORMATION_SCHEMA.STATISTICS where TABLE_SCHEMA=DATABASE() and TABLE_NAME=? and INDEX_NAME=?;";
+    QList<QVariant> args;
+    args<<table<<index;
+    QList<QList<QVariant> > qsl = query(querySql,args);
+    if(qsl.length()==1&&qsl[0].length()==1&&qsl[0][0].toInt()>0){
+        //存在了
+        return true;
+    }
+    args.clear();
+    return exeSql(QString("create index %1 on %2 (%3);").arg(index).arg(table).arg(columns),args);
+}
+
 
 
 //创建数据库连接
@@ -282,4 +334,36 @@ QList<QList<QVariant> > Sql::query(QString qeurysql, QList<QVariant> args)
     return xx;
 }
 
-
+//批量执行同一条sql语句(在一个事务中)，任意一条失败则回滚
+bool Sql::exeSqlBatch(QString esql, QList<QList<QVariant> > argsList)
+{
+    mutex.lock();
+    if(!database.transaction()){
+        qDebug() << "Error: Fail to start transaction."<<database.lastError();
+        mutex.unlock();
+        return false;
+    }
+    QSqlQuery sql_query(database);
+    sql_query.prepare(esql);
+    for(int i=0;i<argsList.length();++i){
+        const QList<QVariant> &args = argsList.at(i);
+        for(int j=0;j<args.length();++j){
+            sql_query.bindValue(j,args[j]);
+        }
+        if(!sql_query.exec())
+        {
+            qDebug() << "Error: Fail to sql_query.exec()."<<sql_query.lastError();
+            database.rollback();
+            mutex.unlock();
+            return false;
+        }
+    }
+    if(!database.commit()){
+        qDebug() << "Error: Fail to commit."<<database.lastError();
+        database.rollback();
+        mutex.unlock();
+        return false;
+    }
+    mutex.unlock();
+    return true;
+}
@@ -29,7 +29,13 @@ public:
     //查询数据
     QList<QList<QVariant>> query(QString qeurysql, QList<QVariant> args);
 
+    //批量执行同一条sql语句(在一个事务中)
+    bool exeSqlBatch(QString exeSql, QList<QList<QVariant> > argsList);
+
 private:
+    //检查索引，不存在就创建
+    bool checkIndex(QString table, QString index, QString columns);
+
     QSqlDatabase database;
     QMutex mutex;
 };
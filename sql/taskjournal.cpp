@@ -0,0 +1,424 @@
+﻿#include "taskjournal.h"
+#include "util/global.h"
+#include "util/common.h"
+#include <QElapsedTimer>
+
+//组提交的间隔(ms)，这段时间内的追加只做一次fsync
+#define JOURNAL_FLUSH_INTERVAL      10
+//批量写数据库的间隔(ms)
+#define JOURNAL_APPLY_INTERVAL      1000
+//日志文件超过这个大小时，即使还有未入库的记录，也进行压缩
+#define JOURNAL_COMPACT_SIZE        (4*1024*1024)
+//每条记录的字段数(和agv_task表的列一一对应)
+#define JOURNAL_FIELD_COUNT         24
+//增加截止时间之前的记录
+#define JOURNAL_FIELD_COUNT_V1      22
+//增加指定车辆之前的记录
+#define JOURNAL_FIELD_COUNT_V2      23
+
+TaskJournal::TaskJournal(QObject *parent) : QThread(parent),
+    maxTaskId(0),
+    memoryOnly(false),
+    isQuit(false)
+{
+
+}
+
+TaskJournal::~TaskJournal()
+{
+    isQuit = true;
+    cond.wakeAll();
+    wait();
+    file.close();
+}
+
+bool TaskJournal::init(const QString &fileName)
+{
+    journalFileName = fileName;
+
+    //不落盘也不入库，只分配任务ID(仿真器使用)，不需要启动线程
+    if(journalFileName.isEmpty()){
+        memoryOnly = true;
+        return true;
+    }
+
+    QString tmpFileName = journalFileName+".tmp";
+
+    //上次压缩时中途崩溃：临时文件已经完整写好，但是还没改名
+    if(!QFile::exists(journalFileName) && QFile::exists(tmpFileName)){
+        QFile::rename(tmpFileName,journalFileName);
+    }
+    QFile::remove(tmpFileName);
+
+    //回放
+    int badLines = 0;
+    QFile readFile(journalFileName);
+    if(readFile.exists() && readFile.open(QIODevice::ReadOnly)){
+        while(!readFile.atEnd()){
+            QByteArray line = readFile.readLine();
+            Task task;
+            if(!decode(line,&task)){
+                //一般是崩溃时最后一条没写完整
+                ++badLines;
+                continue;
+            }
+            unapplied[task.id] = line;
+            if(task.id>maxTaskId)maxTaskId = task.id;
+        }
+        readFile.close();
+    }
+    if(unapplied.size()>0){
+        g_log->log(AGV_LOG_LEVEL_INFO,QString("task journal replay %1 tasks, %2 bad lines").arg(unapplied.size()).arg(badLines));
+    }
+
+    file.setFileName(journalFileName);
+    if(!file.open(QIODevice::ReadWrite | QIODevice::Append)){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"open task journal fail:"+journalFileName);
+        return false;
+    }
+
+    //有残缺的记录，重写一下文件，否则后面追加的记录会接在残缺的行后面
+    if(badLines>0){
+        checkpoint(true);
+    }
+
+    //任务ID的起点
+    QList<QList<QVariant> > result = g_sql->query("select max(id) from agv_task",QList<QVariant>());
+    if(result.length()>0 && result.at(0).length()>0){
+        int dbMaxId = result.at(0).at(0).toInt();
+        if(dbMaxId>maxTaskId)maxTaskId = dbMaxId;
+    }
+    return true;
+}
+
+int TaskJournal::nextTaskId()
+{
+    idMtx.lock();
+    int id = ++maxTaskId;
+    idMtx.unlock();
+    return id;
+}
+
+int TaskJournal::getMaxTaskId()
+{
+    idMtx.lock();
+    int id = maxTaskId;
+    idMtx.unlock();
+    return id;
+}
+
+void TaskJournal::append(const Task *task)
+{
+    if(task==NULL||task->id<=0||memoryOnly)return ;
+    QByteArray line = encode(task);
+    mtx.lock();
+    pendingBuf.append(line);
+    unapplied[task->id] = line;
+    mtx.unlock();
+}
+
+Task *TaskJournal::queryUnapplied(int taskId)
+{
+    QByteArray line;
+    mtx.lock();
+    if(unapplied.contains(taskId))
+        line = unapplied[taskId];
+    mtx.unlock();
+    if(line.isEmpty())return NULL;
+
+    Task *task = new Task;
+    if(!decode(line,task)){
+        delete task;
+        return NULL;
+    }
+    return task;
+}
+
+QList<Task *> TaskJournal::loadUnfinishedTasks()
+{
+    QMap<int,Task *> tasks;
+    if(memoryOnly)return QList<Task *>();
+
+    //1.数据库中的未完成任务
+    QString querySql = "select id,task_produceTime,task_doTime,task_doneTime,task_excuteCar,task_status,task_circle,task_priority,task_currentDoIndex,task_getGoodStation,task_getGoodDirect,task_getGoodDistance,task_getStartTime,task_getFinishTime,task_putGoodStation,task_putGoodDirect,task_putGoodDistance,task_putStartTime,task_putFinishTime,task_standByStation,task_standByStartTime,task_standByFinishTime,task_deadline,task_agvFixed from agv_task where task_status=? or task_status=?";
+    QList<QVariant> params;
+    params<<Task::AGV_TASK_STATUS_UNEXCUTE<<Task::AGV_TASK_STATUS_EXCUTING;
+    QList<QList<QVariant> > result = g_sql->query(querySql,params);
+    for(int i=0;i<result.length();++i){
+        if(result.at(i).length()!=JOURNAL_FIELD_COUNT)continue;
+        Task *task = new Task;
+        fromSqlRow(result.at(i),task);
+        tasks[task->id] = task;
+    }
+
+    //2.日志中的记录比数据库中的新，覆盖
+    mtx.lock();
+    QMap<int,QByteArray> records = unapplied;
+    mtx.unlock();
+    for(QMap<int,QByteArray>::iterator itr=records.begin();itr!=records.end();++itr){
+        Task *task = new Task;
+        if(!decode(itr.value(),task)){
+            delete task;
+            continue;
+        }
+        if(tasks.contains(task->id))
+            delete tasks[task->id];
+        tasks[task->id] = task;
+    }
+
+    //3.筛选未完成的。正在执行的任务，重启后车辆的状态已经未知，重新置为未执行，等待重新分配
+    //执行车辆保留，这样取了货的车辆会继续把货送到
+    QList<Task *> unfinished;
+    for(QMap<int,Task *>::iterator itr=tasks.begin();itr!=tasks.end();++itr){
+        Task *task = itr.value();
+        if(task->status == Task::AGV_TASK_STATUS_UNEXCUTE || task->status == Task::AGV_TASK_STATUS_EXCUTING){
+            task->status = Task::AGV_TASK_STATUS_UNEXCUTE;
+            unfinished.append(task);
+        }else{
+            delete task;
+        }
+    }
+    return unfinished;
+}
+
+void TaskJournal::run()
+{
+    QElapsedTimer applyTimer;
+    applyTimer.start();
+    while(!isQuit)
+    {
+        //1.组提交：把这段时间内的追加一次写盘
+        mtx.lock();
+        if(pendingBuf.isEmpty())
+            cond.wait(&mtx,JOURNAL_FLUSH_INTERVAL);
+        QByteArray data = pendingBuf;
+        pendingBuf.clear();
+        mtx.unlock();
+
+        if(data.length()>0)
+            flushToFile(data);
+
+        //2.批量写数据库
+        if(applyTimer.elapsed() < JOURNAL_APPLY_INTERVAL && !isQuit)continue;
+        applyTimer.restart();
+
+        mtx.lock();
+        QMap<int,QByteArray> records = unapplied;
+        mtx.unlock();
+
+        if(records.size()>0){
+            if(!applyToDb(records)){
+                g_log->log(AGV_LOG_LEVEL_ERROR,QString("task journal apply %1 tasks to database fail,will retry").arg(records.size()));
+                continue;
+            }
+            //已经入库的记录去掉(期间又有变化的保留)
+            mtx.lock();
+            for(QMap<int,QByteArray>::iterator itr=records.begin();itr!=records.end();++itr){
+                if(unapplied.contains(itr.key()) && unapplied[itr.key()] == itr.value())
+                    unapplied.remove(itr.key());
+            }
+            mtx.unlock();
+        }
+
+        //3.压缩日志文件
+        checkpoint();
+    }
+}
+
+QByteArray TaskJournal::encode(const Task *task)
+{
+    QList<QVariant> params = toSqlParams(task);
+    QByteArray line;
+    for(int i=0;i<params.length();++i){
+        if(i>0)line.append(',');
+        const QVariant &v = params.at(i);
+        if(v.type() == QVariant::DateTime){
+            //无效时间留空
+            if(v.toDateTime().isValid())
+                line.append(QByteArray::number(v.toDateTime().toMSecsSinceEpoch()));
+        }else{
+            line.append(QByteArray::number(v.toInt()));
+        }
+    }
+    line.append('#');
+    line.append(QByteArray::number(qChecksum(line.constData(),line.length()-1),16));
+    line.append('\n');
+    return line;
+}
+
+bool TaskJournal::decode(const QByteArray &line, Task *task)
+{
+    QByteArray l = line.trimmed();
+    int pos = l.lastIndexOf('#');
+    if(pos<=0)return false;
+
+    //校验
+    bool ok = false;
+    quint16 sum = l.mid(pos+1).toUShort(&ok,16);
+    if(!ok || sum != qChecksum(l.constData(),pos))return false;
+
+    QList<QByteArray> fields = l.left(pos).split(',');
+    if(fields.length()!=JOURNAL_FIELD_COUNT && fields.length()!=JOURNAL_FIELD_COUNT_V1 && fields.length()!=JOURNAL_FIELD_COUNT_V2)return false;
+
+    QList<QDateTime> times;
+    for(int i=0;i<fields.length();++i){
+        if(fields.at(i).isEmpty())
+            times.append(QDateTime());
+        else
+            times.append(QDateTime::fromMSecsSinceEpoch(fields.at(i).toLongLong()));
+    }
+
+    task->id = fields.at(0).toInt();
+    task->produceTime = times.at(1);
+    task->doTime = times.at(2);
+    task->doneTime = times.at(3);
+    task->excuteCar = fields.at(4).toInt();
+    task->status = fields.at(5).toInt();
+    task->circle = fields.at(6).toInt()!=0;
+    task->priority = fields.at(7).toInt();
+    task->currentDoIndex = fields.at(8).toInt();
+    task->getGoodStation = fields.at(9).toInt();
+    task->getGoodDirect = fields.at(10).toInt();
+    task->getGoodDistance = fields.at(11).toInt();
+    task->getStartTime = times.at(12);
+    task->getFinishTime = times.at(13);
+    task->putGoodStation = fields.at(14).toInt();
+    task->putGoodDirect = fields.at(15).toInt();
+    task->putGoodDistance = fields.at(16).toInt();
+    task->putStartTime = times.at(17);
+    task->putFinishTime = times.at(18);
+    task->standByStation = fields.at(19).toInt();
+    task->standByStartTime = times.at(20);
+    task->standByFinishTime = times.at(21);
+    if(fields.length()>22)
+        task->deadline = times.at(22);
+    if(fields.length()>23)
+        task->agvFixed = fields.at(23).toInt()!=0;
+    return task->id>0;
+}
+
+//顺序和agv_task表的列一致
+QList<QVariant> TaskJournal::toSqlParams(const Task *task)
+{
+    QList<QVariant> params;
+    params<<task->id
+         <<task->produceTime
+        <<task->doTime
+       <<task->doneTime
+      <<task->excuteCar
+     <<task->status
+    <<task->circle
+    <<task->priority
+    <<task->currentDoIndex
+    <<task->getGoodStation
+    <<task->getGoodDirect
+    <<task->getGoodDistance
+    <<task->getStartTime
+    <<task->getFinishTime
+    <<task->putGoodStation
+    <<task->putGoodDirect
+    <<task->putGoodDistance
+    <<task->putStartTime
+    <<task->putFinishTime
+    <<task->standByStation
+    <<task->standByStartTime
+    <<task->standByFinishTime
+    <<task->deadline
+    <<task->agvFixed;
+    return params;
+}
+
+void TaskJournal::fromSqlRow(const QList<QVariant> &row, Task *task)
+{
+    task->id = row.at(0).toInt();
+    task->produceTime = row.at(1).toDateTime();
+    task->doTime = row.at(2).toDateTime();
+    task->doneTime = row.at(3).toDateTime();
+    task->excuteCar = row.at(4).toInt();
+    task->status = row.at(5).toInt();
+    task->circle = row.at(6).toBool();
+    task->priority = row.at(7).toInt();
+    task->currentDoIndex = row.at(8).toInt();
+    task->getGoodStation = row.at(9).toInt();
+    task->getGoodDirect = row.at(10).toInt();
+    task->getGoodDistance = row.at(11).toInt();
+    task->getStartTime = row.at(12).toDateTime();
+    task->getFinishTime = row.at(13).toDateTime();
+    task->putGoodStation = row.at(14).toInt();
+    task->putGoodDirect = row.at(15).toInt();
+    task->putGoodDistance = row.at(16).toInt();
+    task->putStartTime = row.at(17).toDateTime();
+    task->putFinishTime = row.at(18).toDateTime();
+    task->standByStation = row.at(19).toInt();
+    task->standByStartTime = row.at(20).toDateTime();
+    task->standByFinishTime = row.at(21).toDateTime();
+    task->deadline = row.at(22).toDateTime();
+    task->agvFixed = row.at(23).toBool();
+}
+
+bool TaskJournal::flushToFile(const QByteArray &data)
+{
+    if(file.write(data)!=data.length()){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"write task journal fail:"+file.errorString());
+        return false;
+    }
+    if(!file.flush() || !FileSync(file.handle())){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"sync task journal fail");
+        return false;
+    }
+    return true;
+}
+
+bool TaskJournal::applyToDb(const QMap<int, QByteArray> &records)
+{
+    QString replaceSql = "REPLACE INTO agv_task (id,task_produceTime,task_doTime,task_doneTime,task_excuteCar,task_status,task_circle,task_priority,task_currentDoIndex,task_getGoodStation,task_getGoodDirect,task_getGoodDistance,task_getStartTime,task_getFinishTime,task_putGoodStation,task_putGoodDirect,task_putGoodDistance,task_putStartTime,task_putFinishTime,task_standByStation,task_standByStartTime,task_standByFinishTime,task_deadline,task_agvFixed) VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);";
+    QList<QList<QVariant> > argsList;
+    for(QMap<int,QByteArray>::const_iterator itr=records.begin();itr!=records.end();++itr){
+        Task task;
+        if(!decode(itr.value(),&task))continue;
+        argsList.append(toSqlParams(&task));
+    }
+    if(argsList.length()<=0)return true;
+    return g_sql->exeSqlBatch(replaceSql,argsList);
+}
+
+void TaskJournal::checkpoint(bool force)
+{
+    mtx.lock();
+    bool allApplied = unapplied.isEmpty();
+    QByteArray remain;
+    if(!allApplied){
+        for(QMap<int,QByteArray>::iterator itr=unapplied.begin();itr!=unapplied.end();++itr){
+            remain.append(itr.value());
+        }
+    }
+    mtx.unlock();
+
+    if(allApplied){
+        //所有记录都已经入库了，直接截断。期间新追加的记录还在pendingBuf中，不受影响
+        if(file.size()>0)
+            file.resize(0);
+        return ;
+    }
+
+    if(!force && file.size()<JOURNAL_COMPACT_SIZE)return ;
+
+    //还有未入库的记录，只保留这些记录:先写临时文件，再替换
+    QString tmpFileName = journalFileName+".tmp";
+    QFile tmpFile(tmpFileName);
+    if(!tmpFile.open(QIODevice::WriteOnly | QIODevice::Truncate))return ;
+    if(tmpFile.write(remain)!=remain.length() || !tmpFile.flush() || !FileSync(tmpFile.handle())){
+        tmpFile.close();
+        QFile::remove(tmpFileName);
+        return ;
+    }
+    tmpFile.close();
+
+    file.close();
+    QFile::remove(journalFileName);
+    QFile::rename(tmpFileName,journalFileName);
+    file.setFileName(journalFileName);
+    if(!file.open(QIODevice::ReadWrite | QIODevice::Append)){
+        g_log->log(AGV_LOG_LEVEL_ERROR,"reopen task journal fail:"+journalFileName);
+    }
+}
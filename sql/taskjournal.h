@@ -0,0 +1,80 @@
+﻿#ifndef TASKJOURNAL_H
+#define TASKJOURNAL_H
+
+#include <QObject>
+#include <QThread>
+#include <QMap>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <QByteArray>
+#include "bean/task.h"
+
+//任务状态的预写日志
+//任务的每一次状态变化，只是追加一行记录到日志文件(内存中完成，微秒级)
+//后台线程每隔一小段时间把积累的记录一次性写盘+fsync(组提交)
+//再每隔一段时间，把这段时间内变化过的任务批量写入agv_task表
+//写入数据库成功后，对应的日志记录就可以丢弃了
+//启动时回放日志文件，把尚未写入数据库的记录补上，保证崩溃后任务不丢
+class TaskJournal : public QThread
+{
+    Q_OBJECT
+public:
+    explicit TaskJournal(QObject *parent = nullptr);
+
+    ~TaskJournal();
+
+    //打开日志文件，回放上次遗留的记录，并确定任务ID的起点
+    //fileName为空时为纯内存模式:不写文件也不写数据库
+    bool init(const QString &fileName = "agv_task.journal");
+
+    //分配一个新的任务ID(不再依赖数据库的自增)
+    int nextTaskId();
+
+    //已经分配过的最大任务ID，比它大的任务一定不存在
+    int getMaxTaskId();
+
+    //记录一个任务的当前状态(整行快照，同一个任务以最后一条为准)
+    void append(const Task *task);
+
+    //查找尚未写入数据库的任务记录，找不到返回NULL
+    Task *queryUnapplied(int taskId);
+
+    //载入所有未完成的任务(未执行和正在执行的)，用于启动时恢复任务队列
+    QList<Task *> loadUnfinishedTasks();
+
+    void run() override;
+signals:
+
+public slots:
+
+private:
+    QByteArray encode(const Task *task);
+    bool decode(const QByteArray &line, Task *task);
+    QList<QVariant> toSqlParams(const Task *task);
+    void fromSqlRow(const QList<QVariant> &row, Task *task);
+
+    //把记录写盘，并fsync
+    bool flushToFile(const QByteArray &data);
+    //把变化过的任务批量写入数据库
+    bool applyToDb(const QMap<int, QByteArray> &records);
+    //日志中的记录都已经入库后，截断日志文件;或者文件过大时(force时立即)只保留未入库的记录
+    void checkpoint(bool force = false);
+
+    QFile file;
+    QString journalFileName;
+
+    QMutex mtx;
+    QWaitCondition cond;
+    QByteArray pendingBuf;              //尚未写盘的记录
+    QMap<int, QByteArray> unapplied;    //尚未写入数据库的记录(每个任务只保留最后一条)
+
+    int maxTaskId;
+    QMutex idMtx;
+
+    bool memoryOnly;
+
+    volatile bool isQuit;
+};
+
+#endif // TASKJOURNAL_H
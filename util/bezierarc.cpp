@@ -1,83 +1,119 @@
 ﻿#include "bezierarc.h"
 
-#define sqr(x) (x * x)
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <cmath>
+#include <algorithm>
 
-#define _ABS(x) (x < 0 ? -x : x)
-
-const double TOLERANCE = 0.0000001;  // Application specific tolerance
-
-extern double sqrt(double);
-
-double q1, q2, q3, q4, q5;
-
-struct point2d {
-        double x, y;
-};
+//每段用5点高斯-勒让德积分，节点和权重(区间[-1,1])
+static const double GAUSS_X[5] = {-0.9061798459386640,-0.5384693101056831,0.0,0.5384693101056831,0.9061798459386640};
+static const double GAUSS_W[5] = {0.2369268850561891,0.4786286704993665,0.5688888888888889,0.4786286704993665,0.2369268850561891};
 
 BezierArc::BezierArc()
 {
+}
 
+BezierArc::BezierArc(QPointF p0, QPointF p1, QPointF p2, QPointF p3, int segments)
+{
+    p[0] = p0;
+    p[1] = p1;
+    p[2] = p2;
+    p[3] = p3;
+    if(segments<1)segments = 1;
+
+    SpeedPoly q = speedPoly(p0,p1,p2,p3);
+    lengths.resize(segments+1);
+    lengths[0] = 0;
+    double h = 1.0/segments;
+    for(int i=0;i<segments;++i){
+        double mid = (i+0.5)*h;
+        double sum = 0;
+        for(int j=0;j<5;++j)
+            sum += GAUSS_W[j]*speed(q,mid+0.5*h*GAUSS_X[j]);
+        lengths[i+1] = lengths[i]+0.5*h*sum;
+    }
 }
-double BezierArc::BezierArcLength(QPointF p1, QPointF p2, QPointF p3, QPointF p4)
+
+double BezierArc::paramAt(double s) const
+{
+    int segments = lengths.size()-1;
+    if(segments<1 || s<=0)return 0;
+    if(s>=lengths.last())return 1;
+    //第一个大于s的位置，s落在[i-1,i]这一段
+    int i = (int)(std::upper_bound(lengths.constBegin(),lengths.constEnd(),s)-lengths.constBegin());
+    double s0 = lengths[i-1];
+    double s1 = lengths[i];
+    double f = s1>s0?(s-s0)/(s1-s0):0;
+    return (i-1+f)/segments;
+}
+
+QPointF BezierArc::pointAt(double t) const
 {
-    QPointF k1, k2, k3, k4;
+    double u = 1-t;
+    return p[0]*(u*u*u)+p[1]*(3*t*u*u)+p[2]*(3*t*t*u)+p[3]*(t*t*t);
+}
 
-    k1 = -p1 + 3*(p2 - p3) + p4;
-    k2 = 3*(p1 + p3) - 6*p2;
-    k3 = 3*(p2 - p1);
-    k4 = p1;
+double BezierArc::angleAt(double t) const
+{
+    double u = 1-t;
+    QPointF d = (p[1]-p[0])*(3*u*u)+(p[2]-p[1])*(6*u*t)+(p[3]-p[2])*(3*t*t);
+    return atan2(d.y(),d.x())*180/M_PI;
+}
 
-    q1 = 9.0*(sqr(k1.x()) + sqr(k1.y()));
-    q2 = 12.0*(k1.x()*k2.x() + k1.y()*k2.y());
-    q3 = 3.0*(k1.x()*k3.x() + k1.y()*k3.y()) + 4.0*(sqr(k2.x()) + sqr(k2.y()));
-    q4 = 4.0*(k2.x()*k3.x() + k2.y()*k3.y());
-    q5 = sqr(k3.x()) + sqr(k3.y());
+//B'(t) = 3*k1*t^2 + 2*k2*t + k3
+BezierArc::SpeedPoly BezierArc::speedPoly(QPointF p1, QPointF p2, QPointF p3, QPointF p4)
+{
+    QPointF k1 = -p1 + 3*(p2 - p3) + p4;
+    QPointF k2 = 3*(p1 + p3) - 6*p2;
+    QPointF k3 = 3*(p2 - p1);
+
+    SpeedPoly q;
+    q.q1 = 9.0*(k1.x()*k1.x() + k1.y()*k1.y());
+    q.q2 = 12.0*(k1.x()*k2.x() + k1.y()*k2.y());
+    q.q3 = 6.0*(k1.x()*k3.x() + k1.y()*k3.y()) + 4.0*(k2.x()*k2.x() + k2.y()*k2.y());
+    q.q4 = 4.0*(k2.x()*k3.x() + k2.y()*k3.y());
+    q.q5 = k3.x()*k3.x() + k3.y()*k3.y();
+    return q;
+}
 
-    double result = Simpson(balf, 0, 1, 1024, 0.001);
-    return result;
+//没有分支，循环中调用可以向量化
+double BezierArc::speed(const SpeedPoly &q, double t)
+{
+    return std::sqrt(std::fabs(q.q5 + t*(q.q4 + t*(q.q3 + t*(q.q2 + t*q.q1)))));
 }
-//---------------------------------------------------------------------------
-double BezierArc::balf(double t)                   // Bezier Arc Length Function
+
+double BezierArc::BezierArcLength(QPointF p1, QPointF p2, QPointF p3, QPointF p4)
 {
-    double result = q5 + t*(q4 + t*(q3 + t*(q2 + t*q1)));
-    if(result<0)result*=-1;
-    result = sqrt(result);
-    return result;
+    return Simpson(speedPoly(p1,p2,p3,p4), 0, 1, 1024, 0.001);
 }
 
 //---------------------------------------------------------------------------
 // NOTES:       TOLERANCE is a maximum error ratio
 //                      if n_limit isn't a power of 2 it will be act like the next higher
 //                      power of two.
-double BezierArc::Simpson (
-        double (*f)(double),
-        double a,
-        double b,
-        int n_limit,
-        double TOLERANCE)
+double BezierArc::Simpson(const SpeedPoly &q, double a, double b, int n_limit, double TOLERANCE)
 {
     int n = 1;
     double multiplier = (b - a)/6.0;
-    double endsum = f(a) + f(b);
+    double endsum = speed(q,a) + speed(q,b);
     double interval = (b - a)/2.0;
     double asum = 0;
-    double bsum = f(a + interval);
+    double bsum = speed(q,a + interval);
     double est1 = multiplier * (endsum + 2 * asum + 4 * bsum);
     double est0 = 2 * est1;
 
     while(n < n_limit
-          && (_ABS(est1) > 0 && _ABS((est1 - est0) / est1) > TOLERANCE)) {
+          && (std::fabs(est1) > 0 && std::fabs((est1 - est0) / est1) > TOLERANCE)) {
         n *= 2;
         multiplier /= 2;
         interval /= 2;
         asum += bsum;
         bsum = 0;
         est0 = est1;
-        double interval_div_2n = interval / (2.0 * n);
-
+        //新加的点是间隔为interval的奇数点(原来用interval/(2n)，点取错了)
         for (int i = 1; i < 2 * n; i += 2) {
-            double t = a + i * interval_div_2n;
-            bsum += f(t);
+            double t = a + i * interval;
+            bsum += speed(q,t);
         }
 
         est1 = multiplier*(endsum + 2*asum + 4*bsum);
@@ -2,21 +2,50 @@
 #define BEZIERARC_H
 
 #include <QPoint>
+#include <QVector>
 
+//三次贝塞尔曲线 P0(起点) P1 P2 P3(终点)
+//载入地图时建立弧长->参数t的查找表，车辆上报里程时二分查找、线性插值得到t，不再每次积分
 class BezierArc
 {
 public:
+    enum{
+        DEFAULT_SEGMENTS = 64,//查找表把t均分成多少段
+    };
+
     BezierArc();
+    BezierArc(QPointF p0, QPointF p1, QPointF p2, QPointF p3, int segments = DEFAULT_SEGMENTS);
+
+    double length() const {return lengths.isEmpty()?0:lengths.last();}
+
+    //从起点沿曲线走过的长度 -> 参数t [0,1]
+    double paramAt(double s) const;
+
+    //t处的坐标
+    QPointF pointAt(double t) const;
 
+    //t处的切线方向(度)
+    double angleAt(double t) const;
+
+    //曲线长度(自适应辛普森积分，可重入)
     static double BezierArcLength(QPointF p1, QPointF p2, QPointF p3, QPointF p4);
+
 private:
-    static double Simpson (
-            double (*f)(double),
-            double a,
-            double b,
-            int n_limit,
-            double TOLERANCE);
-    static double balf(double t);
+    //|B'(t)|^2 = q1*t^4 + q2*t^3 + q3*t^2 + q4*t + q5
+    struct SpeedPoly{
+        double q1 = 0;
+        double q2 = 0;
+        double q3 = 0;
+        double q4 = 0;
+        double q5 = 0;
+    };
+
+    static SpeedPoly speedPoly(QPointF p1, QPointF p2, QPointF p3, QPointF p4);
+    static double speed(const SpeedPoly &q, double t);
+    static double Simpson(const SpeedPoly &q, double a, double b, int n_limit, double TOLERANCE);
+
+    QPointF p[4];
+    QVector<double> lengths;//lengths[i]是t从0到i/segments的弧长
 };
 
 #endif // BEZIERARC_H
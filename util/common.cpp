@@ -2,6 +2,10 @@
 
 #ifdef WIN32
 #include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <time.h>
 #endif
 
 void TimeSleep(int sleepMS)
@@ -43,14 +47,12 @@ int GetTimeSecond()
     return tickNow;
 }
 
+//最后取低8位和每次取低8位结果一样，循环里没有依赖，可以向量化
 unsigned char checkSum(unsigned char *data,int len)
 {
-    int sum = 0;
-    for(int i=0;i<len;++i){
-        //int v = data[i] &0xFF;
-        sum += data[i] & 0xFF;
-        sum &= 0xFF;
-    }
+    unsigned int sum = 0;
+    for(int i=0;i<len;++i)
+        sum += data[i];
     return sum & 0xFF;
 }
 
@@ -74,3 +76,13 @@ uint8_t getInt8FromByte(char *data)
 {
     return (uint8_t)(data[0]);
 }
+
+bool FileSync(int fd)
+{
+    if(fd<0)return false;
+#ifdef WIN32
+    return _commit(fd) == 0;
+#else
+    return fsync(fd) == 0;
+#endif
+}
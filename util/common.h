@@ -18,4 +18,7 @@ uint16_t getInt16FromByte(char *data);
 
 uint8_t getInt8FromByte(char *data);
 
+//把文件已写入的内容刷到磁盘(fsync)
+bool FileSync(int fd);
+
 #endif // COMMON_H
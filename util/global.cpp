@@ -9,13 +9,20 @@ Sql *g_sql = NULL;//数据库执行
 AgvLog *g_log = NULL;//日志调用
 AgvLogProcess *g_logProcess = NULL;//日志存库、publish
 QyhZmqServer *g_server;//
+TaskJournal *g_taskJournal = NULL;//任务状态日志(写前日志，后台批量入库)
+AgvIoEngine *g_agvIoEngine = NULL;//车辆连接的IO引擎
+TimingWheel *g_timingWheel = NULL;//重传、发布、日志刷新等共用的定时器线程
 
 //所有的业务处理
 MapCenter *g_agvMapCenter;//地图管理(地图载入，地图保存，地图计算)
 TaskCenter *g_taskCenter;//任务管理(任务分配，任务保存，任务调度)
 AgvCenter *g_hrgAgvCenter;//车辆管理(车辆载入。车辆保存。车辆增加。车辆删除)
+FleetState *g_fleetState = NULL;//车队状态，主线程写入，发布、查询无锁读取
+MotionEstimator *g_motionEstimator = NULL;//按里程推算车辆位置，主线程更新，位置发布读取
 UserMsgProcessor *userMsgProcessor = NULL;
 TaskMaker *g_taskMaker;
+AgvRebalancer *g_agvRebalancer = NULL;//空闲车辆按预计需求预先调配
+ChargeScheduler *g_chargeScheduler = NULL;//电量估算和充电调度
 
 //所有的bean集合
 QMap<int,Agv *> g_m_agvs;//车辆
@@ -36,6 +43,20 @@ void QyhSleep(int msec)
         QCoreApplication::processEvents(QEventLoop::AllEvents, 1);
 }
 
+static std::function<qint64 ()> virtualClock = nullptr;
+
+QDateTime getCurrentDateTime()
+{
+    if(virtualClock)
+        return QDateTime::fromMSecsSinceEpoch(virtualClock());
+    return QDateTime::currentDateTime();
+}
+
+void setVirtualClock(std::function<qint64 ()> clock)
+{
+    virtualClock = clock;
+}
+
 int getRandom(int maxRandom)
 {
     QTime t;
@@ -141,13 +162,6 @@ std::string intToStdString(int x)
     return result;
 }
 
-bool agvTaskLessThan( const Task *a, const Task *b )
-{
-    Task aa = *a;
-    Task bb = *b;
-    return aa < bb;
-}
-
 unsigned char crc(unsigned char *data,int len)
 {
     int sum=0;
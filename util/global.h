@@ -7,13 +7,18 @@
 #include <QMutex>
 #include <QDebug>
 #include <QVariant>
+#include <QDateTime>
+#include <functional>
 
 #include "sql/sql.h"
+#include "sql/taskjournal.h"
 #include "log/agvlog.h"
 #include "log/agvlogprocess.h"
 #include "concurrentqueue.h"
+#include "timingwheel.h"
 #include "sql/sqlserver.h"
 #include "network/qyhzmqserver.h"
+#include "network/agvioengine.h"
 
 #include "bean/agv.h"
 #include "bean/agvline.h"
@@ -23,11 +28,15 @@
 #include "business/agvcenter.h"
 #include "business/mapcenter.h"
 #include "business/taskcenter.h"
+#include "business/fleetstate.h"
 #include "business/usermsgprocessor.h"
 
 #include "util/concurrentqueue.h"
+#include "util/motionestimator.h"
 
 #include "service/taskmaker.h"
+#include "service/agvrebalancer.h"
+#include "service/chargescheduler.h"
 
 //定义几个端口
 //消息相应端口
@@ -72,13 +81,20 @@ extern Sql *g_sql;
 extern AgvLog *g_log;
 extern AgvLogProcess *g_logProcess;
 extern QyhZmqServer *g_server;
+extern TaskJournal *g_taskJournal;
+extern AgvIoEngine *g_agvIoEngine;//车辆连接的IO引擎
+extern TimingWheel *g_timingWheel;//共享的定时器
 
 //全局业务处理类实例
 extern MapCenter *g_agvMapCenter;//地图路径中心
 extern TaskCenter *g_taskCenter;//任务中心
 extern AgvCenter *g_hrgAgvCenter;//车辆管理中心
+extern FleetState *g_fleetState;//车队状态(任意线程无锁读取)
+extern MotionEstimator *g_motionEstimator;//车辆位置推算(发布高频位置)
 extern UserMsgProcessor *userMsgProcessor;
 extern TaskMaker *g_taskMaker;
+extern AgvRebalancer *g_agvRebalancer;//空闲车辆预先调配
+extern ChargeScheduler *g_chargeScheduler;//充电调度
 
 //所有的bean集合
 extern QMap<int,Agv *> g_m_agvs;//车辆
@@ -90,6 +106,12 @@ extern QMap<int,int> g_reverseLines;//线路和它的反方向线路的集合。
 
 void QyhSleep(int msec);
 
+//统一的当前时间(任务相关的时间戳都用它)。仿真时返回虚拟时钟的时间
+QDateTime getCurrentDateTime();
+
+//设置虚拟时钟，返回当前的毫秒时间戳(仿真器使用)。传入nullptr恢复使用真实时间
+void setVirtualClock(std::function<qint64 ()> clock);
+
 int getRandom(int maxRandom);
 
 std::string intToStdString(int x);
@@ -109,8 +131,6 @@ extern const QString DATE_TIME_FORMAT;
 extern moodycamel::ConcurrentQueue<OneLog> g_log_queue;
 
 
-bool agvTaskLessThan( const Task *a, const Task *b );
-
 unsigned char crc(unsigned char *data,int len);
 
 #endif // GLOBAL_H
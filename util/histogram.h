@@ -0,0 +1,182 @@
+﻿#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//无锁的对数-线性直方图(HDR风格)
+//每个2的幂次区间再等分成16个子桶，相对误差约6%
+//记录只是几个原子加，可以在任意线程中调用
+class AtomicHistogram
+{
+public:
+    enum{
+        SUB_BUCKET_BITS = 4,
+        SUB_BUCKET_COUNT = 1<<SUB_BUCKET_BITS,
+        MAX_HIGHEST_BIT = 36,//能精确分桶的最大值约2^37，更大的值都记入最后一个桶
+        BUCKET_COUNT = (MAX_HIGHEST_BIT-SUB_BUCKET_BITS+2)*SUB_BUCKET_COUNT,
+    };
+
+    //某一时刻的统计结果(拷贝出来后再计算分位数)
+    struct Snapshot{
+        uint64_t count = 0;
+        int64_t sum = 0;
+        int64_t min = 0;
+        int64_t max = 0;
+        std::vector<uint64_t> buckets;
+
+        double mean() const {
+            return count>0?(double)sum/count:0;
+        }
+
+        //分位数,p取0~100
+        int64_t percentile(double p) const {
+            if(count==0)return 0;
+            uint64_t target = (uint64_t)(count*p/100.0+0.5);
+            if(target<1)target = 1;
+            if(target>count)target = count;
+            uint64_t seen = 0;
+            for(int i=0;i<(int)buckets.size();++i){
+                seen += buckets[i];
+                if(seen>=target){
+                    int64_t v = bucketUpper(i);
+                    return v>max?max:v;
+                }
+            }
+            return max;
+        }
+    };
+
+    AtomicHistogram(){
+        reset();
+    }
+
+    void record(int64_t value){
+        if(value<0)value = 0;
+        buckets[bucketIndex(value)].fetch_add(1,std::memory_order_relaxed);
+        totalCount.fetch_add(1,std::memory_order_relaxed);
+        totalSum.fetch_add(value,std::memory_order_relaxed);
+
+        int64_t m = maxValue.load(std::memory_order_relaxed);
+        while(value>m && !maxValue.compare_exchange_weak(m,value,std::memory_order_relaxed));
+        m = minValue.load(std::memory_order_relaxed);
+        while(value<m && !minValue.compare_exchange_weak(m,value,std::memory_order_relaxed));
+    }
+
+    uint64_t count() const {
+        return totalCount.load(std::memory_order_relaxed);
+    }
+
+    //统计过程中仍然可以记录，结果不是严格的同一时刻，但每个桶都是完整的
+    Snapshot snapshot() const {
+        Snapshot s;
+        s.buckets.resize(BUCKET_COUNT);
+        for(int i=0;i<BUCKET_COUNT;++i){
+            s.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+            s.count += s.buckets[i];
+        }
+        s.sum = totalSum.load(std::memory_order_relaxed);
+        s.max = maxValue.load(std::memory_order_relaxed);
+        s.min = s.count>0?minValue.load(std::memory_order_relaxed):0;
+        return s;
+    }
+
+    void reset(){
+        for(int i=0;i<BUCKET_COUNT;++i)
+            buckets[i].store(0,std::memory_order_relaxed);
+        totalCount.store(0,std::memory_order_relaxed);
+        totalSum.store(0,std::memory_order_relaxed);
+        maxValue.store(0,std::memory_order_relaxed);
+        minValue.store(INT64_MAX,std::memory_order_relaxed);
+    }
+
+    static int bucketIndex(int64_t value){
+        uint64_t v = (uint64_t)value;
+        if(v<2*SUB_BUCKET_COUNT)return (int)v;
+        int highestBit = highestBitOf(v);
+        if(highestBit>MAX_HIGHEST_BIT)return BUCKET_COUNT-1;
+        int shift = highestBit-SUB_BUCKET_BITS;
+        return (shift+1)*SUB_BUCKET_COUNT + (int)(v>>shift) - SUB_BUCKET_COUNT;
+    }
+
+    //桶所代表的最大值
+    static int64_t bucketUpper(int index){
+        if(index<2*SUB_BUCKET_COUNT)return index;
+        int shift = index/SUB_BUCKET_COUNT-1;
+        int64_t sub = index%SUB_BUCKET_COUNT+SUB_BUCKET_COUNT;
+        return ((sub+1)<<shift)-1;
+    }
+
+private:
+    static int highestBitOf(uint64_t v){
+#if defined(_MSC_VER) && defined(_WIN64)
+        unsigned long index;
+        _BitScanReverse64(&index,v);
+        return (int)index;
+#elif defined(__GNUC__)
+        return 63-__builtin_clzll(v);
+#else
+        int n = 0;
+        while(v>>=1)++n;
+        return n;
+#endif
+    }
+
+    std::atomic<uint64_t> buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> totalCount;
+    std::atomic<int64_t> totalSum;
+    std::atomic<int64_t> maxValue;
+    std::atomic<int64_t> minValue;
+};
+
+//滚动计数器:最近60个时间片(默认每片1分钟，合计1小时)内的计数
+//时间片编号和计数打包在一个64位原子量里，跨片时的清零和累加是一次CAS，不会丢计数
+class RollingCounter
+{
+public:
+    enum{
+        SLOT_COUNT = 60,
+    };
+
+    explicit RollingCounter(int64_t _slotMs = 60*1000):slotMs(_slotMs){
+        for(int i=0;i<SLOT_COUNT;++i)
+            slotValues[i].store(0,std::memory_order_relaxed);
+    }
+
+    void add(int64_t nowMs, uint32_t n = 1){
+        uint64_t stamp = (uint64_t)(nowMs/slotMs) & 0xFFFFFFFF;
+        std::atomic<uint64_t> &slot = slotValues[stamp%SLOT_COUNT];
+        uint64_t old = slot.load(std::memory_order_relaxed);
+        uint64_t now;
+        do{
+            if((old>>32) == stamp)
+                now = old + n;
+            else
+                now = (stamp<<32) | n;
+        }while(!slot.compare_exchange_weak(old,now,std::memory_order_relaxed));
+    }
+
+    //最近SLOT_COUNT个时间片内的合计
+    uint64_t sum(int64_t nowMs) const {
+        uint64_t stamp = (uint64_t)(nowMs/slotMs) & 0xFFFFFFFF;
+        uint64_t total = 0;
+        for(int i=0;i<SLOT_COUNT;++i){
+            uint64_t v = slotValues[i].load(std::memory_order_relaxed);
+            uint64_t s = v>>32;
+            if(s<=stamp && stamp-s<SLOT_COUNT)
+                total += v & 0xFFFFFFFF;
+        }
+        return total;
+    }
+
+private:
+    int64_t slotMs;
+    std::atomic<uint64_t> slotValues[SLOT_COUNT];
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,135 @@
+﻿#include "motionestimator.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+
+//新的速度样本的权重(里程的上报间隔有抖动，平滑一下)
+#define MOTION_SPEED_SMOOTHING  0.5
+
+qint64 MotionEstimator::nowMsecs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int MotionEstimator::lowerBound(int agvId)
+{
+    int low = 0;
+    int high = tracks.length();
+    while(low<high){
+        int mid = (low+high)/2;
+        if(tracks.at(mid).agvId<agvId)low = mid+1;
+        else high = mid;
+    }
+    return low;
+}
+
+void MotionEstimator::update(int agvId, const Line &line, double distance, qint64 msecs)
+{
+    QMutexLocker locker(&mtx);
+    int index = lowerBound(agvId);
+    if(index==tracks.length() || tracks.at(index).agvId!=agvId){
+        Track track;
+        track.agvId = agvId;
+        tracks.insert(index,track);
+    }
+    Track &track = tracks[index];
+
+    //很久没有上报(停过车)，原来的速度不能用了
+    if(msecs-track.msecs>MAX_EXTRAPOLATE_MSECS)
+        track.speed = 0;
+
+    if(!track.active || track.line.id!=line.id){
+        //新的线路:从上报的位置开始，速度沿用
+        track.line = line;
+        if(line.straight)
+            track.length = std::sqrt((line.p3x-line.p0x)*(line.p3x-line.p0x)+(line.p3y-line.p0y)*(line.p3y-line.p0y));
+        else
+            track.length = line.arc.length();
+        track.offset = 0;
+    }else{
+        //同一条线路:用里程的变化更新速度，记下推算的偏差
+        qint64 elapsed = msecs-track.msecs;
+        if(elapsed>0){
+            double sample = qMax(0.0,(distance-track.distance)/elapsed);
+            track.speed += MOTION_SPEED_SMOOTHING*(sample-track.speed);
+        }
+        track.offset = distanceAt(track,msecs)-distance;
+    }
+    track.active = true;
+    track.distance = distance;
+    track.msecs = msecs;
+}
+
+void MotionEstimator::stop(int agvId)
+{
+    QMutexLocker locker(&mtx);
+    int index = lowerBound(agvId);
+    if(index<tracks.length() && tracks.at(index).agvId==agvId)
+        tracks[index].active = false;
+}
+
+void MotionEstimator::remove(int agvId)
+{
+    QMutexLocker locker(&mtx);
+    int index = lowerBound(agvId);
+    if(index<tracks.length() && tracks.at(index).agvId==agvId)
+        tracks.removeAt(index);
+}
+
+void MotionEstimator::clear()
+{
+    QMutexLocker locker(&mtx);
+    tracks.clear();
+}
+
+//上报的距离+速度*时间，再加上逐渐消除的偏差，限制在线路上
+double MotionEstimator::distanceAt(const Track &track, qint64 msecs)
+{
+    qint64 elapsed = qBound((qint64)0,msecs-track.msecs,(qint64)MAX_EXTRAPOLATE_MSECS);
+    double s = track.distance+track.speed*elapsed;
+    if(elapsed<CORRECTION_MSECS)
+        s += track.offset*(1-(double)elapsed/CORRECTION_MSECS);
+    return qBound(0.0,s,track.length);
+}
+
+void MotionEstimator::predict(qint64 msecs, std::vector<Pose> &poses)
+{
+    poses.clear();
+    //只增加引用计数。之后主线程更新时复制一份，这份快照不变
+    QVector<Track> snapshot;
+    {
+        QMutexLocker locker(&mtx);
+        snapshot = tracks;
+    }
+    batch.clear();
+    for(int i=0;i<snapshot.length();++i){
+        const Track &track = snapshot.at(i);
+        if(!track.active)continue;
+        const Line &l = track.line;
+        double s = distanceAt(track,msecs);
+        if(l.straight)
+            batch.addLine(l.p0x,l.p0y,l.p3x,l.p3y,track.length>0?s/track.length:0);
+        else
+            batch.addCurve(l.p0x,l.p0y,l.p1x,l.p1y,l.p2x,l.p2y,l.p3x,l.p3y,l.arc.paramAt(s));
+        Pose pose;
+        pose.agvId = track.agvId;
+        poses.push_back(pose);
+    }
+    if(poses.empty())return ;
+
+    PoseKernel::evaluate(batch);
+    for(size_t i=0;i<poses.size();++i){
+        poses[i].x = batch.x[i];
+        poses[i].y = batch.y[i];
+        poses[i].rotation = batch.rotation[i];
+    }
+}
+
+const MotionEstimator::Pose *MotionEstimator::find(const std::vector<Pose> &poses, int agvId)
+{
+    std::vector<Pose>::const_iterator itr = std::lower_bound(poses.begin(),poses.end(),agvId,[](const Pose &p,int id){
+        return p.agvId<id;
+    });
+    if(itr==poses.end() || itr->agvId!=agvId)return NULL;
+    return &(*itr);
+}
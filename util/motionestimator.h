@@ -0,0 +1,85 @@
+﻿#ifndef MOTIONESTIMATOR_H
+#define MOTIONESTIMATOR_H
+
+#include <QtGlobal>
+#include <QMutex>
+#include <QVector>
+#include <vector>
+#include "util/bezierarc.h"
+#include "util/posekernel.h"
+
+//车辆位置推算
+//车辆几百毫秒才上报一次里程。用里程的变化估计速度，发布位置时沿车辆所在的直线/曲线往前推算
+//新的上报到来时，推算的位置和上报的位置之间的偏差在一段时间内逐渐消除，发布的位置不会跳变
+//主线程更新，发布线程推算。推算时整个车队一起计算(PoseKernel)，每辆车的开销是固定的
+//推算只在锁中取一份车队的快照(隐式共享，不复制)，计算时不持有锁，不阻塞主线程的更新
+//时刻都用nowMsecs(单调时钟)，系统时间被调整时推算不会跳
+class MotionEstimator
+{
+public:
+    enum{
+        CORRECTION_MSECS = 300,//偏差在这么长时间内消除
+        MAX_EXTRAPOLATE_MSECS = 1500,//超过这么久没有上报，不再往前推算
+    };
+
+    //车辆所在的线路，直线只用到p0、p3
+    struct Line{
+        int id = 0;
+        bool straight = true;
+        double p0x = 0, p0y = 0, p1x = 0, p1y = 0, p2x = 0, p2y = 0, p3x = 0, p3y = 0;
+        BezierArc arc;//曲线的弧长表
+    };
+
+    //推算出的位姿，rotation单位是度
+    struct Pose{
+        int agvId = 0;
+        double x = 0;
+        double y = 0;
+        double rotation = 0;
+    };
+
+    //单调时钟的当前时刻(ms)，update、predict的时刻都用它
+    static qint64 nowMsecs();
+
+    //主线程:车辆在line上，从起点走过了distance(地图单位)，msecs是上报的时刻
+    void update(int agvId, const Line &line, double distance, qint64 msecs);
+
+    //车辆到站、断开，不再推算。速度保留，出站后接着用
+    void stop(int agvId);
+
+    //车辆删除了
+    void remove(int agvId);
+    //地图重新载入了，原来的线路都不能用了
+    void clear();
+
+    //推算所有在线路上的车辆在msecs时刻的位姿，按agvId排序。poses重复使用，不重新分配
+    //只在一个线程(发布线程)中调用
+    void predict(qint64 msecs, std::vector<Pose> &poses);
+
+    //在predict的结果中查找一辆车，没有返回NULL
+    static const Pose *find(const std::vector<Pose> &poses, int agvId);
+
+private:
+    struct Track{
+        int agvId = 0;
+        bool active = false;
+        Line line;
+        double length = 0;
+        double distance = 0;//上报的距离
+        qint64 msecs = 0;//上报的时刻
+        double speed = 0;//地图单位/ms
+        double offset = 0;//上报时推算的距离-上报的距离
+    };
+
+    //msecs时刻推算的距离
+    static double distanceAt(const Track &track, qint64 msecs);
+
+    //第一个agvId不小于agvId的下标
+    int lowerBound(int agvId);
+
+    QMutex mtx;//保护tracks
+    QVector<Track> tracks;//按agvId排序
+    PoseKernel::Batch batch;//predict使用
+};
+
+#endif // MOTIONESTIMATOR_H
@@ -0,0 +1,159 @@
+﻿#include "posekernel.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <cmath>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+void PoseKernel::Batch::clear()
+{
+    p0x.clear();p0y.clear();p1x.clear();p1y.clear();
+    p2x.clear();p2y.clear();p3x.clear();p3y.clear();
+    t.clear();
+    x.clear();y.clear();rotation.clear();
+}
+
+void PoseKernel::Batch::reserve(int n)
+{
+    p0x.reserve(n);p0y.reserve(n);p1x.reserve(n);p1y.reserve(n);
+    p2x.reserve(n);p2y.reserve(n);p3x.reserve(n);p3y.reserve(n);
+    t.reserve(n);
+}
+
+void PoseKernel::Batch::addCurve(double _p0x, double _p0y, double _p1x, double _p1y,
+                                 double _p2x, double _p2y, double _p3x, double _p3y, double _t)
+{
+    p0x.push_back(_p0x);p0y.push_back(_p0y);
+    p1x.push_back(_p1x);p1y.push_back(_p1y);
+    p2x.push_back(_p2x);p2y.push_back(_p2y);
+    p3x.push_back(_p3x);p3y.push_back(_p3y);
+    t.push_back(_t<0?0:(_t>1?1:_t));
+}
+
+//控制点取三等分点，B(t)就是起点到终点的线性插值，导数是常量
+void PoseKernel::Batch::addLine(double startX, double startY, double endX, double endY, double _t)
+{
+    double dx = (endX-startX)/3;
+    double dy = (endY-startY)/3;
+    addCurve(startX,startY,startX+dx,startY+dy,startX+2*dx,startY+2*dy,endX,endY,_t);
+}
+
+void PoseKernel::evaluateScalar(Batch &batch, int begin)
+{
+    int n = batch.size();
+    batch.x.resize(n);
+    batch.y.resize(n);
+    batch.rotation.resize(n);
+    for(int i=begin;i<n;++i){
+        double t = batch.t[i];
+        double u = 1-t;
+        double b0 = u*u*u, b1 = 3*t*u*u, b2 = 3*t*t*u, b3 = t*t*t;
+        batch.x[i] = batch.p0x[i]*b0+batch.p1x[i]*b1+batch.p2x[i]*b2+batch.p3x[i]*b3;
+        batch.y[i] = batch.p0y[i]*b0+batch.p1y[i]*b1+batch.p2y[i]*b2+batch.p3y[i]*b3;
+        //B'(t)/3 = (P1-P0)u^2 + 2(P2-P1)ut + (P3-P2)t^2
+        double d0 = u*u, d1 = 2*u*t, d2 = t*t;
+        double dx = (batch.p1x[i]-batch.p0x[i])*d0+(batch.p2x[i]-batch.p1x[i])*d1+(batch.p3x[i]-batch.p2x[i])*d2;
+        double dy = (batch.p1y[i]-batch.p0y[i])*d0+(batch.p2y[i]-batch.p1y[i])*d1+(batch.p3y[i]-batch.p2y[i])*d2;
+        batch.rotation[i] = atan2(dy,dx)*180/M_PI;
+    }
+}
+
+#ifdef __AVX2__
+//atan2的多项式近似，误差小于1e-7弧度
+static inline __m256d atan2_pd(__m256d y, __m256d x)
+{
+    const __m256d signMask = _mm256_set1_pd(-0.0);
+    __m256d ax = _mm256_andnot_pd(signMask,x);
+    __m256d ay = _mm256_andnot_pd(signMask,y);
+    __m256d mx = _mm256_max_pd(ax,ay);
+    __m256d mn = _mm256_min_pd(ax,ay);
+    //x、y都是0时结果是0
+    __m256d a = _mm256_div_pd(mn,_mm256_max_pd(mx,_mm256_set1_pd(1e-300)));
+    __m256d s = _mm256_mul_pd(a,a);
+
+    __m256d r = _mm256_set1_pd(-0.0040540580);
+    r = _mm256_add_pd(_mm256_mul_pd(r,s),_mm256_set1_pd(0.0218612288));
+    r = _mm256_add_pd(_mm256_mul_pd(r,s),_mm256_set1_pd(-0.0559098861));
+    r = _mm256_add_pd(_mm256_mul_pd(r,s),_mm256_set1_pd(0.0964200441));
+    r = _mm256_add_pd(_mm256_mul_pd(r,s),_mm256_set1_pd(-0.1390853351));
+    r = _mm256_add_pd(_mm256_mul_pd(r,s),_mm256_set1_pd(0.1994653599));
+    r = _mm256_add_pd(_mm256_mul_pd(r,s),_mm256_set1_pd(-0.3332985605));
+    r = _mm256_add_pd(_mm256_mul_pd(r,s),_mm256_set1_pd(0.9999993329));
+    r = _mm256_mul_pd(r,a);
+
+    //|y|>|x|: pi/2-r
+    r = _mm256_blendv_pd(r,_mm256_sub_pd(_mm256_set1_pd(M_PI_2),r),_mm256_cmp_pd(ay,ax,_CMP_GT_OQ));
+    //x<0: pi-r
+    r = _mm256_blendv_pd(r,_mm256_sub_pd(_mm256_set1_pd(M_PI),r),x);
+    //符号和y相同
+    return _mm256_or_pd(r,_mm256_and_pd(signMask,y));
+}
+
+static void evaluateAvx2(PoseKernel::Batch &batch, int n)
+{
+    const __m256d one = _mm256_set1_pd(1);
+    const __m256d two = _mm256_set1_pd(2);
+    const __m256d three = _mm256_set1_pd(3);
+    const __m256d toDegree = _mm256_set1_pd(180/M_PI);
+    for(int i=0;i+4<=n;i+=4){
+        __m256d t = _mm256_loadu_pd(&batch.t[i]);
+        __m256d u = _mm256_sub_pd(one,t);
+        __m256d uu = _mm256_mul_pd(u,u);
+        __m256d tt = _mm256_mul_pd(t,t);
+        __m256d b0 = _mm256_mul_pd(uu,u);
+        __m256d b1 = _mm256_mul_pd(three,_mm256_mul_pd(t,uu));
+        __m256d b2 = _mm256_mul_pd(three,_mm256_mul_pd(tt,u));
+        __m256d b3 = _mm256_mul_pd(tt,t);
+        __m256d d1 = _mm256_mul_pd(two,_mm256_mul_pd(u,t));
+
+        __m256d p0 = _mm256_loadu_pd(&batch.p0x[i]);
+        __m256d p1 = _mm256_loadu_pd(&batch.p1x[i]);
+        __m256d p2 = _mm256_loadu_pd(&batch.p2x[i]);
+        __m256d p3 = _mm256_loadu_pd(&batch.p3x[i]);
+        __m256d x = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(p0,b0),_mm256_mul_pd(p1,b1)),
+                                  _mm256_add_pd(_mm256_mul_pd(p2,b2),_mm256_mul_pd(p3,b3)));
+        __m256d dx = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(p1,p0),uu),_mm256_mul_pd(_mm256_sub_pd(p2,p1),d1)),
+                                   _mm256_mul_pd(_mm256_sub_pd(p3,p2),tt));
+
+        p0 = _mm256_loadu_pd(&batch.p0y[i]);
+        p1 = _mm256_loadu_pd(&batch.p1y[i]);
+        p2 = _mm256_loadu_pd(&batch.p2y[i]);
+        p3 = _mm256_loadu_pd(&batch.p3y[i]);
+        __m256d y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(p0,b0),_mm256_mul_pd(p1,b1)),
+                                  _mm256_add_pd(_mm256_mul_pd(p2,b2),_mm256_mul_pd(p3,b3)));
+        __m256d dy = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(p1,p0),uu),_mm256_mul_pd(_mm256_sub_pd(p2,p1),d1)),
+                                   _mm256_mul_pd(_mm256_sub_pd(p3,p2),tt));
+
+        _mm256_storeu_pd(&batch.x[i],x);
+        _mm256_storeu_pd(&batch.y[i],y);
+        _mm256_storeu_pd(&batch.rotation[i],_mm256_mul_pd(atan2_pd(dy,dx),toDegree));
+    }
+}
+#endif
+
+void PoseKernel::evaluate(Batch &batch)
+{
+#ifdef __AVX2__
+    int n = batch.size();
+    batch.x.resize(n);
+    batch.y.resize(n);
+    batch.rotation.resize(n);
+    evaluateAvx2(batch,n);
+    //不足4辆的尾部
+    evaluateScalar(batch,n-n%4);
+#else
+    evaluateScalar(batch);
+#endif
+}
+
+bool PoseKernel::hasSimd()
+{
+#ifdef __AVX2__
+    return true;
+#else
+    return false;
+#endif
+}
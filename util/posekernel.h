@@ -0,0 +1,40 @@
+﻿#ifndef POSEKERNEL_H
+#define POSEKERNEL_H
+
+#include <vector>
+
+//整个车队的位姿批量计算
+//每辆车给出所在线路的四个控制点(直线也表示成三次贝塞尔曲线)和曲线参数t，一次算出所有车辆的坐标和朝向
+//按字段分开存放(SoA)，编译时启用了AVX2的一次算4辆车，否则逐个计算
+class PoseKernel
+{
+public:
+    struct Batch{
+        //输入
+        std::vector<double> p0x, p0y, p1x, p1y, p2x, p2y, p3x, p3y;
+        std::vector<double> t;
+        //输出，rotation单位是度
+        std::vector<double> x, y, rotation;
+
+        int size() const {return (int)t.size();}
+        void clear();
+        void reserve(int n);
+
+        //添加一辆车:曲线
+        void addCurve(double _p0x, double _p0y, double _p1x, double _p1y,
+                      double _p2x, double _p2y, double _p3x, double _p3y, double _t);
+        //添加一辆车:直线
+        void addLine(double startX, double startY, double endX, double endY, double _t);
+    };
+
+    //计算batch中所有车辆的位姿
+    static void evaluate(Batch &batch);
+
+    //逐个计算(没有AVX2时，以及对比用)
+    static void evaluateScalar(Batch &batch, int begin = 0);
+
+    //是否编译了AVX2的版本
+    static bool hasSimd();
+};
+
+#endif // POSEKERNEL_H
@@ -0,0 +1,253 @@
+﻿#include "timingwheel.h"
+
+TimingWheel::TimingWheel():
+    currentTick(0),
+    nextId(1),
+    runningId(0),
+    runningCancelled(false),
+    wakeTick(0),
+    quit(false),
+    wakeupCount(0),
+    firedCount(0)
+{
+    for(int l=0;l<LEVELS;++l){
+        for(int s=0;s<SLOTS;++s)buckets[l][s] = NULL;
+        for(int w=0;w<SLOTS/64;++w)bitmap[l][w] = 0;
+    }
+    startTime = std::chrono::steady_clock::now();
+}
+
+TimingWheel::~TimingWheel()
+{
+    stop();
+    for(QHash<TimerId,Node *>::iterator itr=timers.begin();itr!=timers.end();++itr)
+        delete itr.value();
+    timers.clear();
+}
+
+void TimingWheel::start()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    if(thread.joinable())return ;
+    quit = false;
+    thread = std::thread(&TimingWheel::run,this);
+}
+
+void TimingWheel::stop()
+{
+    mtx.lock();
+    quit = true;
+    cond.notify_all();
+    mtx.unlock();
+    if(thread.joinable())thread.join();
+}
+
+quint64 TimingWheel::nowTick()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-startTime).count();
+}
+
+TimingWheel::TimerId TimingWheel::schedule(int delay, Callback callback, int interval)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    Node *node = new Node;
+    node->id = nextId++;
+    //nowTick是向下取整的，多加1保证不会提前
+    node->expire = nowTick()+qMax(1,delay)+1;
+    node->interval = qMax(0,interval);
+    node->callback = callback;
+    timers.insert(node->id,node);
+    insert(node);
+    //比线程等待的时间早，叫醒它重新计算
+    if(wakeTick==0 || node->expire<wakeTick)
+        cond.notify_one();
+    return node->id;
+}
+
+bool TimingWheel::cancel(TimerId id)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    Node *node = timers.value(id,NULL);
+    if(node==NULL)return false;
+    timers.remove(id);
+    if(id == runningId){
+        //正在执行，由线程删除。等它执行完，回调自身取消的不用等
+        runningCancelled = true;
+        if(std::this_thread::get_id() != threadId){
+            while(runningId == id)runningCond.wait(lock);
+        }
+    }else if(node->level>=0){
+        unlink(node);
+        delete node;
+    }else{
+        //已经到期，在等待执行的列表中
+        node->cancelled = true;
+    }
+    return true;
+}
+
+int TimingWheel::getTimerCount()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    return timers.size();
+}
+
+//放入的层由到期时间和当前时间最高的不同字节决定
+void TimingWheel::insert(Node *node)
+{
+    if(node->expire<currentTick)node->expire = currentTick;
+    quint64 diff = node->expire^currentTick;
+    int level = 0;
+    while(level<LEVELS-1 && (diff>>(SLOT_BITS*(level+1)))!=0)++level;
+    int slot = (node->expire>>(SLOT_BITS*level))&SLOT_MASK;
+
+    node->level = level;
+    node->slot = slot;
+    node->prev = NULL;
+    node->next = buckets[level][slot];
+    if(node->next!=NULL)node->next->prev = node;
+    buckets[level][slot] = node;
+    bitmap[level][slot/64] |= (1ULL<<(slot%64));
+}
+
+void TimingWheel::unlink(Node *node)
+{
+    if(node->level<0)return ;
+    if(node->prev!=NULL)node->prev->next = node->next;
+    else buckets[node->level][node->slot] = node->next;
+    if(node->next!=NULL)node->next->prev = node->prev;
+    if(buckets[node->level][node->slot]==NULL)
+        bitmap[node->level][node->slot/64] &= ~(1ULL<<(node->slot%64));
+    node->prev = node->next = NULL;
+    node->level = -1;
+}
+
+//当前tick所在的槽，全部重新放入下面的层
+void TimingWheel::cascade(int level)
+{
+    int slot = (currentTick>>(SLOT_BITS*level))&SLOT_MASK;
+    Node *node = buckets[level][slot];
+    buckets[level][slot] = NULL;
+    bitmap[level][slot/64] &= ~(1ULL<<(slot%64));
+    while(node!=NULL){
+        Node *next = node->next;
+        node->level = -1;
+        insert(node);
+        node = next;
+    }
+}
+
+//from之后(循环)第一个非空的槽，没有返回-1
+int TimingWheel::findSlot(int level, int from)
+{
+    for(int i=1;i<=SLOTS;++i){
+        int slot = (from+i)&SLOT_MASK;
+        quint64 word = bitmap[level][slot/64];
+        if(word==0){
+            //整个字都是空的，跳到下一个字
+            i += 63-(slot%64);
+            continue;
+        }
+        if(word&(1ULL<<(slot%64)))return slot;
+    }
+    return -1;
+}
+
+quint64 TimingWheel::nextTick()
+{
+    quint64 next = 0;
+    for(int level=0;level<LEVELS;++level){
+        int shift = SLOT_BITS*level;
+        int cur = (currentTick>>shift)&SLOT_MASK;
+        int slot = findSlot(level,cur);
+        if(slot<0)continue;
+        //这一层的槽在其编号的位置对齐时处理(第0层到期，其它层下放)
+        quint64 high = (currentTick>>(shift+SLOT_BITS))<<(shift+SLOT_BITS);
+        quint64 tick = high|((quint64)slot<<shift);
+        if(slot<=cur)tick += 1ULL<<(shift+SLOT_BITS);
+        if(next==0 || tick<next)next = tick;
+    }
+    return next;
+}
+
+//推进到to，到期的定时器从轮中取出放入due
+void TimingWheel::advance(quint64 to, QList<Node *> &due)
+{
+    while(currentTick<to){
+        quint64 next = nextTick();
+        if(next==0 || next>to){
+            currentTick = to;
+            break;
+        }
+        currentTick = next;
+        //先下放高层
+        int top = 0;
+        while(top<LEVELS-1 && (currentTick&((1ULL<<(SLOT_BITS*(top+1)))-1))==0)++top;
+        for(int level=top;level>0;--level)
+            cascade(level);
+        int slot = currentTick&SLOT_MASK;
+        Node *node = buckets[0][slot];
+        while(node!=NULL){
+            Node *n = node->next;
+            unlink(node);
+            due.append(node);
+            node = n;
+        }
+    }
+}
+
+void TimingWheel::run()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    threadId = std::this_thread::get_id();
+    QList<Node *> due;
+    while(!quit){
+        advance(nowTick(),due);
+        if(due.isEmpty()){
+            wakeTick = nextTick();
+            if(wakeTick==0){
+                cond.wait(lock);
+            }else{
+                quint64 now = nowTick();
+                if(wakeTick>now)
+                    cond.wait_for(lock,std::chrono::milliseconds(wakeTick-now));
+            }
+            wakeTick = 0;
+            ++wakeupCount;
+            continue;
+        }
+
+        while(!due.isEmpty() && !quit){
+            Node *node = due.takeFirst();
+            if(node->cancelled){
+                delete node;
+                continue;
+            }
+            runningId = node->id;
+            runningCancelled = false;
+            lock.unlock();
+            node->callback();
+            ++firedCount;
+            lock.lock();
+            runningId = 0;
+            runningCond.notify_all();
+            if(runningCancelled){
+                delete node;
+            }else if(node->interval>0){
+                node->expire += node->interval;
+                if(node->expire<=currentTick)node->expire = currentTick+1;
+                insert(node);
+            }else{
+                timers.remove(node->id);
+                delete node;
+            }
+        }
+    }
+    //退出时还没执行的，放回轮中，析构时统一删除
+    while(!due.isEmpty()){
+        Node *node = due.takeFirst();
+        if(node->cancelled)delete node;
+        else insert(node);
+    }
+    runningCond.notify_all();
+}
@@ -0,0 +1,94 @@
+﻿#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <QtGlobal>
+#include <QHash>
+#include <QList>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+//分层时间轮定时器(精度1ms)
+//4层，每层256个槽，最长约49天。插入、取消都是O(1)
+//一个线程统一处理所有的定时器(命令重传、心跳、发布、日志刷新等)，只在有定时器到期时才醒来
+//回调在时间轮的线程中执行，要求很快返回，耗时的处理应该转交给别的线程
+class TimingWheel
+{
+public:
+    typedef quint64 TimerId;
+    typedef std::function<void ()> Callback;
+
+    enum{
+        LEVELS = 4,
+        SLOT_BITS = 8,
+        SLOTS = 1<<SLOT_BITS,
+        SLOT_MASK = SLOTS-1,
+    };
+
+    TimingWheel();
+    ~TimingWheel();
+
+    void start();
+    void stop();
+
+    //delay毫秒后执行callback，interval>0时之后每interval毫秒执行一次。返回的id用于取消
+    //任意线程都可以调用，包括回调中
+    TimerId schedule(int delay, Callback callback, int interval = 0);
+
+    //取消定时器。回调正在执行时，等它执行完再返回(在回调自身中取消不等待)
+    //调用者不要持有回调中会用到的锁
+    bool cancel(TimerId id);
+
+    int getTimerCount();
+    quint64 getWakeupCount(){return wakeupCount.load();}
+    quint64 getFiredCount(){return firedCount.load();}
+
+private:
+    struct Node{
+        TimerId id = 0;
+        quint64 expire = 0;//到期的tick
+        int interval = 0;
+        Callback callback;
+        Node *prev = NULL;
+        Node *next = NULL;
+        int level = -1;//所在的层和槽，-1表示不在轮中
+        int slot = 0;
+        bool cancelled = false;//已到期等待执行时被取消
+    };
+
+    quint64 nowTick();
+    void insert(Node *node);
+    void unlink(Node *node);
+    void cascade(int level);
+    void advance(quint64 to, QList<Node *> &due);
+    //下一个需要处理的tick，没有定时器返回0
+    quint64 nextTick();
+    int findSlot(int level, int from);
+    void run();
+
+    Node *buckets[LEVELS][SLOTS];
+    quint64 bitmap[LEVELS][SLOTS/64];//非空的槽
+    QHash<TimerId,Node *> timers;
+    quint64 currentTick;
+    TimerId nextId;
+
+    TimerId runningId;//正在执行回调的定时器
+    bool runningCancelled;
+    quint64 wakeTick;//线程睡到这个tick，0表示没有定时器一直睡
+
+    std::chrono::steady_clock::time_point startTime;
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::condition_variable runningCond;
+    bool quit;
+    std::thread thread;
+    std::thread::id threadId;
+
+    std::atomic<quint64> wakeupCount;
+    std::atomic<quint64> firedCount;
+};
+
+#endif // TIMINGWHEEL_H